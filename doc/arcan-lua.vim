@@ -446,6 +446,7 @@ syn keyword luaFunc bond_target
 syn keyword luaFunc vr_map_limb
 syn keyword luaFunc center_image
 syn keyword luaFunc finalize_3dmodel
+syn keyword luaFunc instance_3dmodel
 syn keyword luaFunc step3d_model
 syn keyword luaFunc read_rawresource
 syn keyword luaFunc message_target
@@ -552,6 +553,7 @@ syn keyword luaFunc color_surface
 syn keyword luaFunc reset_target
 syn keyword luaFunc build_3dplane
 syn keyword luaFunc benchmark_timestamp
+syn keyword luaFunc benchmark_histogram
 syn keyword luaFunc target_flags
 syn keyword luaFunc play_audio
 syn keyword luaFunc system_load
@@ -4,7 +4,10 @@
 -- @outargs: boolres
 -- @longdescr: Switch attribute for a 3d model on or off. Accepted values are: "infinite"
 -- (use the model as infinite geometry, common cases are skyboxes/skydomes/skyplanes,
--- silhouettes in the horizon etc.).
+-- silhouettes in the horizon etc.) and "cull" (test the bounding volume of the
+-- model against the camera frustum and skip drawing it when it is outside,
+-- default on - disable for models where the vertex stage moves geometry
+-- outside of its original bounds).
 -- @group: 3d
 -- @cfunction: attrtag
 -- @related:
@@ -2,6 +2,7 @@
 -- @short: Toggle the gathering of benchmark data on / off.
 -- @inargs: bool:toggle=on
 -- @inargs: number:size_kb, func:callback(tracetbl)
+-- @inargs: number:size_kb, string:dstfile
 -- @group: system
 -- @longdescr: This function is used to enable collection of timing data
 -- of the rendering pipeline for benchmarking purposes, or for generating
@@ -12,6 +13,11 @@
 -- *callback* will be triggered containing the results and collection will
 -- be terminated.
 --
+-- If the *size_kb* and *dstfile* argument form is used, the collected
+-- trace will instead be written to *dstfile* in the debug namespace as
+-- chrome trace-event JSON that can be loaded into chrome://tracing or
+-- perfetto. The name is restricted to alphanumerics, '_', '-' and '.'.
+--
 -- Collection in trace mode can also be stopped by calling benchmark_enable
 -- again with any argument form, the callback will be triggered if any
 -- data had been collected before stopping. The callback will also be
@@ -31,6 +37,7 @@
 -- int:quantity
 -- string:message
 -- int:identifier
+-- int:thread
 -- @note: All calls to this function will reset all timestamp buffers.
 -- @note: Since this can be called from within error handling, make sure
 -- that the dumping code is robust and fast. The ANR watchdog will also
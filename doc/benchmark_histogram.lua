@@ -0,0 +1,27 @@
+-- benchmark_histogram
+-- @short: Retrieve the frame timing histograms used for synchronization.
+-- @inargs:
+-- @inargs: vid:fsrv
+-- @outargs: composetbl
+-- @outargs: rendertbl, transfertbl
+-- @longdescr: The conductor keeps fixed-bin histograms of how long
+-- composition takes, and for each frameserver, how long a client takes
+-- from being released until a new frame arrives (render) and how long
+-- the buffer transfer of that frame takes (transfer). These are used by
+-- the 'deadline' strategy in ref:video_synchronization to schedule when
+-- to compose and when to wake each client. Without arguments, the compose
+-- histogram is returned, with a frameserver vid as *fsrv*, the render and
+-- transfer histograms for that frameserver are returned.
+-- Each table is indexed 1..n with the number of samples in each bin, and
+-- has the fields *unit* (bin width in microseconds), *samples*, *p50*,
+-- *p90* and *p99* (upper bin edge in microseconds for that percentile).
+-- Older samples decay so the distributions follow recent behaviour.
+-- @group: system
+-- @cfunction: getbenchhisto
+-- @related: benchmark_data, video_synchronization
+function main()
+#ifdef MAIN
+	local tbl = benchmark_histogram()
+	print("compose p90 (us):", tbl.p90, "samples:", tbl.samples)
+#endif
+end
@@ -0,0 +1,37 @@
+-- instance_3dmodel
+-- @short: Create a new 3d model that shares geometry with another
+-- @inargs: vid:src
+-- @outargs: vid
+-- @longdescr: This function creates a new 3d model object that references
+-- the meshes of the finalized model *src* rather than copying them. The new
+-- object has its own position, orientation, scale, opacity, shader and
+-- frameset, and is initially hidden like a model created through
+-- ref:new_3dmodel. Per-mesh shaders set through ref:mesh_shader are shared.
+--
+-- Models that share geometry are grouped together when drawn, so that only
+-- the per-object transform and opacity change between them. This makes large
+-- numbers of repeated objects (vegetation, props, crowds) considerably
+-- cheaper than creating a separate model for each one.
+--
+-- The shared geometry is kept alive until *src* and all of its instances
+-- have been deleted. Instancing an instance shares the geometry of the
+-- original model.
+-- @note: Destructive transforms such as ref:scale_3dvertices and
+-- ref:swizzle_model are refused on an instance, apply them to the source
+-- model instead and all instances will be affected.
+-- @note: If *src* is not a finalized 3d model, BADID is returned.
+-- @group: 3d
+-- @cfunction: instancemodel
+-- @related: new_3dmodel, finalize_3dmodel, attrtag_model
+function main()
+#ifdef MAIN
+	local box = build_3dbox(1, 1, 1)
+	local boxes = {}
+	for i=1,100 do
+		local inst = instance_3dmodel(box)
+		move3d_model(inst, (i % 10) * 2, 0, math.floor(i / 10) * 2)
+		show_image(inst)
+		table.insert(boxes, inst)
+	end
+#endif
+end
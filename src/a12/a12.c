@@ -21,6 +21,7 @@
 
 #include "a12_decode.h"
 #include "a12_encode.h"
+#include "a12_chunk.h"
 #include "arcan_mem.h"
 #include "external/chacha.c"
 #include "external/x25519.h"
@@ -37,6 +38,14 @@
 int a12_trace_targets = 0;
 FILE* a12_trace_dst = NULL;
 
+/* congestion control and frame scheduling time, see a12_set_clock */
+static unsigned long long (*a12_clock)(void);
+
+static uint64_t sched_clock()
+{
+	return a12_clock ? a12_clock() : arcan_timemillis();
+}
+
 static int header_sizes[] = {
 	MAC_BLOCK_SZ + 8 + 1, /* The outer frame */
 	CONTROL_PACKET_SIZE,
@@ -57,6 +66,7 @@ size_t a12int_header_size(int kind)
 }
 
 static void unlink_node(struct a12_state*, struct blob_out*);
+static void bsync_drop(struct binary_frame*);
 
 static uint8_t* grow_array(uint8_t* dst, size_t* cur_sz, size_t new_sz, int ind)
 {
@@ -206,11 +216,72 @@ static void send_hello_packet(struct a12_state* S,
  * a new ciphersuite will need to be added */
 	outb[20] = mode;
 
+/* and which optional protocol features we can deal with */
+	outb[55] = HELLO_CAP_CHUNKSYNC;
+
 /* send it back to client */
 	a12int_append_out(S,
 		STATE_CONTROL_PACKET, outb, CONTROL_PACKET_SIZE, NULL, 0);
 }
 
+/*
+ * [THREADING]
+ * While a thread has a stage set (a12_channel_vstage), packets that would go
+ * to the output buffer are recorded there instead. Sequence number, stream
+ * identifier, MAC and cipher are all applied when the stage is committed so
+ * the encoders themselves only touch per-channel state.
+ *
+ * record: [0] kind, [1] packet type, [2..3] prepend size, [4..7] data size,
+ * followed by prepend and data.
+ */
+enum {
+	STAGE_PACKET = 0,
+	STAGE_STEP = 1
+};
+#define STAGE_RECORD_SZ 8
+
+static _Thread_local struct a12_vstage* out_stage;
+
+static void stage_append(struct a12_vstage* stage, uint8_t kind, uint8_t type,
+	uint8_t* out, size_t out_sz, uint8_t* prepend, size_t prepend_sz)
+{
+	if (stage->failed)
+		return;
+
+	size_t required = stage->used + STAGE_RECORD_SZ + prepend_sz + out_sz;
+	if (required > stage->buf_sz){
+		size_t new_sz = stage->buf_sz ? stage->buf_sz : 65536;
+		while (new_sz < required)
+			new_sz *= 2;
+
+		uint8_t* buf = realloc(stage->buf, new_sz);
+		if (!buf){
+			a12int_trace(A12_TRACE_ALLOC, "kind=stage:size=%zu", new_sz);
+			stage->failed = true;
+			return;
+		}
+		stage->buf = buf;
+		stage->buf_sz = new_sz;
+	}
+
+	uint8_t* dst = &stage->buf[stage->used];
+	dst[0] = kind;
+	dst[1] = type;
+	pack_u16(prepend_sz, &dst[2]);
+	pack_u32(out_sz, &dst[4]);
+	stage->used += STAGE_RECORD_SZ;
+
+	if (prepend_sz){
+		memcpy(&stage->buf[stage->used], prepend, prepend_sz);
+		stage->used += prepend_sz;
+	}
+
+	if (out_sz){
+		memcpy(&stage->buf[stage->used], out, out_sz);
+		stage->used += out_sz;
+	}
+}
+
 /*
  * Used when a full byte buffer for a packet has been prepared, important
  * since it will also encrypt, generate MAC and add to buffer prestate.
@@ -238,6 +309,12 @@ void a12int_append_out(struct a12_state* S, uint8_t type,
 	if (S->state == STATE_BROKEN)
 		return;
 
+	if (out_stage){
+		stage_append(out_stage,
+			STAGE_PACKET, type, out, out_sz, prepend, prepend_sz);
+		return;
+	}
+
 /*
  * QUEUE-slot here,
  * should also have the ability to probe the size of the queue slots
@@ -616,6 +693,7 @@ a12_channel_close(struct a12_state* S)
 		ZSTD_freeDCtx(ch->unpack_state.bframe.zstd);
 		ch->unpack_state.bframe.zstd = NULL;
 	}
+	bsync_drop(&ch->unpack_state.bframe);
 
 	if (ch->active){
 		ch->cont = NULL;
@@ -762,8 +840,8 @@ static void process_srvfirst(struct a12_state* S)
 	}
 }
 
-static void command_cancelstream(
-	struct a12_state* S, uint32_t streamid, uint8_t reason, uint8_t stype)
+static void command_cancelstream(struct a12_state* S,
+	uint8_t ch, uint32_t streamid, uint8_t reason, uint8_t stype)
 {
 	struct blob_out* node = S->pending;
 	a12int_trace(A12_TRACE_SYSTEM, "stream_cancel:%"PRIu32":%"PRIu8, streamid, reason);
@@ -780,6 +858,12 @@ static void command_cancelstream(
 			S->advenc_broken = true;
 		}
 
+/* the sink has a damaged reference frame, rebuild it with a full one */
+		else if (reason == STREAM_CANCEL_DELTA_LOST){
+			a12int_trace(A12_TRACE_VIDEO, "kind=delta_lost:ch=%d", (int) ch);
+			atomic_store(&S->channels[ch].reset_delta, true);
+		}
+
 /* other reasons means that the image contents is already known or too dated,
  * currently just ignore that - when we implement proper image hashing and can
  * use that for known types (cursor, ...) then reconsider */
@@ -801,6 +885,384 @@ static void command_cancelstream(
 	}
 }
 
+static void bsync_drop(struct binary_frame* bframe)
+{
+	if (bframe->sync.basis)
+		munmap(bframe->sync.basis, bframe->sync.basis_sz);
+
+	DYNAMIC_FREE(bframe->sync.local);
+	DYNAMIC_FREE(bframe->sync.remote);
+	memset(&bframe->sync, '\0', sizeof(bframe->sync));
+}
+
+/*
+ * Reply to a chunk manifest, mode 0 carries a window of the bitmap of wanted
+ * chunks, 1 completes the request and 2 asks for the full contents instead.
+ */
+static void send_bstreamreq(struct a12_state* S, uint8_t channel,
+	uint32_t streamid, uint8_t mode, uint32_t first, uint16_t nbits, uint8_t* bits)
+{
+	uint8_t outb[CONTROL_PACKET_SIZE];
+	build_control_header(S, outb, COMMAND_BSTREAMREQ);
+	outb[16] = channel;
+	pack_u32(streamid, &outb[18]);
+	pack_u32(first, &outb[22]);
+	pack_u16(nbits, &outb[26]);
+	outb[28] = mode;
+	if (nbits)
+		memcpy(&outb[29], bits, (nbits + 7) / 8);
+
+	a12int_append_out(S, STATE_CONTROL_PACKET, outb, CONTROL_PACKET_SIZE, NULL, 0);
+}
+
+/*
+ * Map the basis the bhandler gave us and chunk it the same way the source did
+ * with its copy, anything that fails here just means a full transfer.
+ */
+static bool bsync_basis(struct binary_frame* bframe, int fd)
+{
+	struct stat fs;
+	if (-1 == fstat(fd, &fs) || fs.st_size <= 0){
+		close(fd);
+		return false;
+	}
+
+	void* map = mmap(NULL, fs.st_size, PROT_READ, MAP_FILE | MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED)
+		return false;
+
+	bframe->sync.basis = map;
+	bframe->sync.basis_sz = fs.st_size;
+	bframe->sync.local =
+		a12int_chunk_split(map, fs.st_size, &bframe->sync.n_local);
+
+	if (!bframe->sync.local){
+		bsync_drop(bframe);
+		return false;
+	}
+
+	a12int_chunk_index(bframe->sync.local, bframe->sync.n_local);
+	bframe->sync.state = BSTREAM_SYNC_MAP;
+	return true;
+}
+
+static bool bframe_write(int fd, const uint8_t* buf, size_t ntw)
+{
+	size_t pos = 0;
+
+	while(pos < ntw){
+		ssize_t status = write(fd, &buf[pos], ntw - pos);
+		if (-1 == status){
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+				continue;
+			return false;
+		}
+		else
+			pos += status;
+	}
+
+	return true;
+}
+
+/*
+ * Step through the manifest and copy out chunks from the basis until the next
+ * one that has to come from the source. Returns 1 when that one is pending,
+ * 0 at the end of the manifest and -1 on write failure.
+ */
+static int bsync_advance(struct binary_frame* bframe, size_t* nout)
+{
+	while (bframe->sync.pos < bframe->sync.n_remote){
+		struct a12_chunk* cur = &bframe->sync.remote[bframe->sync.pos++];
+
+		if (cur->ofs == UINT64_MAX){
+			bframe->sync.left = cur->size;
+			return 1;
+		}
+
+		if (!bframe_write(bframe->tmp_fd, &bframe->sync.basis[cur->ofs], cur->size))
+			return -1;
+
+		*nout += cur->size;
+	}
+
+	return 0;
+}
+
+/*
+ * Interleave incoming data for the missing chunks with the ones from the basis,
+ * [nout] is set to the number of bytes of the reassembled output.
+ */
+static bool bsync_write(
+	struct binary_frame* bframe, const uint8_t* buf, size_t ntw, size_t* nout)
+{
+	*nout = 0;
+
+	while (ntw){
+		if (!bframe->sync.left && 1 != bsync_advance(bframe, nout))
+			return false;
+
+		size_t step = ntw < bframe->sync.left ? ntw : bframe->sync.left;
+		if (!bframe_write(bframe->tmp_fd, buf, step))
+			return false;
+
+		buf += step;
+		ntw -= step;
+		bframe->sync.left -= step;
+		*nout += step;
+	}
+
+/* a completed chunk might be followed by ones that we already have */
+	if (!bframe->sync.left && -1 == bsync_advance(bframe, nout))
+		return false;
+
+	return true;
+}
+
+static void bframe_complete(
+	struct a12_state* S, struct binary_frame* cbf, uint8_t channel)
+{
+	a12int_trace(A12_TRACE_BTRANSFER,
+		"kind=completed:ch=%d:stream=%"PRId64, (int) channel, cbf->streamid);
+	cbf->active = false;
+	bsync_drop(cbf);
+
+/* finally forward all the metadata to the handler and let the recipient
+ * pack it into the proper event structure and so on. */
+	struct a12_bhandler_meta bm = {
+		.type = cbf->type,
+		.streamid = cbf->streamid,
+		.channel = channel,
+		.identifier = cbf->identifier,
+		.fd = cbf->tmp_fd,
+		.dcont = S->channels[channel].cont,
+		.state = A12_BHANDLER_COMPLETED
+	};
+
+/* note that we do trust the provided checksum here, to actually re-verify that
+ * a possibly cache- stored checksum matches the transfer is up to the callback
+ * handler. otherwise a possible scenario is to have a client taint a binary
+ * cache, but such trust compartmentation should be handled by real separation
+ * between clients. */
+	memcpy(&bm.checksum, cbf->checksum, 16);
+	cbf->tmp_fd = -1;
+	S->binary_handler(S, bm, S->binary_handler_tag);
+}
+
+/*
+ * The manifest is complete, match it against the basis and ask for the rest.
+ * Chunks we already have are written out immediately up until the first one
+ * that needs to be transferred.
+ */
+static void bsync_request(struct a12_state* S, uint8_t channel)
+{
+	struct binary_frame* bframe = &S->channels[channel].unpack_state.bframe;
+	uint8_t bits[96];
+	size_t nbits = sizeof(bits) * 8;
+	size_t n_missing = 0;
+	uint64_t missing_sz = 0;
+
+	for (size_t i = 0; i < bframe->sync.n_remote; i += nbits){
+		size_t nb = bframe->sync.n_remote - i;
+		if (nb > nbits)
+			nb = nbits;
+
+		memset(bits, '\0', sizeof(bits));
+		bool any = false;
+
+		for (size_t j = 0; j < nb; j++){
+			struct a12_chunk* cur = &bframe->sync.remote[i + j];
+			const struct a12_chunk* match = a12int_chunk_find(
+				bframe->sync.local, bframe->sync.n_local, cur->hash);
+
+			if (match && match->size == cur->size){
+				cur->ofs = match->ofs;
+				continue;
+			}
+
+			cur->ofs = UINT64_MAX;
+			bits[j / 8] |= 1 << (j % 8);
+			missing_sz += cur->size;
+			n_missing++;
+			any = true;
+		}
+
+		if (any)
+			send_bstreamreq(S, channel, bframe->streamid, 0, i, nb, bits);
+	}
+
+	send_bstreamreq(S, channel, bframe->streamid, 1, 0, 0, NULL);
+	a12int_trace(A12_TRACE_BTRANSFER,
+		"kind=delta:stream=%"PRId64":chunks=%zu/%zu:size=%"PRIu64"/%"PRIu64,
+		bframe->streamid, n_missing, bframe->sync.n_remote, missing_sz, bframe->size);
+
+/* the local index isn't needed anymore, the basis is */
+	DYNAMIC_FREE(bframe->sync.local);
+	bframe->sync.local = NULL;
+	bframe->sync.n_local = 0;
+	bframe->sync.state = BSTREAM_SYNC_DELTA;
+
+	size_t nout = 0;
+	if (-1 == bsync_advance(bframe, &nout)){
+		a12_stream_cancel(S, channel);
+		return;
+	}
+
+	bframe->size -= nout;
+	if (!bframe->size && S->binary_handler)
+		bframe_complete(S, bframe, channel);
+}
+
+/*
+ * Fall back to a full transfer if the manifest doesn't make sense or we have
+ * nothing to compare against.
+ */
+static void bsync_fallback(struct a12_state* S, uint8_t channel)
+{
+	struct binary_frame* bframe = &S->channels[channel].unpack_state.bframe;
+	a12int_trace(A12_TRACE_BTRANSFER,
+		"kind=delta_fallback:stream=%"PRId64":ch=%d", bframe->streamid, (int)channel);
+
+	bsync_drop(bframe);
+	send_bstreamreq(S, channel, bframe->streamid, 2, 0, 0, NULL);
+}
+
+static void command_bstreammap(struct a12_state* S)
+{
+/*
+ * [18..21] stream-id
+ * [22]     count (0 terminates)
+ * [23+ n * 20] u32 size + blake3-16
+ */
+	uint8_t channel = S->decode[16];
+	struct binary_frame* bframe = &S->channels[channel].unpack_state.bframe;
+	uint32_t streamid;
+	unpack_u32(&streamid, &S->decode[18]);
+
+/* manifest for a stream we cancelled or didn't want the delta for */
+	if (!bframe->active ||
+		bframe->streamid != streamid || bframe->sync.state != BSTREAM_SYNC_MAP)
+		return;
+
+	size_t count = S->decode[22];
+	if (!count){
+		if (bframe->sync.remote_sz != bframe->size){
+			bsync_fallback(S, channel);
+			return;
+		}
+		bsync_request(S, channel);
+		return;
+	}
+
+/* every chunk but the last is at least the minimum size, so that puts an upper
+ * bound on how large the manifest can legitimately get */
+	size_t limit = bframe->size / A12_CHUNK_MIN + 1;
+	if (count > 5 || bframe->sync.n_remote + count > limit){
+		bsync_fallback(S, channel);
+		return;
+	}
+
+	struct a12_chunk* remote = DYNAMIC_REALLOC(bframe->sync.remote,
+		(bframe->sync.n_remote + count) * sizeof(struct a12_chunk));
+	if (!remote){
+		bsync_fallback(S, channel);
+		return;
+	}
+	bframe->sync.remote = remote;
+
+	for (size_t i = 0; i < count; i++){
+		struct a12_chunk* cur = &remote[bframe->sync.n_remote];
+		unpack_u32(&cur->size, &S->decode[23 + i * 20]);
+		memcpy(cur->hash, &S->decode[27 + i * 20], 16);
+
+		if (!cur->size || cur->size > A12_CHUNK_MAX){
+			bsync_fallback(S, channel);
+			return;
+		}
+
+		cur->ofs = bframe->sync.remote_sz;
+		bframe->sync.remote_sz += cur->size;
+		bframe->sync.n_remote++;
+	}
+}
+
+static void command_bstreamreq(struct a12_state* S)
+{
+/*
+ * [18..21] stream-id
+ * [22..25] first chunk
+ * [26..27] number of bits
+ * [28]     mode
+ * [29+ 96] bitmap
+ */
+	uint32_t streamid, first;
+	uint16_t nbits;
+	unpack_u32(&streamid, &S->decode[18]);
+	unpack_u32(&first, &S->decode[22]);
+	unpack_u16(&nbits, &S->decode[26]);
+	uint8_t mode = S->decode[28];
+
+	struct blob_out* node = S->pending;
+	while (node && (!node->active || node->streamid != streamid))
+		node = node->next;
+
+	if (!node || node->sync.state != BSTREAM_SYNC_WAIT){
+		a12int_trace(A12_TRACE_BTRANSFER,
+			"kind=notice:stream=%"PRIu32":message=chunk request on unknown stream",
+			streamid);
+		return;
+	}
+
+/* sink has nothing to compare against, just send everything */
+	if (mode == 2){
+		a12int_trace(A12_TRACE_BTRANSFER, "kind=delta_full:stream=%"PRIu32, streamid);
+		node->sync.state = BSTREAM_SYNC_NONE;
+		return;
+	}
+
+	if (mode == 0){
+		if (nbits > 96 * 8 ||
+			first > node->sync.n_chunks || node->sync.n_chunks - first < nbits){
+			a12int_trace(A12_TRACE_SYSTEM,
+				"kind=error:status=EINVAL:stream=%"PRIu32":message=bad chunk range",
+				streamid);
+			return;
+		}
+
+		for (size_t i = 0; i < nbits; i++){
+			size_t ind = first + i;
+			if (S->decode[29 + i / 8] & (1 << (i % 8)))
+				node->sync.want[ind / 8] |= 1 << (ind % 8);
+		}
+		return;
+	}
+
+/* request is complete, sum up what is left to send */
+	size_t n = 0;
+	node->left = 0;
+	for (size_t i = 0; i < node->sync.n_chunks; i++){
+		if (node->sync.want[i / 8] & (1 << (i % 8))){
+			node->left += node->sync.chunks[i].size;
+			n++;
+		}
+	}
+
+	a12int_trace(A12_TRACE_BTRANSFER,
+		"kind=delta:stream=%"PRIu32":chunks=%zu/%zu:size=%zu",
+		streamid, n, node->sync.n_chunks, node->left);
+
+/* the other end had it all and completes on its own */
+	if (!node->left){
+		unlink_node(S, node);
+		return;
+	}
+
+	node->sync.state = BSTREAM_SYNC_DELTA;
+	node->sync.pos = 0;
+	node->sync.left = 0;
+}
+
 static void command_binarystream(struct a12_state* S)
 {
 /*
@@ -818,6 +1280,7 @@ static void command_binarystream(struct a12_state* S)
 			"kind=error:source=binarystream:kind=EEXIST:ch=%d", (int) channel);
 		a12_stream_cancel(S, channel);
 		bframe->active = false;
+		bsync_drop(bframe);
 		if (bframe->tmp_fd > 0)
 			bframe->tmp_fd = -1;
 		return;
@@ -854,10 +1317,13 @@ static void command_binarystream(struct a12_state* S)
  * get from the cache, but still need to process and discard incoming packages
  * in the meanwhile.
  *
- * This is the point where, for non-streams, provide a table of hashes first
- * and support resume at the first missing or broken hash
+ * For non-streams the source can also offer a chunk manifest [53], and the
+ * handler can provide an older copy to use as basis so that only the chunks
+ * that differ are transferred. The source waits until we have answered.
  */
+	bool offered = S->decode[53] == 1 && bframe->size;
 	int sc = A12_BHANDLER_DONTWANT;
+	int basis = -1;
 	struct a12_bhandler_meta bm = {
 		.state = A12_BHANDLER_INITIALIZE,
 		.known_size = bframe->size,
@@ -865,6 +1331,7 @@ static void command_binarystream(struct a12_state* S)
 		.identifier = bframe->identifier,
 		.type = bframe->type,
 		.dcont = S->channels[channel].cont,
+		.delta = offered,
 		.fd = -1
 	};
 	memcpy(bm.checksum, bframe->checksum, 16);
@@ -873,13 +1340,26 @@ static void command_binarystream(struct a12_state* S)
 		struct a12_bhandler_res res = S->binary_handler(S, bm, S->binary_handler_tag);
 		bframe->tmp_fd = res.fd;
 		sc = res.flag;
+		if (sc == A12_BHANDLER_NEWFD_DELTA)
+			basis = res.basis;
 	}
 
 	if (sc == A12_BHANDLER_DONTWANT || sc == A12_BHANDLER_CACHED){
+		if (-1 != basis)
+			close(basis);
 		a12_stream_cancel(S, channel);
 		a12int_trace(A12_TRACE_BTRANSFER,
 			"kind=reject:stream=%"PRId64":ch=%d", bframe->streamid, channel);
+		return;
+	}
+
+/* the manifest packets that follow are ignored unless we got a usable basis */
+	if (offered){
+		if (-1 == basis || -1 == bframe->tmp_fd || !bsync_basis(bframe, basis))
+			send_bstreamreq(S, channel, bframe->streamid, 2, 0, 0, NULL);
 	}
+	else if (-1 != basis)
+		close(basis);
 }
 
 void a12_vstream_cancel(struct a12_state* S, uint8_t channel, int reason)
@@ -923,6 +1403,7 @@ void a12_stream_cancel(struct a12_state* S, uint8_t channel)
 		ZSTD_freeDCtx(bframe->zstd);
 		bframe->zstd = NULL;
 	}
+	bsync_drop(bframe);
 
 /* forward the cancellation request to the eventhandler, due to the active tracking
  * we are protected against bad use (handler -> cancel -> handler) */
@@ -930,6 +1411,7 @@ void a12_stream_cancel(struct a12_state* S, uint8_t channel)
 		struct a12_bhandler_meta bm = {
 			.fd = bframe->tmp_fd,
 			.state = A12_BHANDLER_CANCELLED,
+			.type = bframe->type,
 			.streamid = bframe->streamid,
 			.channel = channel
 		};
@@ -1143,6 +1625,18 @@ static void command_videoframe(struct a12_state* S)
 	vframe->commit = S->decode[44];
 	S->in_channel = -1;
 
+/* the deltas that were already in flight when a frame broke can't be applied,
+ * wait for the full frame that was requested */
+	if (channel->vdec.broken){
+		if (method == POSTPROCESS_VIDEO_ZSTD)
+			channel->vdec.broken = false;
+		else if (method == POSTPROCESS_VIDEO_DZSTD){
+			a12int_trace(A12_TRACE_VIDEO,
+				"kind=discard:channel=%d:reason=delta_lost", (int) ch);
+			vframe->commit = 255;
+		}
+	}
+
 /* If channel set, apply resize immediately - synch cost should be offset with
  * the buffering being performed at lower layers. Right now the rejection of a
  * resize is not being forwarded, which can cause problems in some edge cases
@@ -1255,13 +1749,23 @@ static void command_videoframe(struct a12_state* S)
 /* out_pos gets validated in the decode stage, so no OOB ->y ->x */
 		vframe->out_pos = vframe->y * cont->pitch + vframe->x;
 		vframe->inbuf_pos = 0;
+		vframe->row_left = vframe->w;
+
+/* zstd- family is decompressed straight into the destination as the packets
+ * arrive, only the others need an intermediate store for the whole frame */
+		if (a12int_stream_format(vframe->postprocess)){
+			a12int_trace(A12_TRACE_VIDEO, "compressed stream in (%"
+				PRIu32") to offset (%zu)", vframe->inbuf_sz, vframe->out_pos);
+			return;
+		}
+
 		vframe->inbuf = DYNAMIC_MALLOC(vframe->inbuf_sz);
 		if (!vframe->inbuf){
 			a12int_trace(A12_TRACE_ALLOC,
 				"couldn't allocate intermediate buffer store");
+			vframe->commit = 255;
 			return;
 		}
-		vframe->row_left = vframe->w;
 		a12int_trace(A12_TRACE_VIDEO, "compressed buffer in (%"
 			PRIu32") to offset (%zu)", vframe->inbuf_sz, vframe->out_pos);
 	}
@@ -1444,7 +1948,27 @@ void a12_enqueue_bstream(struct a12_state* S,
 	blake3_hasher_init(&hash);
 	blake3_hasher_update(&hash, map, fend);
 	blake3_hasher_finalize(&hash, next->checksum, 16);
+
+/* if the other end can work with a chunk manifest, build it while we have the
+ * contents mapped so that it can be offered with the header */
+	if ((S->remote_caps & HELLO_CAP_CHUNKSYNC) && fend >= A12_CHUNK_THRESHOLD){
+		next->sync.chunks = a12int_chunk_split(map, fend, &next->sync.n_chunks);
+		next->sync.want = DYNAMIC_MALLOC((next->sync.n_chunks + 7) / 8);
+
+		if (next->sync.chunks && next->sync.want){
+			memset(next->sync.want, '\0', (next->sync.n_chunks + 7) / 8);
+			next->sync.state = BSTREAM_SYNC_OFFER;
+		}
+		else {
+			DYNAMIC_FREE(next->sync.chunks);
+			DYNAMIC_FREE(next->sync.want);
+			next->sync.chunks = NULL;
+			next->sync.want = NULL;
+		}
+	}
+
 	munmap(map, fend);
+	next->streaming = false;
 	next->left = fend;
 	a12int_trace(A12_TRACE_BTRANSFER,
 		"kind=added:type=%d:stream=no:size=%zu", type, next->left);
@@ -1600,7 +2124,9 @@ static void process_hello_auth(struct a12_state* S)
 - [20]      Flags         : uint8
 - [21+ 32]  x25519 Pk     : blob,
 - [54]      Source/Sink
+- [55]      Capabilities  : uint8
 	 */
+	S->remote_caps = S->decode[55];
 
 	if (S->decode[54]){
 		S->remote_mode = ROLE_PROBE;
@@ -1697,6 +2223,81 @@ static void process_hello_auth(struct a12_state* S)
 	}
 }
 
+/*
+ * An ack for the frame at window slot [i] gives a roundtrip sample and a
+ * delivery rate sample: the bytes acked since the frame was queued over the
+ * time since the ack that was the latest back then, or over the time those
+ * bytes took to queue if that is longer. Anchoring at an earlier ack means a
+ * sample always spans at least one roundtrip, so a burst of acks released
+ * after a stall (retransmission, ...) can't pass for link capacity. The
+ * estimate is the max of the recent samples as periods where the source
+ * doesn't fill the link (app-limited) only give a lower bound.
+ */
+static void bwe_sample(struct a12_state* S, size_t i)
+{
+	uint64_t now = sched_clock();
+	size_t wnd_sz = VIDEO_FRAME_DRIFT_WINDOW;
+	size_t* const frame_bytes = S->congestion_stats.frame_bytes;
+	uint64_t* const frame_ts = S->congestion_stats.frame_ts;
+
+	size_t rtt = now > frame_ts[i] ? now - frame_ts[i] : 0;
+	if (!S->congestion_stats.min_rtt_ts ||
+		rtt < S->congestion_stats.min_rtt ||
+		now - S->congestion_stats.min_rtt_ts > A12_BWE_RTT_EXPIRE){
+		S->congestion_stats.min_rtt = rtt;
+		S->congestion_stats.min_rtt_ts = now;
+	}
+
+	S->stats.roundtrip_latency = S->stats.roundtrip_latency ?
+		(S->stats.roundtrip_latency * 7 + rtt) / 8 : rtt;
+	S->stats.min_latency = S->congestion_stats.min_rtt;
+	S->stats.queue_delay =
+		S->stats.roundtrip_latency > S->stats.min_latency ?
+		S->stats.roundtrip_latency - S->stats.min_latency : 0;
+
+/* where the acked frame ends in the output stream and when that was queued,
+ * without a next frame to mark the end only the start is known to be acked -
+ * b_out would count data that is still in flight */
+	size_t end = frame_bytes[i];
+	uint64_t end_ts = frame_ts[i];
+	if (i + 1 < wnd_sz && S->congestion_stats.frame_window[i+1]){
+		end = frame_bytes[i+1];
+		end_ts = frame_ts[i+1];
+	}
+
+	struct a12_bwe_delivered prev = S->congestion_stats.frame_delivered[i];
+	if (end > S->congestion_stats.delivered.bytes){
+		S->congestion_stats.delivered = (struct a12_bwe_delivered){
+			.bytes = end,
+			.ts = now,
+			.send_ts = end_ts
+		};
+	}
+
+	if (!prev.ts || end <= prev.bytes)
+		return;
+
+	size_t nb = end - prev.bytes;
+	uint64_t ack_elapsed = now - prev.ts;
+	uint64_t send_elapsed = end_ts > prev.send_ts ? end_ts - prev.send_ts : 0;
+	uint64_t elapsed = ack_elapsed > send_elapsed ? ack_elapsed : send_elapsed;
+	if (!elapsed)
+		return;
+
+	size_t ind = S->congestion_stats.bw_sample_ind++ % A12_BWE_SAMPLES;
+	S->congestion_stats.bw_samples[ind] = (uint64_t) nb * 1000 / elapsed;
+
+	size_t max = 0;
+	for (size_t j = 0; j < A12_BWE_SAMPLES; j++)
+		if (S->congestion_stats.bw_samples[j] > max)
+			max = S->congestion_stats.bw_samples[j];
+	S->stats.bw_estimate = max;
+
+	a12int_trace(A12_TRACE_DEBUG,
+		"kind=bwe:rtt=%zu:min_rtt=%zu:sample=%zu:estimate=%zu",
+		rtt, S->stats.min_latency, S->congestion_stats.bw_samples[ind], max);
+}
+
 static void command_pingpacket(struct a12_state* S, uint32_t sid)
 {
 /* might get empty pings, ignore those as they only update last_seen_seq */
@@ -1713,8 +2314,10 @@ static void command_pingpacket(struct a12_state* S, uint32_t sid)
 			return;
 		}
 
-		if (cid == sid)
+		if (cid == sid){
+			bwe_sample(S, i);
 			break;
+		}
 	}
 
 /* the ID might be bad (after the last sent) or truncated or outdated.
@@ -1755,6 +2358,21 @@ static void command_pingpacket(struct a12_state* S, uint32_t sid)
 		&S->congestion_stats.frame_window[i_start],
 		to_move * sizeof(uint32_t)
 	);
+	memmove(
+		S->congestion_stats.frame_ts,
+		&S->congestion_stats.frame_ts[i_start],
+		to_move * sizeof(uint64_t)
+	);
+	memmove(
+		S->congestion_stats.frame_bytes,
+		&S->congestion_stats.frame_bytes[i_start],
+		to_move * sizeof(size_t)
+	);
+	memmove(
+		S->congestion_stats.frame_delivered,
+		&S->congestion_stats.frame_delivered[i_start],
+		to_move * sizeof(struct a12_bwe_delivered)
+	);
 
 	S->stats.vframe_backpressure = to_move +
 		(S->congestion_stats.frame_window[0] - sid);
@@ -1892,7 +2510,8 @@ static void process_control(struct a12_state* S, void (*on_event)
 	case COMMAND_CANCELSTREAM:{
 		uint32_t streamid;
 		unpack_u32(&streamid, &S->decode[18]);
-		command_cancelstream(S, streamid, S->decode[22], S->decode[23]);
+		command_cancelstream(S,
+			S->decode[16], streamid, S->decode[22], S->decode[23]);
 	}
 	break;
 	case COMMAND_PING:{
@@ -1930,6 +2549,12 @@ static void process_control(struct a12_state* S, void (*on_event)
 	case COMMAND_DIRSTATE:
 		add_dirent(S);
 	break;
+	case COMMAND_BSTREAMMAP:
+		command_bstreammap(S);
+	break;
+	case COMMAND_BSTREAMREQ:
+		command_bstreamreq(S);
+	break;
 	default:
 		a12int_trace(A12_TRACE_SYSTEM, "Unknown message type: %d", (int)command);
 	break;
@@ -1938,6 +2563,24 @@ static void process_control(struct a12_state* S, void (*on_event)
 	reset_state(S);
 }
 
+/*
+ * Track the hints that the other side gives about which channels the user
+ * is looking at / interacting with, used for prioritizing video frames.
+ */
+static void sched_event(struct a12_state* S, uint8_t ch, struct arcan_event* ev)
+{
+	if (ev->category == EVENT_IO){
+		S->channels[ch].sched.last_input = sched_clock();
+		return;
+	}
+
+	if (ev->category == EVENT_TARGET &&
+		ev->tgt.kind == TARGET_COMMAND_DISPLAYHINT){
+		S->channels[ch].sched.unfocused = (ev->tgt.ioevs[2].iv & 4) != 0;
+		S->channels[ch].sched.hidden = (ev->tgt.ioevs[2].iv & 2) != 0;
+	}
+}
+
 static void process_event(struct a12_state* S, void* tag,
 	void (*on_event)(
 		struct arcan_shmif_cont* wnd, int chid, struct arcan_event*, void*))
@@ -1959,9 +2602,13 @@ static void process_event(struct a12_state* S, void* tag,
 	{
 		a12int_trace(A12_TRACE_SYSTEM, "broken event packet received");
 	}
-	else if (on_event){
-		a12int_trace(A12_TRACE_EVENT, "unpack event to %d", channel);
-		on_event(S->channels[channel].cont, channel, &aev, tag);
+	else {
+		sched_event(S, channel, &aev);
+
+		if (on_event){
+			a12int_trace(A12_TRACE_EVENT, "unpack event to %d", channel);
+			on_event(S->channels[channel].cont, channel, &aev, tag);
+		}
 	}
 
 	reset_state(S);
@@ -2069,74 +2716,47 @@ static void process_blob(struct a12_state* S)
  * that routes via a pipe onwards to another client. Normal splice etc.
  * operations won't work so we are left with this. To not block video/audio
  * processing we would have to buffer / flush this separately, with a big
- * complexity leap. */
-	if (-1 != cbf->tmp_fd){
-		size_t pos = 0;
+ * complexity leap.
+ *
+ * With delta synchronisation the data only covers the missing chunks and the
+ * rest is filled in from the basis, so the output size differs from ntw. */
+	size_t nout = ntw;
+	bool ok = true;
 
-		while(pos < ntw){
-			ssize_t status = write(cbf->tmp_fd, &buf[pos], ntw - pos);
-			if (-1 == status){
-				if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
-					continue;
+	if (cbf->sync.state == BSTREAM_SYNC_DELTA)
+		ok = bsync_write(cbf, buf, ntw, &nout);
+	else if (-1 != cbf->tmp_fd)
+		ok = bframe_write(cbf->tmp_fd, buf, ntw);
+
+	if (free_buf)
+		DYNAMIC_FREE(buf);
 
 /* so there was a problem writing (dead pipe, out of space etc). send a cancel
  * on the stream,this will also forward the status change to the event handler
  * itself who is responsible for closing the tmp_fd */
-				a12_stream_cancel(S, S->in_channel);
-				reset_state(S);
-				if (free_buf)
-					DYNAMIC_FREE(buf);
-				return;
-			}
-			else
-				pos += status;
-		}
+	if (!ok){
+		a12_stream_cancel(S, S->in_channel);
+		reset_state(S);
+		return;
 	}
 
-	if (free_buf)
-		DYNAMIC_FREE(buf);
-
 	if (!S->binary_handler)
 		return;
 
 /* is it a streaming transfer or a known size? */
 	if (cbf->size){
-		if (ntw > cbf->size){
+		if (nout > cbf->size){
 			a12int_trace(A12_TRACE_SYSTEM,
 				"kind=btransfer_overflow:size=%zu:ch=%d:stream=%"PRId64,
-				(size_t)(ntw - cbf->size), S->in_channel, cbf->streamid
+				(size_t)(nout - cbf->size), S->in_channel, cbf->streamid
 			);
 			cbf->size = 0;
 		}
 		else
-			cbf->size -= ntw;
+			cbf->size -= nout;
 
 		if (!cbf->size){
-			a12int_trace(A12_TRACE_BTRANSFER,
-				"kind=completed:ch=%d:stream=%"PRId64, S->in_channel, cbf->streamid);
-			cbf->active = false;
-
-/* finally forward all the metadata to the handler and let the recipient
- * pack it into the proper event structure and so on. */
-			struct a12_bhandler_meta bm = {
-				.type = cbf->type,
-				.streamid = cbf->streamid,
-				.channel = S->in_channel,
-				.identifier = cbf->identifier,
-				.fd = cbf->tmp_fd,
-				.dcont = cont,
-				.state = A12_BHANDLER_COMPLETED
-			};
-
-/* note that we do trust the provided checksum here, to actually re-verify that
- * a possibly cache- stored checksum matches the transfer is up to the callback
- * handler. otherwise a possible scenario is to have a client taint a binary
- * cache, but such trust compartmentation should be handled by real separation
- * between clients. */
-			memcpy(&bm.checksum, cbf->checksum, 16);
-			cbf->tmp_fd = -1;
-			S->binary_handler(S, bm, S->binary_handler_tag);
-
+			bframe_complete(S, cbf, S->in_channel);
 			return;
 		}
 	}
@@ -2210,9 +2830,12 @@ static void process_video(struct a12_state* S)
 			S->in_channel, S->decode_pos, left
 		);
 
-/* buffer and slide? */
+/* decompress in place or buffer and slide? */
 		if (left >= S->decode_pos){
-			memcpy(&cvf->inbuf[cvf->inbuf_pos], S->decode, S->decode_pos);
+			if (a12int_stream_format(cvf->postprocess))
+				a12int_decode_vchunk(S, ch, cvf, S->decode, S->decode_pos);
+			else
+				memcpy(&cvf->inbuf[cvf->inbuf_pos], S->decode, S->decode_pos);
 			cvf->inbuf_pos += S->decode_pos;
 			left -= S->decode_pos;
 		}
@@ -2523,7 +3146,7 @@ a12_unpack(struct a12_state* S, const uint8_t* buf,
  * that we risk sending very small blocks of data as part of the stream,
  * wasting bandwidth.
  */
-static void* read_data(int fd, size_t cap, uint16_t* nts, bool* die)
+static void* read_data(int fd, off_t ofs, size_t cap, uint16_t* nts, bool* die)
 {
 	void* buf = DYNAMIC_MALLOC(65536);
 	if (!buf){
@@ -2532,7 +3155,8 @@ static void* read_data(int fd, size_t cap, uint16_t* nts, bool* die)
 		return NULL;
 	}
 
-	ssize_t nr = read(fd, buf, cap);
+/* positional reads for seekable sources, negative offset for streams */
+	ssize_t nr = ofs < 0 ? read(fd, buf, cap) : pread(fd, buf, cap, ofs);
 
 /* possibly non-fatal or no data present yet, keep stream alive - a bad stream
  * source with no timeout will block / preempt other binary transfers though so
@@ -2583,6 +3207,9 @@ static void unlink_node(struct a12_state* S, struct blob_out* node)
 		node->zstd = NULL;
 	}
 
+	DYNAMIC_FREE(node->sync.chunks);
+	DYNAMIC_FREE(node->sync.want);
+
 	DYNAMIC_FREE(node);
 }
 
@@ -2714,6 +3341,9 @@ static size_t begin_bstream(struct a12_state* S, struct blob_out* node)
 		ZSTD_CCtx_setParameter(node->zstd, ZSTD_c_nbWorkers, 4);
 		outb[52] = 1;
 	}
+	if (node->sync.state == BSTREAM_SYNC_OFFER)
+		outb[53] = 1;
+
 	a12int_append_out(S, STATE_CONTROL_PACKET, outb, CONTROL_PACKET_SIZE, NULL, 0);
 
 	node->active = true;
@@ -2723,6 +3353,32 @@ static size_t begin_bstream(struct a12_state* S, struct blob_out* node)
 		node->left, node->streamid, node->chid
 	);
 
+/* follow up with the manifest, five chunks per packet and an empty one to
+ * terminate, then hold the stream until the other end has said what it wants */
+	if (node->sync.state == BSTREAM_SYNC_OFFER){
+		size_t i = 0;
+		do {
+			build_control_header(S, outb, COMMAND_BSTREAMMAP);
+			outb[16] = node->chid;
+			pack_u32(node->streamid, &outb[18]);
+
+			size_t count = node->sync.n_chunks - i;
+			if (count > 5)
+				count = 5;
+
+			outb[22] = count;
+			for (size_t j = 0; j < count; j++, i++){
+				pack_u32(node->sync.chunks[i].size, &outb[23 + j * 20]);
+				memcpy(&outb[27 + j * 20], node->sync.chunks[i].hash, 16);
+			}
+
+			a12int_append_out(S, STATE_CONTROL_PACKET, outb, CONTROL_PACKET_SIZE, NULL, 0);
+		} while (outb[22]);
+
+		node->sync.state = BSTREAM_SYNC_WAIT;
+		return 0;
+	}
+
 /* set a small cap for the first packet, and defer the next queue node until
  * the ack:ed serial has advanced a bit to let the other end cancel before we
  * push too much so that we don't just burst - better rampup is needed here */
@@ -2747,6 +3403,32 @@ static size_t queue_node(struct a12_state* S, struct blob_out* node)
 			cap = rampup;
 	}
 
+/* manifest sent, nothing to do until the request comes back */
+	if (node->sync.state == BSTREAM_SYNC_WAIT)
+		return 0;
+
+/* delta, seek to the next chunk that was asked for and don't read past it */
+	if (node->sync.state == BSTREAM_SYNC_DELTA){
+		if (!node->sync.left){
+			while (node->sync.pos < node->sync.n_chunks &&
+				!(node->sync.want[node->sync.pos / 8] & (1 << (node->sync.pos % 8))))
+				node->sync.pos++;
+
+			if (node->sync.pos == node->sync.n_chunks){
+				a12int_trace(A12_TRACE_SYSTEM,
+					"kind=error:status=ECHUNK:stream=%"PRIu64, node->streamid);
+				unlink_node(S, node);
+				return 0;
+			}
+
+			node->ofs = node->sync.chunks[node->sync.pos].ofs;
+			node->sync.left = node->sync.chunks[node->sync.pos++].size;
+		}
+
+		if (cap > node->sync.left)
+			cap = node->sync.left;
+	}
+
 /* if we have a non-streaming pre-allocated source, just slice off and keep */
 	if (node->buf){
 		buf = &node->buf[node->buf_sz - node->left];
@@ -2755,7 +3437,13 @@ static size_t queue_node(struct a12_state* S, struct blob_out* node)
 		free_buf = false;
 	}
 	else {
-		buf = read_data(node->fd, cap, &nts, &die);
+		buf = read_data(node->fd,
+			node->streaming ? -1 : node->ofs, cap, &nts, &die);
+		free_buf = true;
+		if (buf && !node->streaming)
+			node->ofs += nts;
+		if (buf && node->sync.state == BSTREAM_SYNC_DELTA)
+			node->sync.left -= nts;
 	}
 
 /* streaming or file source that broke before we finished sending it all */
@@ -2801,6 +3489,10 @@ static size_t append_blob(struct a12_state* S, int mode)
 		return 0;
 	}
 
+/* similarly, a delta transfer waits for the chunk request */
+	else if (S->pending->sync.state == BSTREAM_SYNC_WAIT)
+		return 0;
+
 /* only current channel? */
 	else if (mode == A12_FLUSH_CHONLY){
 		struct blob_out* parent = S->pending;
@@ -2905,16 +3597,186 @@ a12_channel_aframe(struct a12_state* S,
 }
 
 /*
- * This function merely performs basic sanity checks of the input sources
- * then forwards to the corresponding _encode method that match the set opts.
+ * [Congestion control]
+ * The other side tells us (DISPLAYHINT, input) which channel matters, and the
+ * acks (bwe_sample) give roundtrip, queueing delay and delivery rate. Every
+ * channel has a frame budget in the window of frames in flight depending on
+ * priority, and channels without priority also share what the estimate allows
+ * through a token bucket so that they can't build a queue in front of the one
+ * the user is interacting with.
  */
-void
-a12_channel_vframe(struct a12_state* S,
-	struct shmifsrv_vbuffer* vb, struct a12_vframe_opts opts)
+enum {
+	SCHED_HIDDEN = 0,
+	SCHED_BACKGROUND = 1,
+	SCHED_FOCUS = 2
+};
+
+static int sched_priority(struct a12_state* S, uint8_t chid, uint64_t now)
 {
-	if (!S || S->cookie != 0xfeedface || S->state == STATE_BROKEN)
+	struct a12_channel* ch = &S->channels[chid];
+	if (ch->sched.hidden)
+		return SCHED_HIDDEN;
+
+	if (!ch->sched.unfocused ||
+		(ch->sched.last_input && now - ch->sched.last_input < A12_INPUT_ACTIVE_MS))
+		return SCHED_FOCUS;
+
+	return SCHED_BACKGROUND;
+}
+
+static void sched_charge(
+	struct a12_state* S, uint8_t chid, size_t nb, int method)
+{
+	struct a12_channel* ch = &S->channels[chid];
+	if (!nb)
 		return;
 
+	ch->sched.credit -= nb;
+	ch->sched.frame_bytes = ch->sched.frame_bytes ?
+		(ch->sched.frame_bytes * 3 + nb) / 4 : nb;
+
+	if (method != VFRAME_METHOD_H264)
+		ch->sched.delta_bytes = ch->sched.delta_bytes ?
+			(ch->sched.delta_bytes * 3 + nb) / 4 : nb;
+}
+
+bool
+a12_vframe_admit(struct a12_state* S, uint8_t chid)
+{
+	if (!S || S->cookie != 0xfeedface || S->state == STATE_BROKEN)
+		return false;
+
+	uint64_t now = sched_clock();
+	int prio = sched_priority(S, chid, now);
+	size_t wnd = VIDEO_FRAME_DRIFT_WINDOW - 1;
+	size_t inflight = S->congestion_stats.pending;
+
+	size_t limit = wnd;
+	if (prio == SCHED_BACKGROUND)
+		limit = wnd >> 1;
+	else if (prio == SCHED_HIDDEN)
+		limit = 1;
+
+	if (inflight >= limit)
+		return false;
+
+/* nothing more to go on until the first acks have arrived */
+	size_t bw = S->stats.bw_estimate;
+	if (!bw)
+		return true;
+
+/* the delay is from the last ack, with nothing in flight there's no queue */
+	size_t qd_limit = A12_QUEUE_DELAY_MS;
+	if (prio == SCHED_FOCUS)
+		qd_limit *= 2;
+
+	if (inflight && S->stats.queue_delay > qd_limit){
+		a12int_trace(A12_TRACE_VDETAIL,
+			"kind=defer:ch=%d:queue_delay=%zu", (int) chid, S->stats.queue_delay);
+		return false;
+	}
+
+/* focus doesn't accrue debt, so losing it doesn't mean a stall */
+	struct a12_channel* ch = &S->channels[chid];
+	if (prio == SCHED_FOCUS){
+		ch->sched.credit = 0;
+		ch->sched.credit_ts = now;
+		return true;
+	}
+
+/* share by weight, the focused channels count four times */
+	size_t weight = 0;
+	for (size_t i = 0; i < 256; i++){
+		if (!S->channels[i].active && i != chid)
+			continue;
+
+		int cprio = sched_priority(S, i, now);
+		weight += cprio == SCHED_FOCUS ? 4 : cprio;
+	}
+
+	size_t share = bw / (weight ? weight : 1);
+
+	if (ch->sched.credit_ts){
+		ch->sched.credit += (int64_t) share * (now - ch->sched.credit_ts) / 1000;
+	}
+	ch->sched.credit_ts = now;
+
+/* don't let an idle channel save up for a burst */
+	int64_t cap = share >> 2;
+	if (cap < (int64_t) ch->sched.frame_bytes)
+		cap = ch->sched.frame_bytes;
+	if (ch->sched.credit > cap)
+		ch->sched.credit = cap;
+
+	return ch->sched.credit >= 0;
+}
+
+struct a12_vframe_opts
+a12_vframe_adapt(
+	struct a12_state* S, uint8_t chid, struct a12_vframe_opts opts)
+{
+	if (!S || S->cookie != 0xfeedface)
+		return opts;
+
+	if (opts.method != VFRAME_METHOD_DZSTD &&
+		opts.method != VFRAME_METHOD_ZSTD && opts.method != VFRAME_METHOD_H264)
+		return opts;
+
+	size_t bw = S->stats.bw_estimate;
+	if (!bw)
+		return opts;
+
+	struct a12_channel* ch = &S->channels[chid];
+	size_t frame_ms = (uint64_t) ch->sched.delta_bytes * 1000 / bw;
+	bool congested = S->stats.queue_delay > A12_QUEUE_DELAY_MS;
+
+/* with a rate that can't fit the zstd family at all, a lossy codec is the
+ * only way to maintain a framerate, go back when it would fit comfortably.
+ * The delta chain is reset on return as the sink has the h264 output. */
+#ifdef WANT_H264_ENC
+	if (!S->advenc_broken){
+		if (!ch->sched.h264 && frame_ms > 4 * A12_FRAME_BUDGET_MS){
+			a12int_trace(A12_TRACE_VIDEO,
+				"kind=adapt:ch=%d:codec=h264:frame_ms=%zu", (int) chid, frame_ms);
+			ch->sched.h264 = true;
+		}
+		else if (ch->sched.h264 && frame_ms < A12_FRAME_BUDGET_MS && !congested){
+			a12int_trace(A12_TRACE_VIDEO,
+				"kind=adapt:ch=%d:codec=dzstd:frame_ms=%zu", (int) chid, frame_ms);
+			ch->sched.h264 = false;
+			ch->acc.w = 0;
+		}
+
+		if (ch->sched.h264){
+			opts.method = VFRAME_METHOD_H264;
+			opts.bias = VFRAME_BIAS_LATENCY;
+			if (!opts.bitrate)
+				opts.bitrate = (uint64_t) bw * 8 * 3 / 4 / 1000;
+			return opts;
+		}
+	}
+#endif
+
+/* for the zstd family, trade cpu for bandwidth when tight, and the other way
+ * around when there's plenty of headroom */
+	if (opts.method == VFRAME_METHOD_H264)
+		return opts;
+
+	if (congested || frame_ms > A12_FRAME_BUDGET_MS)
+		opts.bias = VFRAME_BIAS_QUALITY;
+	else if (frame_ms < A12_FRAME_BUDGET_MS / 4)
+		opts.bias = VFRAME_BIAS_LATENCY;
+
+	return opts;
+}
+
+/*
+ * Shared between the direct and the staged vframe path, returns the number of
+ * pixels covered by the update (0 on failure) and the encoding time in [ms].
+ */
+static size_t encode_vframe(struct a12_state* S, uint8_t chid,
+	struct shmifsrv_vbuffer* vb, struct a12_vframe_opts opts, size_t* ms)
+{
 /* use a fix size now as the outb- writer lacks queueing and interleaving */
 	size_t chunk_sz = 32768;
 
@@ -2927,10 +3789,14 @@ a12_channel_vframe(struct a12_state* S,
 		h = vb->region.y2 - y;
 	}
 
+/* the sink lost track, the accumulation buffer is rebuilt as for a resize */
+	if (atomic_exchange(&S->channels[chid].reset_delta, false))
+		S->channels[chid].acc.w = 0;
+
 /* sanity check against a dumb client here as well */
 	if (!w || !h){
 		a12int_trace(A12_TRACE_SYSTEM, "kind=einval:status=bad dimensions");
-		return;
+		return 0;
 	}
 
 	if (x + w > vb->w || y + h > vb->h){
@@ -2962,7 +3828,7 @@ a12_channel_vframe(struct a12_state* S,
 
 	a12int_trace(A12_TRACE_VIDEO,
 		"out vframe: %zu*%zu @%zu,%zu+%zu,%zu", vb->w, vb->h, w, h, x, y);
-#define argstr S, vb, opts, sid, x, y, w, h, chunk_sz, S->out_channel
+#define argstr S, vb, opts, sid, x, y, w, h, chunk_sz, chid
 
 	size_t now = arcan_timemillis();
 	switch(opts.method){
@@ -2994,14 +3860,128 @@ a12_channel_vframe(struct a12_state* S,
 	break;
 	default:
 		a12int_trace(A12_TRACE_SYSTEM, "unknown format: %d\n", opts.method);
-		return;
+		return 0;
 	break;
 	}
+#undef argstr
+
 	size_t then = arcan_timemillis();
-	if (then > now){
-		S->stats.ms_vframe = then - now;
-		S->stats.ms_vframe_px = (float)(then - now) / (float)(w * h);
+	*ms = then > now ? then - now : 0;
+	return w * h;
+}
+
+/*
+ * This function merely performs basic sanity checks of the input sources
+ * then forwards to the corresponding _encode method that match the set opts.
+ */
+void
+a12_channel_vframe(struct a12_state* S,
+	struct shmifsrv_vbuffer* vb, struct a12_vframe_opts opts)
+{
+	if (!S || S->cookie != 0xfeedface || S->state == STATE_BROKEN)
+		return;
+
+	size_t ms;
+	size_t b_out = S->stats.b_out;
+	size_t px = encode_vframe(S, S->out_channel, vb, opts, &ms);
+	if (px && ms){
+		S->stats.ms_vframe = ms;
+		S->stats.ms_vframe_px = (float)ms / (float)px;
+	}
+
+	sched_charge(S, S->out_channel, S->stats.b_out - b_out, opts.method);
+}
+
+void
+a12_channel_vstage(struct a12_state* S, uint8_t chid,
+	struct a12_vstage* stage, struct shmifsrv_vbuffer* vb,
+	struct a12_vframe_opts opts)
+{
+	if (!S || S->cookie != 0xfeedface || S->state == STATE_BROKEN || !stage)
+		return;
+
+	stage->used = 0;
+	stage->failed = false;
+	stage->ms_vframe = 0;
+	stage->ms_vframe_px = 0;
+	stage->chid = chid;
+	stage->method = opts.method;
+
+	out_stage = stage;
+	size_t ms;
+	size_t px = encode_vframe(S, chid, vb, opts, &ms);
+	out_stage = NULL;
+
+	if (px && ms){
+		stage->ms_vframe = ms;
+		stage->ms_vframe_px = (float)ms / (float)px;
+	}
+}
+
+void
+a12_channel_vstage_commit(struct a12_state* S, struct a12_vstage* stage)
+{
+	if (!S || S->cookie != 0xfeedface || !stage)
+		return;
+
+/* a partial frame would leave the decoder with a broken delta chain */
+	if (stage->failed){
+		stage->used = 0;
+		return;
+	}
+
+/* the encoders step the stream before appending the control packet, so the
+ * stream identifier to patch in is the one that was current at the step */
+	uint32_t sid = S->out_stream;
+	size_t b_out = S->stats.b_out;
+	size_t pos = 0;
+
+	while (pos + STAGE_RECORD_SZ <= stage->used){
+		uint8_t* rec = &stage->buf[pos];
+		uint16_t prepend_sz;
+		uint32_t out_sz;
+		unpack_u16(&prepend_sz, &rec[2]);
+		unpack_u32(&out_sz, &rec[4]);
+		pos += STAGE_RECORD_SZ;
+
+		uint8_t* prepend = &stage->buf[pos];
+		pos += prepend_sz;
+		uint8_t* out = &stage->buf[pos];
+		pos += out_sz;
+
+		if (rec[0] == STAGE_STEP){
+			sid = S->out_stream;
+			a12int_step_vstream(S, sid);
+			continue;
+		}
+
+		if (rec[1] == STATE_CONTROL_PACKET &&
+			out_sz == CONTROL_PACKET_SIZE && out[17] == COMMAND_VIDEOFRAME){
+			pack_u64(S->last_seen_seqnr, &out[0]);
+			pack_u32(sid, &out[18]);
+		}
+
+		a12int_append_out(S, rec[1], out, out_sz,
+			prepend_sz ? prepend : NULL, prepend_sz);
 	}
+
+	if (stage->ms_vframe){
+		S->stats.ms_vframe = stage->ms_vframe;
+		S->stats.ms_vframe_px = stage->ms_vframe_px;
+	}
+
+	sched_charge(S, stage->chid, S->stats.b_out - b_out, stage->method);
+	stage->used = 0;
+}
+
+void
+a12_vstage_free(struct a12_vstage* stage)
+{
+	if (!stage)
+		return;
+
+	free(stage->buf);
+	*stage = (struct a12_vstage){};
 }
 
 bool
@@ -3081,6 +4061,12 @@ a12_set_trace_level(int mask, FILE* dst)
 	a12_trace_dst = dst;
 }
 
+void
+a12_set_clock(unsigned long long (*clock)(void))
+{
+	a12_clock = clock;
+}
+
 static const char* groups[] = {
 	"video",
 	"audio",
@@ -3140,6 +4126,11 @@ void* a12_sensitive_alloc(size_t nb)
 
 void a12int_step_vstream(struct a12_state* S, uint32_t id)
 {
+	if (out_stage){
+		stage_append(out_stage, STAGE_STEP, 0, NULL, 0, NULL, 0);
+		return;
+	}
+
 	size_t slot = S->congestion_stats.pending;
 
 /* clamp so that sz-1 compared to sz-2 can indicate how reckless the api
@@ -3148,6 +4139,9 @@ void a12int_step_vstream(struct a12_state* S, uint32_t id)
 		S->congestion_stats.pending++;
 
 	S->congestion_stats.frame_window[slot] = S->out_stream++;
+	S->congestion_stats.frame_ts[slot] = sched_clock();
+	S->congestion_stats.frame_bytes[slot] = S->stats.b_out;
+	S->congestion_stats.frame_delivered[slot] = S->congestion_stats.delivered;
 }
 
 bool a12_ok(struct a12_state* S)
@@ -353,6 +353,14 @@ enum trace_groups {
 void
 a12_set_trace_level(int mask, FILE* dst);
 
+/*
+ * Replace the millisecond clock used for congestion control and frame
+ * scheduling, intended for tests that drive a simulated link. Set to NULL to
+ * go back to arcan_timemillis.
+ */
+void
+a12_set_clock(unsigned long long (*clock)(void));
+
 /*
  * forward a vbuffer from shm
  */
@@ -430,12 +438,19 @@ struct a12_aframe_cfg {
  * new file descriptor will be populated and when the transfer is
  * completed / cancelled, the handler will be invoked again. It is up
  * to the handler to close any descriptor.
+ *
+ * If [delta] is set in the metadata, the other side can send only the parts
+ * that differ from an older copy. Respond with NEWFD_DELTA and set [basis]
+ * to a descriptor of that copy. The basis descriptor is taken over by the
+ * state machine, its contents should not change until the transfer has
+ * completed or been cancelled.
  */
 enum a12_bhandler_flag {
 	A12_BHANDLER_CACHED = 0,
 	A12_BHANDLER_NEWFD,
 	A12_BHANDLER_DONTWANT,
-	A12_BHANDLER_NEWFD_NOCOMPRESS
+	A12_BHANDLER_NEWFD_NOCOMPRESS,
+	A12_BHANDLER_NEWFD_DELTA
 };
 
 enum a12_bhandler_state {
@@ -450,6 +465,7 @@ struct a12_bhandler_meta {
 	uint8_t checksum[16];
 	uint64_t known_size;
 	bool streaming;
+	bool delta;
 	uint8_t channel;
 	uint64_t streamid;
 	uint32_t identifier;
@@ -459,6 +475,7 @@ struct a12_bhandler_meta {
 struct a12_bhandler_res {
 	enum a12_bhandler_flag flag;
 	int fd;
+	int basis;
 };
 void
 a12_set_bhandler(struct a12_state*,
@@ -505,6 +522,67 @@ a12_channel_vframe(
 	struct a12_vframe_opts opts
 );
 
+/*
+ * Split version of a12_channel_vframe for callers that want to encode
+ * several channels in parallel. a12_channel_vstage encodes [vb] for [chid]
+ * into [stage] without touching the shared output buffer, sequence numbers or
+ * cipher state, and may be called from several threads at once as long as
+ * they work on different channels and the channel is not closed meanwhile.
+ *
+ * a12_channel_vstage_commit appends the staged packets to the output buffer
+ * and needs the same serialization as any other call into [S]. The stage is
+ * caller- owned, zero-initialize before first use and release the buffer
+ * with a12_vstage_free.
+ */
+struct a12_vstage {
+	uint8_t* buf;
+	size_t buf_sz;
+	size_t used;
+	bool failed;
+
+	size_t ms_vframe;
+	float ms_vframe_px;
+
+	uint8_t chid;
+	int method;
+};
+
+void
+a12_channel_vstage(
+	struct a12_state* S,
+	uint8_t chid,
+	struct a12_vstage* stage,
+	struct shmifsrv_vbuffer* vb,
+	struct a12_vframe_opts opts
+);
+
+void
+a12_channel_vstage_commit(struct a12_state* S, struct a12_vstage* stage);
+
+void
+a12_vstage_free(struct a12_vstage* stage);
+
+/*
+ * Congestion control for the video source side. The state tracks a bandwidth
+ * and queueing delay estimate from the acks of video frames, and which
+ * channels have focus or recent input from the hints sent by the other side.
+ *
+ * a12_vframe_admit returns true if a new frame for [chid] should be encoded
+ * now or if it should be deferred. Channels with focus get the full window of
+ * frames in flight and are only held back on severe queueing, the others are
+ * throttled first and share the remaining estimated bandwidth.
+ *
+ * a12_vframe_adapt tunes [opts] (compression level, codec and bitrate) for
+ * [chid] against the estimated headroom. Only the zstd family and h264 are
+ * modified, other methods are returned as is.
+ */
+bool
+a12_vframe_admit(struct a12_state* S, uint8_t chid);
+
+struct a12_vframe_opts
+a12_vframe_adapt(
+	struct a12_state* S, uint8_t chid, struct a12_vframe_opts opts);
+
 /*
  * Forward / start a new channel intended for the 'real' client. If this
  * comes as a NEWSEGMENT event from the 'real' arcan instance, make sure
@@ -555,7 +633,8 @@ int a12_remote_mode(struct a12_state* S);
 enum stream_cancel {
 	STREAM_CANCEL_DONTWANT = 0,
 	STREAM_CANCEL_DECODE_ERROR = 1,
-	STREAM_CANCEL_KNOWN = 2
+	STREAM_CANCEL_KNOWN = 2,
+	STREAM_CANCEL_DELTA_LOST = 3
 };
 void a12_vstream_cancel(struct a12_state* S, uint8_t chid, int reason);
 
@@ -570,10 +649,13 @@ struct a12_iostat {
 	size_t b_in;
 	size_t b_out;
 	size_t vframe_backpressure; /* number of encoded vframes vs. pending */
-	size_t roundtrip_latency;
+	size_t roundtrip_latency;   /* ms, smoothed, from vframe acks */
 	size_t ms_vframe;           /* for last encoded video frame */
 	float ms_vframe_px;
 	size_t packets_pending;     /* delta between seqnr and last-seen seqnr */
+	size_t min_latency;         /* ms, lowest recent roundtrip */
+	size_t queue_delay;         /* ms, roundtrip above min_latency */
+	size_t bw_estimate;         /* bytes/s, 0 until the first acks */
 };
 
 /*
@@ -0,0 +1,192 @@
+/*
+ * Copyright: Björn Ståhl
+ * Description: A12 protocol state machine, content defined chunking for
+ * binary stream delta synchronisation.
+ * License: 3-Clause BSD, see COPYING file in arcan source repository.
+ * Reference: https://arcan-fe.com
+ */
+#include <arcan_shmif.h>
+#include <arcan_shmif_server.h>
+
+#include <inttypes.h>
+#include <string.h>
+
+#include "a12.h"
+#include "a12_int.h"
+#include "a12_chunk.h"
+
+/*
+ * Gear rolling hash table, 256 random 64-bit values (splitmix64 sequence),
+ * the fingerprint is shifted one step per byte so only the top bits carry
+ * the window of the last 64 bytes and that is where the cut mask is applied.
+ */
+static const uint64_t gear[256] = {
+	0xedf767e063541a0fULL, 0x4182fe6dfefe0c9aULL, 0xcd41c70be3e33b6cULL,
+	0xe603e58fac7420caULL, 0x16070b8f9719b12aULL, 0x47fbe333697e4dadULL,
+	0x06c817cb817ffa52ULL, 0x1f31ba2c4f6a28e8ULL, 0x3fc3934edb4d2f2aULL,
+	0x809379829cae8cdfULL, 0x24f0776fab7918c0ULL, 0x84ea107d8f0d74faULL,
+	0xf76468ada7cfdb27ULL, 0x49e16b9b58925e2bULL, 0xc49749e357c5bcb0ULL,
+	0xe915865cc9dea1edULL, 0x25cf03d3b987ef4bULL, 0x34a3fcbf55fa6613ULL,
+	0x395bda6fd18bf6bdULL, 0x1870dd462cf3368bULL, 0x924350f8cbe7c82fULL,
+	0xda12d072b188650cULL, 0xc6b9148c66ae11feULL, 0x7257b7fc3493b3ceULL,
+	0xcf9a496d0a205b8eULL, 0xc0bbdac08f421d03ULL, 0x046c8e597c1953caULL,
+	0xadc60564fb1be791ULL, 0x01f418ad764728e3ULL, 0x7fb1aaec386009f4ULL,
+	0x012ca288292bec0cULL, 0x84082e803b0ebcb9ULL, 0xf8a5a61644be7c78ULL,
+	0xe68580510342c042ULL, 0x68058bf657ba2d23ULL, 0x15c6970619550196ULL,
+	0x32a95cdf2982478dULL, 0x8edf5f9a37520df3ULL, 0xfdd02bfd73e15e1aULL,
+	0xc142ce914d946e49ULL, 0xef4a12c0e4546c9fULL, 0x13818c5e1e8a3a2aULL,
+	0x6c4c929af8038213ULL, 0x198a20a5a3e7efbcULL, 0x303ac3cf0797882dULL,
+	0xbe0f0143c68fee84ULL, 0x4a7e322050c9d334ULL, 0x05d96ed6efd8e652ULL,
+	0x6c506050c9e9c3b8ULL, 0xfe5139f40d0157e3ULL, 0x12978f6586415805ULL,
+	0x55387daa191bd7c5ULL, 0x2ae5c705a30d1f7aULL, 0x93ee44d3861e5b84ULL,
+	0xec5a6a73edb399b7ULL, 0x958be1ea9e4f8f05ULL, 0xadedff2949896263ULL,
+	0x1b764a64813daedaULL, 0xd9541f5001d923bcULL, 0xbb627e616dd3804dULL,
+	0xe03cabf2c1b8eea0ULL, 0x7e1d3cc25bcfaa73ULL, 0xa06957625dbd4517ULL,
+	0x1984d7d1011836e3ULL, 0x01dd7dd277befe67ULL, 0xe284f9ac419c4e7fULL,
+	0xaa873a9046ee9958ULL, 0x8e963af574f7a105ULL, 0x341e489cf4d1fb76ULL,
+	0xb357887b2554c3a9ULL, 0x5cf9b95fea27b3faULL, 0x63052e205c7f118aULL,
+	0x9b7e19f4fb43ab6eULL, 0xc730eed71e5b9adfULL, 0x5ca73be76e365888ULL,
+	0xcb665ed3e15f92d8ULL, 0x61446629f72df731ULL, 0x62d0dcc73706fb09ULL,
+	0x6b2eecd505472057ULL, 0x83edaac982b5e63cULL, 0x1a03e1cdcd91a9a9ULL,
+	0x4affd45e4ee47a61ULL, 0xf66d228f37e8f1ebULL, 0x1800ccf06279fa20ULL,
+	0x83c093c7750ecb55ULL, 0x919da2162601f2d4ULL, 0xc0448a94bca34648ULL,
+	0xcbdae8bd69a7a24aULL, 0x661f8849b0e91ff7ULL, 0x731d8a7406da30d3ULL,
+	0x5105f8eb6ee3bc89ULL, 0xd8bb437dd5652570ULL, 0x3e1b2583961f2887ULL,
+	0x475844e64d88fb67ULL, 0x054b5091f2bf3274ULL, 0xcdded7482a77f718ULL,
+	0x9524bacbe039d9a8ULL, 0x8fe0ce123863a829ULL, 0x204754dd364660abULL,
+	0xbc5fa016f078cbb0ULL, 0x72fcaedaad9151ecULL, 0x160279c37fb84f4bULL,
+	0xf767eeb94276be5bULL, 0x7b1985144dbca181ULL, 0xe1f376ca0ba54f36ULL,
+	0xbb26702901bbb62cULL, 0x80da80b7802563b1ULL, 0xcde77265af14c5b0ULL,
+	0x1aad8f1cb0e2a7c2ULL, 0xcd596c77d402be14ULL, 0x0c2c8767e0643969ULL,
+	0x063cb9310b1ae3f3ULL, 0x7ab45fa617e38132ULL, 0x0caf1fa77e43d316ULL,
+	0xb19d2a12d320c78aULL, 0x6d8054d41cda1973ULL, 0x2ec3526970beee76ULL,
+	0x61c62d2edc94256cULL, 0x1965eaa54cf9861dULL, 0x4682f7ef7673fb3fULL,
+	0x27cb6ac66c2e2c65ULL, 0xee780994e7e7a8c8ULL, 0xb5cd5df93064d2c7ULL,
+	0xb196a3f484237b57ULL, 0xeb179fb83fa9c2f2ULL, 0x0eacac6602466506ULL,
+	0xe6577b8e6698b8adULL, 0x4c5503ced82dbb70ULL, 0xcf67bd5880d24727ULL,
+	0x447795ea1b53c786ULL, 0xd4c04021c8ffc84fULL, 0x0e1de1ca001540bbULL,
+	0xe4de2607e47888a6ULL, 0x85faf8d2f4471116ULL, 0xe7e9a0b0c708b748ULL,
+	0xd1ff7ac36067bbd5ULL, 0xbcc004e8867ee7b7ULL, 0xad456213a8e6f6f4ULL,
+	0x213130058e775cc4ULL, 0x97787b50f1c5803cULL, 0x8f579fb04a9a9a73ULL,
+	0x2201cd938a1af8afULL, 0x87f0e07f728c435dULL, 0xcb9f3078fbff554bULL,
+	0x2b6f4e885b4b14dbULL, 0xa950dcd726a5e852ULL, 0x8d2abe4df567e913ULL,
+	0x3f806f14403c87ecULL, 0xe091f64e102f7043ULL, 0x530b1d6a8d83737fULL,
+	0x7f114420f73ec2c2ULL, 0x74d2f46d5c34a31aULL, 0x586096b10087af63ULL,
+	0x765ac7e854220bb9ULL, 0xd6bb54590fa4e2c1ULL, 0x15f4c5db343f091bULL,
+	0xa13c5d0e4821650fULL, 0x85aa637cc423e9f0ULL, 0xe21a46cfe4022c98ULL,
+	0x681da71ca84385afULL, 0x4ef5ba1dbbbc3245ULL, 0xe75a54b16b5e3364ULL,
+	0xdce8327b9590fc39ULL, 0xa098e45328fd3967ULL, 0x0db81ad4c9696287ULL,
+	0xcd5e3c4a05884acdULL, 0xaa2c19cf1a28a1e3ULL, 0x42bb35b4c29d5d0dULL,
+	0xa0d2496d096602abULL, 0x4b0af8fadf25be3bULL, 0xc9a39adfee7cacbfULL,
+	0xfcd0d20cdcacca31ULL, 0x5692f4d514973edeULL, 0x6f98a58311917827ULL,
+	0x1d89c0d8254c22adULL, 0xaa1687dd4427e9e2ULL, 0x38f110a50c1c625eULL,
+	0x7fb7a9da84248541ULL, 0xa876953bdca84fc4ULL, 0x5433c5b884634e40ULL,
+	0xb1d6a7071cc86f9eULL, 0xceada8b76f14f5fbULL, 0x0b4f5694fd500078ULL,
+	0x4de2dec3331b64feULL, 0x0bd833c1162f14eeULL, 0x432988944424a1e9ULL,
+	0xc8d5c8c7cbda8d52ULL, 0x4a535dad66a61f6aULL, 0x3f3931f877b34b5cULL,
+	0xa725b2976a7f9622ULL, 0x3fd5ee9bfa567af7ULL, 0xb5faf6a1913206afULL,
+	0x849eb14671b5f06aULL, 0x88e349ecbe91bd7aULL, 0x0693992bb91d8ca1ULL,
+	0x2c0d8cc5b09f86d2ULL, 0xf29b356a59995b93ULL, 0x9b53f6a2ac7ea9aaULL,
+	0x4001c57378575cffULL, 0x4b5bfb01728e6081ULL, 0xa41150890b3e3218ULL,
+	0x4688e0f301e7ca7eULL, 0x5e78b34c4f6e1142ULL, 0x21926f3fc4e3869aULL,
+	0xd0f8d80ab68cc73cULL, 0xe61642c6dd4b6fb1ULL, 0x51e13e727cc359e0ULL,
+	0x41d150157b519f7dULL, 0x555abc1cbecaaf60ULL, 0xf3d3a27f7d3e5419ULL,
+	0xf132ab876db30bd1ULL, 0x01ee44a3c4da3e2dULL, 0x3435428614487952ULL,
+	0xf45f82d4472ea01dULL, 0x88445f51ef1299e8ULL, 0x4b394cf7a95f954bULL,
+	0x275a63ac74f7b477ULL, 0x1b5b3aa0e20fcec8ULL, 0x09839884faba22b3ULL,
+	0x660280ad0e7163ecULL, 0x64a680db44a06225ULL, 0x259a595db2c9513fULL,
+	0x415d6674ecbe25c0ULL, 0x6fe26e3680a980b3ULL, 0xd4dbb937b04acc77ULL,
+	0xb14aee97e5da2a5bULL, 0xcede664d261247d4ULL, 0x20e7fbfa6f9dcc23ULL,
+	0xcd4d1d32be06082bULL, 0x1ff578293a16467eULL, 0xc715ee4d0580535fULL,
+	0x72ea50579938e512ULL, 0x4e894b5b289df50cULL, 0x6d6778c504efdab8ULL,
+	0xdd79bdbe309b7e08ULL, 0x8c7de786494a0f4cULL, 0x79e5f66d5331c7b8ULL,
+	0x1622312f67542262ULL, 0x9d7859dfcd41d46dULL, 0x29e83a95fd4e8e2bULL,
+	0x2848c5ed3ac109e9ULL, 0xc7b3c11a25df43c1ULL, 0x050ee6a1153fcdebULL,
+	0x8626ad84d334d486ULL, 0xb138c8b0105cf029ULL, 0xf53c3b3f8622b9d5ULL,
+	0x840f821227df0426ULL, 0x9d3e505168737c47ULL, 0x438202d49cd133f8ULL,
+	0xb28526d0cec600f0ULL, 0x9b5484425f8bb61bULL, 0x4efc41597730a527ULL,
+	0x738d48643fa400b3ULL, 0xbfe9edf4c9bb6f59ULL, 0xc6798806df650e89ULL,
+	0xc7f6e544ff1d6749ULL
+};
+
+/* 13 bits gives an average of 8k on top of the minimum size */
+#define CHUNK_MASK 0xfff8000000000000ULL
+
+static size_t chunk_next(const uint8_t* buf, size_t sz)
+{
+	if (sz <= A12_CHUNK_MIN)
+		return sz;
+
+	size_t lim = sz > A12_CHUNK_MAX ? A12_CHUNK_MAX : sz;
+	uint64_t fp = 0;
+
+/* the first min bytes are skipped entirely, the cut can't go there anyhow */
+	for (size_t i = A12_CHUNK_MIN; i < lim; i++){
+		fp = (fp << 1) + gear[buf[i]];
+		if (!(fp & CHUNK_MASK))
+			return i + 1;
+	}
+
+	return lim;
+}
+
+struct a12_chunk* a12int_chunk_split(const uint8_t* buf, size_t sz, size_t* n)
+{
+	*n = 0;
+	if (!sz)
+		return NULL;
+
+/* start with a guess around the average size and grow if that was wrong */
+	size_t cap = sz / 8192 + 16;
+	struct a12_chunk* res = DYNAMIC_MALLOC(cap * sizeof(struct a12_chunk));
+	if (!res)
+		return NULL;
+
+	size_t pos = 0;
+	while (pos < sz){
+		if (*n == cap){
+			struct a12_chunk* nres =
+				DYNAMIC_REALLOC(res, cap * 2 * sizeof(struct a12_chunk));
+			if (!nres){
+				DYNAMIC_FREE(res);
+				*n = 0;
+				return NULL;
+			}
+			res = nres;
+			cap *= 2;
+		}
+
+		size_t step = chunk_next(&buf[pos], sz - pos);
+		struct a12_chunk* cur = &res[(*n)++];
+		cur->ofs = pos;
+		cur->size = step;
+
+		blake3_hasher hash;
+		blake3_hasher_init(&hash);
+		blake3_hasher_update(&hash, &buf[pos], step);
+		blake3_hasher_finalize(&hash, cur->hash, 16);
+
+		pos += step;
+	}
+
+	return res;
+}
+
+static int cmphash(const void* a, const void* b)
+{
+	return memcmp(
+		((const struct a12_chunk*)a)->hash, ((const struct a12_chunk*)b)->hash, 16);
+}
+
+void a12int_chunk_index(struct a12_chunk* set, size_t n)
+{
+	qsort(set, n, sizeof(struct a12_chunk), cmphash);
+}
+
+const struct a12_chunk* a12int_chunk_find(
+	const struct a12_chunk* set, size_t n, const uint8_t hash[static 16])
+{
+	struct a12_chunk key;
+	memcpy(key.hash, hash, 16);
+	return bsearch(&key, set, n, sizeof(struct a12_chunk), cmphash);
+}
@@ -0,0 +1,41 @@
+#ifndef HAVE_A12_CHUNK
+#define HAVE_A12_CHUNK
+
+/*
+ * Content defined chunking for binary stream delta synchronisation.
+ *
+ * Both ends split a file at the same content dependent cut points, so an
+ * insertion or removal only changes the chunks around the edit and the
+ * rest can be matched by hash against an older copy on the receiving side.
+ *
+ * The cut points (gear table, mask and size limits) are part of the
+ * protocol, changing them breaks matching between versions.
+ */
+#define A12_CHUNK_MIN 2048
+#define A12_CHUNK_MAX 65536
+
+/* below this size the extra round trip costs more than it can save */
+#define A12_CHUNK_THRESHOLD 65536
+
+struct a12_chunk {
+	uint64_t ofs;
+	uint32_t size;
+	uint8_t hash[16];
+};
+
+/*
+ * Split [buf, buf+sz) into chunks and hash each one, returns a dynamically
+ * allocated array with [*n] entries or NULL on an empty buffer / alloc failure.
+ */
+struct a12_chunk* a12int_chunk_split(const uint8_t* buf, size_t sz, size_t* n);
+
+/*
+ * Sort [set] by hash so that it can be used with chunk_find, the order of
+ * equal hashes is kept undefined as they refer to identical contents.
+ */
+void a12int_chunk_index(struct a12_chunk* set, size_t n);
+
+const struct a12_chunk* a12int_chunk_find(
+	const struct a12_chunk* set, size_t n, const uint8_t hash[static 16]);
+
+#endif
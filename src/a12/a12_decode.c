@@ -6,6 +6,7 @@
  */
 #include <arcan_shmif.h>
 #include <arcan_shmif_server.h>
+#include <arcan_shmif_pixconv.h>
 
 #include <inttypes.h>
 #include <string.h>
@@ -15,6 +16,10 @@
 #include "a12_int.h"
 #include "zstd.h"
 
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
 #ifdef LOG_FRAME_OUTPUT
 #define STB_IMAGE_WRITE_STATIC
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -50,19 +55,97 @@ bool a12int_buffer_format(int method)
 		method == POSTPROCESS_VIDEO_DZSTD;
 }
 
+bool a12int_stream_format(int method)
+{
+	return
+		method == POSTPROCESS_VIDEO_TZSTD ||
+		method == POSTPROCESS_VIDEO_ZSTD ||
+		method == POSTPROCESS_VIDEO_DZSTD;
+}
+
+/*
+ * Unpack [n] packed RGB888 pixels from [src] into [dst], either as a plain
+ * copy or XORed against what is already in [dst] for delta frames. Alpha is
+ * always forced to fully opaque.
+ */
+static void unpack_rgb_span(
+	shmif_pixel* restrict dst, const uint8_t* restrict src, size_t n, bool delta)
+{
+	size_t i = 0;
+
+	if (!delta){
+		arcan_shmif_pixconv_import(SHMIF_PIXFMT_RGB888,
+			(const uint8_t* const[3]){src}, NULL, n, 1, dst, 0, 0);
+		return;
+	}
+
+#if defined(__SSSE3__) && SHMIF_RGBA_RSHIFT == 16 && SHMIF_RGBA_GSHIFT == 8 &&\
+	SHMIF_RGBA_BSHIFT == 0 && SHMIF_RGBA_ASHIFT == 24
+	const __m128i shuf = _mm_setr_epi8(
+		2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+	const __m128i alpha = _mm_set1_epi32((int) 0xff000000);
+
+/* 16 byte loads at a 12 byte stride, stop while the load is still in range */
+	for (; i + 6 <= n; i += 4){
+		__m128i px = _mm_shuffle_epi8(
+			_mm_loadu_si128((const __m128i*) &src[i * 3]), shuf);
+
+		px = _mm_xor_si128(px, _mm_loadu_si128((const __m128i*) &dst[i]));
+		_mm_storeu_si128((__m128i*) &dst[i], _mm_or_si128(px, alpha));
+	}
+#endif
+
+	for (; i < n; i++){
+		const uint8_t* px = &src[i * 3];
+		shmif_pixel val = SHMIF_RGBA(px[0], px[1], px[2], 0x00);
+		dst[i] = (dst[i] ^ val) | SHMIF_RGBA(0x00, 0x00, 0x00, 0xff);
+	}
+}
+
+/*
+ * Zstd frames are applied straight into the destination as they are being
+ * decompressed, so a frame that fails or is cut short midway leaves a mix of
+ * old and new contents that no later delta can be applied to. Mark that and
+ * ask the source for a full frame.
+ */
+static void stream_broken(
+	struct a12_state* S, struct a12_channel* ch, struct video_frame* cvf)
+{
+	cvf->commit = 255;
+	if (cvf->postprocess == POSTPROCESS_VIDEO_TZSTD || ch->vdec.broken)
+		return;
+
+	ch->vdec.broken = true;
+	a12_vstream_cancel(S, S->in_channel, STREAM_CANCEL_DELTA_LOST);
+}
+
 static int video_miniz(const void* buf, int len, void* user)
 {
 	struct a12_state* S = user;
 	struct video_frame* cvf = &S->channels[S->in_channel].unpack_state.vframe;
 	struct arcan_shmif_cont* cont = S->channels[S->in_channel].cont;
 	const uint8_t* inbuf = buf;
+	bool delta = cvf->postprocess == POSTPROCESS_VIDEO_DZSTD;
+	size_t out_lim;
 
 	if (!cont || len > cvf->expanded_sz){
 		a12int_trace(A12_TRACE_SYSTEM, "decompression resulted in data overcommit");
 		return 0;
 	}
 
-/* we have a 1..4 byte spill from a previous call so we need to have
+	cvf->expanded_sz -= len;
+
+/* tpack is easier, just write into vidb, ensure that we don't exceed
+ * the size from a missed resize_ call and the rest is done consumer side */
+	if (cvf->postprocess == POSTPROCESS_VIDEO_TZSTD){
+		memcpy(&cont->vidb[cvf->out_pos], inbuf, len);
+		cvf->out_pos += len;
+		return 1;
+	}
+
+	out_lim = (size_t) cont->pitch * cont->h;
+
+/* we have a 1..2 byte spill from a previous call so we need to have
  * a 1-px buffer that we populate before packing */
 	if (cvf->carry){
 		while (cvf->carry < 3){
@@ -70,25 +153,17 @@ static int video_miniz(const void* buf, int len, void* user)
 			len--;
 
 /* and this spill can also be short */
-			if (!len)
+			if (!len && cvf->carry < 3)
 				return 1;
 		}
 
-/* and commit */
-		if (cvf->postprocess == POSTPROCESS_VIDEO_DZSTD){
-			uint8_t r, g, b, a;
-			SHMIF_RGBA_DECOMP(cont->vidp[cvf->out_pos], &r, &g, &b, &a);
-
-			cont->vidp[cvf->out_pos++] = SHMIF_RGBA(
-				cvf->pxbuf[0] ^ r,
-				cvf->pxbuf[1] ^ g,
-				cvf->pxbuf[2] ^ b,
-				0xff
-			);
+		if (cvf->out_pos >= out_lim){
+			a12int_trace(A12_TRACE_SYSTEM, "decompression exceeds destination");
+			return 0;
 		}
-		else
-			cont->vidp[cvf->out_pos++] =
-				SHMIF_RGBA(cvf->pxbuf[0], cvf->pxbuf[1], cvf->pxbuf[2], 0xff);
+
+		unpack_rgb_span(&cont->vidp[cvf->out_pos++], cvf->pxbuf, 1, delta);
+		cvf->carry = 0;
 
 /* which can happen on a row boundary */
 		cvf->row_left--;
@@ -97,38 +172,23 @@ static int video_miniz(const void* buf, int len, void* user)
 			cvf->out_pos += cont->pitch;
 			cvf->row_left = cvf->w;
 		}
-		cvf->carry = 0;
-	}
-
-/* tpack is easier, just write into vidb, ensure that we don't exceed
- * the size from a missed resize_ call and the rest is done consumer side */
-	if (cvf->postprocess == POSTPROCESS_VIDEO_TZSTD){
-		memcpy(&cont->vidb[cvf->out_pos], inbuf, len);
-		cvf->out_pos += len;
-		cvf->expanded_sz -= len;
-		return 1;
 	}
 
-/* pixel-aligned fill/unpack, same as everywhere else */
-	size_t npx = (len / 3) * 3;
-	for (size_t i = 0; i < npx; i += 3){
-		if (cvf->postprocess == POSTPROCESS_VIDEO_DZSTD){
-			uint8_t r, g, b, a;
-			SHMIF_RGBA_DECOMP(cont->vidp[cvf->out_pos], &r, &g, &b, &a);
-
-			cont->vidp[cvf->out_pos++] = SHMIF_RGBA(
-				inbuf[i+0] ^ r,
-				inbuf[i+1] ^ g,
-				inbuf[i+2] ^ b,
-				0xff
-			);
-		}
-		else{
-			cont->vidp[cvf->out_pos++] =
-				SHMIF_RGBA(inbuf[i], inbuf[i+1], inbuf[i+2], 0xff);
+/* pixel-aligned fill/unpack in row- sized runs */
+	size_t npx = len / 3;
+	while (npx){
+		size_t run = npx < cvf->row_left ? npx : cvf->row_left;
+		if (cvf->out_pos + run > out_lim){
+			a12int_trace(A12_TRACE_SYSTEM, "decompression exceeds destination");
+			return 0;
 		}
 
-		cvf->row_left--;
+		unpack_rgb_span(&cont->vidp[cvf->out_pos], inbuf, run, delta);
+		cvf->out_pos += run;
+		inbuf += run * 3;
+		npx -= run;
+
+		cvf->row_left -= run;
 		if (cvf->row_left == 0){
 			cvf->out_pos -= cvf->w;
 			cvf->out_pos += cont->pitch;
@@ -137,14 +197,10 @@ static int video_miniz(const void* buf, int len, void* user)
 	}
 
 /* we need to account for len bytes not aligning */
-	if (len - npx){
-		cvf->carry = 0;
-		for (size_t i = 0; i < len - npx; i++){
-			cvf->pxbuf[cvf->carry++] = inbuf[npx + i];
-		}
+	for (size_t i = 0; i < len % 3; i++){
+		cvf->pxbuf[cvf->carry++] = inbuf[i];
 	}
 
-	cvf->expanded_sz -= len;
 	return 1;
 }
 
@@ -259,11 +315,18 @@ static bool ffmpeg_alloc(struct a12_channel* ch, int method)
 
 void a12int_decode_drop(struct a12_state* S, int chid, bool failed)
 {
-	if (S->channels[chid].unpack_state.vframe.zstd){
-		ZSTD_freeDCtx(S->channels[chid].unpack_state.vframe.zstd);
-		S->channels[chid].zstd = NULL;
+	struct a12_channel* ch = &S->channels[chid];
+
+	if (ch->vdec.zstd){
+		ZSTD_freeDCtx(ch->vdec.zstd);
+		ch->vdec.zstd = NULL;
 	}
 
+	DYNAMIC_FREE(ch->vdec.buf);
+	ch->vdec.buf = NULL;
+	ch->vdec.buf_sz = 0;
+	ch->vdec.broken = false;
+
 #if defined(WANT_H264_ENC) || defined(WANT_H264_DEC)
 	if (!S->channels[chid].videnc.encdec)
 		return;
@@ -291,50 +354,81 @@ bool a12int_vframe_setup(struct a12_channel* ch, struct video_frame* dst, int me
 		return false;
 #endif
 	}
+
+/* the decompression context and scratch buffer is retained for the channel
+ * and only needs its session reset between frames */
+	else if (a12int_stream_format(method)){
+		if (!ch->vdec.zstd && !(ch->vdec.zstd = ZSTD_createDCtx())){
+			a12int_trace(A12_TRACE_ALLOC, "kind=alloc_error:zstd_context_alloc");
+			return false;
+		}
+
+		if (!ch->vdec.buf){
+			ch->vdec.buf_sz = ZSTD_DStreamOutSize();
+			ch->vdec.buf = DYNAMIC_MALLOC(ch->vdec.buf_sz);
+			if (!ch->vdec.buf){
+				a12int_trace(A12_TRACE_ALLOC, "kind=alloc_error:zstd_scratch_alloc");
+				ch->vdec.buf_sz = 0;
+				return false;
+			}
+		}
+
+		ZSTD_DCtx_reset(ch->vdec.zstd, ZSTD_reset_session_only);
+	}
+
 	return true;
 }
 
+void a12int_decode_vchunk(struct a12_state* S, struct a12_channel* ch,
+	struct video_frame* cvf, const uint8_t* buf, size_t buf_sz)
+{
+	ZSTD_inBuffer in = {.src = buf, .size = buf_sz};
+
+	if (cvf->commit == 255)
+		return;
+
+/* drain the decompressor in scratch sized chunks so that the unpack/delta
+ * step works on cache-warm data and there is no full-frame intermediate */
+	for(;;){
+		ZSTD_outBuffer out = {.dst = ch->vdec.buf, .size = ch->vdec.buf_sz};
+		size_t status = ZSTD_decompressStream(ch->vdec.zstd, &out, &in);
+
+		if (ZSTD_isError(status)){
+			a12int_trace(A12_TRACE_SYSTEM,
+				"kind=decode_error:message=%s", ZSTD_getErrorName(status));
+			stream_broken(S, ch, cvf);
+			return;
+		}
+
+		if (out.pos && !video_miniz(out.dst, out.pos, S)){
+			stream_broken(S, ch, cvf);
+			return;
+		}
+
+/* frame is complete or the input is consumed and nothing more is buffered */
+		if (status == 0 || (in.pos == in.size && out.pos < out.size))
+			return;
+	}
+}
+
 void a12int_decode_vbuffer(struct a12_state* S,
 	struct a12_channel* ch, struct video_frame* cvf, struct arcan_shmif_cont* cont)
 {
 	a12int_trace(A12_TRACE_VIDEO, "decode vbuffer, method: %d", cvf->postprocess);
-	if ( cvf->postprocess == POSTPROCESS_VIDEO_DZSTD
-		|| cvf->postprocess == POSTPROCESS_VIDEO_ZSTD
-		|| cvf->postprocess == POSTPROCESS_VIDEO_TZSTD)
-	{
-		uint64_t content_sz = ZSTD_getFrameContentSize(cvf->inbuf, cvf->inbuf_pos);
-
-/* repeat and compare, don't le/gt */
-		if (content_sz == cvf->expanded_sz){
-			if (!ch->unpack_state.vframe.zstd &&
-				!(ch->unpack_state.vframe.zstd = ZSTD_createDCtx())){
-				a12int_trace(A12_TRACE_SYSTEM,
-					"kind=alloc_error:zstd_context_alloc");
-			}
-/* actually decompress */
-			else {
-				void* buffer = malloc(content_sz);
-				if (buffer){
-					uint64_t decode =
-						ZSTD_decompressDCtx(ch->unpack_state.vframe.zstd,
-							buffer, content_sz, cvf->inbuf, cvf->inbuf_pos);
-					a12int_trace(A12_TRACE_VIDEO, "kind=zstd_state:%"PRIu64, decode);
-					video_miniz(buffer, content_sz, S);
-					free(buffer);
-				}
-			}
-		}
-		else {
+
+/* the data has already been decompressed chunk by chunk as it arrived, just
+ * make sure that it all came through before forwarding */
+	if (a12int_stream_format(cvf->postprocess)){
+		if (cvf->expanded_sz || cvf->carry){
 			a12int_trace(A12_TRACE_SYSTEM,
-				"kind=decode_error:in_sz=%zu:exp_sz=%zu:message=size mismatch",
-				(size_t) content_sz, (size_t) cvf->expanded_sz
+				"kind=decode_error:left=%zu:carry=%d:message=size mismatch",
+				(size_t) cvf->expanded_sz, (int) cvf->carry
 			);
+			cvf->carry = 0;
+			stream_broken(S, ch, cvf);
+			return;
 		}
 
-		free(cvf->inbuf);
-		cvf->inbuf = NULL;
-		cvf->carry = 0;
-
 /* this is a junction where other local transfer strategies should be considered,
  * i.e. no-block and defer process on the next stepframe or spin on the vready */
 		if (cvf->commit && cvf->commit != 255){
@@ -343,7 +437,7 @@ void a12int_decode_vbuffer(struct a12_state* S,
 		return;
 	}
 #ifdef WANT_H264_DEC
-	else if (cvf->postprocess == POSTPROCESS_VIDEO_H264){
+	if (cvf->postprocess == POSTPROCESS_VIDEO_H264){
 /* just keep it around after first time of use */
 /* since these are stateful, we need to tie them to the channel dynamically */
 		a12int_trace(A12_TRACE_VIDEO,
@@ -406,61 +500,44 @@ void a12int_unpack_vbuffer(struct a12_state* S,
 /* raw frame types, the implementations and variations are so small that
  * we can just do it here - no need for the more complex stages like for
  * 264, ... */
-	if (cvf->postprocess == POSTPROCESS_VIDEO_RGBA){
-		for (size_t i = 0; i < S->decode_pos; i += 4){
-			cont->vidp[cvf->out_pos++] = SHMIF_RGBA(
-				S->decode[i+0], S->decode[i+1], S->decode[i+2], S->decode[i+3]);
-			cvf->row_left--;
-			if (cvf->row_left == 0){
-				cvf->out_pos -= cvf->w;
-				cvf->out_pos += cont->pitch;
-				cvf->row_left = cvf->w;
-			}
-		}
-	}
-	else if (cvf->postprocess == POSTPROCESS_VIDEO_RGB){
-		for (size_t i = 0; i < S->decode_pos; i += 3){
-			cont->vidp[cvf->out_pos++] = SHMIF_RGBA(
-				S->decode[i+0], S->decode[i+1], S->decode[i+2], 0xff);
-			cvf->row_left--;
-			if (cvf->row_left == 0){
-				cvf->out_pos -= cvf->w;
-				cvf->out_pos += cont->pitch;
-				cvf->row_left = cvf->w;
-			}
-		}
+	int fmt;
+	size_t px_sz;
+
+	switch (cvf->postprocess){
+	case POSTPROCESS_VIDEO_RGBA:
+		fmt = SHMIF_PIXFMT_ABGR8888;
+		px_sz = 4;
+	break;
+	case POSTPROCESS_VIDEO_RGB:
+		fmt = SHMIF_PIXFMT_RGB888;
+		px_sz = 3;
+	break;
+	case POSTPROCESS_VIDEO_RGB565:
+		fmt = SHMIF_PIXFMT_RGB565;
+		px_sz = 2;
+	break;
+	default:
+		fmt = -1;
+		px_sz = 1;
+	break;
 	}
-	else if (cvf->postprocess == POSTPROCESS_VIDEO_RGB565){
-		static const uint8_t rgb565_lut5[] = {
-			0,     8,  16,  25,  33,  41,  49,  58,  66,   74,  82,  90,  99, 107,
-			115, 123, 132, 140, 148, 156, 165, 173, 181, 189,  197, 206, 214, 222,
-			230, 239, 247, 255
-		};
-
-		static const uint8_t rgb565_lut6[] = {
-			0,     4,   8,  12,  16,  20,  24,  28,  32,  36,  40,  45,  49,  53,  57,
-			61,   65,  69,  73,  77,  81,  85,  89,  93,  97, 101, 105, 109, 113, 117,
-			121, 125, 130, 134, 138, 142, 146, 150, 154, 158, 162, 166, 170, 174,
-			178, 182, 186, 190, 194, 198, 202, 206, 210, 215, 219, 223, 227, 231,
-			235, 239, 243, 247, 251, 255
-		};
-
-		for (size_t i = 0; i < S->decode_pos; i += 2){
-			uint16_t px;
-			unpack_u16(&px, &S->decode[i]);
-			cont->vidp[cvf->out_pos++] =
-				SHMIF_RGBA(
-					rgb565_lut5[ (px & 0xf800) >> 11],
-					rgb565_lut6[ (px & 0x07e0) >>  5],
-					rgb565_lut5[ (px & 0x001f)      ],
-					0xff
-				);
-			cvf->row_left--;
-			if (cvf->row_left == 0){
-				cvf->out_pos -= cvf->w;
-				cvf->out_pos += cont->pitch;
-				cvf->row_left = cvf->w;
-			}
+
+/* the decode buffer isn't row aligned, so convert in row sized runs */
+	const uint8_t* inbuf = S->decode;
+	size_t npx = fmt == -1 ? 0 : S->decode_pos / px_sz;
+	while (npx){
+		size_t run = npx < cvf->row_left ? npx : cvf->row_left;
+		arcan_shmif_pixconv_import(fmt, (const uint8_t* const[3]){inbuf},
+			NULL, run, 1, &cont->vidp[cvf->out_pos], 0, 0);
+		cvf->out_pos += run;
+		inbuf += run * px_sz;
+		npx -= run;
+
+		cvf->row_left -= run;
+		if (cvf->row_left == 0){
+			cvf->out_pos -= cvf->w;
+			cvf->out_pos += cont->pitch;
+			cvf->row_left = cvf->w;
 		}
 	}
 
@@ -7,6 +7,12 @@
  */
 bool a12int_buffer_format(int method);
 
+/*
+ * Return true if the buffer format is decompressed incrementally as the
+ * packets arrive (see a12int_decode_vchunk) rather than being accumulated
+ */
+bool a12int_stream_format(int method);
+
 bool a12int_vframe_setup(struct a12_channel* ch, struct video_frame* dst, int method);
 
 /* Release any encoder contexts and intermediate buffers tied to the state/channel */
@@ -16,6 +22,13 @@ void a12int_decode_vbuffer(
 	struct a12_state* S,
 	struct a12_channel* ch, struct video_frame*, struct arcan_shmif_cont*);
 
+/*
+ * Feed [buf_sz] bytes of compressed input through the channel decompressor
+ * and unpack the results directly into the destination buffer
+ */
+void a12int_decode_vchunk(struct a12_state* S, struct a12_channel* ch,
+	struct video_frame* cvf, const uint8_t* buf, size_t buf_sz);
+
 void a12int_unpack_vbuffer(
 	struct a12_state* S, struct video_frame* cvf, struct arcan_shmif_cont* cont);
 #endif
@@ -6,6 +6,7 @@
  */
 #include <arcan_shmif.h>
 #include <arcan_shmif_server.h>
+#include <arcan_shmif_pixconv.h>
 
 #include <inttypes.h>
 #include <string.h>
@@ -123,6 +124,29 @@ void a12int_encode_araw(struct a12_state* S,
 	free(outb);
 }
 
+/*
+ * Convert [n] pixels starting at [*pos] in [vb] into [fmt] at [dst], the
+ * blocks don't align with rows so step [*pos] to the next one whenever
+ * [*row_len] runs out.
+ */
+static void pack_span(int fmt, size_t px_sz, struct shmifsrv_vbuffer* vb,
+	size_t* pos, size_t* row_len, size_t w, uint8_t* dst, size_t n)
+{
+	while (n){
+		size_t run = n < *row_len ? n : *row_len;
+		arcan_shmif_pixconv_export(fmt, &vb->buffer[*pos], 0, run, 1, dst, 0, 0);
+		dst += run * px_sz;
+		*pos += run;
+		n -= run;
+
+		*row_len -= run;
+		if (*row_len == 0){
+			*pos += vb->pitch - w;
+			*row_len = w;
+		}
+	}
+}
+
 /*
  * the rgb565, rgb and rgba function all follow the same pattern
  */
@@ -136,8 +160,7 @@ void a12int_encode_rgb565(PACK_ARGS)
 	size_t bpb = ppb * px_sz;
 	size_t blocks = w * h / ppb;
 
-	shmif_pixel* inbuf = vb->buffer;
-	size_t pos = y * vb->pitch + x;
+size_t pos = y * vb->pitch + x;
 
 /* get the packing buffer, cancel if oom */
 	uint8_t* outb = malloc(hdr_sz + bpb);
@@ -163,22 +186,8 @@ void a12int_encode_rgb565(PACK_ARGS)
 /* sweep the incoming frame, and pack maximum block size */
 	size_t row_len = w;
 	for (size_t i = 0; i < blocks; i++){
-		for (size_t j = 0; j < bpb; j += px_sz){
-			uint8_t r, g, b, ign;
-			uint16_t px;
-			SHMIF_RGBA_DECOMP(inbuf[pos++], &r, &g, &b, &ign);
-			px =
-				(((b >> 3) & 0x1f) << 0) |
-				(((g >> 2) & 0x3f) << 5) |
-				(((r >> 3) & 0x1f) << 11)
-			;
-			pack_u16(px, &outb[hdr_sz+j]);
-			row_len--;
-			if (row_len == 0){
-				pos += vb->pitch - w;
-				row_len = w;
-			}
-		}
+		pack_span(SHMIF_PIXFMT_RGB565,
+			px_sz, vb, &pos, &row_len, w, &outb[hdr_sz], ppb);
 		a12int_append_out(S, STATE_VIDEO_PACKET, outb, hdr_sz + bpb, NULL, 0);
 	}
 
@@ -187,22 +196,8 @@ void a12int_encode_rgb565(PACK_ARGS)
 	if (left){
 		pack_u16(left, &outb[5]);
 		a12int_trace(A12_TRACE_VDETAIL, "small block of %zu bytes", left);
-		for (size_t i = 0; i < left; i+= px_sz){
-			uint8_t r, g, b, ign;
-			uint16_t px;
-			SHMIF_RGBA_DECOMP(inbuf[pos++], &r, &g, &b, &ign);
-			px =
-				(((b >> 3) & 0x1f) << 0) |
-				(((g >> 2) & 0x3f) << 5) |
-				(((r >> 3) & 0x1f) << 11)
-			;
-			pack_u16(px, &outb[hdr_sz+i]);
-			row_len--;
-			if (row_len == 0){
-				pos += vb->pitch - w;
-				row_len = w;
-			}
-		}
+		pack_span(SHMIF_PIXFMT_RGB565,
+			px_sz, vb, &pos, &row_len, w, &outb[hdr_sz], left / px_sz);
 		a12int_append_out(S, STATE_VIDEO_PACKET, outb, left+hdr_sz, NULL, 0);
 	}
 
@@ -220,8 +215,7 @@ void a12int_encode_rgba(PACK_ARGS)
 	size_t bpb = ppb * px_sz;
 	size_t blocks = w * h / ppb;
 
-	shmif_pixel* inbuf = vb->buffer;
-	size_t pos = y * vb->pitch + x;
+size_t pos = y * vb->pitch + x;
 
 /* get the packing buffer, cancel if oom */
 	uint8_t* outb = malloc(hdr_sz + bpb);
@@ -245,15 +239,8 @@ void a12int_encode_rgba(PACK_ARGS)
 /* sweep the incoming frame, and pack maximum block size */
 	size_t row_len = w;
 	for (size_t i = 0; i < blocks; i++){
-		for (size_t j = 0; j < bpb; j += px_sz){
-			uint8_t* dst = &outb[hdr_sz+j];
-			SHMIF_RGBA_DECOMP(inbuf[pos++], &dst[0], &dst[1], &dst[2], &dst[3]);
-			row_len--;
-			if (row_len == 0){
-				pos += vb->pitch - w;
-				row_len = w;
-			}
-		}
+		pack_span(SHMIF_PIXFMT_ABGR8888,
+			px_sz, vb, &pos, &row_len, w, &outb[hdr_sz], ppb);
 
 /* dispatch to out-queue(s) */
 		a12int_append_out(S, STATE_VIDEO_PACKET, outb, hdr_sz + bpb, NULL, 0);
@@ -265,15 +252,8 @@ void a12int_encode_rgba(PACK_ARGS)
 		pack_u16(left, &outb[5]);
 		a12int_trace(A12_TRACE_VDETAIL,
 			"kind=status:message=padblock:size=%zu", left);
-		for (size_t i = 0; i < left; i+= px_sz){
-			uint8_t* dst = &outb[hdr_sz+i];
-			SHMIF_RGBA_DECOMP(inbuf[pos++], &dst[0], &dst[1], &dst[2], &dst[3]);
-			row_len--;
-			if (row_len == 0){
-				pos += vb->pitch - w;
-				row_len = w;
-			}
-		}
+		pack_span(SHMIF_PIXFMT_ABGR8888,
+			px_sz, vb, &pos, &row_len, w, &outb[hdr_sz], left / px_sz);
 		a12int_append_out(S, STATE_VIDEO_PACKET, outb, hdr_sz + left, NULL, 0);
 	}
 
@@ -291,8 +271,7 @@ void a12int_encode_rgb(PACK_ARGS)
 	size_t bpb = ppb * px_sz;
 	size_t blocks = w * h / ppb;
 
-	shmif_pixel* inbuf = vb->buffer;
-	size_t pos = y * vb->pitch + x;
+size_t pos = y * vb->pitch + x;
 
 /* get the packing buffer, cancel if oom */
 	uint8_t* outb = malloc(hdr_sz + bpb);
@@ -316,16 +295,8 @@ void a12int_encode_rgb(PACK_ARGS)
 /* sweep the incoming frame, and pack maximum block size */
 	size_t row_len = w;
 	for (size_t i = 0; i < blocks; i++){
-		for (size_t j = 0; j < bpb; j += px_sz){
-			uint8_t ign;
-			uint8_t* dst = &outb[hdr_sz+j];
-			SHMIF_RGBA_DECOMP(inbuf[pos++], &dst[0], &dst[1], &dst[2], &ign);
-			row_len--;
-			if (row_len == 0){
-				pos += vb->pitch - w;
-				row_len = w;
-			}
-		}
+		pack_span(SHMIF_PIXFMT_RGB888,
+			px_sz, vb, &pos, &row_len, w, &outb[hdr_sz], ppb);
 
 /* dispatch to out-queue(s) */
 		a12int_append_out(S, STATE_VIDEO_PACKET, outb, hdr_sz + bpb, NULL, 0);
@@ -335,21 +306,9 @@ void a12int_encode_rgb(PACK_ARGS)
  */
 	size_t bytes_left = ((w * h) - (blocks * ppb)) * px_sz;
 	if (bytes_left){
-		size_t ofs = 0;
 		pack_u16(bytes_left, &outb[5]);
-
-		while (bytes_left - ofs){
-			uint8_t ign;
-			uint8_t* dst = &outb[hdr_sz+ofs];
-			SHMIF_RGBA_DECOMP(inbuf[pos++], &dst[0], &dst[1], &dst[2], &ign);
-			ofs += px_sz;
-
-			row_len--;
-			if (row_len == 0){
-				pos += vb->pitch - w;
-				row_len = w;
-			}
-		}
+		pack_span(SHMIF_PIXFMT_RGB888,
+			px_sz, vb, &pos, &row_len, w, &outb[hdr_sz], bytes_left / px_sz);
 
 		a12int_append_out(S, STATE_VIDEO_PACKET, outb, hdr_sz + bytes_left, NULL, 0);
 	}
@@ -472,7 +431,8 @@ void a12int_encode_ztz(PACK_ARGS)
 }
 
 static struct compress_res compress_deltaz(struct a12_state* S, uint8_t ch,
-	struct shmifsrv_vbuffer* vb, size_t* x, size_t* y, size_t* w, size_t* h, bool zstd)
+	struct shmifsrv_vbuffer* vb, size_t* x, size_t* y, size_t* w, size_t* h,
+	bool zstd, int level)
 {
 	int type;
 	uint8_t* compress_in;
@@ -574,7 +534,7 @@ static struct compress_res compress_deltaz(struct a12_state* S, uint8_t ch,
 		return (struct compress_res){};
 
 	out_sz = ZSTD_compressCCtx(
-		S->channels[ch].zstd, buf, out_sz, compress_in, compress_in_sz, 1);
+		S->channels[ch].zstd, buf, out_sz, compress_in, compress_in_sz, level);
 
 	if (ZSTD_isError(out_sz)){
 		a12int_trace(A12_TRACE_ALLOC,
@@ -599,7 +559,10 @@ static struct compress_res compress_deltaz(struct a12_state* S, uint8_t ch,
 
 void a12int_encode_dzstd(PACK_ARGS)
 {
-	struct compress_res cres = compress_deltaz(S, chid, vb, &x, &y, &w, &h, true);
+/* the quality bias is picked by a12_vframe_adapt when bandwidth is short */
+	int level = opts.bias == VFRAME_BIAS_QUALITY ? ZSTD_VIDEO_LEVEL_HIGH : 1;
+	struct compress_res cres =
+		compress_deltaz(S, chid, vb, &x, &y, &w, &h, true, level);
 	if (!cres.ok)
 		return;
 
@@ -624,7 +587,8 @@ void a12int_encode_dzstd(PACK_ARGS)
 
 void a12int_encode_dpng(PACK_ARGS)
 {
-	struct compress_res cres = compress_deltaz(S, chid, vb, &x, &y, &w, &h, false);
+	struct compress_res cres =
+		compress_deltaz(S, chid, vb, &x, &y, &w, &h, false, 1);
 	if (!cres.ok)
 		return;
 
@@ -3,6 +3,7 @@
 
 #include "blake3.h"
 #include "pack.h"
+#include <stdatomic.h>
 
 #if defined(WANT_H264_DEC) || defined(WANT_H264_ENC)
 #include <libavcodec/avcodec.h>
@@ -26,6 +27,40 @@
 #define VIDEO_FRAME_DRIFT_WINDOW 8
 #endif
 
+/* compression level used for dzstd when the bias is towards quality, i.e.
+ * spend more time to save bandwidth */
+#ifndef ZSTD_VIDEO_LEVEL_HIGH
+#define ZSTD_VIDEO_LEVEL_HIGH 6
+#endif
+
+/* number of ack-rate samples the bandwidth estimate is the max of */
+#ifndef A12_BWE_SAMPLES
+#define A12_BWE_SAMPLES 16
+#endif
+
+/* the lowest observed roundtrip is forgotten after this many ms so that a
+ * changed route can be detected */
+#ifndef A12_BWE_RTT_EXPIRE
+#define A12_BWE_RTT_EXPIRE 10000
+#endif
+
+/* a channel that got input within this many ms is treated as focused */
+#ifndef A12_INPUT_ACTIVE_MS
+#define A12_INPUT_ACTIVE_MS 500
+#endif
+
+/* queueing delay (above the lowest roundtrip) where channels without focus
+ * stop getting new frames, the focused channel gets twice this */
+#ifndef A12_QUEUE_DELAY_MS
+#define A12_QUEUE_DELAY_MS 40
+#endif
+
+/* the time a frame should take to transfer at the estimated rate, used to
+ * pick how hard to compress */
+#ifndef A12_FRAME_BUDGET_MS
+#define A12_FRAME_BUDGET_MS 33
+#endif
+
 #define MAC_BLOCK_SZ 16
 #define NONCE_SIZE 8
 #define CONTROL_PACKET_SIZE 128
@@ -75,6 +110,21 @@ enum control_commands {
 	COMMAND_REKEY        = 8, /* new x25519 change               */
 	COMMAND_DIRLIST      = 9, /* request list of items           */
 	COMMAND_DIRSTATE     = 10,/* update / present a new appl     */
+	COMMAND_BSTREAMMAP   = 11,/* chunk manifest for a bstream    */
+	COMMAND_BSTREAMREQ   = 12,/* chunks wanted from a bstream    */
+};
+
+/* capability bits in the hello [55], older implementations leave it empty */
+enum hello_caps {
+	HELLO_CAP_CHUNKSYNC = 1
+};
+
+enum bstream_sync {
+	BSTREAM_SYNC_NONE  = 0, /* plain transfer of the full contents         */
+	BSTREAM_SYNC_OFFER = 1, /* source: manifest ready, sent with the header */
+	BSTREAM_SYNC_WAIT  = 2, /* source: waiting for sink chunk request       */
+	BSTREAM_SYNC_MAP   = 3, /* sink: collecting the manifest                */
+	BSTREAM_SYNC_DELTA = 4  /* transferring / reassembling missing chunks   */
 };
 
 enum hello_mode {
@@ -112,6 +162,7 @@ size_t a12int_header_size(int type);
 struct ZSTD_CCtx_s;
 struct ZSTD_DCtx_s;
 struct appl_meta;
+struct a12_chunk;
 
 struct audio_frame {
 	uint32_t id;
@@ -139,6 +190,22 @@ struct binary_frame {
 	uint8_t checksum[16];
 	int64_t streamid; /* actual type is uint32 but -1 for cancel */
 	struct ZSTD_DCtx_s* zstd;
+
+/* delta synchronisation against an older copy (basis) provided by the bhandler,
+ * remote is the manifest from the source, with .ofs rewritten to the matching
+ * chunk in the basis or UINT64_MAX if it has to be transferred */
+	struct {
+		uint8_t state;
+		uint8_t* basis;
+		size_t basis_sz;
+		struct a12_chunk* local;
+		size_t n_local;
+		struct a12_chunk* remote;
+		size_t n_remote;
+		uint64_t remote_sz;
+		size_t pos;
+		size_t left;
+	} sync;
 };
 
 struct video_frame {
@@ -174,8 +241,6 @@ struct video_frame {
 	} ffmpeg;
 #endif
 
-	struct ZSTD_DCtx_s* zstd;
-
 	/* bytes left on current row for raw-dec */
 };
 
@@ -187,6 +252,10 @@ struct blob_out {
 	int type;
 	uint32_t identifier;
 	size_t left;
+
+/* read position for file backed sources, the descriptor can be shared with
+ * other readers (e.g. forked directory workers) so the file offset is unused */
+	off_t ofs;
 	char* buf;
 	size_t buf_sz;
 	bool streaming;
@@ -194,6 +263,17 @@ struct blob_out {
 	uint64_t streamid;
 	uint64_t rampup_seqnr;
 
+/* chunk manifest of the source and the bitmap of chunks the sink asked for,
+ * pos/left track the chunk currently being sent */
+	struct {
+		uint8_t state;
+		struct a12_chunk* chunks;
+		size_t n_chunks;
+		uint8_t* want;
+		size_t pos;
+		size_t left;
+	} sync;
+
 	struct ZSTD_CCtx_s* zstd;
 	struct blob_out* next;
 };
@@ -213,6 +293,34 @@ struct a12_channel {
 /* used for both encoding and decoding, state is aliased into unpack_state */
 	struct shmifsrv_vbuffer acc;
 
+/* priority and bandwidth share for a12_vframe_admit / a12_vframe_adapt */
+	struct {
+		bool unfocused;
+		bool hidden;
+		uint64_t last_input;
+		int64_t credit;
+		uint64_t credit_ts;
+		size_t frame_bytes; /* moving average of the encoded frame size */
+		size_t delta_bytes; /* same but only for the zstd family */
+		bool h264;
+	} sched;
+
+/* set by the sink reporting a lost delta reference, consumed by the encoder
+ * of the channel which might be running outside of the state lock */
+	_Atomic bool reset_delta;
+
+/* streaming decompression context and the chunk scratch buffer it drains
+ * into, these outlive the individual frames and are reused between them */
+	struct {
+		struct ZSTD_DCtx_s* zstd;
+		uint8_t* buf;
+		size_t buf_sz;
+
+/* set when a frame was only partly applied, deltas are dropped until a
+ * full frame has been received */
+		bool broken;
+	} vdec;
+
 	struct {
 		uint8_t* compression;
 		struct ZSTD_CCtx_s* zstd;
@@ -244,6 +352,7 @@ struct a12_state {
 	uint64_t last_seen_seqnr;
 	uint64_t out_stream;
 	bool advenc_broken;
+	uint8_t remote_caps;
 
 /* The biggest concern of congestion is video frames as that tends to be most
  * primary data. The decision to act upon this is still up to the tool feeding
@@ -253,6 +362,25 @@ struct a12_state {
 	struct {
 		uint32_t frame_window[VIDEO_FRAME_DRIFT_WINDOW]; /* seqnrs tied to vframes */
 		size_t pending; /* updated whenever we send something out */
+
+/* when each frame in the window was queued and the b_out at that time, the
+ * acks then give both a roundtrip and a delivery rate sample */
+		uint64_t frame_ts[VIDEO_FRAME_DRIFT_WINDOW];
+		size_t frame_bytes[VIDEO_FRAME_DRIFT_WINDOW];
+
+		size_t bw_samples[A12_BWE_SAMPLES];
+		size_t bw_sample_ind;
+
+/* how far into the output stream acks have reached, when that ack arrived and
+ * when the acked data was queued. Each frame keeps a copy from when it was
+ * queued so that its rate sample spans at least one roundtrip */
+		struct a12_bwe_delivered {
+			size_t bytes;
+			uint64_t ts;
+			uint64_t send_ts;
+		} delivered, frame_delivered[VIDEO_FRAME_DRIFT_WINDOW];
+		size_t min_rtt;
+		uint64_t min_rtt_ts;
 	} congestion_stats;
 	struct a12_iostat stats;
 
@@ -353,6 +481,9 @@ struct appl_meta {
 	uint16_t permissions;
 	uint8_t hash[4];
 
+/* server side only, the full tree hash that names the archive in the store */
+	uint8_t tree_hash[16];
+
 	char applname[18];
 	char short_descr[69];
 	bool remote;
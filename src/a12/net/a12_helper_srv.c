@@ -31,27 +31,92 @@ struct shmifsrv_thread_data {
 	float font_sz;
 	int kill_fd;
 	uint8_t chid;
+
+/* guards calls into C, the worker only needs it for releasing the frame */
+	pthread_mutex_t lock;
+
+/* written to by the main loop (events, congestion lifted) and workers (frame
+ * done) so that the channel thread does not have to spin to find work */
+	int wake[2];
+
+/* the frame currently handed to the worker pool, the channel thread does not
+ * touch C while busy is set */
+	_Atomic bool busy;
+	_Atomic bool deferred;
+	_Atomic bool closing;
+	struct shmifsrv_vbuffer vb;
+	struct a12_vframe_opts vopts;
+	struct a12_vstage stage;
+	struct shmifsrv_thread_data* next_job;
 };
 
 /* [THREADING]
- * We use a giant lock (a12 not liking multiple- call into via threading, mostly
- * due to the buffer function and the channel- state tracker, not impossible just
- * easier to solve like this).
+ * There are three kinds of threads:
+ *
+ * 1. the main loop that reads/unpacks from the socket and flushes output.
+ * 2. one thread per channel that monitors the shmifsrv client for events,
+ *    frames and liveness.
+ * 3. a small pool of workers that encode video frames.
+ *
+ * The a12 state is not safe to call into from multiple threads, so anything
+ * touching it goes through state_lock. The exception is the staged encode
+ * (a12_channel_vstage) that only touches per-channel state and is what lets
+ * the workers encode different channels in parallel, the output is then
+ * appended to the shared output buffer in one short critical section.
  *
- * The buffer-out is simply a way for the main feed thread to forward the current
- * pending buffer output
+ * Each channel has its own lock for calls into its shmifsrv client. Lock
+ * order is state_lock before channel lock, never the other way around.
  *
+ * The kill_fd is written to whenever new output is pending so the main loop
+ * wakes up and can flush.
 */
 static bool spawn_thread(struct shmifsrv_thread_data* inarg);
-static pthread_mutex_t giant_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t state_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static const char* last_lock;
 static _Atomic volatile size_t buffer_out = 0;
 static _Atomic volatile uint8_t n_segments;
 
+/* only touched with state_lock held */
+static struct shmifsrv_thread_data* channels[256];
+
 #define BEGIN_CRITICAL(X, Y) do{pthread_mutex_lock(X); last_lock = Y;} while(0);
 #define END_CRITICAL(X) do{pthread_mutex_unlock(X);} while(0);
 
+#ifndef A12_SRV_WORKERS
+#define A12_SRV_WORKERS 4
+#endif
+
+/* Without a monitorable trigger for inbound video frames, the channel thread
+ * polls with a timeout that backs off while the client is idle. Events and
+ * completed frames wake it up immediately. */
+#ifndef A12_SRV_POLL_MIN
+#define A12_SRV_POLL_MIN 1
+#endif
+
+#ifndef A12_SRV_POLL_MAX
+#define A12_SRV_POLL_MAX 16
+#endif
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct shmifsrv_thread_data* first;
+	struct shmifsrv_thread_data* last;
+	pthread_t workers[A12_SRV_WORKERS];
+	size_t n_workers;
+	bool shutdown;
+} pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER
+};
+
+static void wake_channel(struct shmifsrv_thread_data* data)
+{
+	uint8_t ch = 1;
+	write(data->wake[1], &ch, 1);
+}
+
 /*
  * Figure out encoding parameters based on client type and buffer parameters.
  * This is the first heurstic catch-all to later feed in backpressure,
@@ -85,12 +150,14 @@ extern uint8_t* arcan_base64_encode(
 
 /*
  * the bhandler -related calls are already running inside critical as
- * they come from the data parsing itself.
+ * they come from the data parsing itself, the channel lock is taken for
+ * the client access.
  */
 static void dispatch_bdata(
 	struct a12_state* S, int fd, int type, struct shmifsrv_thread_data* D)
 {
 	struct shmifsrv_client* srv_cl = D->C;
+	pthread_mutex_lock(&D->lock);
 	switch(type){
 	case A12_BTYPE_STATE:
 		shmifsrv_enqueue_event(srv_cl, &(struct arcan_event){
@@ -132,6 +199,7 @@ static void dispatch_bdata(
 			"kind=error:status=EBADTYPE:message=%d", type);
 	break;
 	}
+	pthread_mutex_unlock(&D->lock);
 
 	close(fd);
 }
@@ -288,10 +356,70 @@ static void redirect_exit(
 	a12int_trace(A12_TRACE_EVENT, "kind=redirect:destination=%s", path);
 }
 
+/*
+ * The channel thread owns the encoder state of its channel and a worker might
+ * be encoding on it, so closing from the main loop is deferred to the thread.
+ * [THREADING] called with state_lock held
+ */
+static void request_close(struct a12_state* S, uint8_t chid)
+{
+	struct shmifsrv_thread_data* data = channels[chid];
+	if (!data){
+		a12_set_channel(S, chid);
+		a12_channel_close(S);
+		return;
+	}
+
+	atomic_store(&data->closing, true);
+	wake_channel(data);
+}
+
+static struct shmifsrv_thread_data* alloc_channel(
+	struct shmifsrv_thread_data* src, struct shmifsrv_client* C, uint8_t chid)
+{
+	struct shmifsrv_thread_data* res =
+		malloc(sizeof(struct shmifsrv_thread_data));
+	if (!res)
+		return NULL;
+
+	*res = (struct shmifsrv_thread_data){
+		.C = C,
+		.S = src->S,
+		.opts = src->opts,
+		.font_sz = src->font_sz,
+		.kill_fd = src->kill_fd,
+		.chid = chid
+	};
+
+	if (-1 == pipe(res->wake)){
+		free(res);
+		return NULL;
+	}
+
+	fcntl(res->wake[0], F_SETFL, O_NONBLOCK);
+	fcntl(res->wake[1], F_SETFL, O_NONBLOCK);
+	pthread_mutex_init(&res->lock, NULL);
+	res->fake.user = res;
+	return res;
+}
+
+static void free_channel(struct shmifsrv_thread_data* data)
+{
+	a12_vstage_free(&data->stage);
+	pthread_mutex_destroy(&data->lock);
+	close(data->wake[0]);
+	close(data->wake[1]);
+	free(data);
+}
+
 /*
  * [THREADING]
- * Called from within a _lock / _unlock block
+ * Called from within a _lock / _unlock block on state_lock, the channel lock
+ * is held for the duration of route_srv_event.
  */
+static void route_srv_event(struct shmifsrv_thread_data* data,
+	struct arcan_shmif_cont* cont, int chid, struct arcan_event* ev);
+
 static void on_srv_event(
 	struct arcan_shmif_cont* cont, int chid, struct arcan_event* ev, void* tag)
 {
@@ -300,6 +428,21 @@ static void on_srv_event(
 		a12int_trace(A12_TRACE_SYSTEM, "kind=error:type=EINVALCH:val=%d", chid);
 		return;
 	}
+
+	pthread_mutex_lock(&data->lock);
+		route_srv_event(data, cont, chid, ev);
+	pthread_mutex_unlock(&data->lock);
+
+/* the client will likely respond (new frame on DISPLAYHINT and so on), wake
+ * the thread of the channel so that it drops back to the shortest poll step
+ * rather than finding out at the end of its current backoff */
+	struct shmifsrv_thread_data* dst = cont->user ? cont->user : data;
+	wake_channel(dst);
+}
+
+static void route_srv_event(struct shmifsrv_thread_data* data,
+	struct arcan_shmif_cont* cont, int chid, struct arcan_event* ev)
+{
 	struct shmifsrv_client* srv_cl = data->C;
 
 /*
@@ -387,18 +530,15 @@ static void on_srv_event(
 
 /* First we need a copy of the current processing thread structure */
 	struct shmifsrv_thread_data* new_data =
-		malloc(sizeof(struct shmifsrv_thread_data));
+		alloc_channel(data, NULL, ev->tgt.ioevs[0].iv);
 	if (!new_data){
 		a12int_trace(A12_TRACE_SYSTEM,
 			"kind=error:type=ENOMEM:src_ch=%d:dst_ch=%d", chid, ev->tgt.ioevs[0].iv);
-		a12_set_channel(data->S, chid);
-		a12_channel_close(data->S);
+		request_close(data->S, chid);
 		return;
 	}
-	*new_data = *data;
 
 /* Then we forward the subsegment to the local client */
-	new_data->chid = ev->tgt.ioevs[0].iv;
 	new_data->C = shmifsrv_send_subsegment(
 		srv_cl, ev->tgt.ioevs[2].iv, 0, 32, 32, chid, ev->tgt.ioevs[3].uiv);
 
@@ -406,29 +546,29 @@ static void on_srv_event(
 	if (!new_data->C){
 		a12int_trace(A12_TRACE_SYSTEM,
 			"kind=error:type=ENOSRVMEM:src_ch=%d:dst_ch=%d", chid, ev->tgt.ioevs[0].iv);
-		free(new_data);
-		a12_set_channel(data->S, chid);
-		a12_channel_close(data->S);
+		free_channel(new_data);
+		request_close(data->S, chid);
+		return;
 	}
 
 /* Attach to a new processing thread, and tie this channel to the 'fake'
  * segment that we only use to extract back the events and so on to for now,
  * when we deal with 'output' segments as well, this is where we'd need to do
  * the encoding dance */
-	new_data->fake.user = new_data;
 	a12_set_destination(data->S, &new_data->fake, new_data->chid);
 
+	uint8_t new_chid = new_data->chid;
 	if (!spawn_thread(new_data)){
 		a12int_trace(A12_TRACE_SYSTEM,
 			"kind=error:type=ENOTHRDMEM:src_ch=%d:dst_ch=%d", chid, ev->tgt.ioevs[0].iv);
-		free(new_data);
-		a12_set_channel(data->S, chid);
+		a12_set_channel(data->S, new_chid);
 		a12_channel_close(data->S);
+		request_close(data->S, chid);
 		return;
 	}
 
 	a12int_trace(A12_TRACE_ALLOC,
-		"kind=new_channel:src_ch=%d:dst_ch=%d", chid, (int)new_data->chid);
+		"kind=new_channel:src_ch=%d:dst_ch=%d", chid, (int)new_chid);
 }
 
 static void on_audio_cb(shmif_asample* buf,
@@ -447,24 +587,183 @@ static void on_audio_cb(shmif_asample* buf,
 	);
 }
 
+/*
+ * Worker side of the video path, the frame has already passed the congestion
+ * checks in the channel thread. The client is released as soon as the frame
+ * has been staged, only the final append needs the state lock.
+ */
+static void encode_job(struct shmifsrv_thread_data* data)
+{
+	a12_channel_vstage(data->S, data->chid, &data->stage, &data->vb, data->vopts);
+
+	pthread_mutex_lock(&data->lock);
+		shmifsrv_video_step(data->C);
+	pthread_mutex_unlock(&data->lock);
+
+	BEGIN_CRITICAL(&state_lock, "video-commit");
+		a12_channel_vstage_commit(data->S, &data->stage);
+		struct a12_iostat stat = a12_state_iostat(data->S);
+		a12int_trace(A12_TRACE_VDETAIL,
+			"vbuffer=release:ch=%d:time_ms=%zu:time_ms_px=%.4f:congestion=%zu",
+			(int)data->chid, stat.ms_vframe, stat.ms_vframe_px,
+			stat.vframe_backpressure
+		);
+		write(data->kill_fd, &data->chid, 1);
+	END_CRITICAL(&state_lock);
+
+/* the channel thread waits for this to look for the next frame */
+	atomic_store(&data->busy, false);
+	wake_channel(data);
+}
+
+static void* worker_thread(void* tag)
+{
+	for(;;){
+		pthread_mutex_lock(&pool.lock);
+		while (!pool.first && !pool.shutdown)
+			pthread_cond_wait(&pool.cond, &pool.lock);
+
+		struct shmifsrv_thread_data* job = pool.first;
+		if (!job){
+			pthread_mutex_unlock(&pool.lock);
+			break;
+		}
+
+		pool.first = job->next_job;
+		if (!pool.first)
+			pool.last = NULL;
+		job->next_job = NULL;
+		pthread_mutex_unlock(&pool.lock);
+
+		encode_job(job);
+	}
+
+	return NULL;
+}
+
+static void queue_job(struct shmifsrv_thread_data* data)
+{
+	atomic_store(&data->busy, true);
+
+/* no workers (failed to spawn), just encode in the channel thread */
+	if (!pool.n_workers){
+		encode_job(data);
+		return;
+	}
+
+	pthread_mutex_lock(&pool.lock);
+		if (pool.last)
+			pool.last->next_job = data;
+		else
+			pool.first = data;
+		pool.last = data;
+		pthread_cond_signal(&pool.cond);
+	pthread_mutex_unlock(&pool.lock);
+}
+
+static void start_pool()
+{
+	long n_cpu = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t lim = n_cpu > 0 && n_cpu < A12_SRV_WORKERS ? n_cpu : A12_SRV_WORKERS;
+
+	pool.shutdown = false;
+	for (pool.n_workers = 0; pool.n_workers < lim; pool.n_workers++){
+		if (0 != pthread_create(
+			&pool.workers[pool.n_workers], NULL, worker_thread, NULL)){
+			a12int_trace(A12_TRACE_ALLOC, "kind=error:message=could not spawn worker");
+			break;
+		}
+	}
+}
+
+static void stop_pool()
+{
+	pthread_mutex_lock(&pool.lock);
+		pool.shutdown = true;
+		pthread_cond_broadcast(&pool.cond);
+	pthread_mutex_unlock(&pool.lock);
+
+	for (size_t i = 0; i < pool.n_workers; i++)
+		pthread_join(pool.workers[i], NULL);
+	pool.n_workers = 0;
+}
+
+/*
+ * Check if the pending frame can be handed to the encoder or if it should be
+ * deferred due to congestion. [THREADING] called with state_lock held.
+ */
+static bool accept_frame(struct shmifsrv_thread_data* data)
+{
+/* the shared buffer_out marks if we should wait a bit before releasing the
+ * client as to not keep oversaturating with incoming video frames, we could
+ * threshold this to something more reasonable, or just have two congestion
+ * levels, one for focused channel and one lower for the rest */
+	if (atomic_load(&buffer_out) > 0){
+		return false;
+	}
+
+/* check the congestion window - the user provided limits are hard caps, the
+ * a12 estimate based scheduling comes after that */
+	struct a12_iostat stat = a12_state_iostat(data->S);
+	struct shmifsrv_vbuffer vb = data->vb;
+
+	if (data->opts.vframe_block &&
+		stat.vframe_backpressure >= data->opts.vframe_soft_block){
+
+/* the soft block caps at ~20% of buffer difs for large buffers, the other
+ * option is to have aggregation and dirty rectangles here, then invalidate if
+ * they accumulate to cover all */
+		size_t px_c = vb.w * vb.h;
+		size_t reg_c =
+			(vb.region.x2 - vb.region.x1) * (vb.region.y2 - vb.region.y1);
+		bool allow_soft = vb.flags.subregion &&
+			(reg_c < px_c) && ((float)reg_c / (float)px_c) <= 0.2;
+
+		if (stat.vframe_backpressure >= data->opts.vframe_block && !allow_soft){
+			a12int_trace(A12_TRACE_VDETAIL,
+				"vbuffer=defer:congestion=%zu:soft=%zu:limit=%zu",
+				stat.vframe_backpressure, data->opts.vframe_soft_block,
+				data->opts.vframe_block
+			);
+			return false;
+		}
+	}
+
+/* this prioritises the channel with focus or recent input and holds back the
+ * others when the estimated bandwidth or queueing delay says so */
+	if (!a12_vframe_admit(data->S, data->chid))
+		return false;
+
+/* vopts_from_segment here lets the caller pick compression parameters (coarse),
+ * including the special 'defer this frame until later', these are then tuned
+ * against the estimated headroom */
+	data->vopts = a12_vframe_adapt(
+		data->S, data->chid, vopts_from_segment(data, vb));
+	return true;
+}
+
 static void* client_thread(void* inarg)
 {
 	struct shmifsrv_thread_data* data = inarg;
 	static const short errmask = POLLERR | POLLNVAL | POLLHUP;
-	struct pollfd pfd[2] = {
+	struct pollfd pfd[3] = {
 		{ .fd = shmifsrv_client_handle(data->C), .events = POLLIN | errmask },
-		{ .fd = data->kill_fd, errmask }
+		{ .fd = data->kill_fd, errmask },
+		{ .fd = data->wake[0], .events = POLLIN | errmask }
 	};
 
 /* We don't have a monitorable trigger for inbound video/audio frames, so some
- * timeout is in order for the time being. It might be useful to add that kind
- * of signalling to shmif though */
-	size_t poll_step = 4;
+ * timeout is in order. It starts short and backs off while nothing happens,
+ * incoming events, lifted congestion and finished frames all come through the
+ * wake pipe. It might be useful to add that kind of signalling to shmif. */
+	int poll_step = A12_SRV_POLL_MIN;
 
 /* the ext-io thread might be sleeping waiting for input, when we finished
  * one pass/burst and know there is queued data to be sent, wake it up */
 	bool dirty = false;
-	redirect_exit(data->C, 4, data->opts.redirect_exit);
+	pthread_mutex_lock(&data->lock);
+		redirect_exit(data->C, 4, data->opts.redirect_exit);
+	pthread_mutex_unlock(&data->lock);
 
 	for(;;){
 		if (dirty){
@@ -472,7 +771,10 @@ static void* client_thread(void* inarg)
 			dirty = false;
 		}
 
-		if (-1 == poll(pfd, 2, poll_step)){
+/* while a frame is with the workers, the client is left alone until the
+ * worker signals completion */
+		bool busy = atomic_load(&data->busy);
+		if (-1 == poll(pfd, 3, busy ? -1 : poll_step)){
 			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR){
 				a12int_trace(A12_TRACE_SYSTEM,
 					"kind=error:status=EPOLL:message=%s", strerror(errno));
@@ -487,35 +789,68 @@ static void* client_thread(void* inarg)
 			break;
 		}
 
+		bool active = false;
+		if (pfd[2].revents & POLLIN){
+			uint8_t buf[64];
+			while (read(data->wake[0], buf, 64) > 0){}
+			active = true;
+		}
+
+		if (atomic_load(&data->closing))
+			break;
+
+		if (atomic_load(&data->busy))
+			continue;
+
 		struct arcan_event ev;
+		for(;;){
+			pthread_mutex_lock(&data->lock);
+			if (!shmifsrv_dequeue_events(data->C, &ev, 1)){
+				pthread_mutex_unlock(&data->lock);
+				break;
+			}
+			active = true;
 
-		while (shmifsrv_dequeue_events(data->C, &ev, 1)){
 			if (arcan_shmif_descrevent(&ev)){
+				pthread_mutex_unlock(&data->lock);
 				a12int_trace(A12_TRACE_SYSTEM,
 					"kind=error:status=EINVAL:message=client->server descriptor event");
 				continue;
 			}
 
 /* server-consumed or should be forwarded? */
-			BEGIN_CRITICAL(&giant_lock, "client_event");
-				if (shmifsrv_process_event(data->C, &ev)){
-					a12int_trace(A12_TRACE_EVENT,
-						"kind=consumed:channel=%d:eventstr=%s",
-						data->chid, arcan_shmif_eventstr(&ev, NULL, 0)
-					);
-				}
-				else {
-					a12_set_channel(data->S, data->chid);
-					a12int_trace(A12_TRACE_EVENT, "kind=forward:channel=%d:eventstr=%s",
-						data->chid, arcan_shmif_eventstr(&ev, NULL, 0));
-					a12_channel_enqueue(data->S, &ev);
-					dirty = true;
-				}
-			END_CRITICAL(&giant_lock);
+			bool consumed = shmifsrv_process_event(data->C, &ev);
+			pthread_mutex_unlock(&data->lock);
+
+			if (consumed){
+				a12int_trace(A12_TRACE_EVENT,
+					"kind=consumed:channel=%d:eventstr=%s",
+					data->chid, arcan_shmif_eventstr(&ev, NULL, 0)
+				);
+				continue;
+			}
+
+			BEGIN_CRITICAL(&state_lock, "client_event");
+				a12_set_channel(data->S, data->chid);
+				a12int_trace(A12_TRACE_EVENT, "kind=forward:channel=%d:eventstr=%s",
+					data->chid, arcan_shmif_eventstr(&ev, NULL, 0));
+				a12_channel_enqueue(data->S, &ev);
+				dirty = true;
+			END_CRITICAL(&state_lock);
 		}
 
 		int pv;
-		while ((pv = shmifsrv_poll(data->C)) != CLIENT_NOT_READY){
+		bool deferred = false;
+		for(;;){
+			pthread_mutex_lock(&data->lock);
+			pv = shmifsrv_poll(data->C);
+			if (pv & CLIENT_VBUFFER_READY)
+				data->vb = shmifsrv_video(data->C);
+			pthread_mutex_unlock(&data->lock);
+
+			if (pv == CLIENT_NOT_READY)
+				break;
+
 /* Dead client, send the close message and that should cascade down the rest
  * and kill relevant sockets. */
 			if (pv == CLIENT_DEAD){
@@ -523,91 +858,71 @@ static void* client_thread(void* inarg)
 				goto out;
 			}
 
-/* the shared buffer_out marks if we should wait a bit before releasing the
- * client as to not keep oversaturating with incoming video frames, we could
- * threshold this to something more reasonable, or just have two congestion
- * levels, one for focused channel and one lower for the rest */
-			if (pv & CLIENT_VBUFFER_READY){
-				if (atomic_load(&buffer_out) > 0){
-					break;
-				}
-
-/* check the congestion window - there are many more options for congestion
- * control here, and the tuning is not figured out. One venue would be to
- * track which channel has a segment with focus, and prioritise those higher. */
-				struct a12_iostat stat = a12_state_iostat(data->S);
-				struct shmifsrv_vbuffer vb = shmifsrv_video(data->C);
-
-				if (data->opts.vframe_block &&
-					stat.vframe_backpressure >= data->opts.vframe_soft_block){
-
-/* the soft block caps at ~20% of buffer difs for large buffers, the other
- * option is to have aggregation and dirty rectangles here, then invalidate if
- * they accumulate to cover all */
-					size_t px_c = vb.w * vb.h;
-					size_t reg_c =
-						(vb.region.x2 - vb.region.x1) * (vb.region.y2 - vb.region.y1);
-					bool allow_soft = vb.flags.subregion &&
-						(reg_c < px_c) && ((float)reg_c / (float)px_c) <= 0.2;
-
-					if (stat.vframe_backpressure >= data->opts.vframe_block && !allow_soft){
-						a12int_trace(A12_TRACE_VDETAIL,
-							"vbuffer=defer:congestion=%zu:soft=%zu:limit=%zu",
-							stat.vframe_backpressure, data->opts.vframe_soft_block,
-							data->opts.vframe_block
-						);
-						break;
-					}
-				}
-
-/* two option, one is to map the dma-buf ourselves and do the readback, or with
- * streams map the stream and convert to h264 on gpu, but easiest now is to
- * just reject and let the caller do the readback. this is currently done by
- * default in shmifsrv.*/
-				BEGIN_CRITICAL(&giant_lock, "video-buffer");
-					a12_set_channel(data->S, data->chid);
-
-/* vopts_from_segment here lets the caller pick compression parameters (coarse),
- * including the special 'defer this frame until later' */
-					a12_channel_vframe(data->S, &vb, vopts_from_segment(data, vb));
-					dirty = true;
-				END_CRITICAL(&giant_lock);
-				stat = a12_state_iostat(data->S);
-				a12int_trace(A12_TRACE_VDETAIL,
-					"vbuffer=release:time_ms=%zu:time_ms_px=%.4f:congestion=%zu",
-					stat.ms_vframe, stat.ms_vframe_px,
-					stat.vframe_backpressure
-				);
-
-/* the other part is to, after a certain while of VBUFFER_READY but not any
- * buffer- out space, track if any of our segments have focus, if so, inject it
- * anyhow (should help responsiveness), increase video compression time-
- * tradeoff and defer the step stage so the client gets that we are limited */
-				shmifsrv_video_step(data->C);
-			}
-
 /* send audio anyway, as not all clients are providing audio and there is less
  * tricks that can be applied from the backpressured client, dynamic resampling
  * and heavier compression is an option here as well though */
 			if (pv & CLIENT_ABUFFER_READY){
 				a12int_trace(A12_TRACE_AUDIO, "audio-buffer");
-				BEGIN_CRITICAL(&giant_lock, "audio_buffer");
+				BEGIN_CRITICAL(&state_lock, "audio_buffer");
 					a12_set_channel(data->S, data->chid);
-					shmifsrv_audio(data->C, on_audio_cb, data->S);
+					pthread_mutex_lock(&data->lock);
+						shmifsrv_audio(data->C, on_audio_cb, data->S);
+					pthread_mutex_unlock(&data->lock);
 					dirty = true;
-				END_CRITICAL(&giant_lock);
+				END_CRITICAL(&state_lock);
+				active = true;
 			}
+
+			if (!(pv & CLIENT_VBUFFER_READY))
+				continue;
+
+/* on congestion the main loop wakes us up again when the output has drained,
+ * the other part is to, after a certain while of VBUFFER_READY but not any
+ * buffer- out space, track if any of our segments have focus, if so, inject it
+ * anyhow (should help responsiveness), increase video compression time-
+ * tradeoff and defer the step stage so the client gets that we are limited */
+			BEGIN_CRITICAL(&state_lock, "video-buffer");
+				bool accept = accept_frame(data);
+				atomic_store(&data->deferred, !accept);
+			END_CRITICAL(&state_lock);
+
+/* two option, one is to map the dma-buf ourselves and do the readback, or with
+ * streams map the stream and convert to h264 on gpu, but easiest now is to
+ * just reject and let the caller do the readback. this is currently done by
+ * default in shmifsrv.*/
+			if (accept){
+				active = true;
+				queue_job(data);
+			}
+			else
+				deferred = true;
+			break;
 		}
 
+		if (deferred)
+			poll_step = A12_SRV_POLL_MAX;
+		else if (active)
+			poll_step = A12_SRV_POLL_MIN;
+		else if (poll_step < A12_SRV_POLL_MAX)
+			poll_step *= 2;
 	}
 
 out:
-	BEGIN_CRITICAL(&giant_lock, "client_death");
+/* a worker might still be busy with our last frame */
+	while (atomic_load(&data->busy)){
+		poll(&pfd[2], 1, -1);
+		uint8_t buf[64];
+		while (read(data->wake[0], buf, 64) > 0){}
+	}
+
+	BEGIN_CRITICAL(&state_lock, "client_death");
+		if (channels[data->chid] == data)
+			channels[data->chid] = NULL;
 		a12_set_channel(data->S, data->chid);
 		a12_channel_close(data->S);
 		write(data->kill_fd, &data->chid, 1);
 		a12int_trace(A12_TRACE_SYSTEM, "client died");
-	END_CRITICAL(&giant_lock);
+	END_CRITICAL(&state_lock);
 
 /* only shut-down everything on the primary- segment failure */
 	if (data->chid == 0 && data->kill_fd != -1)
@@ -620,10 +935,13 @@ out:
 
 	atomic_fetch_sub(&n_segments, 1);
 
-	free(inarg);
+	free_channel(data);
 	return NULL;
 }
 
+/*
+ * [THREADING] called with state_lock held, on failure [inarg] is freed
+ */
 static bool spawn_thread(struct shmifsrv_thread_data* inarg)
 {
 	pthread_t pth;
@@ -631,19 +949,33 @@ static bool spawn_thread(struct shmifsrv_thread_data* inarg)
 	pthread_attr_init(&pthattr);
 	pthread_attr_setdetachstate(&pthattr, PTHREAD_CREATE_DETACHED);
 	atomic_fetch_add(&n_segments, 1);
+	channels[inarg->chid] = inarg;
 
-	if (-1 == pthread_create(&pth, &pthattr, client_thread, inarg)){
-		BEGIN_CRITICAL(&giant_lock, "cleanup-spawn");
-			atomic_fetch_sub(&n_segments, 1);
-			a12int_trace(A12_TRACE_ALLOC, "could not spawn thread");
-			free(inarg);
-		END_CRITICAL(&giant_lock);
+	if (0 != pthread_create(&pth, &pthattr, client_thread, inarg)){
+		channels[inarg->chid] = NULL;
+		atomic_fetch_sub(&n_segments, 1);
+		a12int_trace(A12_TRACE_ALLOC, "could not spawn thread");
+		free_channel(inarg);
 		return false;
 	}
 
 	return true;
 }
 
+/*
+ * Channels that deferred a frame due to congestion have nothing else that
+ * would wake them up. [THREADING] called with state_lock held.
+ */
+static void wake_deferred()
+{
+	for (size_t i = 0; i < 256; i++){
+		if (channels[i] && atomic_load(&channels[i]->deferred)){
+			atomic_store(&channels[i]->deferred, false);
+			wake_channel(channels[i]);
+		}
+	}
+}
+
 void a12helper_a12cl_shmifsrv(struct a12_state* S,
 	struct shmifsrv_client* C, int fd_in, int fd_out, struct a12helper_opts opts)
 {
@@ -663,33 +995,35 @@ void a12helper_a12cl_shmifsrv(struct a12_state* S,
 		return;
 
 /*
- * Spawn the processing- thread that will take care of a shmifsrv_client
+ * Spawn the processing- thread that will take care of a shmifsrv_client,
+ * the kill_fd will be shared among the other segments, so it is only
+ * here where there is reason to clean it up like this
  */
-	struct shmifsrv_thread_data* arg;
-	arg = malloc(sizeof(struct shmifsrv_thread_data));
+	struct shmifsrv_thread_data* arg = alloc_channel(
+		&(struct shmifsrv_thread_data){
+			.S = S,
+			.kill_fd = pipe_pair[1],
+			.opts = opts
+		}, C, 0
+	);
 	if (!arg){
 		close(pipe_pair[0]);
 		close(pipe_pair[1]);
 		return;
 	}
+	fake.user = arg;
 
-/*
- * the kill_fd will be shared among the other segments, so it is only
- * here where there is reason to clean it up like this
- */
-	*arg = (struct shmifsrv_thread_data){
-		.C = C,
-		.S = S,
-		.kill_fd = pipe_pair[1],
-		.opts = opts,
-		.chid = 0
-	};
-	if (!spawn_thread(arg)){
+	start_pool();
+	BEGIN_CRITICAL(&state_lock, "spawn-primary");
+		bool spawned = spawn_thread(arg);
+	END_CRITICAL(&state_lock);
+
+	if (!spawned){
+		stop_pool();
 		close(pipe_pair[0]);
 		close(pipe_pair[1]);
 		return;
 	}
-	fake.user = arg;
 
 /* Socket in/out liveness, buffer flush / dispatch */
 	size_t n_fd = 2;
@@ -701,7 +1035,9 @@ void a12helper_a12cl_shmifsrv(struct a12_state* S,
 	};
 
 /* flush authentication leftovers */
-	a12_unpack(S, NULL, 0, arg, on_srv_event);
+	BEGIN_CRITICAL(&state_lock, "unpack-leftovers");
+		a12_unpack(S, NULL, 0, arg, on_srv_event);
+	END_CRITICAL(&state_lock);
 
 	uint8_t inbuf[9000];
 	while(a12_ok(S) && -1 != poll(fds, n_fd, -1)){
@@ -716,10 +1052,10 @@ void a12helper_a12cl_shmifsrv(struct a12_state* S,
 /* flush wakeup data from threads */
 		if (fds[1].revents){
 			if (a12_trace_targets & A12_TRACE_TRANSFER){
-				BEGIN_CRITICAL(&giant_lock, "flush-iopipe");
+				BEGIN_CRITICAL(&state_lock, "flush-iopipe");
 					a12int_trace(
 						A12_TRACE_TRANSFER, "client thread wakeup");
-				END_CRITICAL(&giant_lock);
+				END_CRITICAL(&state_lock);
 			}
 
 			read(fds[1].fd, inbuf, 9000);
@@ -730,10 +1066,10 @@ void a12helper_a12cl_shmifsrv(struct a12_state* S,
 			ssize_t nw = write(fd_out, outbuf, outbuf_sz);
 
 			if (a12_trace_targets & A12_TRACE_TRANSFER){
-				BEGIN_CRITICAL(&giant_lock, "buffer-send");
+				BEGIN_CRITICAL(&state_lock, "buffer-send");
 				a12int_trace(
 					A12_TRACE_TRANSFER, "send %zd (left %zu) bytes", nw, outbuf_sz);
-				END_CRITICAL(&giant_lock);
+				END_CRITICAL(&state_lock);
 			}
 
 			if (nw > 0){
@@ -748,30 +1084,33 @@ void a12helper_a12cl_shmifsrv(struct a12_state* S,
 			ssize_t nr = recv(fd_in, inbuf, 9000, 0);
 			if (-1 == nr && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR){
 				if (a12_trace_targets & A12_TRACE_SYSTEM){
-					BEGIN_CRITICAL(&giant_lock, "data error");
+					BEGIN_CRITICAL(&state_lock, "data error");
 						a12int_trace(A12_TRACE_SYSTEM, "data-in, error: %s", strerror(errno));
-					END_CRITICAL(&giant_lock);
+					END_CRITICAL(&state_lock);
 				}
 				break;
 			}
 	/* pollin- says yes, but recv says no? */
 			if (nr == 0){
-				BEGIN_CRITICAL(&giant_lock, "socket closed");
+				BEGIN_CRITICAL(&state_lock, "socket closed");
 				a12int_trace(A12_TRACE_SYSTEM, "data-in, other side closed connection");
-				END_CRITICAL(&giant_lock);
+				END_CRITICAL(&state_lock);
 				break;
 			}
 
-			BEGIN_CRITICAL(&giant_lock, "unpack-event");
+			BEGIN_CRITICAL(&state_lock, "unpack-event");
 				a12int_trace(A12_TRACE_TRANSFER, "unpack %zd bytes", nr);
 				a12_unpack(S, inbuf, nr, arg, on_srv_event);
-			END_CRITICAL(&giant_lock);
+
+/* incoming acks might have lifted the congestion for deferred channels */
+				wake_deferred();
+			END_CRITICAL(&state_lock);
 		}
 
 		if (!outbuf_sz){
-			BEGIN_CRITICAL(&giant_lock, "get-buffer");
+			BEGIN_CRITICAL(&state_lock, "get-buffer");
 				outbuf_sz = a12_flush(S, &outbuf, 0);
-			END_CRITICAL(&giant_lock);
+			END_CRITICAL(&state_lock);
 		}
 		n_fd = outbuf_sz > 0 ? 3 : 2;
 	}
@@ -782,6 +1121,8 @@ void a12helper_a12cl_shmifsrv(struct a12_state* S,
 	a12int_trace(A12_TRACE_SYSTEM, "(srv) shutting down connection");
 	close(pipe_pair[0]);
 	while(atomic_load(&n_segments) > 0){}
+	stop_pool();
+
 	if (!a12_free(S)){
 		a12int_trace(A12_TRACE_ALLOC, "error cleaning up a12 context");
 	}
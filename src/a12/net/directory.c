@@ -29,11 +29,16 @@
 #include <fcntl.h>
 #include <poll.h>
 
+#ifdef __LINUX
+#include <sys/inotify.h>
+#endif
+
 struct cb_tag {
 	struct appl_meta* dir;
 	struct a12_state* S;
+	struct anet_dirsrv_opts* srvopt;
 	struct anet_dircl_opts* clopt;
-	FILE* appl_out;
+	int appl_out;
 	bool appl_out_complete;
 	int state_in;
 	bool state_in_complete;
@@ -44,92 +49,568 @@ static bool g_shutdown;
 static struct a12_bhandler_res srv_bevent(
 	struct a12_state* S, struct a12_bhandler_meta M, void* tag);
 
-static FILE* cmd_to_membuf(const char* cmd, char** out, size_t* out_sz)
+/*
+ * Appl store:
+ *
+ * Each appl directory is identified by a blake3 hash over its tree (relative
+ * paths, types, sizes and modification times) rather than its contents, so a
+ * restart only needs to walk the metadata. The tar archive built from a tree
+ * is kept in the store directory as <hash>.tar and reused as long as the tree
+ * hash is unchanged, identical trees share the same archive.
+ *
+ * Without a store directory the archives go into unlinked temporary files
+ * that are kept open for the lifetime of the process instead.
+ *
+ * Where inotify is available, the appl trees are watched and a rescan only
+ * revisits the appls that had some change since the last one.
+ */
+struct store_watch {
+	int wd;
+	char applname[18];
+};
+
+static struct {
+	bool initialized;
+	bool full_rescan;
+	int notify;
+	int base_wd;
+
+	struct store_watch* watches;
+	size_t n_watches;
+	size_t watches_sz;
+
+	char (* dirty)[18];
+	size_t n_dirty;
+	size_t dirty_sz;
+} g_store = {
+	.notify = -1,
+	.base_wd = -1
+};
+
+static void store_watch(int wd, const char* applname)
 {
-	FILE* applin = popen(cmd, "r");
-	if (!applin)
-		return NULL;
+	for (size_t i = 0; i < g_store.n_watches; i++){
+		if (g_store.watches[i].wd == wd){
+			snprintf(g_store.watches[i].applname, 18, "%s", applname);
+			return;
+		}
+	}
 
-	FILE* applbuf = open_memstream(out, out_sz);
-	if (!applbuf){
-		fclose(applin);
-		return NULL;
+	if (g_store.n_watches == g_store.watches_sz){
+		size_t new_sz = g_store.watches_sz ? g_store.watches_sz * 2 : 64;
+		struct store_watch* new =
+			realloc(g_store.watches, new_sz * sizeof(struct store_watch));
+		if (!new)
+			return;
+		g_store.watches = new;
+		g_store.watches_sz = new_sz;
 	}
 
-	char buf[4096];
-	size_t nr;
-	bool ok = true;
+	g_store.watches[g_store.n_watches].wd = wd;
+	snprintf(g_store.watches[g_store.n_watches].applname, 18, "%s", applname);
+	g_store.n_watches++;
+}
 
-	while ((nr = fread(buf, 1, 4096, applin))){
-		if (1 != fwrite(buf, nr, 1, applbuf)){
-			ok = false;
-			break;
+static void store_unwatch(int wd)
+{
+	for (size_t i = 0; i < g_store.n_watches; i++){
+		if (g_store.watches[i].wd == wd){
+			g_store.watches[i] = g_store.watches[--g_store.n_watches];
+			return;
 		}
 	}
+}
 
-	fclose(applin);
-	if (!ok){
-		fclose(applbuf);
-		return NULL;
+static void mark_dirty(const char* applname)
+{
+	if (strlen(applname) >= 18)
+		return;
+
+	for (size_t i = 0; i < g_store.n_dirty; i++)
+		if (strcmp(g_store.dirty[i], applname) == 0)
+			return;
+
+	if (g_store.n_dirty == g_store.dirty_sz){
+		size_t new_sz = g_store.dirty_sz ? g_store.dirty_sz * 2 : 16;
+		char (* new)[18] = realloc(g_store.dirty, new_sz * 18);
+
+/* can't track it individually, fall back to walking everything */
+		if (!new){
+			g_store.full_rescan = true;
+			return;
+		}
+		g_store.dirty = new;
+		g_store.dirty_sz = new_sz;
 	}
 
-/* actually keep both in order to allow appending elsewhere */
-	fflush(applbuf);
-	return applbuf;
+	snprintf(g_store.dirty[g_store.n_dirty++], 18, "%s", applname);
 }
 
-/* This part is much more PoC - we'd need a nicer cache / store (sqlite?) so
- * that each time we start up, we don't have to rescan and the other end don't
- * have to redownload if nothing's changed. */
-static size_t scan_appdir(int fd, struct appl_meta* dst)
+static void store_notify_setup(int basedir)
 {
-	lseek(fd, 0, SEEK_SET);
-	DIR* dir = fdopendir(fd);
+#ifdef __LINUX
+	g_store.notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (-1 == g_store.notify){
+		a12int_trace(A12_TRACE_DIRECTORY, "kind=store:inotify=unavailable");
+		return;
+	}
+
+	fchdir(basedir);
+	g_store.base_wd = inotify_add_watch(g_store.notify, ".",
+		IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR);
+
+	if (-1 == g_store.base_wd){
+		close(g_store.notify);
+		g_store.notify = -1;
+	}
+#endif
+}
+
+/* walk the pending change notifications and mark the affected appls */
+static void store_notify_drain()
+{
+#ifdef __LINUX
+	char buf[4096]
+		__attribute__ ((aligned(__alignof__(struct inotify_event))));
+	ssize_t nr;
+
+	while ((nr = read(g_store.notify, buf, sizeof(buf))) > 0){
+		for (char* cur = buf; cur < buf + nr;){
+			struct inotify_event* ev = (struct inotify_event*) cur;
+			cur += sizeof(struct inotify_event) + ev->len;
+
+			if (ev->mask & IN_Q_OVERFLOW){
+				g_store.full_rescan = true;
+				continue;
+			}
+
+/* something got added / removed in the base, the name is the appl itself */
+			if (ev->wd == g_store.base_wd){
+				if (ev->len)
+					mark_dirty(ev->name);
+				continue;
+			}
+
+			for (size_t i = 0; i < g_store.n_watches; i++){
+				if (g_store.watches[i].wd == ev->wd){
+					mark_dirty(g_store.watches[i].applname);
+					break;
+				}
+			}
+
+			if (ev->mask & IN_IGNORED)
+				store_unwatch(ev->wd);
+		}
+	}
+#endif
+}
+
+static int cmpstr(const void* a, const void* b)
+{
+	return strcmp(*(const char**) a, *(const char**) b);
+}
+
+/*
+ * Hash the metadata of the tree at [dfd] (consumed) in a stable order, [rel]
+ * is the path relative to the appl root and [wpath] relative to the basedir
+ * (cwd) for registering change notifications.
+ */
+static bool hash_tree(blake3_hasher* H,
+	int dfd, const char* rel, const char* wpath, const char* applname)
+{
+	DIR* dir = fdopendir(dfd);
+	if (!dir){
+		close(dfd);
+		return false;
+	}
+
+#ifdef __LINUX
+	if (-1 != g_store.notify){
+		int wd = inotify_add_watch(g_store.notify, wpath,
+			IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM |
+			IN_MOVED_TO | IN_DELETE_SELF | IN_CLOSE_WRITE | IN_ONLYDIR);
+		if (-1 != wd)
+			store_watch(wd, applname);
+	}
+#endif
+
+	size_t n_names = 0, names_sz = 0;
+	char** names = NULL;
 	struct dirent* ent;
-	size_t count = 0;
+	bool ok = true;
 
-	while (dir && (ent = readdir(dir))){
-		if (
-			strlen(ent->d_name) >= 18 ||
-			strcmp(ent->d_name, "..") == 0 || strcmp(ent->d_name, ".") == 0){
+	while ((ent = readdir(dir))){
+		if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
 			continue;
+
+		if (n_names == names_sz){
+			names_sz = names_sz ? names_sz * 2 : 32;
+			char** new = realloc(names, names_sz * sizeof(char*));
+			if (!new){
+				ok = false;
+				break;
+			}
+			names = new;
 		}
-		fchdir(fd);
 
-	/* just want directories */
+		if (!(names[n_names] = strdup(ent->d_name))){
+			ok = false;
+			break;
+		}
+		n_names++;
+	}
+
+	qsort(names, n_names, sizeof(char*), cmpstr);
+
+	for (size_t i = 0; i < n_names && ok; i++){
 		struct stat sbuf;
-		if (-1 == stat(ent->d_name, &sbuf) || (sbuf.st_mode & S_IFMT) != S_IFDIR)
+		if (-1 == fstatat(dirfd(dir), names[i], &sbuf, AT_SYMLINK_NOFOLLOW))
 			continue;
 
-		chdir(ent->d_name);
+		size_t rel_sz = strlen(rel) + strlen(names[i]) + 2;
+		size_t wpath_sz = strlen(wpath) + strlen(names[i]) + 2;
+		char nrel[rel_sz];
+		char nwpath[wpath_sz];
+		snprintf(nrel, rel_sz, "%s/%s", rel, names[i]);
+		snprintf(nwpath, wpath_sz, "%s/%s", wpath, names[i]);
+
+		uint8_t md[40];
+		pack_u64((uint64_t) sbuf.st_mode, &md[0]);
+		pack_u64((uint64_t) sbuf.st_size, &md[8]);
+		pack_u64((uint64_t) sbuf.st_ino, &md[16]);
+		pack_u64((uint64_t) sbuf.st_mtime, &md[24]);
+#ifdef __LINUX
+		pack_u64((uint64_t) sbuf.st_mtim.tv_nsec, &md[32]);
+#else
+		pack_u64(0, &md[32]);
+#endif
+		blake3_hasher_update(H, nrel, strlen(nrel) + 1);
+		blake3_hasher_update(H, md, sizeof(md));
+
+		if ((sbuf.st_mode & S_IFMT) == S_IFDIR){
+			int nfd = openat(dirfd(dir), names[i], O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+			if (-1 != nfd)
+				ok = hash_tree(H, nfd, nrel, nwpath, applname);
+		}
+	}
 
-		struct appl_meta* new = malloc(sizeof(struct appl_meta));
-		if (!new)
-			break;
+	for (size_t i = 0; i < n_names; i++)
+		free(names[i]);
+	free(names);
+	closedir(dir);
+
+	return ok;
+}
+
+static void hash_name(const uint8_t hash[static 16], char out[static 37])
+{
+	for (size_t i = 0; i < 16; i++)
+		snprintf(&out[i * 2], 3, "%02x", hash[i]);
+	snprintf(&out[32], 5, ".tar");
+}
+
+/* tar the appl at [basedir]/[name] into [dstfd], same format as always */
+static bool build_archive(int basedir, const char* name, int dstfd)
+{
+/* the listening loop ignores SIGCHLD so that clients are reaped, but then
+ * there is no exit status to collect and a tar that died halfway would look
+ * like a valid (truncated) archive - restore the default while we wait */
+	struct sigaction old_chld, dfl_chld = {.sa_handler = SIG_DFL};
+	sigemptyset(&dfl_chld.sa_mask);
+	sigaction(SIGCHLD, &dfl_chld, &old_chld);
+
+	pid_t pid = fork();
+	if (pid == 0){
+		if (-1 == fchdir(basedir) || -1 == chdir(name))
+			_exit(EXIT_FAILURE);
+
+		dup2(dstfd, STDOUT_FILENO);
+		execlp("tar", "tar", "cf", "-", ".", (char*) NULL);
+		_exit(EXIT_FAILURE);
+	}
+
+	int status;
+	pid_t rv = -1;
+	if (-1 != pid)
+		while (-1 == (rv = waitpid(pid, &status, 0)) && errno == EINTR){}
+
+/* any client that exited in the meantime is left as a zombie, collect those
+ * before going back to ignoring */
+	sigaction(SIGCHLD, &old_chld, NULL);
+	if (old_chld.sa_handler == SIG_IGN)
+		while (waitpid(-1, NULL, WNOHANG) > 0){}
+
+	return -1 != rv && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static int store_tmpfile()
+{
+	const char* base = getenv("TMPDIR");
+	if (!base)
+		base = "/tmp";
+
+	size_t tmpl_sz = strlen(base) + sizeof("/a12appl-XXXXXX");
+	char tmpl[tmpl_sz];
+	snprintf(tmpl, tmpl_sz, "%s/a12appl-XXXXXX", base);
+
+	int fd = mkstemp(tmpl);
+	if (-1 != fd){
+		unlink(tmpl);
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+	}
+	return fd;
+}
+
+/*
+ * Resolve the appl [name] to a store entry in [dst], reusing the archive if
+ * the tree is unchanged and building it otherwise.
+ */
+static bool store_entry(
+	struct anet_dirsrv_opts* opts, const char* name, struct appl_meta* dst)
+{
+	int dfd = openat(opts->basedir, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (-1 == dfd)
+		return false;
+
+	blake3_hasher H;
+	blake3_hasher_init(&H);
+	fchdir(opts->basedir);
+	if (!hash_tree(&H, dfd, ".", name, name))
+		return false;
+
+	uint8_t tree_hash[16];
+	blake3_hasher_finalize(&H, tree_hash, 16);
+
+/* nothing changed, keep the archive we have */
+	if (dst->buf_sz && memcmp(dst->tree_hash, tree_hash, 16) == 0)
+		return true;
+
+	int fd = -1;
+	char hname[37];
+	hash_name(tree_hash, hname);
+
+	if (-1 != opts->cachedir){
+		fd = openat(opts->cachedir, hname, O_RDONLY | O_CLOEXEC);
+
+		if (-1 == fd){
+			char tname[37];
+			memcpy(tname, hname, 37);
+			memcpy(&tname[32], ".tmp", 5);
+
+			int tfd = openat(opts->cachedir,
+				tname, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+			if (-1 == tfd)
+				return false;
+
+			bool ok = build_archive(opts->basedir, name, tfd);
+			close(tfd);
+
+			if (!ok || -1 == renameat(opts->cachedir, tname, opts->cachedir, hname)){
+				unlinkat(opts->cachedir, tname, 0);
+				return false;
+			}
+
+			a12int_trace(A12_TRACE_DIRECTORY, "kind=store:built=%s:name=%s", hname, name);
+			fd = openat(opts->cachedir, hname, O_RDONLY | O_CLOEXEC);
+		}
+	}
+	else {
+		fd = store_tmpfile();
+		if (-1 != fd && !build_archive(opts->basedir, name, fd)){
+			close(fd);
+			fd = -1;
+		}
+	}
+
+	if (-1 == fd)
+		return false;
+
+	struct stat sbuf;
+	if (-1 == fstat(fd, &sbuf) || !sbuf.st_size){
+		close(fd);
+		return false;
+	}
+
+/* the persistent store is re-opened on demand, the temporary one has to be
+ * kept alive */
+	if (dst->handle){
+		fclose(dst->handle);
+		dst->handle = NULL;
+	}
+
+	if (-1 == opts->cachedir)
+		dst->handle = fdopen(fd, "r");
+	else
+		close(fd);
+
+	memcpy(dst->tree_hash, tree_hash, 16);
+	memcpy(dst->hash, tree_hash, 4);
+	dst->buf_sz = sbuf.st_size;
+	snprintf(dst->applname, 18, "%s", name);
+
+	return true;
+}
 
-		*dst = (struct appl_meta){0};
-		dst->handle = cmd_to_membuf("tar cf - .", &dst->buf, &dst->buf_sz);
-		fchdir(fd);
+/* open the archive for [meta], the returned descriptor is owned by the caller.
+ * The temporary store has no name to reopen so the file description (and its
+ * offset) is shared between workers, which is fine as bstreams use pread */
+static int store_open(struct anet_dirsrv_opts* opts, struct appl_meta* meta)
+{
+	if (meta->handle)
+		return dup(fileno(meta->handle));
+
+	if (-1 == opts->cachedir)
+		return -1;
+
+	char hname[37];
+	hash_name(meta->tree_hash, hname);
+	return openat(opts->cachedir, hname, O_RDONLY | O_CLOEXEC);
+}
 
-		if (!dst->handle){
-			free(new);
+/* sweep the store for archives no longer referenced by any appl */
+static void store_gc(struct anet_dirsrv_opts* opts)
+{
+	if (-1 == opts->cachedir)
+		return;
+
+	int dfd = dup(opts->cachedir);
+	DIR* dir = fdopendir(dfd);
+	if (!dir){
+		close(dfd);
+		return;
+	}
+
+	rewinddir(dir);
+	struct dirent* ent;
+	while ((ent = readdir(dir))){
+		size_t len = strlen(ent->d_name);
+		if (len != 36 ||
+			(strcmp(&ent->d_name[32], ".tar") && strcmp(&ent->d_name[32], ".tmp")))
 			continue;
+
+		bool found = false;
+		for (struct appl_meta* cur = opts->dir; cur && !found; cur = cur->next){
+			char hname[37];
+			hash_name(cur->tree_hash, hname);
+			found = strcmp(hname, ent->d_name) == 0;
 		}
-		dst->identifier = count++;
 
-		blake3_hasher temp;
-		blake3_hasher_init(&temp);
-		blake3_hasher_update(&temp, dst->buf, dst->buf_sz);
-		blake3_hasher_finalize(&temp, dst->hash, 4);
-		snprintf(dst->applname, 18, "%s", ent->d_name);
+		if (!found){
+			a12int_trace(A12_TRACE_DIRECTORY, "kind=store:unlink=%s", ent->d_name);
+			unlinkat(opts->cachedir, ent->d_name, 0);
+		}
+	}
+
+	closedir(dir);
+}
+
+static void drop_entry(struct appl_meta** cur)
+{
+	struct appl_meta* old = *cur;
+	*cur = old->next;
+
+	if (old->handle)
+		fclose(old->handle);
+	free(old);
+}
 
-		*new = (struct appl_meta){0};
-		dst->next = new;
-		dst = new;
+/* re-evaluate a single appl, adding, updating or removing it from the set */
+static bool rescan_appl(struct anet_dirsrv_opts* opts, const char* name)
+{
+	struct appl_meta** cur = &opts->dir;
+	uint16_t next_id = 0;
+
+	while (*cur && strcmp((*cur)->applname, name) != 0){
+		if ((*cur)->identifier >= next_id)
+			next_id = (*cur)->identifier + 1;
+		cur = &(*cur)->next;
+	}
+
+/* just want directories */
+	struct stat sbuf;
+	if (strlen(name) >= 18 ||
+		-1 == fstatat(opts->basedir, name, &sbuf, 0) ||
+		(sbuf.st_mode & S_IFMT) != S_IFDIR){
+		if (*cur){
+			a12int_trace(A12_TRACE_DIRECTORY, "kind=store:removed=%s", name);
+			drop_entry(cur);
+			opts->dir_count--;
+			return true;
+		}
+		return false;
+	}
+
+	if (*cur){
+		uint8_t old_hash[16];
+		memcpy(old_hash, (*cur)->tree_hash, 16);
+
+		if (!store_entry(opts, name, *cur)){
+			drop_entry(cur);
+			opts->dir_count--;
+			return true;
+		}
+
+		return memcmp(old_hash, (*cur)->tree_hash, 16) != 0;
+	}
+
+	struct appl_meta* new = malloc(sizeof(struct appl_meta));
+	if (!new)
+		return false;
+
+	*new = (struct appl_meta){0};
+	if (!store_entry(opts, name, new)){
+		free(new);
+		return false;
+	}
+
+/* identifiers are stable for as long as the appl stays around */
+	for (struct appl_meta* rest = *cur; rest; rest = rest->next)
+		if (rest->identifier >= next_id)
+			next_id = rest->identifier + 1;
+
+	new->identifier = next_id;
+	*cur = new;
+	opts->dir_count++;
+
+	a12int_trace(A12_TRACE_DIRECTORY, "kind=store:added=%s:id=%"PRIu16, name, next_id);
+	return true;
+}
+
+static bool scan_appdir(struct anet_dirsrv_opts* opts)
+{
+	int dfd = dup(opts->basedir);
+	DIR* dir = fdopendir(dfd);
+	struct dirent* ent;
+	bool changed = false;
+
+	if (!dir){
+		close(dfd);
+		return false;
+	}
+
+	rewinddir(dir);
+	while ((ent = readdir(dir))){
+		if (strcmp(ent->d_name, "..") == 0 || strcmp(ent->d_name, ".") == 0)
+			continue;
+
+		changed |= rescan_appl(opts, ent->d_name);
 	}
 
 	closedir(dir);
-	return count;
+
+/* and anything that is no longer there */
+	for (struct appl_meta** cur = &opts->dir; *cur;){
+		struct stat sbuf;
+		if (-1 == fstatat(opts->basedir, (*cur)->applname, &sbuf, 0)){
+			drop_entry(cur);
+			opts->dir_count--;
+			changed = true;
+		}
+		else
+			cur = &(*cur)->next;
+	}
+
+	return changed;
 }
 
 static void on_srv_event(
@@ -162,9 +643,18 @@ static void on_srv_event(
 					close(fd);
 				}
 
+				int appl_fd = store_open(cbt->srvopt, meta);
+				if (-1 == appl_fd){
+					a12int_trace(A12_TRACE_DIRECTORY,
+						"event=bchunkstate:error=store_missing:name=%s", meta->applname);
+					return;
+				}
+
 				a12int_trace(A12_TRACE_DIRECTORY,
 					"event=bchunkstate:send=%s", meta->applname);
-				a12_enqueue_blob(cbt->S, meta->buf, meta->buf_sz, meta->identifier);
+				a12_enqueue_bstream(cbt->S,
+					appl_fd, A12_BTYPE_BLOB, meta->identifier, false, meta->buf_sz);
+				close(appl_fd);
 				return;
 			}
 			meta = meta->next;
@@ -251,21 +741,76 @@ static void ioloop(struct a12_state* S, void* tag, int fdin, int fdout, void
 
 }
 
-/* this will just keep / cache the built .tars in memory, the startup times
- * will still be long and there is no detection when / if to rebuild or when
- * the state has changed - a better server would use sqlite and some basic
- * signalling. */
 void anet_directory_srv_rescan(struct anet_dirsrv_opts* opts)
 {
-	opts->dir_count = scan_appdir(dup(opts->basedir), &opts->dir);
+	bool changed = false;
+
+	if (!g_store.initialized){
+		g_store.initialized = true;
+		store_notify_setup(opts->basedir);
+		g_store.full_rescan = true;
+	}
+/* without change notification there is no other option than to walk, the
+ * archives are still reused so it's just the metadata */
+	else if (-1 == g_store.notify)
+		g_store.full_rescan = true;
+	else
+		store_notify_drain();
+
+	if (g_store.full_rescan){
+		changed = scan_appdir(opts);
+	}
+	else {
+		for (size_t i = 0; i < g_store.n_dirty; i++)
+			changed |= rescan_appl(opts, g_store.dirty[i]);
+	}
+
+	g_store.full_rescan = false;
+	g_store.n_dirty = 0;
+
+	if (changed){
+		store_gc(opts);
+		a12int_trace(A12_TRACE_DIRECTORY,
+			"kind=store:status=updated:count=%zu", opts->dir_count);
+	}
+}
+
+int anet_directory_srv_notify(struct anet_dirsrv_opts* opts)
+{
+	return g_store.notify;
+}
+
+/* the a12 state takes ownership of the list it gets, so give it a copy
+ * of the metadata without the store references */
+static struct appl_meta* copy_directory(struct appl_meta* cur)
+{
+	struct appl_meta* first = NULL;
+	struct appl_meta** dst = &first;
+
+	for (; cur; cur = cur->next){
+		struct appl_meta* new = malloc(sizeof(struct appl_meta));
+		if (!new)
+			break;
+
+		*new = *cur;
+		new->handle = NULL;
+		new->buf = NULL;
+		new->next = NULL;
+		*dst = new;
+		dst = &new->next;
+	}
+
+	return first;
 }
 
 void anet_directory_srv(
 	struct a12_state* S, struct anet_dirsrv_opts opts, int fdin, int fdout)
 {
 	struct cb_tag cbt = {
-		.dir = &opts.dir,
-		.S = S
+		.dir = opts.dir,
+		.srvopt = &opts,
+		.S = S,
+		.appl_out = -1
 	};
 
 	if (!opts.dir_count){
@@ -273,7 +818,7 @@ void anet_directory_srv(
 		return;
 	}
 
-	a12int_set_directory(S, &opts.dir);
+	a12int_set_directory(S, copy_directory(opts.dir));
 	a12_set_bhandler(S, srv_bevent, &cbt);
 	ioloop(S, &cbt, fdin, fdout, on_srv_event, NULL);
 }
@@ -327,6 +872,64 @@ static bool ensure_appldir(const char* name, int basedir)
 	return true;
 }
 
+/*
+ * The appl archive is first stored and then unpacked on completion. With a
+ * cache directory the last one received is kept there as [applname].tar and
+ * used as the basis for the next download, so that only changed chunks need
+ * to be transferred.
+ */
+static int open_archive(struct anet_dircl_opts* opts, bool delta, int* basis)
+{
+	*basis = -1;
+	if (-1 == opts->cachedir)
+		return store_tmpfile();
+
+	char name[strlen(opts->applname) + sizeof(".tar.new")];
+	snprintf(name, sizeof(name), "%s.tar", opts->applname);
+	if (delta)
+		*basis = openat(opts->cachedir, name, O_RDONLY | O_CLOEXEC);
+
+	snprintf(name, sizeof(name), "%s.tar.new", opts->applname);
+	return openat(opts->cachedir,
+		name, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+}
+
+static bool extract_archive(struct anet_dircl_opts* opts, int fd)
+{
+	if (-1 != opts->cachedir){
+		char src[strlen(opts->applname) + sizeof(".tar.new")];
+		char dst[strlen(opts->applname) + sizeof(".tar")];
+		snprintf(src, sizeof(src), "%s.tar.new", opts->applname);
+		snprintf(dst, sizeof(dst), "%s.tar", opts->applname);
+		renameat(opts->cachedir, src, opts->cachedir, dst);
+	}
+
+	if (-1 == lseek(fd, 0, SEEK_SET))
+		return false;
+
+	pid_t pid = fork();
+	if (pid == 0){
+		if (-1 != opts->basedir)
+			fchdir(opts->basedir);
+
+		if (-1 == chdir(opts->applname))
+			_exit(EXIT_FAILURE);
+
+		dup2(fd, STDIN_FILENO);
+		execlp("tar", "tar", "xfm", "-", (char*) NULL);
+		_exit(EXIT_FAILURE);
+	}
+
+	if (-1 == pid)
+		return false;
+
+	int status;
+	pid_t rv;
+	while (-1 == (rv = waitpid(pid, &status, 0)) && errno == EINTR){}
+
+	return -1 != rv && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
 /* assumes that cwd points to our scratch folder for extracted appls */
 static bool handover_exec(struct a12_state* S, const char* name,
 	FILE* state_in, struct anet_dircl_opts* opts, int* state, size_t* state_sz)
@@ -532,11 +1135,51 @@ static struct appl_meta* find_identifier(struct appl_meta* base, unsigned id)
 	return NULL;
 }
 
+/*
+ * The state store for a slot gets truncated when a new state comes in, so
+ * the old contents have to be copied out to act as basis for the delta.
+ */
+static int copy_basis(int fd)
+{
+	if (-1 == fd)
+		return -1;
+
+	int res = store_tmpfile();
+	char buf[65536];
+	ssize_t nr;
+
+	while (-1 != res && (nr = read(fd, buf, sizeof(buf))) != 0){
+		if (-1 == nr){
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			close(res);
+			res = -1;
+			break;
+		}
+
+		for (ssize_t ofs = 0; ofs < nr;){
+			ssize_t nw = write(res, &buf[ofs], nr - ofs);
+			if (-1 == nw){
+				if (errno == EINTR || errno == EAGAIN)
+					continue;
+				close(res);
+				close(fd);
+				return -1;
+			}
+			ofs += nw;
+		}
+	}
+
+	close(fd);
+	return res;
+}
+
 static struct a12_bhandler_res srv_bevent(
 	struct a12_state* S, struct a12_bhandler_meta M, void* tag)
 {
 	struct a12_bhandler_res res = {
 		.fd = -1,
+		.basis = -1,
 		.flag = A12_BHANDLER_DONTWANT
 	};
 
@@ -561,6 +1204,8 @@ static struct a12_bhandler_res srv_bevent(
 /* 2. reserve the state slot - add suffix if it is debug */
 /* 3. setup the result structure. */
 		if (M.type == A12_BTYPE_STATE){
+			if (M.delta)
+				res.basis = copy_basis(a12_access_state(S, meta->applname, "r", 0));
 			res.fd = a12_access_state(S, meta->applname, "w+", M.known_size);
 			ftruncate(res.fd, 0);
 		}
@@ -573,7 +1218,10 @@ static struct a12_bhandler_res srv_bevent(
 	}
 
 	if (-1 != res.fd)
-		res.flag = A12_BHANDLER_NEWFD;
+		res.flag = -1 != res.basis ? A12_BHANDLER_NEWFD_DELTA : A12_BHANDLER_NEWFD;
+	else if (-1 != res.basis)
+		close(res.basis);
+
 	return res;
 }
 
@@ -593,7 +1241,7 @@ static void mark_xfer_complete(
 		return;
 
 /* signs of foul-play */
-	if (!cbt->appl_out){
+	if (-1 == cbt->appl_out){
 		fprintf(stderr, "xfer completed on blob without an active state");
 		g_shutdown = true;
 		return;
@@ -618,8 +1266,10 @@ static void mark_xfer_complete(
  * monitor interface.
  */
 run:
-	pclose(cbt->appl_out);
-	cbt->appl_out = NULL;
+	if (!extract_archive(cbt->clopt, cbt->appl_out))
+		fprintf(stderr, "Couldn't unpack appl archive\n");
+	close(cbt->appl_out);
+	cbt->appl_out = -1;
 	cbt->appl_out_complete = false;
 
 /* rewind the state block and pass it (if present) to the execution setup */
@@ -681,6 +1331,7 @@ static struct a12_bhandler_res cl_bevent(
 	struct cb_tag* cbt = tag;
 	struct a12_bhandler_res res = {
 		.fd = -1,
+		.basis = -1,
 		.flag = A12_BHANDLER_DONTWANT
 	};
 
@@ -712,7 +1363,7 @@ static struct a12_bhandler_res cl_bevent(
 			return res;
 		}
 
-		if (cbt->appl_out){
+		if (-1 != cbt->appl_out){
 			fprintf(stderr, "Appl transfer initiated while one was pending\n");
 			return res;
 		}
@@ -726,9 +1377,14 @@ static struct a12_bhandler_res cl_bevent(
 /* for restoring the DB, can simply popen to arcan_db with the piped mode
  * (arcan_db add_appl_kv basename key value) and send a SIGUSR2 to the process
  * to indicate that the state has been updated. */
-		cbt->appl_out = popen("tar xfm -", "w");
-		res.fd = fileno(cbt->appl_out);
-		res.flag = A12_BHANDLER_NEWFD;
+		cbt->appl_out = open_archive(cbt->clopt, M.delta, &res.basis);
+		if (-1 == cbt->appl_out){
+			fprintf(stderr, "Couldn't create appl archive store\n");
+			return res;
+		}
+
+		res.fd = cbt->appl_out;
+		res.flag = -1 != res.basis ? A12_BHANDLER_NEWFD_DELTA : A12_BHANDLER_NEWFD;
 
 		if (-1 != cbt->clopt->basedir)
 			fchdir(cbt->clopt->basedir);
@@ -747,9 +1403,9 @@ static struct a12_bhandler_res cl_bevent(
 			cbt->state_in_complete = false;
 		}
 		else if (M.type == A12_BTYPE_BLOB){
-			if (cbt->appl_out){
-				pclose(cbt->appl_out);
-				cbt->appl_out = NULL;
+			if (-1 != cbt->appl_out){
+				close(cbt->appl_out);
+				cbt->appl_out = -1;
 				cbt->appl_out_complete = false;
 			}
 			clean_appldir(cbt->clopt->applname, cbt->clopt->basedir);
@@ -812,7 +1468,8 @@ void anet_directory_cl(
 	struct cb_tag cbt = {
 		.S = S,
 		.clopt = &opts,
-		.state_in = -1
+		.state_in = -1,
+		.appl_out = -1
 	};
 
 	sigaction(SIGPIPE,&(struct sigaction){.sa_handler = SIG_IGN}, 0);
@@ -2,11 +2,13 @@
 #define HAVE_DIRECTORY
 
 /*
- * where is the basedir
+ * where is the basedir, and the store for the appl archives built from it
+ * (-1 for unlinked temporary files that are kept open instead)
  */
 struct anet_dirsrv_opts {
 	int basedir;
-	struct appl_meta dir;
+	int cachedir;
+	struct appl_meta* dir;
 	size_t dir_count;
 };
 
@@ -27,6 +29,7 @@ struct anet_dirsrv_opts {
  */
 struct anet_dircl_opts {
 	int basedir;
+	int cachedir; /* keeps the last appl archive, -1 to disable */
 	const char* applname;
 	bool die_on_list;
 	bool reload;
@@ -35,8 +38,20 @@ struct anet_dircl_opts {
 	bool keep_appl;
 };
 
+/*
+ * Synch the set of appls and their archives with the basedir, the first call
+ * walks everything, subsequent ones only revisit the appls that have changed
+ * (if change notification is available) and otherwise reuse the archives.
+ */
 void anet_directory_srv_rescan(struct anet_dirsrv_opts* opts);
 
+/*
+ * Descriptor that becomes readable when there are changes that warrant a
+ * rescan, or -1 if change notification is unavailable (then the caller has
+ * to rescan periodically). Valid after the first rescan.
+ */
+int anet_directory_srv_notify(struct anet_dirsrv_opts* opts);
+
 void anet_directory_srv(
 	struct a12_state* S, struct anet_dirsrv_opts opts, int fdin, int fdout);
 
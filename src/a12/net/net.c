@@ -58,7 +58,15 @@ static struct {
 } global = {
 	.backpressure_soft = 2,
 	.backpressure = 6,
-	.directory = -1
+	.directory = -1,
+	.dirsrv = {
+		.basedir = -1,
+		.cachedir = -1
+	},
+	.dircl = {
+		.basedir = -1,
+		.cachedir = -1
+	}
 };
 
 static const char* trace_groups[] = {
@@ -177,6 +185,21 @@ static int get_bcache_dir()
 	return open(base, O_DIRECTORY);
 }
 
+/* appl archives for the directory server (appl) and the last downloaded ones
+ * on the client side (applcl) go into subdirectories of the cache */
+static int get_applcache_dir(const char* name)
+{
+	int dir = get_bcache_dir();
+	if (-1 == dir)
+		return -1;
+
+	mkdirat(dir, name, S_IRWXU);
+	int res = openat(dir, name, O_DIRECTORY | O_CLOEXEC);
+	close(dir);
+
+	return res;
+}
+
 /*
  * in this mode we should really fexec ourselves so we don't risk exposing
  * aslr or canaries, as well as handle the key-generation
@@ -316,6 +339,13 @@ static struct a12_vframe_opts vcodec_tuning(
 	return opts;
 }
 
+/* invoked from the listening loop on appl changes (or periodically without
+ * change notification) so clients just get the set as it is when they arrive */
+static void directory_rescan(void* tag)
+{
+	anet_directory_srv_rescan(&global.dirsrv);
+}
+
 static void single_a12srv(struct a12_state* S, int fd, void* tag)
 {
 	struct shmifsrv_client* C = NULL;
@@ -351,6 +381,7 @@ static void a12cl_dispatch(
  * needed. */
 	if (global.directory){
 		global.dircl.basedir = global.directory;
+		global.dircl.cachedir = get_applcache_dir("applcl");
 		anet_directory_cl(S, global.dircl, fd, fd);
 		close(fd);
 		return;
@@ -605,7 +636,7 @@ static bool show_usage(const char* msg)
 #endif
 	"\tA12_VBP        \t backpressure maximium cap (0..8)\n"
 	"\tA12_VBP_SOFT   \t backpressure soft (full-frames) cap (< VBP)\n"
-	"\tA12_CACHE_DIR  \t Used for caching binary stores (fonts, ...)\n\n"
+	"\tA12_CACHE_DIR  \t Used for caching binary stores (fonts, appls, ...)\n\n"
 	"Keystore mode (ignores connection arguments):\n"
 	"\tAdd/Append key: arcan-net keystore tag host [port=6680]\n"
 	"\t                tag=default is reserved\n"
@@ -1080,6 +1111,7 @@ int main(int argc, char** argv)
 				global.dircl.applname = global.reqname;
 				global.dircl.die_on_list;
 				global.dircl.basedir = global.directory;
+				global.dircl.cachedir = get_applcache_dir("applcl");
 				if (argi <= argc - 1){
 					global.dircl.applname = argv[argi];
 				}
@@ -1129,12 +1161,17 @@ int main(int argc, char** argv)
 
 /* the directory option is not applied through the mode/role but rather as part
  * of handover_setup, but before then (since we can chose between single or
- * forking) we should scan / cache the applstore - then devise a way to do
- * dynamic updates. */
+ * forking) we should scan / cache the applstore, later changes are picked up
+ * from the listening loop. */
 	if (anet.mode == ANET_SHMIF_CL || anet.mode == ANET_SHMIF_EXEC){
 		if (global.directory != -1){
 			global.dirsrv.basedir = global.directory;
+			global.dirsrv.cachedir = get_applcache_dir("appl");
 			anet_directory_srv_rescan(&global.dirsrv);
+
+			anet.on_aux = directory_rescan;
+			anet.aux_fd = anet_directory_srv_notify(&global.dirsrv);
+			anet.aux_timeout = -1 == anet.aux_fd ? 5000 : -1;
 		}
 		switch (anet.mt_mode){
 		case MT_SINGLE:
@@ -37,15 +37,46 @@
 	#define lua_rawlen(x, y) lua_objlen(x, y)
 #endif
 
-static struct nonblock_io open_fds[LUACTX_OPEN_FILES];
-
 /* open_nonblock and similar functions need to register their fds here as they
  * are force-closed on context shutdown, this is necessary with crash recovery
- * and scripting errors. The limit is set based on the same open limit imposed
- * by arcan_event_ sources. */
+ * and scripting errors. The set is indexed by descriptor like the event source
+ * registry the jobs are added to, and grows from LUACTX_OPEN_FILES as needed. */
+static struct nonblock_io** open_fds;
+static size_t open_fds_sz;
+
 static bool (*add_job)(int fd, mode_t mode, intptr_t tag);
 static bool (*remove_job)(int fd, mode_t mode, intptr_t* out);
 
+static void track_fd(struct nonblock_io* ib)
+{
+	if (ib->fd < 0)
+		return;
+
+	if ((size_t) ib->fd >= open_fds_sz){
+		size_t new_sz = open_fds_sz ? open_fds_sz : LUACTX_OPEN_FILES;
+		while (new_sz <= (size_t) ib->fd)
+			new_sz *= 2;
+
+		struct nonblock_io** new_set =
+			realloc(open_fds, sizeof(struct nonblock_io*) * new_sz);
+		if (!new_set)
+			return;
+
+		memset(&new_set[open_fds_sz], '\0',
+			sizeof(struct nonblock_io*) * (new_sz - open_fds_sz));
+		open_fds = new_set;
+		open_fds_sz = new_sz;
+	}
+
+	open_fds[ib->fd] = ib;
+}
+
+static void untrack_fd(struct nonblock_io* ib)
+{
+	if (ib->fd >= 0 && (size_t) ib->fd < open_fds_sz && open_fds[ib->fd] == ib)
+		open_fds[ib->fd] = NULL;
+}
+
 static void set_nonblock_cloexec(int fd, bool socket)
 {
 #ifdef __APPLE__
@@ -226,6 +257,18 @@ int alt_nbio_close(lua_State* L, struct nonblock_io** ibb)
 {
 	struct nonblock_io* ib = *ibb;
 	int fd = ib->fd;
+
+/* no-op if nothing registered, this needs to happen before closing so that
+ * the descriptor can't be reused while still being in the pollset */
+	intptr_t tag;
+	if (remove_job(fd, O_RDONLY, &tag)){
+		luaL_unref(L, LUA_REGISTRYINDEX, tag);
+	}
+	if (remove_job(fd, O_WRONLY, &tag)){
+		luaL_unref(L, LUA_REGISTRYINDEX, tag);
+	}
+
+	untrack_fd(ib);
 	if (fd > 0)
 		close(fd);
 
@@ -246,27 +289,9 @@ int alt_nbio_close(lua_State* L, struct nonblock_io** ibb)
 	if (ib->write_handler)
 		luaL_unref(L, LUA_REGISTRYINDEX, ib->write_handler);
 
-/* no-op if nothing registered */
-	intptr_t tag;
-	if (remove_job(fd, O_RDONLY, &tag)){
-		luaL_unref(L, LUA_REGISTRYINDEX, tag);
-	}
-	if (remove_job(fd, O_WRONLY, &tag)){
-		luaL_unref(L, LUA_REGISTRYINDEX, tag);
-	}
-
 	free(ib);
 	*ibb = NULL;
 
-/* remove the entry, close will be called from nbio_close, and any current
- * event handlers and triggers will be removed through drop_all_jobs */
-	for (size_t i = 0; i < LUACTX_OPEN_FILES; i++){
-		if (open_fds[i].fd == fd){
-			open_fds[i] = (struct nonblock_io){0};
-			break;
-		}
-	}
-
 	return 0;
 }
 
@@ -387,9 +412,11 @@ static int nbio_socketaccept(lua_State* L)
 		close(newfd);
 		LUA_ETRACE("open_nonblock:accept", "out of memory", 0);
 	}
+	track_fd(conn);
 
 	uintptr_t* dp = lua_newuserdata(L, sizeof(uintptr_t));
 	if (!dp){
+		untrack_fd(conn);
 		close(newfd);
 		arcan_mem_free(conn);
 		LUA_ETRACE("open_nonblock:accept", "couldn't alloc UD", 0);
@@ -781,16 +808,26 @@ void alt_nbio_release()
 /* make sure there are no registered event sources that would remain open
  * without any interpreter-space accessible recipients - the L context is
  * already dead or dying so ignore unref */
-	for (size_t i = 0; i < LUACTX_OPEN_FILES; i++){
-		struct nonblock_io* ent = &open_fds[i];
+	for (size_t i = 0; i < open_fds_sz; i++){
+		struct nonblock_io* ent = open_fds[i];
+		if (!ent)
+			continue;
+
+/* the userdata is still alive until the context is closed and the gc might
+ * reach it, so invalidate the descriptor rather than freeing */
 		if (ent->fd > 0){
 			remove_job(ent->fd, O_RDONLY, NULL);
 			remove_job(ent->fd, O_WRONLY, NULL);
 			close(ent->fd);
 		}
 		drop_all_jobs(ent);
-		open_fds[i] = (struct nonblock_io){0};
+		ent->fd = -1;
+		open_fds[i] = NULL;
 	}
+
+	free(open_fds);
+	open_fds = NULL;
+	open_fds_sz = 0;
 }
 
 int alt_nbio_open(lua_State* L)
@@ -1184,6 +1221,7 @@ bool alt_nbio_import(
 		.fd = fd,
 		.mode = mode
 	};
+	track_fd(nbio);
 
 	if (out)
 		*out = nbio;
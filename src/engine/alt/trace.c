@@ -13,6 +13,7 @@
 #include <lualib.h>
 #include <lauxlib.h>
 #include <string.h>
+#include <ctype.h>
 
 typedef struct arcan_vobject arcan_vobject;
 
@@ -27,6 +28,7 @@ static bool got_trace_buffer;
 static uint8_t* trace_buffer;
 static size_t trace_buffer_sz;
 static intptr_t trace_cb;
+static char* trace_dst;
 
 static char* crash_source;
 
@@ -94,11 +96,75 @@ bool alt_trace_start(lua_State* L, intptr_t cb, size_t sz)
 	return true;
 }
 
+bool alt_trace_start_chrome(lua_State* L, const char* dst, size_t sz)
+{
+/* only allow a plain filename, the result always goes into the debug path */
+	for (const char* ch = dst; *ch; ch++)
+		if (!isalnum(*ch) && *ch != '_' && *ch != '-' && *ch != '.')
+			return false;
+
+	if (!dst[0] || dst[0] == '.')
+		return false;
+
+	char* path = arcan_expand_resource(dst, RESOURCE_SYS_DEBUG);
+	if (!path)
+		return false;
+
+	uint8_t* interim =
+		arcan_alloc_mem(sz,
+			ARCAN_MEM_EXTSTRUCT,
+			ARCAN_MEM_BZERO | ARCAN_MEM_NONFATAL, ARCAN_MEMALIGN_NATURAL
+		);
+
+	if (!interim){
+		arcan_mem_free(path);
+		return false;
+	}
+
+	arcan_trace_setbuffer(interim, sz, &got_trace_buffer);
+	trace_buffer = interim;
+	trace_buffer_sz = sz;
+	trace_cb = 0;
+	trace_dst = path;
+
+	return true;
+}
+
+static void finish_chrome()
+{
+	FILE* fout = fopen(trace_dst, "w");
+	if (!fout ||
+		!arcan_trace_export_chrome(fout, trace_buffer, trace_buffer_sz)){
+		arcan_warning("benchmark_enable(), couldn't write trace to %s\n", trace_dst);
+	}
+
+	if (fout)
+		fclose(fout);
+
+	arcan_mem_free(trace_dst);
+	trace_dst = NULL;
+
+	free(trace_buffer);
+	trace_buffer = NULL;
+	trace_buffer_sz = 0;
+	got_trace_buffer = false;
+}
+
 void alt_trace_finish(lua_State* L)
 {
+/* move marks from the per-thread rings into the collection buffer, this may
+ * also be what fills it up and triggers the finish */
+	if (!got_trace_buffer && trace_buffer)
+		arcan_trace_flush();
+
 	if (!got_trace_buffer)
 		return;
 
+	if (trace_dst){
+		finish_chrome();
+		return;
+	}
+
 	lua_rawgeti(L, LUA_REGISTRYINDEX, trace_cb);
 	lua_newtable(L);
 	int ttop = lua_gettop(L);
@@ -171,6 +237,12 @@ void alt_trace_finish(lua_State* L)
 		pos += 4;
 		tblnum(L, "quantity", quant, top);
 
+/* thread */
+		uint32_t thread;
+		memcpy(&thread, &buf[pos], 4);
+		pos += 4;
+		tblnum(L, "thread", thread, top);
+
 /* caller message */
 		nb = strlen(&buf[pos]);
 		lua_pushliteral(L, "message");
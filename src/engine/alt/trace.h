@@ -5,7 +5,15 @@
 bool alt_trace_start(lua_State* ctx, intptr_t cb, size_t sz);
 
 /*
- * activate / flush any pending trace buffer
+ * same as alt_trace_start, but rather than handing the result to a callback,
+ * write it in the chrome/perfetto JSON trace format to [dst] in the debug
+ * namespace. [dst] is restricted to a plain filename.
+ */
+bool alt_trace_start_chrome(lua_State* ctx, const char* dst, size_t sz);
+
+/*
+ * drain the per-thread trace rings and activate / flush any pending trace
+ * buffer, this is expected to be called regularly (per tick)
  */
 void alt_trace_finish(lua_State* ctx);
 
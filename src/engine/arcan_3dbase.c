@@ -14,6 +14,7 @@
 #include <string.h>
 #include <stdarg.h>
 #include <inttypes.h>
+#include <float.h>
 
 #include <assert.h>
 
@@ -52,17 +53,24 @@ struct geometry {
 	struct geometry* next;
 };
 
-typedef struct {
+typedef struct arcan_3dmodel {
 	pthread_mutex_t lock;
 	int work_count;
 
 	struct geometry* geometry;
 
-/* AA-BB */
+/* AA-BB, the bounding sphere is centered on the box and a radius of 0
+ * means that the bounds are unknown and the model can't be culled */
 	vector bbmin;
 	vector bbmax;
+	vector center;
 	float radius;
 
+/* instanced models borrow the geometry of [source], which is kept alive
+ * (refs) until the last instance has been released */
+	struct arcan_3dmodel* source;
+	size_t refs;
+
 /* position, opacity etc. are inherited from parent */
 	struct {
 /* debug geometry (position, normals, bounding box, ...) */
@@ -74,6 +82,12 @@ typedef struct {
 
 /* ignore projection matrix */
 		bool infinite;
+
+/* never cull against the camera frustum, e.g. vertex shader displacement */
+		bool nocull;
+
+/* vobject is gone but geometry is still referenced by instances */
+		bool orphan;
 	} flags;
 
 	struct {
@@ -145,19 +159,15 @@ static void build_plane(point min, point max, point step,
 	*nindices = vofs;
 }
 
-static void freemodel(arcan_3dmodel* src)
+static void dropmodel(arcan_3dmodel* src)
 {
-	if (!src)
+	struct geometry* geom = src->geometry;
+	if (!geom){
+		pthread_mutex_destroy(&src->lock);
+		arcan_mem_free(src);
 		return;
-
-	if (src->vrref){
-		arcan_vr_release(src->vrref,
-			src->parent ? src->parent->cellid : ARCAN_EID);
-		src->vrref = NULL;
 	}
 
-	struct geometry* geom = src->geometry;
-
 /* always make sure the model is loaded before freeing */
 	while(geom){
 		if (geom->threaded){
@@ -210,6 +220,37 @@ static void freemodel(arcan_3dmodel* src)
 	arcan_mem_free(src);
 }
 
+static void freemodel(arcan_3dmodel* src)
+{
+	if (!src)
+		return;
+
+	if (src->vrref){
+		arcan_vr_release(src->vrref,
+			src->parent ? src->parent->cellid : ARCAN_EID);
+		src->vrref = NULL;
+	}
+
+/* instances only hold a reference to the geometry of their source */
+	if (src->source){
+		arcan_3dmodel* source = src->source;
+		pthread_mutex_destroy(&src->lock);
+		arcan_mem_free(src);
+
+		if (--source->refs == 0 && source->flags.orphan)
+			dropmodel(source);
+		return;
+	}
+
+	if (src->refs > 0){
+		src->flags.orphan = true;
+		src->parent = NULL;
+		return;
+	}
+
+	dropmodel(src);
+}
+
 static void push_deferred(arcan_3dmodel* model)
 {
 	if (model->work_count > 0)
@@ -255,24 +296,56 @@ matr[3], matr[7], matr[11], matr[15]);
 /*
  * Render-loops, Pass control, Initialization
  */
-static void rendermodel(arcan_vobject* vobj, arcan_3dmodel* src,
-	agp_shader_id baseprog, surface_properties props, float* view,
-	enum agp_mesh_flags flags)
-{
-	assert(vobj);
 
-	if (props.opa < EPSILON || !src->flags.complete || src->work_count > 0)
-		return;
+/*
+ * Models in a pass are first collected into a draw list so that they can be
+ * tested against the camera frustum and reordered to cut down on program,
+ * texture and blend state changes before being submitted. Models that share
+ * geometry (instances) end up next to each other so that only the per-object
+ * uniforms change between their submissions. The list is reused between
+ * passes and only grows.
+ */
+struct draw_call {
+	_Alignas(16) float mvm[16];
+	arcan_vobject* vobj;
+	arcan_3dmodel* mesh;
+	agp_shader_id program;
+	struct agp_vstore* store;
+	float opa;
+	size_t run;
+	size_t seq;
+	bool opaque;
+};
+
+static struct {
+	struct draw_call* calls;
+	size_t count;
+	size_t limit;
+} drawlist;
+
+/* last state set in the current pass, reset whenever a pass starts */
+static struct {
+	struct agp_vstore* store;
+	int blend;
+} drawstate;
+
+static arcan_3dmodel* mesh_model(arcan_3dmodel* model)
+{
+	return model->source ? model->source : model;
+}
 
+static void build_modelview(arcan_vobject* vobj,
+	surface_properties* props, float* view, float* out)
+{
 /* transform order: scale */
 	float _Alignas(16) scale[16] = {
-		props.scale.x, 0.0, 0.0, 0.0,
-		0.0, props.scale.y, 0.0, 0.0,
-		0.0, 0.0, props.scale.z, 0.0,
-		0.0, 0.0, 0.0,           1.0
+		props->scale.x, 0.0, 0.0, 0.0,
+		0.0, props->scale.y, 0.0, 0.0,
+		0.0, 0.0, props->scale.z, 0.0,
+		0.0, 0.0, 0.0,            1.0
 	};
 
-  float ox = vobj->origo_ofs.x;
+	float ox = vobj->origo_ofs.x;
 	float oy = vobj->origo_ofs.y;
 	float oz = vobj->origo_ofs.z;
 
@@ -281,36 +354,120 @@ static void rendermodel(arcan_vobject* vobj, arcan_3dmodel* src,
 
 /* rotate */
 	float _Alignas(16) orient[16];
-	matr_quatf(props.rotation.quaternion, orient);
+	matr_quatf(props->rotation.quaternion, orient);
 	float _Alignas(16) model[16];
 	multiply_matrix(model, orient, scale);
 
 /* object translation */
 	translate_matrix(model,
-		props.position.x - ox,
-		props.position.y - oy,
-		props.position.z - oz
+		props->position.x - ox,
+		props->position.y - oy,
+		props->position.z - oz
 	);
 
-	float _Alignas(16) out[16];
 	multiply_matrix(out, view, model);
+}
+
+/* view-space frustum planes from the rows of the projection matrix,
+ * normalized so that the distance can be compared to a radius */
+static void frustum_planes(const float* proj, float planes[6][4])
+{
+	for (size_t i = 0; i < 6; i++){
+		size_t row = i >> 1;
+		float sign = (i & 1) ? -1.0 : 1.0;
+
+		for (size_t j = 0; j < 4; j++)
+			planes[i][j] = proj[j * 4 + 3] + sign * proj[j * 4 + row];
+
+		float len = sqrtf(planes[i][0] * planes[i][0] +
+			planes[i][1] * planes[i][1] + planes[i][2] * planes[i][2]);
+
+		if (len > EPSILON)
+			for (size_t j = 0; j < 4; j++)
+				planes[i][j] /= len;
+	}
+}
+
+static bool in_frustum(arcan_3dmodel* mesh, float* mvm, float planes[6][4])
+{
+	if (mesh->radius < EPSILON)
+		return true;
+
+	float _Alignas(16) center[4] = {
+		mesh->center.x, mesh->center.y, mesh->center.z, 1.0};
+	float _Alignas(16) vc[4];
+	mult_matrix_vecf(mvm, center, vc);
+
+/* the longest basis vector gives the worst-case scale of the sphere */
+	float sf = 0;
+	for (size_t i = 0; i < 12; i += 4){
+		float len = mvm[i] * mvm[i] + mvm[i+1] * mvm[i+1] + mvm[i+2] * mvm[i+2];
+		if (len > sf)
+			sf = len;
+	}
+	float r = mesh->radius * sqrtf(sf);
+
+	for (size_t i = 0; i < 6; i++){
+		if (planes[i][0] * vc[0] +
+			planes[i][1] * vc[1] + planes[i][2] * vc[2] + planes[i][3] < -r)
+			return false;
+	}
+
+	return true;
+}
+
+static bool prepare_draw(struct draw_call* dc, arcan_vobject* vobj,
+	arcan_3dmodel* model, surface_properties* props, float* view)
+{
+	arcan_3dmodel* mesh = mesh_model(model);
+
+	if (props->opa < EPSILON || !mesh->geometry ||
+		!mesh->flags.complete || mesh->work_count > 0)
+		return false;
 
-	agp_shader_envv(MODELVIEW_MATR, out, sizeof(float) * 16);
-	agp_shader_envv(OBJ_OPACITY, &props.opa, sizeof(float));
+	build_modelview(vobj, props, view, dc->mvm);
+	dc->vobj = vobj;
+	dc->mesh = mesh;
+	dc->opa = props->opa;
+	dc->program = mesh->geometry->program > 0 ?
+		mesh->geometry->program : vobj->program;
+	dc->store = vobj->frameset ?
+		vobj->frameset->frames[vobj->frameset->index].frame : vobj->vstore;
+	dc->opaque = vobj->blendmode == BLEND_NONE ||
+		(vobj->blendmode == BLEND_NORMAL && props->opa > 1.0 - EPSILON);
+
+	return true;
+}
+
+static void bind_store(struct agp_vstore* store)
+{
+	if (drawstate.store == store)
+		return;
 
-	struct geometry* base = src->geometry;
+	agp_activate_vstore(store);
+	drawstate.store = store;
+}
 
-	agp_blendstate(vobj->blendmode);
+static void submit_draw(struct draw_call* dc, enum agp_mesh_flags flags)
+{
+	arcan_vobject* vobj = dc->vobj;
+
+	if (drawstate.blend != vobj->blendmode){
+		agp_blendstate(vobj->blendmode);
+		drawstate.blend = vobj->blendmode;
+	}
+
+	agp_shader_envv(OBJ_OPACITY, &dc->opa, sizeof(float));
 	int fset_ofs = vobj->frameset ? vobj->frameset->index : 0;
 
-	while (base){
-		agp_shader_activate(base->program > 0 ? base->program : baseprog);
+	for (struct geometry* base = dc->mesh->geometry; base; base = base->next){
+		agp_shader_activate(base->program > 0 ? base->program : vobj->program);
 
 		if (!vobj->frameset)
-			agp_activate_vstore(vobj->vstore);
+			bind_store(vobj->vstore);
 		else {
 			if (base->nmaps == 1){
-				agp_activate_vstore(vobj->frameset->frames[fset_ofs].frame);
+				bind_store(vobj->frameset->frames[fset_ofs].frame);
 				fset_ofs = (fset_ofs + 1) % vobj->frameset->n_frames;
 			}
 			else if (base->nmaps > 1){
@@ -320,17 +477,86 @@ static void rendermodel(arcan_vobject* vobj, arcan_3dmodel* src,
 					fset_ofs = (fset_ofs + 1) % vobj->frameset->n_frames;
 				}
 				agp_activate_vstore_multi(backing, base->nmaps);
+				drawstate.store = NULL;
 			}
 			else
 				;
 		}
 
-		agp_shader_envv(MODELVIEW_MATR, out, sizeof(float) * 16);
+		agp_shader_envv(MODELVIEW_MATR, dc->mvm, sizeof(float) * 16);
 		agp_submit_mesh(&base->store, flags);
-		base = base->next;
 	}
 }
 
+/*
+ * Within a run of models with the same order value, opaque ones are sorted on
+ * program, geometry and texture, translucent ones are kept in list order and
+ * drawn after the opaque ones as their result depends on what is behind them.
+ */
+static int cmp_draw(const void* a, const void* b)
+{
+	const struct draw_call* da = a;
+	const struct draw_call* db = b;
+
+	if (da->run != db->run)
+		return da->run < db->run ? -1 : 1;
+
+	if (da->opaque != db->opaque)
+		return da->opaque ? -1 : 1;
+
+	if (da->opaque){
+		if (da->program != db->program)
+			return da->program < db->program ? -1 : 1;
+
+		if (da->mesh != db->mesh)
+			return (uintptr_t) da->mesh < (uintptr_t) db->mesh ? -1 : 1;
+
+		if (da->store != db->store)
+			return (uintptr_t) da->store < (uintptr_t) db->store ? -1 : 1;
+	}
+
+	return da->seq < db->seq ? -1 : (da->seq > db->seq);
+}
+
+static void flush_drawlist(enum agp_mesh_flags flags)
+{
+	if (drawlist.count > 1)
+		qsort(drawlist.calls,
+			drawlist.count, sizeof(struct draw_call), cmp_draw);
+
+	for (size_t i = 0; i < drawlist.count; i++)
+		submit_draw(&drawlist.calls[i], flags);
+
+	drawlist.count = 0;
+}
+
+static struct draw_call* next_draw(enum agp_mesh_flags flags)
+{
+	if (drawlist.count < drawlist.limit)
+		return &drawlist.calls[drawlist.count];
+
+	size_t new_limit = drawlist.limit ? drawlist.limit * 2 : 64;
+	struct draw_call* calls = arcan_alloc_mem(
+		sizeof(struct draw_call) * new_limit,
+		ARCAN_MEM_VSTRUCT, ARCAN_MEM_NONFATAL, ARCAN_MEMALIGN_SIMD
+	);
+
+/* on allocation failure, draw what we have and reuse the list */
+	if (!calls){
+		flush_drawlist(flags);
+		return drawlist.limit ? &drawlist.calls[0] : NULL;
+	}
+
+	if (drawlist.calls){
+		memcpy(calls, drawlist.calls, sizeof(struct draw_call) * drawlist.count);
+		arcan_mem_free(drawlist.calls);
+	}
+
+	drawlist.calls = calls;
+	drawlist.limit = new_limit;
+	return &drawlist.calls[drawlist.count];
+}
+
 enum arcan_ffunc_rv arcan_ffunc_3dobj FFUNC_HEAD
 {
 	if ( (state.tag == ARCAN_TAG_3DOBJ ||
@@ -364,7 +590,8 @@ enum arcan_ffunc_rv arcan_ffunc_3dobj FFUNC_HEAD
 }
 
 /* normal scene process, except stops after no objects with infinite
- * flag (skybox, skygeometry etc.) */
+ * flag (skybox, skygeometry etc.) - these are drawn in list order and
+ * never culled */
 static arcan_vobject_litem* process_scene_infinite(
 	arcan_vobject_litem* cell, float lerp, float* view,
 	enum agp_mesh_flags flags)
@@ -394,10 +621,11 @@ static arcan_vobject_litem* process_scene_infinite(
 			break;
 
 		surface_properties dprops;
+		struct draw_call dc;
 
 		arcan_resolve_vidprop(cvo, lerp, &dprops);
-		rendermodel(cvo,
-			obj3d, cvo->program, dprops, view, flags | MESH_FACING_NODEPTH);
+		if (prepare_draw(&dc, cvo, obj3d, &dprops, view))
+			submit_draw(&dc, flags | MESH_FACING_NODEPTH);
 
 		current = current->next;
 	}
@@ -406,7 +634,7 @@ static arcan_vobject_litem* process_scene_infinite(
 }
 
 static void process_scene_normal(arcan_vobject_litem* cell,
-	float lerp, float* modelview, enum agp_mesh_flags flags)
+	float lerp, float* modelview, enum agp_mesh_flags flags, float planes[6][4])
 {
 	arcan_vobject_litem* current = cell;
 	struct rendertarget* rtgt = arcan_vint_current_rt();
@@ -416,6 +644,10 @@ static void process_scene_normal(arcan_vobject_litem* cell,
 		max = rtgt->max_order;
 	}
 
+	size_t run = 0, seq = 0, culled = 0;
+	int last_order = 0;
+	drawlist.count = 0;
+
 	while (current){
 		arcan_vobject* cvo = current->elem;
 
@@ -439,10 +671,42 @@ static void process_scene_normal(arcan_vobject_litem* cell,
 			dprops = cvo->current;
 		else
 			arcan_resolve_vidprop(cvo, lerp, &dprops);
-		rendermodel(cvo, model, cvo->program, dprops, modelview, flags);
+
+		struct draw_call* dc = next_draw(flags);
+		if (!dc){
+			struct draw_call tmp;
+			if (prepare_draw(&tmp, cvo, model, &dprops, modelview))
+				submit_draw(&tmp, flags);
+			current = current->next;
+			continue;
+		}
+
+		if (!prepare_draw(dc, cvo, model, &dprops, modelview)){
+			current = current->next;
+			continue;
+		}
+
+		if (!model->flags.nocull && !in_frustum(dc->mesh, dc->mvm, planes)){
+			culled++;
+			current = current->next;
+			continue;
+		}
+
+		if (seq && cvo->order != last_order)
+			run++;
+		last_order = cvo->order;
+
+		dc->run = run;
+		dc->seq = seq++;
+		drawlist.count++;
 
 		current = current->next;
 	}
+
+	TRACE_MARK_ONESHOT("3d", "frustum-cull",
+		TRACE_SYS_DEFAULT, 0, culled, "culled models");
+
+	flush_drawlist(flags);
 }
 
 arcan_errc arcan_3d_bindvr(arcan_vobj_id id, struct arcan_vr_ctx* vrref)
@@ -500,7 +764,7 @@ bool arcan_3d_obj_bb_intersect(arcan_vobj_id cam,
 	vector ray_pos;
 	vector ray_dir;
 
-	float rad = ((arcan_3dmodel*)model->feed.state.ptr)->radius;
+	float rad = mesh_model(model->feed.state.ptr)->radius;
 	arcan_3d_viewray(cam, x, y, arcan_video_display.c_lerp, &ray_pos, &ray_dir);
 
 	float d1, d2;
@@ -538,6 +802,11 @@ arcan_vobject_litem* arcan_3d_refresh(arcan_vobj_id camtag,
 	agp_shader_activate(agp_default_shader(BASIC_3D));
 	agp_shader_envv(PROJECTION_MATR, camera->projection, sizeof(float) * 16);
 
+	float planes[6][4];
+	frustum_planes(camera->projection, planes);
+	drawstate.store = NULL;
+	drawstate.blend = -1;
+
 /* scale */
 	identity_matrix(matr);
 	scale_matrix(matr, dprop.scale.x, dprop.scale.y, dprop.scale.z);
@@ -557,7 +826,7 @@ arcan_vobject_litem* arcan_3d_refresh(arcan_vobj_id camtag,
 	translate_matrix(dmatr, dprop.position.x, dprop.position.y, dprop.position.z);
 	memcpy(cdata->mvm, dmatr, sizeof(float) * 16);
 
-	process_scene_normal(cell, fract, dmatr, camera->flags);
+	process_scene_normal(cell, fract, dmatr, camera->flags, planes);
 
 	return cell;
 }
@@ -576,6 +845,39 @@ static void minmax_verts(vector* minp, vector* maxp,
 	}
 }
 
+/* recalculate the bounding box and sphere from the current vertices, this
+ * should be done whenever the geometry has been built or transformed */
+static void update_bounds(arcan_3dmodel* model)
+{
+	vector bbmin = {.x =  FLT_MAX, .y =  FLT_MAX, .z =  FLT_MAX};
+	vector bbmax = {.x = -FLT_MAX, .y = -FLT_MAX, .z = -FLT_MAX};
+	bool found = false;
+
+	for (struct geometry* geom = model->geometry; geom; geom = geom->next){
+		if (!geom->store.verts || !geom->store.n_vertices)
+			continue;
+
+/* unknown layout, can't say anything about the extents */
+		if (geom->store.vertex_size != 3){
+			model->radius = 0;
+			return;
+		}
+
+		minmax_verts(&bbmin, &bbmax, geom->store.verts, geom->store.n_vertices);
+		found = true;
+	}
+
+	if (!found){
+		model->radius = 0;
+		return;
+	}
+
+	model->bbmin = bbmin;
+	model->bbmax = bbmax;
+	model->center = mul_vectorf(add_vector(bbmin, bbmax), 0.5);
+	model->radius = len_vector(sub_vector(bbmax, bbmin)) * 0.5;
+}
+
 /* Go through the indices of a model and reverse the winding-
  * order of its indices or verts so that front/back facing attribute of
  * each triangle is inverted */
@@ -591,6 +893,9 @@ arcan_errc arcan_3d_swizzlemodel(arcan_vobj_id dst)
 		return ARCAN_ERRC_UNACCEPTED_STATE;
 
 	arcan_3dmodel* model = (arcan_3dmodel*) vobj->feed.state.ptr;
+	if (model->source)
+		return ARCAN_ERRC_UNACCEPTED_STATE;
+
 	pthread_mutex_lock(&model->lock);
 	if (model->work_count != 0 || !model->flags.complete){
 		model->deferred.swizzle = true;
@@ -679,12 +984,7 @@ arcan_vobj_id arcan_3d_pointcloud(size_t count, size_t nmaps)
 		*tbuf++ = (cz + 1.0) / 2.0;
 	}
 
-	newmodel->radius = 1.0;
-
-	vector bbmin = {-1, -1, -1};
-	vector bbmax = { 1,  1,  1};
-	newmodel->bbmin = bbmin;
-	newmodel->bbmax = bbmax;
+	update_bounds(newmodel);
 	newmodel->flags.complete = true;
 	newmodel->flags.debug = true;
 	newmodel->geometry->nmaps = nmaps;
@@ -748,7 +1048,7 @@ arcan_vobj_id arcan_3d_buildcylinder(float r,
 	newmodel->geometry->store.n_vertices = n_verts / 3;
 	newmodel->geometry->nmaps = nmaps;
 	newmodel->geometry->complete = true;
-	newmodel->radius = r > (2.0 * hh) ? r : 2.0 * hh;
+	newmodel->radius = sqrtf(r * r + hh * hh);
 	newmodel->bbmin = (vector){.x = -r, .y = -hh, .z = -r};
 	newmodel->bbmax = (vector){.x =  r, .y =  hh, .z =  r};
 	newmodel->flags.complete = true;
@@ -882,9 +1182,7 @@ arcan_vobj_id arcan_3d_buildsphere(
 	newmodel->geometry->store.n_indices = ni;
 	newmodel->geometry->store.n_vertices = nv / 3;
 	newmodel->geometry->complete = true;
-	newmodel->radius = r;
 	newmodel->flags.complete = true;
-/* bbmin, bbmax */
 
 /* pass one, base data */
 	float step_l = 1.0f / (float)(l - 1);
@@ -928,6 +1226,7 @@ arcan_vobj_id arcan_3d_buildsphere(
 		}
 	}
 
+	update_bounds(newmodel);
 	return rv;
 }
 
@@ -1102,7 +1401,7 @@ arcan_vobj_id arcan_3d_buildbox(float w, float h, float d, size_t nmaps, bool s)
 		newmodel->geometry->complete = true;
 	}
 
-	newmodel->radius = d;
+	newmodel->radius = sqrtf(w * w + h * h + d * d);
 	newmodel->bbmin = bbmin;
 	newmodel->bbmax = bbmax;
 	newmodel->flags.complete = true;
@@ -1164,8 +1463,7 @@ arcan_vobj_id arcan_3d_buildplane(
 /* though we do know the bounding box and shouldn't need to calculate
  * or iterate, plan is to possibly add transform / lookup functions
  * during creation step, so this is a precaution */
-	minmax_verts(&newmodel->bbmin, &newmodel->bbmax,
-			dst->store.verts, dst->store.n_vertices);
+	update_bounds(newmodel);
 	dst->complete = true;
 	newmodel->flags.complete = true;
 
@@ -1193,7 +1491,8 @@ arcan_errc arcan_3d_meshshader(arcan_vobj_id dst,
 	if (vobj->feed.state.tag != ARCAN_TAG_3DOBJ)
 		return ARCAN_ERRC_UNACCEPTED_STATE;
 
-	struct geometry* cur = ((arcan_3dmodel*)vobj->feed.state.ptr)->geometry;
+/* instances share the per-mesh shader of their source */
+	struct geometry* cur = mesh_model(vobj->feed.state.ptr)->geometry;
 	while (cur && slot){
 		cur = cur->next;
 		slot--;
@@ -1332,6 +1631,8 @@ arcan_errc arcan_3d_scalevertices(arcan_vobj_id vid)
 	}
 
 	arcan_3dmodel* dst = (arcan_3dmodel*) vobj->feed.state.ptr;
+	if (dst->source)
+		return ARCAN_ERRC_UNACCEPTED_STATE;
 
 	pthread_mutex_lock(&dst->lock);
 	if (dst->work_count != 0 || !dst->flags.complete){
@@ -1382,6 +1683,7 @@ arcan_errc arcan_3d_scalevertices(arcan_vobj_id vid)
 		geom = geom->next;
 	}
 
+	update_bounds(dst);
 	pthread_mutex_unlock(&dst->lock);
 	return ARCAN_OK;
 }
@@ -1402,6 +1704,21 @@ arcan_errc arcan_3d_infinitemodel(arcan_vobj_id id, bool state)
 	return ARCAN_OK;
 }
 
+arcan_errc arcan_3d_cullmodel(arcan_vobj_id id, bool state)
+{
+	arcan_vobject* vobj = arcan_video_getobject(id);
+	if (!vobj)
+		return ARCAN_ERRC_NO_SUCH_OBJECT;
+
+	if (vobj->feed.state.tag != ARCAN_TAG_3DOBJ)
+		return ARCAN_ERRC_UNACCEPTED_STATE;
+
+	arcan_3dmodel* dstobj = vobj->feed.state.ptr;
+	dstobj->flags.nocull = !state;
+
+	return ARCAN_OK;
+}
+
 arcan_errc arcan_3d_finalizemodel(arcan_vobj_id id)
 {
 	arcan_vobject* vobj = arcan_video_getobject(id);
@@ -1415,6 +1732,8 @@ arcan_errc arcan_3d_finalizemodel(arcan_vobj_id id)
 
 	if (dstobj->flags.complete == false){
 		dstobj->flags.complete = true;
+		if (dstobj->work_count == 0)
+			update_bounds(dstobj);
 		push_deferred(dstobj);
 	}
 
@@ -1440,6 +1759,43 @@ arcan_vobj_id arcan_3d_emptymodel()
 	return rv;
 }
 
+arcan_vobj_id arcan_3d_instancemodel(arcan_vobj_id src)
+{
+	arcan_vobject* vobj = arcan_video_getobject(src);
+	if (!vobj || vobj->feed.state.tag != ARCAN_TAG_3DOBJ)
+		return ARCAN_EID;
+
+/* instancing an instance resolves to the model that owns the geometry */
+	arcan_3dmodel* source = mesh_model(vobj->feed.state.ptr);
+	if (!source->flags.complete)
+		return ARCAN_EID;
+
+	img_cons econs = {0};
+	arcan_3dmodel* newmodel = arcan_alloc_mem(sizeof(arcan_3dmodel),
+		ARCAN_MEM_VTAG, ARCAN_MEM_BZERO | ARCAN_MEM_NONFATAL,
+		ARCAN_MEMALIGN_NATURAL);
+	if (!newmodel)
+		return ARCAN_EID;
+
+	vfunc_state state = {.tag = ARCAN_TAG_3DOBJ, .ptr = newmodel};
+	arcan_vobj_id rv = arcan_video_addfobject(FFUNC_3DOBJ, state, econs, 1);
+	if (rv == ARCAN_EID){
+		arcan_mem_free(newmodel);
+		return rv;
+	}
+
+	pthread_mutex_init(&newmodel->lock, NULL);
+	newmodel->parent = arcan_video_getobject(rv);
+	newmodel->source = source;
+	newmodel->flags.complete = true;
+	newmodel->flags.infinite = source->flags.infinite;
+	newmodel->flags.nocull = source->flags.nocull;
+	source->refs++;
+
+	arcan_video_allocframes(rv, 1, ARCAN_FRAMESET_SPLIT);
+	return rv;
+}
+
 arcan_errc arcan_3d_baseorient(arcan_vobj_id dst,
 	float roll, float pitch, float yaw)
 {
@@ -1452,6 +1808,9 @@ arcan_errc arcan_3d_baseorient(arcan_vobj_id dst,
 		return ARCAN_ERRC_UNACCEPTED_STATE;
 
 	arcan_3dmodel* model = vobj->feed.state.ptr;
+	if (model->source)
+		return ARCAN_ERRC_UNACCEPTED_STATE;
+
 	pthread_mutex_lock(&model->lock);
 
 	if (model->work_count != 0 || !model->flags.complete){
@@ -1487,6 +1846,7 @@ arcan_errc arcan_3d_baseorient(arcan_vobj_id dst,
 		geom = geom->next;
 	}
 
+	update_bounds(model);
 	pthread_mutex_unlock(&model->lock);
 	return ARCAN_OK;
 }
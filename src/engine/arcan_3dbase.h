@@ -120,6 +120,15 @@ void arcan_3d_viewray(arcan_vobj_id camtag,
  * bounding volumes. Only finalized models will be drawn in 3d_refresh */
 arcan_vobj_id arcan_3d_emptymodel();
 
+/*
+ * Create a new model that shares the geometry (and per-mesh shaders) of the
+ * finalized model [src] but has its own transform, textures and program.
+ * The geometry is kept alive until both [src] and all instances are deleted,
+ * and destructive transforms are refused on the instance. Instances of the
+ * same geometry are grouped together when drawn.
+ */
+arcan_vobj_id arcan_3d_instancemodel(arcan_vobj_id src);
+
 /*
  * Mark a model as completed, this is a contract that no-more meshes will be
  * added and that it is safe to calculate values that require the entire model
@@ -135,6 +144,13 @@ arcan_errc arcan_3d_finalizemodel(arcan_vobj_id);
  */
 arcan_errc arcan_3d_infinitemodel(arcan_vobj_id, bool);
 
+/*
+ * Toggle if the bounding volume of the model should be tested against the
+ * camera frustum and the model skipped if it falls outside (default: on).
+ * Disable for models whose shaders move vertices outside of the bounds.
+ */
+arcan_errc arcan_3d_cullmodel(arcan_vobj_id, bool);
+
 /*
  * Specify the shader [shid] that is to be applied when drawing a submesh
  * in [slot]. This overrides the shader that may be set for the entire [dst].
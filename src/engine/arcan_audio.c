@@ -19,6 +19,7 @@
 #include <limits.h>
 #include <inttypes.h>
 #include <pthread.h>
+#include <stdatomic.h>
 
 #include <al.h>
 #include <alc.h>
@@ -76,6 +77,393 @@ static struct arcan_acontext* current_acontext = &_current_acontext;
 static arcan_aobj* arcan_audio_getobj(arcan_aobj_id);
 static arcan_errc audio_free(arcan_aobj_id);
 
+/*
+ * Streaming sources fed by frameservers can optionally be decoupled from the
+ * main loop. The conductor still pulls from the shmif audio buffers (that
+ * side requires the frameserver to stay alive and is not thread safe) but it
+ * only copies into a single-producer single-consumer ring per stream. The
+ * mixer thread owns the AL queue for those sources: it unqueues processed
+ * buffers, refills them from the ring in small chunks and restarts playback.
+ *
+ * The amount of audio kept buffered before starting playback (the target)
+ * tracks the largest recent gap between pulls from the main loop, with an
+ * additional boost on each underrun that decays slowly. Anything buffered
+ * beyond twice the target is dropped so latency stays bounded if a client
+ * produces faster than the device consumes.
+ *
+ * The mixer lock protects the stream list and the AL source/buffer names of
+ * the streams, the ring itself is lock-free.
+ */
+#ifndef AUDIO_RING_SZ
+#define AUDIO_RING_SZ (1 << 19)
+#endif
+
+/* largest single shmif audio buffer, abufsize is 16-bit */
+#define AUDIO_RING_MARGIN 65536
+
+#ifndef AUDIO_MIXER_PERIOD
+#define AUDIO_MIXER_PERIOD 5
+#endif
+
+#ifndef AUDIO_MIXER_CHUNK_MS
+#define AUDIO_MIXER_CHUNK_MS 10
+#endif
+
+#ifndef AUDIO_MIXER_MIN_US
+#define AUDIO_MIXER_MIN_US 20000
+#endif
+
+#ifndef AUDIO_MIXER_MAX_US
+#define AUDIO_MIXER_MAX_US 250000
+#endif
+
+#define AUDIO_MIXER_BOOST_US 20000
+#define AUDIO_MIXER_HOLD_US 5000000
+
+struct arcan_astream {
+	unsigned alid;
+	unsigned buffers[ARCAN_ASTREAMBUF_LIMIT];
+	size_t bufsz[ARCAN_ASTREAMBUF_LIMIT];
+	bool queued[ARCAN_ASTREAMBUF_LIMIT];
+	size_t n_buffers;
+	size_t queued_bytes;
+
+/* mixer thread only */
+	bool started;
+	bool prebuffer;
+	uint32_t boost;
+	unsigned long long last_underrun;
+
+/* protected by the mixer lock */
+	bool paused;
+	bool linked;
+
+/* main thread only */
+	unsigned long long last_pull;
+
+	_Atomic unsigned channels;
+	_Atomic unsigned samplerate;
+	_Atomic uint32_t peak_gap;
+
+	_Atomic size_t head;
+	_Atomic size_t tail;
+	uint8_t* ring;
+
+	struct arcan_astream* next;
+};
+
+static struct {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct arcan_astream* streams;
+	bool alive;
+	bool suspended;
+} mixer = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER
+};
+
+static size_t ring_used(struct arcan_astream* s)
+{
+	return atomic_load_explicit(&s->head, memory_order_acquire) -
+		atomic_load_explicit(&s->tail, memory_order_acquire);
+}
+
+static void ring_push(struct arcan_astream* s, uint8_t* buf, size_t nb)
+{
+	size_t head = atomic_load_explicit(&s->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&s->tail, memory_order_acquire);
+	size_t frame = atomic_load(&s->channels) * sizeof(int16_t);
+	size_t space = AUDIO_RING_SZ - (head - tail);
+
+/* on overflow the tail end of the buffer is lost, the consumer is either
+ * suspended or way behind and will drop down to the target anyhow */
+	if (nb > space)
+		nb = space - (space % frame);
+
+	size_t ofs = head % AUDIO_RING_SZ;
+	size_t ntc = nb > AUDIO_RING_SZ - ofs ? AUDIO_RING_SZ - ofs : nb;
+	memcpy(&s->ring[ofs], buf, ntc);
+	memcpy(s->ring, &buf[ntc], nb - ntc);
+
+	atomic_store_explicit(&s->head, head + nb, memory_order_release);
+}
+
+static size_t ring_pop(struct arcan_astream* s, uint8_t* buf, size_t nb)
+{
+	size_t tail = atomic_load_explicit(&s->tail, memory_order_relaxed);
+	size_t used = atomic_load_explicit(&s->head, memory_order_acquire) - tail;
+	if (nb > used)
+		nb = used;
+
+	size_t ofs = tail % AUDIO_RING_SZ;
+	size_t ntc = nb > AUDIO_RING_SZ - ofs ? AUDIO_RING_SZ - ofs : nb;
+	if (buf){
+		memcpy(buf, &s->ring[ofs], ntc);
+		memcpy(&buf[ntc], s->ring, nb - ntc);
+	}
+
+	atomic_store_explicit(&s->tail, tail + nb, memory_order_release);
+	return nb;
+}
+
+static void stream_unqueue(struct arcan_astream* s, bool all)
+{
+	ALint processed = 0;
+	if (all){
+		alSourceStop(s->alid);
+		alSourcei(s->alid, AL_BUFFER, AL_NONE);
+		for (size_t i = 0; i < s->n_buffers; i++)
+			s->queued[i] = false;
+		s->queued_bytes = 0;
+		return;
+	}
+
+	alGetSourcei(s->alid, AL_BUFFERS_PROCESSED, &processed);
+	while (processed-- > 0){
+		unsigned buffer = 0;
+		alSourceUnqueueBuffers(s->alid, 1, &buffer);
+
+		for (size_t i = 0; i < s->n_buffers; i++)
+			if (s->buffers[i] == buffer){
+				s->queued[i] = false;
+				s->queued_bytes -= s->bufsz[i];
+				break;
+			}
+	}
+}
+
+static void stream_step(
+	struct arcan_astream* s, unsigned long long now, uint8_t* scratch, size_t lim)
+{
+	if (!s->alid || s->paused)
+		return;
+
+	unsigned channels = atomic_load(&s->channels);
+	unsigned rate = atomic_load(&s->samplerate);
+	if (!channels || !rate)
+		return;
+
+	ALenum state = 0;
+	alGetSourcei(s->alid, AL_SOURCE_STATE, &state);
+
+/* the queue ran dry while we were playing, grow the target and rebuffer */
+	if (s->started && state != AL_PLAYING){
+		s->started = false;
+		s->prebuffer = true;
+		s->boost += AUDIO_MIXER_BOOST_US;
+		if (s->boost > AUDIO_MIXER_MAX_US)
+			s->boost = AUDIO_MIXER_MAX_US;
+		s->last_underrun = now;
+		TRACE_MARK_ONESHOT("audio", "mixer", TRACE_SYS_WARN, s->alid, s->boost, "underrun");
+	}
+	else if (s->boost && now - s->last_underrun > AUDIO_MIXER_HOLD_US){
+		uint32_t step = AUDIO_MIXER_PERIOD * 1000 / 8;
+		s->boost = s->boost > step ? s->boost - step : 0;
+	}
+
+	stream_unqueue(s, false);
+
+	size_t frame = channels * sizeof(int16_t);
+	uint64_t target = (uint64_t) atomic_load(&s->peak_gap) * 5 / 4 + s->boost;
+	if (target < AUDIO_MIXER_MIN_US)
+		target = AUDIO_MIXER_MIN_US;
+	else if (target > AUDIO_MIXER_MAX_US)
+		target = AUDIO_MIXER_MAX_US;
+
+	size_t target_b = (target * rate / 1000000) * frame;
+	size_t used = ring_used(s);
+
+	if (used + s->queued_bytes > 2 * target_b){
+		size_t drop = used + s->queued_bytes - target_b;
+		drop = drop > used ? used : drop;
+		ring_pop(s, NULL, drop - (drop % frame));
+		used = ring_used(s);
+	}
+
+	if (s->prebuffer){
+		if (used + s->queued_bytes < target_b)
+			return;
+		s->prebuffer = false;
+	}
+
+	size_t chunk = (rate * AUDIO_MIXER_CHUNK_MS / 1000) * frame;
+	if (chunk > lim)
+		chunk = lim - (lim % frame);
+
+	ALenum fmt = channels == 2 ? AL_FORMAT_STEREO16 : AL_FORMAT_MONO16;
+	for (size_t i = 0; i < s->n_buffers && used >= frame; i++){
+		if (s->queued[i])
+			continue;
+
+		size_t nb = used > chunk ? chunk : used - (used % frame);
+		nb = ring_pop(s, scratch, nb);
+		alBufferData(s->buffers[i], fmt, scratch, nb, rate);
+		alSourceQueueBuffers(s->alid, 1, &s->buffers[i]);
+		s->queued[i] = true;
+		s->bufsz[i] = nb;
+		s->queued_bytes += nb;
+		used -= nb;
+	}
+
+	if (!s->started && s->queued_bytes){
+		alSourcePlay(s->alid);
+		s->started = true;
+	}
+}
+
+static void* mixer_thread(void* arg)
+{
+	size_t lim = 65536;
+	uint8_t* scratch = malloc(lim);
+	if (!scratch)
+		return NULL;
+
+	pthread_mutex_lock(&mixer.lock);
+	while (mixer.alive){
+		if (!mixer.streams || mixer.suspended){
+			pthread_cond_wait(&mixer.cond, &mixer.lock);
+			continue;
+		}
+
+		unsigned long long now = arcan_timemicros();
+		for (struct arcan_astream* s = mixer.streams; s; s = s->next)
+			stream_step(s, now, scratch, lim);
+
+		pthread_mutex_unlock(&mixer.lock);
+		arcan_timesleep(AUDIO_MIXER_PERIOD);
+		pthread_mutex_lock(&mixer.lock);
+	}
+	pthread_mutex_unlock(&mixer.lock);
+
+	free(scratch);
+	return NULL;
+}
+
+static struct arcan_astream* stream_alloc()
+{
+	struct arcan_astream* s = arcan_alloc_mem(sizeof(struct arcan_astream),
+		ARCAN_MEM_ATAG, ARCAN_MEM_BZERO | ARCAN_MEM_NONFATAL, ARCAN_MEMALIGN_NATURAL);
+	if (!s)
+		return NULL;
+
+	s->ring = arcan_alloc_mem(AUDIO_RING_SZ,
+		ARCAN_MEM_ABUFFER, ARCAN_MEM_NONFATAL, ARCAN_MEMALIGN_PAGE);
+	if (!s->ring){
+		arcan_mem_free(s);
+		return NULL;
+	}
+
+	s->prebuffer = true;
+	return s;
+}
+
+/* first data on a stream, get AL names and hand it over to the mixer */
+static void stream_attach(arcan_aobj* aobj)
+{
+	struct arcan_astream* s = aobj->stream;
+
+	alGenSources(1, &aobj->alid);
+	alSourcef(aobj->alid, AL_GAIN, aobj->gain);
+	alGenBuffers(aobj->n_streambuf, s->buffers);
+	_wrap_alError(aobj, "audio_stream(genBuffers)");
+
+	pthread_mutex_lock(&mixer.lock);
+	s->alid = aobj->alid;
+	s->n_buffers = aobj->n_streambuf;
+	s->next = mixer.streams;
+	s->linked = true;
+	mixer.streams = s;
+	pthread_cond_signal(&mixer.cond);
+	pthread_mutex_unlock(&mixer.lock);
+}
+
+/* unlink from the mixer and release AL names, the source is gone after this */
+static void stream_release(arcan_aobj* aobj)
+{
+	struct arcan_astream* s = aobj->stream;
+	pthread_mutex_lock(&mixer.lock);
+	if (s->linked){
+		struct arcan_astream** cur = &mixer.streams;
+		while (*cur != s)
+			cur = &(*cur)->next;
+		*cur = s->next;
+	}
+
+	if (s->alid){
+		stream_unqueue(s, true);
+		alDeleteSources(1, &s->alid);
+		alDeleteBuffers(s->n_buffers, s->buffers);
+		_wrap_alError(aobj, "audio_stream(release)");
+	}
+	pthread_mutex_unlock(&mixer.lock);
+
+	aobj->alid = AL_NONE;
+	aobj->n_streambuf = 0;
+	aobj->stream = NULL;
+	arcan_mem_free(s->ring);
+	arcan_mem_free(s);
+}
+
+static void stream_pause(arcan_aobj* aobj, bool pause)
+{
+	struct arcan_astream* s = aobj->stream;
+	pthread_mutex_lock(&mixer.lock);
+	s->paused = pause;
+	if (pause && s->alid){
+		alSourcePause(s->alid);
+	}
+	else if (!pause && s->alid && s->started){
+		alSourcePlay(s->alid);
+	}
+	pthread_mutex_unlock(&mixer.lock);
+}
+
+/*
+ * Drain what the frameserver has ready into the ring. cont=false to the feed
+ * releases the segment, so that is used for the last buffer we know fits.
+ */
+static void stream_pull(arcan_aobj* aobj)
+{
+	struct arcan_astream* s = aobj->stream;
+	unsigned long long now = arcan_timemicros();
+
+/* peak-hold of the pull interval, rises immediately and decays slowly */
+	if (s->last_pull){
+		uint32_t gap = now - s->last_pull > AUDIO_MIXER_MAX_US ?
+			AUDIO_MIXER_MAX_US : now - s->last_pull;
+		uint32_t peak = atomic_load(&s->peak_gap);
+		peak = gap > peak ? gap : peak - ((peak - gap) >> 8);
+		atomic_store(&s->peak_gap, peak);
+	}
+	s->last_pull = now;
+
+	for (size_t i = 0; i < ARCAN_ASTREAMBUF_LIMIT && aobj->feed; i++){
+		size_t space = AUDIO_RING_SZ - ring_used(s);
+		if (space < AUDIO_RING_MARGIN)
+			break;
+
+		bool cont = i < ARCAN_ASTREAMBUF_LIMIT - 1 && space >= 2 * AUDIO_RING_MARGIN;
+		arcan_errc rv = aobj->feed(aobj, aobj->alid, 0, cont, aobj->tag);
+
+		if (rv == ARCAN_OK){
+			if (!cont)
+				break;
+			continue;
+		}
+
+		if (rv != ARCAN_ERRC_NOTREADY){
+			arcan_event_denqueue(arcan_event_defaultctx(), &(struct arcan_event){
+				.category = EVENT_AUDIO,
+				.aud.kind = EVENT_AUDIO_PLAYBACK_FINISHED,
+				.aud.source = aobj->id
+			});
+		}
+		break;
+	}
+}
+
 static ALuint load_wave(const char* fname){
 	ALuint rv = 0;
 
@@ -299,6 +687,9 @@ static arcan_errc audio_free(arcan_aobj_id id)
 	if (current){
 		*owner = current->next;
 
+		if (current->stream)
+			stream_release(current);
+
 		if (current->alid != AL_NONE){
 			alSourceStop(current->alid);
 			alDeleteSources(1, &current->alid);
@@ -360,6 +751,14 @@ arcan_errc arcan_audio_setup(bool nosound)
 		current_acontext->al_active = true;
 		rv = ARCAN_OK;
 
+		if (!getenv("ARCAN_AUDIO_SYNCH")){
+			mixer.alive = true;
+			if (0 != pthread_create(&mixer.thread, NULL, mixer_thread, NULL)){
+				arcan_warning("arcan_audio_init(), couldn't spawn mixer thread\n");
+				mixer.alive = false;
+			}
+		}
+
 		/* just give a slightly "random" base so that
 		 user scripts don't get locked into hard-coded ids .. */
 		arcan_random((unsigned char*)&current_acontext->lastid, sizeof(arcan_aobj_id));
@@ -391,6 +790,13 @@ arcan_errc arcan_audio_shutdown()
 		return rv;
 
 /* there might be more to clean-up here, monitoring /callback buffers/tags */
+	if (mixer.alive){
+		pthread_mutex_lock(&mixer.lock);
+		mixer.alive = false;
+		pthread_cond_signal(&mixer.cond);
+		pthread_mutex_unlock(&mixer.lock);
+		pthread_join(mixer.thread, NULL);
+	}
 
 	alcDestroyContext(ctx);
 	current_acontext->al_active = false;
@@ -426,6 +832,11 @@ arcan_errc arcan_audio_play(
 				break;
 			}
 	}
+/* the mixer starts playback on its own once enough has been buffered */
+	else if (aobj->stream){
+		stream_pause(aobj, false);
+		aobj->active = true;
+	}
 /* some kind of streaming source, can't play if it is already active */
 	else if (aobj->active == false && aobj->alid != AL_NONE){
 		alSourcePlay(aobj->alid);
@@ -554,6 +965,9 @@ arcan_aobj_id arcan_audio_feed(arcan_afunc_cb feed, void* tag, arcan_errc* errc)
 	aobj->gain = 1.0;
 	aobj->kind = AOBJ_STREAM;
 
+	if (mixer.alive)
+		aobj->stream = stream_alloc();
+
 	if (errc) *errc = ARCAN_OK;
 	return rid;
 }
@@ -566,6 +980,21 @@ arcan_errc arcan_audio_rebuild(arcan_aobj_id id)
 	if (!aobj || aobj->alid == AL_NONE)
 		return ARCAN_ERRC_NO_SUCH_OBJECT;
 
+	if (aobj->stream){
+		struct arcan_astream* s = aobj->stream;
+		pthread_mutex_lock(&mixer.lock);
+		stream_unqueue(s, true);
+		alDeleteSources(1, &aobj->alid);
+		alGenSources(1, &aobj->alid);
+		alSourcef(aobj->alid, AL_GAIN, aobj->gain);
+		s->alid = aobj->alid;
+		s->started = false;
+		s->prebuffer = true;
+		pthread_mutex_unlock(&mixer.lock);
+		_wrap_alError(NULL, "audio_rebuild(recreate)");
+		return ARCAN_OK;
+	}
+
 	alSourceStop(aobj->alid);
 	_wrap_alError(NULL, "audio_rebuild(stop)");
 
@@ -609,6 +1038,10 @@ arcan_errc arcan_audio_suspend()
 	}
 
 	current_acontext->al_active = false;
+	pthread_mutex_lock(&mixer.lock);
+	mixer.suspended = true;
+	pthread_mutex_unlock(&mixer.lock);
+
 	if (alc_device_pause_soft)
 		alc_device_pause_soft(current_acontext->device);
 
@@ -632,6 +1065,10 @@ arcan_errc arcan_audio_resume()
 	}
 
 	current_acontext->al_active = true;
+	pthread_mutex_lock(&mixer.lock);
+	mixer.suspended = false;
+	pthread_cond_signal(&mixer.cond);
+	pthread_mutex_unlock(&mixer.lock);
 
 	rv = ARCAN_OK;
 
@@ -643,7 +1080,12 @@ arcan_errc arcan_audio_pause(arcan_aobj_id id)
 	arcan_aobj* dobj = arcan_audio_getobj(id);
 	arcan_errc rv = ARCAN_ERRC_NO_SUCH_OBJECT;
 
-	if (dobj && dobj->alid != AL_NONE) {
+	if (dobj && dobj->stream){
+		stream_pause(dobj, true);
+		dobj->active = false;
+		rv = ARCAN_OK;
+	}
+	else if (dobj && dobj->alid != AL_NONE) {
 /*
  * int processed;
  * alGetSourcei(dobj->alid, AL_BUFFERS_PROCESSED, &processed);
@@ -796,6 +1238,20 @@ void arcan_audio_buffer(arcan_aobj* aobj, ssize_t buffer, void* audbuf,
 		current_acontext->globalhook(aobj->id, audbuf, abufs, channels,
 			samplerate, current_acontext->global_hooktag);
 
+/* buffer indices are meaningless here, the mixer thread handles queueing */
+	if (aobj->stream){
+		if (aobj->alid == AL_NONE)
+			stream_attach(aobj);
+
+		if (!aobj->gproxy && channels && channels <= 2 && samplerate){
+			aobj->last_used = current_acontext->atick_counter;
+			atomic_store(&aobj->stream->channels, channels);
+			atomic_store(&aobj->stream->samplerate, samplerate);
+			ring_push(aobj->stream, audbuf, abufs);
+		}
+		return;
+	}
+
 /*
  * the audio system can bounce back in the case of many allocations
  * exceeding what can be mixed internally, through the _tick mechanism
@@ -836,6 +1292,11 @@ static void astream_refill(arcan_aobj* current)
 	ALenum state = 0;
 	ALint processed = 0;
 
+	if (current->stream){
+		stream_pull(current);
+		return;
+	}
+
 	if (current->alid == AL_NONE && current->feed){
 		current->feed(current, current->alid, 0, false, current->tag);
 		return;
@@ -1080,7 +1541,7 @@ size_t arcan_audio_refresh()
 			astream_refill(current);
 
 		_wrap_alError(current, "audio_refresh()");
-		if (current->used)
+		if (current->used || (current->stream && current->alid != AL_NONE))
 			rv++;
 
 		current = current->next;
@@ -1192,6 +1653,9 @@ void arcan_audio_purge(arcan_aobj_id* ids, size_t nids)
 
 			_wrap_alError(current, "audio_stop(stop)");
 
+			if (current->stream)
+				stream_release(current);
+
 			if (current->alid != AL_NONE){
 				alSourceStop(current->alid);
 				alDeleteSources(1, &current->alid);
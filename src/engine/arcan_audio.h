@@ -73,6 +73,11 @@ void arcan_audio_tick(uint8_t ntt);
 /*
  * Process the list of active streaming audio sources and dequeue/refill
  * buffers as needed. Returns the number of sources with active buffers.
+ *
+ * Unless ARCAN_AUDIO_SYNCH is set in the environment, frameserver streams
+ * are only pulled into intermediate buffers here and the actual queueing
+ * happens from a separate mixer thread, so that stalls in the main loop
+ * do not translate into underruns.
  */
 size_t arcan_audio_refresh();
 
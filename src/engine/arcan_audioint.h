@@ -14,6 +14,7 @@
 #define ARCAN_ASTREAMBUF_LIMIT ARCAN_SHMIF_ABUFC_LIM
 
 struct arcan_aobj_cell;
+struct arcan_astream;
 
 struct arcan_achain {
 	unsigned t_gain;
@@ -51,6 +52,9 @@ typedef struct arcan_aobj {
 
 	short used;
 
+/* set when buffering goes through the mixer thread, see arcan_audio.c */
+	struct arcan_astream* stream;
+
 /* global hooks */
 	arcan_afunc_cb feed;
 	arcan_monafunc_cb monitor;
@@ -78,6 +78,7 @@ static struct {
 	int64_t set_deadline;
 	double render_cost;
 	double transfer_cost;
+	struct arcan_frameserver_histogram compose;
 	uint8_t timestep;
 	bool in_frame;
 } conductor = {
@@ -103,6 +104,7 @@ static char* synchopts[] = {
 	"powersave", "synch to clock tick (~25Hz)",
 	"adaptive", "defer composition",
 	"tight", "defer composition, delay client-wake",
+	"deadline", "defer composition, wake clients by predicted frame time",
 	NULL
 };
 
@@ -125,7 +127,10 @@ enum synchopts {
 /* defer composition, wake clients after vsynch */
 	SYNCH_ADAPTIVE,
 /* defer composition, wake clients after half-time */
-	SYNCH_TIGHT
+	SYNCH_TIGHT,
+/* defer composition, wake each client at the last moment its render time
+ * histogram says it can still make the deadline */
+	SYNCH_DEADLINE
 };
 
 static int synchopt = SYNCH_IMMEDIATE;
@@ -293,7 +298,8 @@ int arcan_conductor_yield(struct conductor_display* disps, size_t pset_count)
 
 	for (size_t i=0, j=frameservers.used; i < frameservers.count && j > 0; i++){
 		if (frameservers.ref[i]){
-			arcan_vint_pollfeed(frameservers.ref[i]->vid, false);
+			if (arcan_frameserver_pollready(frameservers.ref[i]))
+				arcan_vint_pollfeed(frameservers.ref[i]->vid, false);
 			j--;
 		}
 	}
@@ -345,6 +351,7 @@ void arcan_conductor_setsynch(const char* arg)
 		arcan_frameserver_lock_buffers(2);
 	break;
 	case SYNCH_TIGHT:
+	case SYNCH_DEADLINE:
 		arcan_frameserver_lock_buffers(2);
 	break;
 	case SYNCH_IMMEDIATE:
@@ -492,6 +499,82 @@ static int estimate_frame_cost()
 	return conductor.render_cost + conductor.transfer_cost + conductor.timestep;
 }
 
+/* histograms with fewer samples than this are not trusted for prediction */
+#define DEADLINE_MIN_SAMPLES 8
+
+/* clients that haven't delivered a frame in this long are idle and won't
+ * add to the transfer cost of the next one */
+#define DEADLINE_IDLE_US 100000
+
+static int us_to_ms(unsigned long long us)
+{
+	return (us + 999) / 1000;
+}
+
+/*
+ * Same as estimate_frame_cost but using the upper percentile of the compose
+ * histogram and the transfer histogram of every client that might deliver,
+ * that is one holding a frame or one that has delivered recently, rather than
+ * the moving averages.
+ */
+static int estimate_deadline_cost()
+{
+	if (conductor.compose.total < DEADLINE_MIN_SAMPLES)
+		return estimate_frame_cost();
+
+	unsigned long long now = arcan_timemicros();
+	unsigned long long xfer = 0;
+	for (size_t i = 0, j = frameservers.used; i < frameservers.count && j; i++){
+		struct arcan_frameserver* fsrv = frameservers.ref[i];
+		if (!fsrv)
+			continue;
+		j--;
+
+		if (!fsrv->flags.release_pending &&
+			now - fsrv->timing.transferred > DEADLINE_IDLE_US)
+			continue;
+
+		xfer += arcan_frameserver_histogram_pct(&fsrv->timing.transfer, 0.9);
+	}
+
+	return us_to_ms(
+		arcan_frameserver_histogram_pct(&conductor.compose, 0.9) + xfer) +
+		conductor.timestep;
+}
+
+/*
+ * Wake the clients that are still holding on to a composed frame when the
+ * time left until [margin] matches what their render time histogram predicts
+ * it needs. The focus target uses a more pessimistic percentile as missing
+ * its frame is more noticeable than for the rest.
+ */
+static void deadline_release(ssize_t margin, int elapsed)
+{
+	for (size_t i = 0, j = frameservers.used; i < frameservers.count && j; i++){
+		struct arcan_frameserver* fsrv = frameservers.ref[i];
+		if (!fsrv)
+			continue;
+		j--;
+
+		if (!fsrv->flags.release_pending)
+			continue;
+
+		struct arcan_frameserver_histogram* hist = &fsrv->timing.render;
+		float pct = fsrv == frameservers.focus ? 0.99 : 0.9;
+		ssize_t predict = us_to_ms(arcan_frameserver_histogram_pct(hist, pct)) +
+			us_to_ms(arcan_frameserver_histogram_pct(&fsrv->timing.transfer, 0.9)) +
+			conductor.timestep;
+
+/* no confidence in the prediction or the client is too slow to make it in
+ * this period anyhow, wake immediately to catch the next */
+		if (hist->total < DEADLINE_MIN_SAMPLES || elapsed + predict >= margin){
+			TRACE_MARK_ONESHOT("conductor", "synchronization",
+				TRACE_SYS_DEFAULT, fsrv->vid, predict, "deadline-release");
+			arcan_frameserver_releaselock(fsrv);
+		}
+	}
+}
+
 static bool preframe_synch(int next, int elapsed)
 {
 	switch(synchopt){
@@ -532,6 +615,24 @@ static bool preframe_synch(int next, int elapsed)
 			TRACE_SYS_DEFAULT, 0, elapsed - margin, "tight-deadline");
 		return true;
 	}
+	case SYNCH_DEADLINE:{
+		ssize_t margin = next - estimate_deadline_cost();
+		if (elapsed < margin){
+			deadline_release(margin, elapsed);
+			internal_yield();
+			return false;
+		}
+
+/* collect frames that landed during the last yield so they make this one,
+ * then wake everyone still holding a frame as they have missed their window
+ * and would otherwise stay blocked through the next one */
+		arcan_video_pollfeed();
+		unlock_herd();
+
+		TRACE_MARK_ONESHOT("conductor", "synchronization",
+			TRACE_SYS_DEFAULT, 0, elapsed - margin, "deadline");
+		return true;
+	}
 	case SYNCH_VSYNCH:
 	case SYNCH_PROCESSING:
 	case SYNCH_IMMEDIATE:
@@ -549,6 +650,11 @@ static uint64_t postframe_synch(uint64_t next)
 	case SYNCH_POWERSAVE:
 		unlock_herd();
 	break;
+/* without a platform deadline there is no preframe pass to release in */
+	case SYNCH_DEADLINE:
+		if (next <= 0)
+			unlock_herd();
+	break;
 	case SYNCH_PROCESSING:
 	case SYNCH_IMMEDIATE:
 	break;
@@ -585,6 +691,9 @@ static int trigger_video_synch(float frag)
 		0.8 * (double)stats->framecost[(uint8_t)stats->costofs] +
 		0.2 * conductor.render_cost;
 
+	arcan_frameserver_histogram_add(&conductor.compose,
+		(unsigned long long) stats->framecost[(uint8_t)stats->costofs] * 1000, 1000);
+
 	TRACE_MARK_ONESHOT("conductor", "frame-over", TRACE_SYS_DEFAULT, 0, conductor.set_deadline, "");
 
 	valid_cycle = true;
@@ -700,6 +809,11 @@ void arcan_conductor_fakesynch(uint8_t left)
 		TRACE_SYS_SLOW, 0, left, "fake synch");
 }
 
+struct arcan_frameserver_histogram* arcan_conductor_compose_histogram()
+{
+	return &conductor.compose;
+}
+
 void arcan_conductor_deadline(uint8_t deadline)
 {
 	if (conductor.set_deadline == -1 || deadline < conductor.set_deadline){
@@ -730,6 +844,7 @@ static void conductor_cycle(int nticks)
 
 	arcan_lua_tick(main_lua_context, nticks, conductor.tick_count);
 	outcb(nticks);
+	platform_launch_prefork_tick();
 
 	while(nticks--)
 		arcan_mem_tick();
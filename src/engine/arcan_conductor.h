@@ -123,6 +123,11 @@ void arcan_conductor_fakesynch(uint8_t left_ms);
  * strategy so permits */
 void arcan_conductor_focus(struct arcan_frameserver* fsrv);
 
+/* Retrieve the histogram of composition (platform video synch) costs used
+ * as part of the 'deadline' synchronization strategy. The per-client render
+ * and transfer histograms are tracked in the frameserver timing field. */
+struct arcan_frameserver_histogram* arcan_conductor_compose_histogram();
+
 /* add a frameserver to the set of external data sources that should be
  * monitored for transfer requests and resize/renegotiation, invoked when a
  * frameserver structure is built and activated */
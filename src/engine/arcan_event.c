@@ -24,6 +24,10 @@
 #include <assert.h>
 #include <signal.h>
 
+#ifdef __LINUX
+#include <sys/epoll.h>
+#endif
+
 /*
  * fixed limit of allowed events in queue before we need to do something more
  * aggressive (flush queue to script, blacklist noisy sources, rate- limit
@@ -72,15 +76,43 @@ static struct arcan_evctx default_evctx = {
  * cleanly based on a certain keybinding */
 static int panic_keysym = -1, panic_keymod = -1;
 
-/* fixed size 64 entries bitmap for dynamic event source tracking */
+/*
+ * Dynamic event source registry, indexed by descriptor so that the tag lookup
+ * for a ready source is O(1). On linux readiness comes from a persistent epoll
+ * set so the cost of a wakeup depends on the number of ready sources rather
+ * than the number of registered ones, elsewhere a pollset is rebuilt only when
+ * the registry changes.
+ */
 struct evsrc_meta {
-	intptr_t tag;
-	mode_t mode;
+	int mask;
+	intptr_t tag_in;
+	intptr_t tag_out;
+	arcan_event_source_handler handler;
+
+/* epoll refuses regular files, poll always treats them as ready */
+	bool always;
 };
 
-static struct pollfd evsrc_pollset[64];
-static struct evsrc_meta evsrc_meta[64];
-static uint64_t evsrc_bitmap;
+static struct {
+	struct evsrc_meta* meta;
+	size_t meta_sz;
+	size_t count;
+
+	int* always;
+	size_t always_used, always_sz;
+
+#ifdef __LINUX
+	int epfd;
+#else
+	struct pollfd* pset;
+	size_t pset_sz, pset_used;
+	bool dirty;
+#endif
+} evsrc = {
+#ifdef __LINUX
+	.epfd = -1
+#endif
+};
 
 arcan_evctx* arcan_event_defaultctx(){
 	return &default_evctx;
@@ -120,7 +152,7 @@ int arcan_event_poll(arcan_evctx* ctx, struct arcan_event* dst)
  * wake the guard thread that will try to safely shut down */
 	if (ctx->local == false){
 		FORCE_SYNCH();
-		if ( *(ctx->front) > PP_QUEUE_SZ ){
+		if ( *(ctx->front) >= PP_QUEUE_SZ ){
 			pull_killswitch(ctx);
 			return 0;
 		}
@@ -324,7 +356,7 @@ int arcan_event_queuetransfer(arcan_evctx* dstqueue, arcan_evctx* srcqueue,
 		|| (srcqueue && !srcqueue->back))
 		return 0;
 
-	bool wake = false;
+	size_t polled = 0;
 	bool drain = false;
 
 /* If we set negative saturation, it means that it is permitted for this source
@@ -344,6 +376,7 @@ int arcan_event_queuetransfer(arcan_evctx* dstqueue, arcan_evctx* srcqueue,
 		arcan_event inev;
 		if (arcan_event_poll(srcqueue, &inev) == 0)
 			break;
+		polled++;
 
 /* Ioevents have special behavior as the routed path (via frameserver callback
  * or global event handler) can be decided here: if raw transfers have been
@@ -388,7 +421,7 @@ int arcan_event_queuetransfer(arcan_evctx* dstqueue, arcan_evctx* srcqueue,
 				case EVENT_EXTERNAL_BUFFERSTREAM:
 /* this assumes that we are in non-blocking state and that a single CMSG on a
  * socket is sufficient for a non-blocking recvmsg */
-					wake = append_bufferstream(tgt, &inev.ext);
+					append_bufferstream(tgt, &inev.ext);
 					continue;
 				break;
 
@@ -412,7 +445,6 @@ int arcan_event_queuetransfer(arcan_evctx* dstqueue, arcan_evctx* srcqueue,
 					if (tgt->flags.autoclock && !inev.ext.clock.once){
 						tgt->clock.frame = inev.ext.clock.dynamic;
 						tgt->clock.left = tgt->clock.start = inev.ext.clock.rate;
-						wake = true;
 						continue;
 					}
 				break;
@@ -451,7 +483,6 @@ int arcan_event_queuetransfer(arcan_evctx* dstqueue, arcan_evctx* srcqueue,
 		else if (inev.category == EVENT_IO && tgt){
 			inev.io.subid = tgt->vid;
 		}
-		wake = true;
 
 /* it might be slightly faster to drain multiple events here, but since the
  * source might be mapped to an untrusted in-memory queue it would still take a
@@ -497,8 +528,17 @@ int arcan_event_queuetransfer(arcan_evctx* dstqueue, arcan_evctx* srcqueue,
 		arcan_event_enqueue(dstqueue, &inev);
 	}
 
-	if (wake)
-		arcan_sem_post(srcqueue->synch.handle);
+/* The source only sleeps on the semaphore when it finds its queue full, so
+ * post when every slot that was freed here has been refilled (the queue was
+ * or became full during the transfer) rather than once per transfer, which
+ * would just build up a count for the next full-queue wait to spin through */
+	if (polled){
+		FORCE_SYNCH();
+		size_t free_slots = (*srcqueue->front +
+			srcqueue->eventbuf_sz - *srcqueue->back - 1) % srcqueue->eventbuf_sz;
+		if (free_slots <= polled)
+			arcan_sem_post(srcqueue->synch.handle);
+	}
 
 	return tgt->fuse_blown ? -2 : 0;
 }
@@ -710,75 +750,286 @@ bool arcan_event_feed(struct arcan_evctx* ctx,
 static int mode_to_poll(mode_t mode)
 {
 	if (mode == O_RDWR)
-		mode = POLLIN | POLLOUT;
+		return POLLIN | POLLOUT;
 	else if (mode == O_WRONLY)
-		mode = POLLOUT;
-	else if (mode == O_RDONLY)
-		mode = POLLIN;
-	return mode | POLLERR | POLLHUP;
+		return POLLOUT;
+	return POLLIN;
 }
 
-bool arcan_event_add_source(
-	struct arcan_evctx* ctx, int fd, mode_t mode, intptr_t otag)
+static struct evsrc_meta* evsrc_get(int fd, bool alloc)
 {
-	int mask = 0;
-	mode = mode_to_poll(mode);
+	if (fd < 0)
+		return NULL;
 
-/* allocate new */
-	uint64_t i = __builtin_ffsll(~evsrc_bitmap);
-	if (!i)
-		return false;
+	if ((size_t) fd < evsrc.meta_sz)
+		return &evsrc.meta[fd];
+
+	if (!alloc)
+		return NULL;
 
-	i--;
-	evsrc_pollset[i].fd = fd;
-	evsrc_pollset[i].events = mode;
-	evsrc_meta[i].mode = mode;
-	evsrc_meta[i].tag = otag;
-	evsrc_bitmap |= (uint64_t)1 << i;
+	size_t new_sz = evsrc.meta_sz ? evsrc.meta_sz : 64;
+	while (new_sz <= (size_t) fd)
+		new_sz *= 2;
 
+	struct evsrc_meta* new_meta = arcan_alloc_mem(
+		sizeof(struct evsrc_meta) * new_sz, ARCAN_MEM_VSTRUCT,
+		ARCAN_MEM_BZERO | ARCAN_MEM_NONFATAL, ARCAN_MEMALIGN_NATURAL
+	);
+	if (!new_meta)
+		return NULL;
+
+	if (evsrc.meta){
+		memcpy(new_meta, evsrc.meta, sizeof(struct evsrc_meta) * evsrc.meta_sz);
+		arcan_mem_free(evsrc.meta);
+	}
+
+	evsrc.meta = new_meta;
+	evsrc.meta_sz = new_sz;
+	return &evsrc.meta[fd];
+}
+
+static bool always_add(int fd)
+{
+	if (evsrc.always_used == evsrc.always_sz){
+		size_t new_sz = evsrc.always_sz ? evsrc.always_sz * 2 : 8;
+		int* new_set = arcan_alloc_mem(sizeof(int) * new_sz,
+			ARCAN_MEM_VSTRUCT, ARCAN_MEM_NONFATAL, ARCAN_MEMALIGN_NATURAL);
+		if (!new_set)
+			return false;
+
+		if (evsrc.always){
+			memcpy(new_set, evsrc.always, sizeof(int) * evsrc.always_used);
+			arcan_mem_free(evsrc.always);
+		}
+		evsrc.always = new_set;
+		evsrc.always_sz = new_sz;
+	}
+
+	evsrc.always[evsrc.always_used++] = fd;
 	return true;
 }
 
-void arcan_event_poll_sources(struct arcan_evctx* ctx, int timeout)
+static void always_del(int fd)
 {
-	ssize_t nelem = poll(evsrc_pollset, 64, timeout);
-	if (nelem <= 0){
-		if (timeout > 0)
-			arcan_timesleep(timeout);
-		return;
+	for (size_t i = 0; i < evsrc.always_used; i++)
+		if (evsrc.always[i] == fd){
+			evsrc.always[i] = evsrc.always[--evsrc.always_used];
+			return;
+		}
+}
+
+/* synch the monitored mask of [fd] with the backend, [old] is the previous */
+static bool evsrc_commit(int fd, struct evsrc_meta* meta, int old)
+{
+	if (meta->always){
+		if (!meta->mask){
+			always_del(fd);
+			meta->always = false;
+		}
+		return true;
 	}
 
-	for (size_t i = 0; i < 64; i++){
-		struct pollfd* ent = &evsrc_pollset[i];
-		if (ent->fd <= 0 || !ent->revents)
-			continue;
+#ifdef __LINUX
+	if (-1 == evsrc.epfd){
+		evsrc.epfd = epoll_create1(EPOLL_CLOEXEC);
+		if (-1 == evsrc.epfd){
+			arcan_warning("event_add_source(), couldn't create epoll set\n");
+			return false;
+		}
+	}
 
-		struct arcan_event ev = (struct arcan_event){
-			.category = EVENT_SYSTEM,
-			.sys.data.fd = evsrc_pollset[i].fd,
-			.sys.data.otag = evsrc_meta[i].tag
-		};
+	struct epoll_event ev = {
+		.events = ((meta->mask & POLLIN) ? EPOLLIN : 0) |
+			((meta->mask & POLLOUT) ? EPOLLOUT : 0),
+		.data.fd = fd
+	};
+
+	int op = !meta->mask ? EPOLL_CTL_DEL : (old ? EPOLL_CTL_MOD : EPOLL_CTL_ADD);
+	if (-1 == epoll_ctl(evsrc.epfd, op, fd, &ev)){
+		if (op == EPOLL_CTL_ADD && errno == EPERM && always_add(fd)){
+			meta->always = true;
+			return true;
+		}
+/* the descriptor might already have been closed, that removes it from the set */
+		return op == EPOLL_CTL_DEL;
+	}
+#else
+	evsrc.dirty = true;
+#endif
+
+	return true;
+}
+
+static bool add_source(int fd, mode_t mode,
+	arcan_event_source_handler handler, intptr_t otag)
+{
+	struct evsrc_meta* meta = evsrc_get(fd, true);
+	if (!meta)
+		return false;
+
+	int old = meta->mask;
+	int mask = mode_to_poll(mode);
+
+	meta->mask |= mask;
+	meta->handler = handler;
+	if (mask & POLLIN)
+		meta->tag_in = otag;
+	if (mask & POLLOUT)
+		meta->tag_out = otag;
+
+	if (old == meta->mask)
+		return true;
+
+	if (!evsrc_commit(fd, meta, old)){
+		*meta = (struct evsrc_meta){0};
+		return false;
+	}
+
+	if (!old)
+		evsrc.count++;
+
+	return true;
+}
+
+bool arcan_event_add_source(
+	struct arcan_evctx* ctx, int fd, mode_t mode, intptr_t otag)
+{
+	return add_source(fd, mode, NULL, otag);
+}
+
+bool arcan_event_add_handler(struct arcan_evctx* ctx,
+	int fd, mode_t mode, arcan_event_source_handler handler, intptr_t tag)
+{
+	return add_source(fd, mode, handler, tag);
+}
+
+static void dispatch_source(struct arcan_evctx* ctx, int fd, int revents)
+{
+	struct evsrc_meta* meta = evsrc_get(fd, false);
+	if (!meta || !meta->mask)
+		return;
 
 /* Note that we send IN/OUT even in the case of failure. This is to force the
  * recipient to use normal error handling for read/write to react to a
  * monitored source failing. */
-		if (ent->revents & POLLIN ||
-			((ent->revents & (POLLERR | POLLHUP)) && (ent->events & POLLIN))){
-				ev.sys.kind = EVENT_SYSTEM_DATA_IN;
-				arcan_event_denqueue(ctx, &ev);
-			}
+	bool in = (revents & POLLIN) ||
+		((revents & (POLLERR | POLLHUP)) && (meta->mask & POLLIN));
+	bool out = (revents & POLLOUT) ||
+		((revents & (POLLERR | POLLHUP)) && (meta->mask & POLLOUT));
+
+	if (meta->handler){
+		meta->handler(ctx, fd, revents & (POLLIN | POLLOUT | POLLERR | POLLHUP),
+			meta->tag_in ? meta->tag_in : meta->tag_out);
+		return;
+	}
+
+	struct arcan_event ev = (struct arcan_event){
+		.category = EVENT_SYSTEM,
+		.sys.data.fd = fd,
+		.sys.data.otag = meta->tag_in
+	};
+
+	if (in && (meta->mask & POLLIN)){
+		ev.sys.kind = EVENT_SYSTEM_DATA_IN;
+		arcan_event_denqueue(ctx, &ev);
+	}
 
 /* This is subtle - the events here go direct to drain. That means that
  * infinitely many calls to add_source and del_source can happen between these
  * two, possibly changing the otag being used to map to VM objects. Removing
- * the source is save though, as the pollset is cleared when the source is
- * removed, and this condition won't fire an extraneous event. */
-		if (ent->revents & POLLOUT ||
-			((ent->revents & (POLLERR | POLLHUP)) && (ent->events & POLLOUT))){
-			ev.sys.kind = EVENT_SYSTEM_DATA_OUT;
-			arcan_event_denqueue(ctx, &ev);
+ * the source is safe though as the registry entry is cleared when the source
+ * is removed, and this condition won't fire an extraneous event. */
+	meta = evsrc_get(fd, false);
+	if (!meta || !(meta->mask & POLLOUT) || !out)
+		return;
+
+	ev.sys.kind = EVENT_SYSTEM_DATA_OUT;
+	ev.sys.data.otag = meta->tag_out;
+	arcan_event_denqueue(ctx, &ev);
+}
+
+void arcan_event_poll_sources(struct arcan_evctx* ctx, int timeout)
+{
+/* sources that can't be waited on are always ready, so don't block on them */
+	if (evsrc.always_used)
+		timeout = 0;
+
+	if (!evsrc.count){
+		if (timeout > 0)
+			arcan_timesleep(timeout);
+		return;
+	}
+
+/* dispatch might modify the set, so work on a copy */
+	if (evsrc.always_used){
+		size_t n = evsrc.always_used;
+		int fds[n];
+		memcpy(fds, evsrc.always, sizeof(int) * n);
+		for (size_t i = 0; i < n; i++){
+			struct evsrc_meta* meta = evsrc_get(fds[i], false);
+			if (meta && meta->always)
+				dispatch_source(ctx, fds[i], meta->mask);
 		}
 	}
+
+#ifdef __LINUX
+/* level triggered, so sources beyond the batch size are picked up next call
+ * and epoll rotates the ready list to avoid starving those */
+	struct epoll_event evs[64];
+	int nelem = evsrc.epfd == -1 ?
+		0 : epoll_wait(evsrc.epfd, evs, COUNT_OF(evs), timeout);
+
+	if (nelem <= 0){
+		if (nelem == -1 && timeout > 0 && errno != EINTR)
+			arcan_timesleep(timeout);
+		return;
+	}
+
+	for (size_t i = 0; i < (size_t) nelem; i++){
+		int revents =
+			((evs[i].events & EPOLLIN) ? POLLIN : 0) |
+			((evs[i].events & EPOLLOUT) ? POLLOUT : 0) |
+			((evs[i].events & EPOLLERR) ? POLLERR : 0) |
+			((evs[i].events & EPOLLHUP) ? POLLHUP : 0);
+		dispatch_source(ctx, evs[i].data.fd, revents);
+	}
+#else
+	if (evsrc.dirty){
+		if (evsrc.pset_sz < evsrc.count){
+			arcan_mem_free(evsrc.pset);
+			evsrc.pset_sz = evsrc.count * 2;
+			evsrc.pset = arcan_alloc_mem(sizeof(struct pollfd) * evsrc.pset_sz,
+				ARCAN_MEM_VSTRUCT, ARCAN_MEM_BZERO, ARCAN_MEMALIGN_NATURAL);
+		}
+
+		evsrc.pset_used = 0;
+		for (size_t i = 0; i < evsrc.meta_sz; i++){
+			if (!evsrc.meta[i].mask || evsrc.meta[i].always)
+				continue;
+
+			evsrc.pset[evsrc.pset_used++] = (struct pollfd){
+				.fd = i,
+				.events = evsrc.meta[i].mask | POLLERR | POLLHUP
+			};
+		}
+		evsrc.dirty = false;
+	}
+
+	ssize_t nelem = poll(evsrc.pset, evsrc.pset_used, timeout);
+	if (nelem <= 0){
+		if (nelem == -1 && timeout > 0 && errno != EINTR)
+			arcan_timesleep(timeout);
+		return;
+	}
+
+	for (size_t i = 0; i < evsrc.pset_used && nelem; i++){
+		if (!evsrc.pset[i].revents)
+			continue;
+
+		nelem--;
+		dispatch_source(ctx, evsrc.pset[i].fd, evsrc.pset[i].revents);
+	}
+#endif
 }
 
 /* Remove a source previously added through add_source. Will return true if
@@ -786,20 +1037,30 @@ void arcan_event_poll_sources(struct arcan_evctx* ctx, int timeout)
 bool arcan_event_del_source(
 	struct arcan_evctx* ctx, int fd, mode_t mode, intptr_t* out)
 {
-	mode = mode_to_poll(mode);
-	for (uint64_t i = 0; i < 64; i++){
-		if (evsrc_pollset[i].fd == fd && evsrc_pollset[i].events == mode){
-			evsrc_pollset[i].fd = -1;
-			evsrc_bitmap &= ~((uint64_t)1 << i);
-			if (out)
-				*out = evsrc_meta[i].tag;
-			evsrc_meta[i] = (struct evsrc_meta){0};
-			evsrc_pollset[i] = (struct pollfd){0};
-			return true;
-		}
+	struct evsrc_meta* meta = evsrc_get(fd, false);
+	int mask = mode_to_poll(mode);
+
+	if (!meta || (meta->mask & mask) != mask)
+		return false;
+
+	if (out)
+		*out = (mask & POLLIN) ? meta->tag_in : meta->tag_out;
+
+	int old = meta->mask;
+	meta->mask &= ~mask;
+	if (mask & POLLIN)
+		meta->tag_in = 0;
+	if (mask & POLLOUT)
+		meta->tag_out = 0;
+
+	evsrc_commit(fd, meta, old);
+
+	if (!meta->mask){
+		*meta = (struct evsrc_meta){0};
+		evsrc.count--;
 	}
 
-	return false;
+	return true;
 }
 
 void arcan_event_setdrain(arcan_evctx* ctx, arcan_event_handler drain)
@@ -60,6 +60,17 @@ float arcan_event_process(struct arcan_evctx*, arcan_tick_cb);
 bool arcan_event_add_source(
 	struct arcan_evctx*, int fd, mode_t mode, intptr_t otag);
 
+/* Platform variant of add_source. Rather than queueing DATA_IN/DATA_OUT events,
+ * [handler] is invoked from within poll_sources with the poll(2) style mask of
+ * what triggered (POLLIN, POLLOUT, POLLERR, POLLHUP) and the tag. This is used
+ * for sources that are serviced inside the engine, e.g. input devices, so that
+ * they share the same wakeup as script-monitored descriptors. Remove with
+ * del_source as usual. */
+typedef void (*arcan_event_source_handler)(
+	struct arcan_evctx*, int fd, int mask, intptr_t tag);
+bool arcan_event_add_handler(struct arcan_evctx*,
+	int fd, mode_t mode, arcan_event_source_handler handler, intptr_t tag);
+
 /* Remove a source previously added through add_source. Will return true if
  * the source existed and set the last known otag in *out if provided. Since
  * the same descriptor can be registered multiple times (each with a different
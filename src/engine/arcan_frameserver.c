@@ -19,6 +19,8 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <fcntl.h>
+#include <poll.h>
 
 #include "arcan_math.h"
 #include "arcan_general.h"
@@ -59,6 +61,7 @@ static inline void emit_deliveredframe(arcan_frameserver* src,
 	unsigned long long pts, unsigned long long framecount);
 static inline void emit_droppedframe(arcan_frameserver* src,
 	unsigned long long pts, unsigned long long framecount);
+static void wake_drop(struct arcan_frameserver* tgt);
 
 static void autoclock_frame(arcan_frameserver* tgt)
 {
@@ -106,6 +109,7 @@ arcan_errc arcan_frameserver_free(arcan_frameserver* src)
 
 	arcan_conductor_deregister_frameserver(src);
 	arcan_frameserver_close_bufferqueues(src, true, true);
+	wake_drop(src);
 
 	arcan_aobj_id aid = src->aid;
 	uintptr_t tag = src->tag;
@@ -619,6 +623,162 @@ static void flush_queued(arcan_frameserver* tgt)
 		sizeof(struct arcan_event) * tgt->n_pending);
 }
 
+static void wake_drop(struct arcan_frameserver* tgt)
+{
+	if (tgt->wake.fd != BADFD){
+		arcan_event_del_source(arcan_event_defaultctx(), tgt->wake.fd, O_RDONLY, NULL);
+		close(tgt->wake.fd);
+	}
+
+	tgt->wake.fd = BADFD;
+	tgt->wake.capable = false;
+	tgt->wake.pending = false;
+}
+
+static void wake_handler(struct arcan_evctx* ctx, int fd, int mask, intptr_t tag)
+{
+	struct arcan_frameserver* tgt = (struct arcan_frameserver*) tag;
+
+/* the client closed its end, fall back to checking the page every cycle and
+ * leave detecting the dead client to the normal liveness checks */
+	if (mask & (POLLERR | POLLHUP)){
+		wake_drop(tgt);
+		return;
+	}
+
+	char buf[64];
+	while (read(fd, buf, sizeof(buf)) > 0){}
+
+	tgt->wake.capable = true;
+	tgt->wake.pending = true;
+}
+
+/*
+ * Hand the client one end of a socketpair that it pokes after setting any of
+ * the readiness flags. A socket rather than a pipe so that the client can
+ * write without risking SIGPIPE should we have dropped our end. This is done
+ * again if the connection is replaced as the new client might not be the one
+ * that had the descriptor.
+ */
+static void wake_setup(struct arcan_frameserver* tgt)
+{
+	wake_drop(tgt);
+	tgt->wake.dpipe = tgt->dpipe;
+
+	int pair[2];
+	if (-1 == socketpair(AF_UNIX, SOCK_STREAM, 0, pair))
+		return;
+
+	for (size_t i = 0; i < 2; i++){
+		fcntl(pair[i], F_SETFD, FD_CLOEXEC);
+		fcntl(pair[i], F_SETFL, O_NONBLOCK);
+#ifdef __APPLE__
+		int val = 1;
+		setsockopt(pair[i], SOL_SOCKET, SO_NOSIGPIPE, &val, sizeof(int));
+#endif
+	}
+
+	if (!arcan_event_add_handler(arcan_event_defaultctx(),
+		pair[0], O_RDONLY, wake_handler, (intptr_t) tgt)){
+		close(pair[0]);
+		close(pair[1]);
+		return;
+	}
+	tgt->wake.fd = pair[0];
+
+	if (ARCAN_OK != platform_fsrv_pushfd(tgt, &(struct arcan_event){
+		.category = EVENT_TARGET,
+		.tgt.kind = TARGET_COMMAND_DEVICE_NODE,
+		.tgt.ioevs[0].iv = pair[1],
+		.tgt.ioevs[1].iv = 6
+	}, pair[1])){
+		wake_drop(tgt);
+	}
+
+	close(pair[1]);
+}
+
+bool arcan_frameserver_pollready(struct arcan_frameserver* tgt)
+{
+	struct arcan_shmif_page* shmpage = tgt->shm.ptr;
+
+/* anything not in the connected 'steady' state is left to the feed function */
+	if (!shmpage || tgt->segid == SEGID_UNKNOWN || tgt->n_pending ||
+		(tgt->flags.autoclock && tgt->clock.frame))
+		return true;
+
+	if (tgt->wake.dpipe != tgt->dpipe)
+		wake_setup(tgt);
+
+/* nothing has been signalled since the page was last found idle */
+	if (tgt->wake.capable && !tgt->wake.pending)
+		return false;
+
+/* the page is client controlled and can be truncated under us, on SIGBUS
+ * report ready so that the feed function gets to deal with the dead client */
+	TRAMP_GUARD(true, tgt);
+
+	bool ready = shmpage->resized ||
+		atomic_load_explicit(&shmpage->vready, memory_order_acquire) ||
+		atomic_load_explicit(&shmpage->aready, memory_order_acquire);
+
+	platform_fsrv_leave();
+
+/* the client sets the flags before writing to the pipe, so a signal that
+ * races this check will still be picked up by the handler */
+	if (!ready)
+		tgt->wake.pending = false;
+
+	return ready;
+}
+
+void arcan_frameserver_histogram_add(
+	struct arcan_frameserver_histogram* hist,
+	unsigned long long us, uint32_t unit_us)
+{
+/* unit changes invalidates the distribution */
+	if (hist->unit_us != unit_us){
+		memset(hist, '\0', sizeof(struct arcan_frameserver_histogram));
+		hist->unit_us = unit_us;
+	}
+
+	size_t bin = us / unit_us;
+	if (bin >= FSRV_HISTOGRAM_BINS)
+		bin = FSRV_HISTOGRAM_BINS - 1;
+
+/* decay by halving so that old samples fade out, this keeps the bins within
+ * 16-bit range and lets the prediction follow changes in client behaviour */
+	if (hist->total >= 1024 || hist->bins[bin] == UINT16_MAX){
+		hist->total = 0;
+		for (size_t i = 0; i < FSRV_HISTOGRAM_BINS; i++){
+			hist->bins[i] >>= 1;
+			hist->total += hist->bins[i];
+		}
+	}
+
+	hist->bins[bin]++;
+	hist->total++;
+}
+
+unsigned long long arcan_frameserver_histogram_pct(
+	struct arcan_frameserver_histogram* hist, float pct)
+{
+	if (!hist->total)
+		return 0;
+
+	uint32_t lim = (float)hist->total * pct;
+	uint32_t acc = 0;
+
+/* return the upper edge of the bin so the prediction is conservative */
+	for (size_t i = 0; i < FSRV_HISTOGRAM_BINS; i++){
+		acc += hist->bins[i];
+		if (acc > lim)
+			return (unsigned long long)(i + 1) * hist->unit_us;
+	}
+
+	return (unsigned long long) FSRV_HISTOGRAM_BINS * hist->unit_us;
+}
+
 enum arcan_ffunc_rv arcan_frameserver_emptyframe FFUNC_HEAD
 {
 	arcan_frameserver* tgt = state.ptr;
@@ -678,6 +838,7 @@ int arcan_frameserver_releaselock(struct arcan_frameserver* tgt)
 	tgt->flags.release_pending = false;
 	TRAMP_GUARD(0, tgt);
 
+	tgt->timing.released = arcan_timemicros();
 	atomic_store_explicit(&tgt->shm.ptr->vready, 0, memory_order_release);
 	arcan_sem_post( tgt->vsync );
 		if (tgt->desc.hints & SHMIF_RHINT_VSIGNAL_EV){
@@ -748,6 +909,14 @@ enum arcan_ffunc_rv arcan_frameserver_vdirect FFUNC_HEAD
  * initiated or not */
 		rv = (tgt->shm.ptr->vready &&
 			!tgt->flags.release_pending) ? FRV_GOTFRAME : FRV_NOFRAME;
+
+/* first sighting of a new frame since the client was woken up gives the
+ * render time sample that the conductor uses for wakeup scheduling */
+		if (rv == FRV_GOTFRAME && tgt->timing.released){
+			arcan_frameserver_histogram_add(&tgt->timing.render,
+				arcan_timemicros() - tgt->timing.released, 1000);
+			tgt->timing.released = 0;
+		}
 	break;
 
 	case FFUNC_TICK:
@@ -794,10 +963,17 @@ enum arcan_ffunc_rv arcan_frameserver_vdirect FFUNC_HEAD
  * to be repeat until it succeeds - this mechanism could/should(?) also
  * be used with the vpts- below, simply defer until the deadline has
  * passed */
-		if (g_buffers_locked == 1 || tgt->flags.locked || !push_buffer(tgt,
-				dst_store, shmpage->hints & SHMIF_RHINT_SUBREGION ? &dirty : NULL)){
+		if (g_buffers_locked == 1 || tgt->flags.locked)
+			goto no_out;
+
+		unsigned long long xfer_start = arcan_timemicros();
+		if (!push_buffer(tgt,
+			dst_store, shmpage->hints & SHMIF_RHINT_SUBREGION ? &dirty : NULL)){
 			goto no_out;
 		}
+		tgt->timing.transferred = arcan_timemicros();
+		arcan_frameserver_histogram_add(&tgt->timing.transfer,
+			tgt->timing.transferred - xfer_start, 250);
 
 /* for tighter latency management, here is where the estimated next
  * synch deadline for any output it is used on could/should be set,
@@ -815,6 +991,7 @@ enum arcan_ffunc_rv arcan_frameserver_vdirect FFUNC_HEAD
 		if (g_buffers_locked != 2){
 			atomic_store_explicit(&shmpage->vready, 0, memory_order_release);
 
+			tgt->timing.released = arcan_timemicros();
 			arcan_sem_post( tgt->vsync );
 			if (tgt->desc.hints & SHMIF_RHINT_VSIGNAL_EV){
 				TRACE_MARK_ONESHOT("frameserver", "signal", TRACE_SYS_DEFAULT, tgt->vid, 0, "");
@@ -958,7 +1135,18 @@ enum arcan_ffunc_rv arcan_frameserver_avfeedframe FFUNC_HEAD
  */
 	else if (cmd == FFUNC_READBACK){
 		if (src->shm.ptr && !src->shm.ptr->vready){
-			memcpy(src->vbufs[0], buf, buf_sz);
+/* with a region set, only that part of [buf] is defined (see agp_request_
+ * readback) and the rest of the client buffer is left as it was */
+			struct arcan_shmif_region* r = &src->desc.region;
+			if (src->desc.region_valid && r->x2 <= width && r->y2 <= height &&
+				r->x1 < r->x2 && r->y1 < r->y2 && buf_sz == width * height * sizeof(av_pixel)){
+				for (size_t y = r->y1; y < r->y2; y++)
+					memcpy(&src->vbufs[0][y * width + r->x1],
+						&buf[y * width + r->x1], (r->x2 - r->x1) * sizeof(av_pixel));
+			}
+			else
+				memcpy(src->vbufs[0], buf, buf_sz);
+
 			if (src->ofs_audb){
 				memcpy(src->abufs[0], src->audb, src->ofs_audb);
 				src->shm.ptr->abufused[0] = src->ofs_audb;
@@ -26,6 +26,19 @@ enum arcan_playstate {
 	ARCAN_PAUSED = 3
 };
 
+/*
+ * Fixed-bin timing histogram used by the conductor to predict per-feed
+ * render and transfer times. Bins are [unit_us] wide with the last bin
+ * acting as overflow, and the counts are halved when [total] saturates so
+ * that the distribution follows the recent behaviour of the client.
+ */
+#define FSRV_HISTOGRAM_BINS 32
+struct arcan_frameserver_histogram {
+	uint16_t bins[FSRV_HISTOGRAM_BINS];
+	uint32_t total;
+	uint32_t unit_us;
+};
+
 /*
  * This substructure is a cache of the negotiated state, i.e.  the server side
  * view of the agreed upon use and limits of the contents of the shared memory
@@ -179,6 +192,26 @@ struct arcan_frameserver {
 		int activated;
 	} flags;
 
+/* client render time (release to next frame) and buffer transfer time,
+ * sampled by vdirect and consumed by the deadline synch strategy */
+	struct {
+		unsigned long long released;
+		unsigned long long transferred;
+		struct arcan_frameserver_histogram render;
+		struct arcan_frameserver_histogram transfer;
+	} timing;
+
+/* readiness signalling: the other end of [fd] is handed to the client over
+ * [dpipe] and written to whenever it sets vready, aready or resized. Once it
+ * has been seen working ([capable]), the page is only inspected when the
+ * client has [pending] signals rather than every cycle */
+	struct {
+		file_handle fd;
+		file_handle dpipe;
+		bool capable;
+		bool pending;
+	} wake;
+
 /* if autoclock is set, track and use as metric for firing events */
 	struct {
 		uint32_t left;
@@ -502,6 +535,27 @@ void arcan_frameserver_displayhint(
  */
 void arcan_frameserver_lock_buffers(int state);
 
+/*
+ * Check if a FFUNC_POLL on the frameserver would have anything to do (new
+ * audio/video buffers, resize request, queued events, clocking). Clients that
+ * signal through the wake descriptor (see the wake member) are answered from
+ * local state without touching the shared page until they have signalled,
+ * others get their page flags checked. Returns true if the frameserver should
+ * be polled.
+ */
+bool arcan_frameserver_pollready(struct arcan_frameserver* tgt);
+
+/*
+ * Add a sample (in microseconds) to a timing histogram with bins that are
+ * [unit_us] wide, and retrieve the sample value (in microseconds) below
+ * which [pct] (0..1) of the recorded samples fall. An empty histogram
+ * returns 0.
+ */
+void arcan_frameserver_histogram_add(
+	struct arcan_frameserver_histogram*, unsigned long long us, uint32_t unit_us);
+unsigned long long arcan_frameserver_histogram_pct(
+	struct arcan_frameserver_histogram*, float pct);
+
 /*
  * IF the frameserver is in pending-release state, this will send signals
  * unlock semaphores and clear the flag. This is used in combination with
@@ -523,6 +577,14 @@ arcan_frameserver* platform_launch_internal(const char* fname,
 	struct arcan_strarr* argv, struct arcan_strarr* envv,
 	struct arcan_strarr* libs, uintptr_t tag);
 
+/*
+ * Maintain the pool of pre-forked builtin frameservers that platform_launch_
+ * fork claims from (if configured), refilling at most one entry per call.
+ * Flush kills and releases the waiting entries.
+ */
+void platform_launch_prefork_tick();
+void platform_launch_prefork_flush();
+
 /*
  * Working against the mapped shared memory page is a critical section,
  * there are corner cases and DoS opportunities that could be exploited
@@ -52,6 +52,7 @@
 #define NULFILE "/dev/null"
 #define BROKEN_PROCESS_HANDLE -1
 
+#include <stdio.h>
 #include <semaphore.h>
 #include <getopt.h>
 struct shm_handle {
@@ -158,18 +159,39 @@ extern bool arcan_trace_enabled;
  * to setbuffer or when the buffer is full. When that occurs finish_flag
  * is set to true and control over buf will be relinquished.
  *
+ * marks are first recorded in per-thread rings and only packed into the
+ * buffer on arcan_trace_flush (and implicitly on setbuffer).
+ *
  * the buffer will be packaged as follow:
  * [status flag] (1b) 0xff for complete, otherwise invalid and processing
  * can stop.
  * timestamp (uint64_t)
  * variable-length system marker (char*)
  * variable-length subsystem marker (char*)
+ * trigger (uint8_t)
  * tracelevel (uint8_t)
+ * identifier (uint64_t)
  * quantifier (uint32_t)
- * variable-length message (char*)
+ * thread (uint32_t), index of the ring the mark was recorded in
+ * variable-length message (char*), truncated to 35 characters
  */
 void arcan_trace_setbuffer(uint8_t* buf, size_t buf_sz, bool* finish_flag);
 
+/*
+ * move pending marks from the per-thread rings into the collection buffer,
+ * ordered by timestamp. Should be called by the owner of the buffer outside
+ * of any timing sensitive path. Marks that arrive while a ring is full are
+ * dropped and counted, see arcan_trace_dropped.
+ */
+void arcan_trace_flush();
+size_t arcan_trace_dropped();
+
+/*
+ * convert a buffer in the format above to the chrome / perfetto JSON trace
+ * event format and write into [out].
+ */
+bool arcan_trace_export_chrome(FILE* out, const uint8_t* buf, size_t buf_sz);
+
 /* add a trace entry-point (though call through the TRACE_MARK macros),
  * sys returns to the main system group (graphics, video, 3d, ...) and
  * subsys for a group specific subsystem (where useful distinctions exist).
@@ -245,6 +245,17 @@ static struct {
 
 	size_t last_clock;
 
+/* opt-in batched input delivery through the _input_batch entry point, io
+ * events are queued and coalesced here until the next flush, and the tables
+ * handed to the script are recycled through a registry-held pool */
+	struct {
+		arcan_ioevent* queue;
+		size_t used;
+		size_t size;
+		int batch_ref;
+		int pool_ref;
+	} inbatch;
+
 } luactx = {0};
 
 extern char* _n_strdup(const char* instr, const char* alt);
@@ -3935,10 +3946,8 @@ static const char* kindstr(int num)
  * primarly used for the normal appl_input callback, but may also come
  * nested from a frameserver.
  */
-static void append_iotable(lua_State* ctx, arcan_ioevent* ev)
+static void fill_iotable(lua_State* ctx, arcan_ioevent* ev, int top)
 {
-	int top = funtable(ctx, ev->kind);
-
 	lua_pushliteral(ctx, "kind");
 	if (ev->label[0] && ev->kind != EVENT_IO_STATUS &&
 		ev->label[COUNT_OF(ev->label)-1] == '\0'){
@@ -4084,6 +4093,194 @@ static void append_iotable(lua_State* ctx, arcan_ioevent* ev)
 	}
 }
 
+static void append_iotable(lua_State* ctx, arcan_ioevent* ev)
+{
+	fill_iotable(ctx, ev, funtable(ctx, ev->kind));
+}
+
+/* max number of recycled tables kept around between batches */
+#define INBATCH_POOL_LIM 256
+
+/* upper bound on queued io events before a batch is forced out */
+#define INBATCH_QUEUE_LIM 4096
+
+static void clear_table(lua_State* ctx, int ind)
+{
+/* assigning nil to existing fields during traversal is permitted */
+	lua_pushnil(ctx);
+	while (lua_next(ctx, ind)){
+		lua_pop(ctx, 1);
+		lua_pushvalue(ctx, -1);
+		lua_pushnil(ctx);
+		lua_rawset(ctx, ind);
+	}
+}
+
+static int16_t sat_add16(int16_t a, int16_t b)
+{
+	int32_t res = (int32_t) a + (int32_t) b;
+	if (res > INT16_MAX)
+		return INT16_MAX;
+	if (res < INT16_MIN)
+		return INT16_MIN;
+	return res;
+}
+
+/*
+ * Merge [ev] into a queued sample from the same device/subid if they are
+ * only separated by other samples of the same kind. For analog input the
+ * relative axes accumulate and the absolute ones take the newest value, for
+ * touch the newest position wins as long as the contact state is unchanged.
+ * Mouse motion is usually split into interleaved x/y samples on subid 0/1,
+ * which is why this looks further back than just the last entry.
+ */
+static bool coalesce_io(arcan_ioevent* ev)
+{
+	if (ev->kind != EVENT_IO_AXIS_MOVE && ev->kind != EVENT_IO_TOUCH)
+		return false;
+
+	size_t lim = luactx.inbatch.used > 8 ? luactx.inbatch.used - 8 : 0;
+	for (size_t i = luactx.inbatch.used; i > lim; i--){
+		arcan_ioevent* cur = &luactx.inbatch.queue[i-1];
+		if (cur->kind != ev->kind)
+			return false;
+
+		if (cur->devid != ev->devid ||
+			cur->subid != ev->subid || cur->devkind != ev->devkind)
+			continue;
+
+		if (ev->kind == EVENT_IO_TOUCH){
+			if (cur->input.touch.active != ev->input.touch.active)
+				return false;
+			*cur = *ev;
+			return true;
+		}
+
+		if (cur->input.analog.gotrel != ev->input.analog.gotrel ||
+			cur->input.analog.nvalues != ev->input.analog.nvalues)
+			return false;
+
+/* see the axisval layout in arcan_shmif_event.h, gotrel determines if the
+ * relative sample is first or second and 4 values carry a second axis */
+		size_t nv = ev->input.analog.nvalues;
+		size_t base = ev->input.analog.gotrel ? 0 : 1;
+		int16_t acc[4];
+		memcpy(acc, cur->input.analog.axisval, sizeof(acc));
+
+		*cur = *ev;
+		if (base < nv)
+			cur->input.analog.axisval[base] =
+				sat_add16(acc[base], ev->input.analog.axisval[base]);
+		if (nv == 4)
+			cur->input.analog.axisval[base+2] =
+				sat_add16(acc[base+2], ev->input.analog.axisval[base+2]);
+		return true;
+	}
+
+	return false;
+}
+
+static void flush_inbatch(lua_State* ctx)
+{
+	size_t n = luactx.inbatch.used;
+	if (!n)
+		return;
+
+	luactx.inbatch.used = 0;
+
+/* the entry point might have been removed since the events were queued */
+	if (!alt_lookup_entry(ctx, "input_batch", 11)){
+		for (size_t i = 0; i < n; i++){
+			if (!alt_lookup_entry(ctx, "input", 5))
+				return;
+			append_iotable(ctx, &luactx.inbatch.queue[i]);
+			alt_call(ctx, CB_SOURCE_NONE, 0, 1, 0, LINE_TAG":event:input");
+		}
+		return;
+	}
+
+	if (!luactx.inbatch.batch_ref){
+		lua_newtable(ctx);
+		luactx.inbatch.batch_ref = luaL_ref(ctx, LUA_REGISTRYINDEX);
+		lua_newtable(ctx);
+		luactx.inbatch.pool_ref = luaL_ref(ctx, LUA_REGISTRYINDEX);
+	}
+
+	lua_rawgeti(ctx, LUA_REGISTRYINDEX, luactx.inbatch.batch_ref);
+	int batch = lua_gettop(ctx);
+	lua_rawgeti(ctx, LUA_REGISTRYINDEX, luactx.inbatch.pool_ref);
+	int pool = lua_gettop(ctx);
+	size_t pool_n = lua_rawlen(ctx, pool);
+
+/* return the tables from the previous batch to the pool, this is done here
+ * rather than after the call so that a script error can't leave stale ones */
+	size_t last_n = lua_rawlen(ctx, batch);
+	for (size_t i = 1; i <= last_n; i++){
+		if (pool_n < INBATCH_POOL_LIM){
+			lua_rawgeti(ctx, batch, i);
+			lua_rawseti(ctx, pool, ++pool_n);
+		}
+		lua_pushnil(ctx);
+		lua_rawseti(ctx, batch, i);
+	}
+
+	for (size_t i = 0; i < n; i++){
+		arcan_ioevent* ev = &luactx.inbatch.queue[i];
+		int top;
+
+		if (pool_n){
+			lua_rawgeti(ctx, pool, pool_n);
+			lua_pushnil(ctx);
+			lua_rawseti(ctx, pool, pool_n--);
+			top = lua_gettop(ctx);
+			clear_table(ctx, top);
+			tblnum(ctx, "kind", ev->kind, top);
+		}
+		else
+			top = funtable(ctx, ev->kind);
+
+		fill_iotable(ctx, ev, top);
+		lua_rawseti(ctx, batch, i + 1);
+	}
+
+	lua_pop(ctx, 1);
+	lua_pushnumber(ctx, n);
+	alt_call(ctx, CB_SOURCE_NONE, 0, 2, 0, LINE_TAG":event:input_batch");
+}
+
+static void queue_inbatch(lua_State* ctx, arcan_ioevent* ev)
+{
+	if (coalesce_io(ev))
+		return;
+
+	if (luactx.inbatch.used == luactx.inbatch.size){
+		if (luactx.inbatch.size >= INBATCH_QUEUE_LIM)
+			flush_inbatch(ctx);
+		else {
+			size_t new_sz = luactx.inbatch.size ? luactx.inbatch.size * 2 : 64;
+			arcan_ioevent* new_queue = arcan_alloc_mem(
+				sizeof(arcan_ioevent) * new_sz, ARCAN_MEM_VSTRUCT,
+				ARCAN_MEM_NONFATAL, ARCAN_MEMALIGN_NATURAL
+			);
+
+			if (!new_queue){
+				flush_inbatch(ctx);
+			}
+			else {
+				if (luactx.inbatch.queue){
+					memcpy(new_queue, luactx.inbatch.queue,
+						sizeof(arcan_ioevent) * luactx.inbatch.used);
+					arcan_mem_free(luactx.inbatch.queue);
+				}
+				luactx.inbatch.queue = new_queue;
+				luactx.inbatch.size = new_sz;
+			}
+		}
+	}
+
+	luactx.inbatch.queue[luactx.inbatch.used++] = *ev;
+}
+
 #ifdef ARCAN_LWA
 void arcan_lwa_subseg_ev(
 	arcan_luactx* ctx, arcan_vobj_id source, uintptr_t cb_tag, arcan_event* ev)
@@ -4204,6 +4401,9 @@ bool arcan_lua_pushevent(lua_State* ctx, arcan_event* ev)
 	bool adopt_check = false;
 	char msgbuf[sizeof(arcan_event)+1];
 	if (!ev){
+		if (!arcan_conductor_gpus_locked())
+			flush_inbatch(ctx);
+
 		if (alt_lookup_entry(ctx, "input_end", 9)){
 			alt_call(ctx, CB_SOURCE_NONE, 0, 0, 0, LINE_TAG":event:input_eob");
 		}
@@ -4227,6 +4427,13 @@ bool arcan_lua_pushevent(lua_State* ctx, arcan_event* ev)
 			return consumed;
 		}
 
+/* batched mode takes precedence, delivery is deferred to the next flush */
+		if (alt_lookup_entry(ctx, "input_batch", 11)){
+			lua_pop(ctx, 1);
+			queue_inbatch(ctx, &ev->io);
+			return true;
+		}
+
 		if (alt_lookup_entry(ctx, "input", 5)){
 			append_iotable(ctx, &ev->io);
 			alt_call(ctx, CB_SOURCE_NONE, 0, 1, 0, LINE_TAG":event:input");
@@ -4257,6 +4464,9 @@ bool arcan_lua_pushevent(lua_State* ctx, arcan_event* ev)
 		return false;
 	}
 
+/* preserve ordering between queued input and the event about to be handled */
+	flush_inbatch(ctx);
+
 	if (ev->category == EVENT_EXTERNAL){
 		bool preroll = false;
 /* need to jump through a few hoops to get hold of the possible callback */
@@ -5325,6 +5535,9 @@ static int attrtag(lua_State* ctx)
 	if (strcmp(attr, "infinite") == 0)
 		lua_pushboolean(ctx,
 			arcan_3d_infinitemodel(did, state != 0) != ARCAN_OK);
+	else if (strcmp(attr, "cull") == 0)
+		lua_pushboolean(ctx,
+			arcan_3d_cullmodel(did, state != 0) == ARCAN_OK);
 	else
 		lua_pushboolean(ctx, false);
 
@@ -5346,6 +5559,21 @@ static int buildmodel(lua_State* ctx)
 	LUA_ETRACE("new_3dmodel", NULL, 1);
 }
 
+static int instancemodel(lua_State* ctx)
+{
+	LUA_TRACE("instance_3dmodel");
+
+	arcan_vobj_id src = luaL_checkvid(ctx, 1, NULL);
+	arcan_vobj_id id = arcan_3d_instancemodel(src);
+
+	if (id != ARCAN_EID)
+		arcan_video_objectopacity(id, 0, 0);
+
+	lua_pushvid(ctx, id);
+	trace_allocation(ctx, "instance_3dmodel", id);
+	LUA_ETRACE("instance_3dmodel", NULL, 1);
+}
+
 static int finalmodel(lua_State* ctx)
 {
 	LUA_TRACE("finalize_3dmodel");
@@ -6829,6 +7057,11 @@ void arcan_lua_shutdown(lua_State* ctx)
 	luactx.pending_socket_label = NULL;
 	luactx.pending_socket_descr = 0;
 
+/* the registry references die with the context, the queue memory is kept */
+	luactx.inbatch.used = 0;
+	luactx.inbatch.batch_ref = 0;
+	luactx.inbatch.pool_ref = 0;
+
 	lua_close(ctx);
 }
 
@@ -8172,10 +8405,18 @@ static int targetstepframe(lua_State* ctx)
 		fsrv->desc.region_valid = true;
 	}
 
-/* cascade / repeat call protection, only request read if we aren't in that
- * state already - this is for the asynch behavior */
-	if (!FL_TEST(rtgt, TGTFL_READING)){
-		agp_request_readback(rtgt->color->vstore);
+/* cascade / repeat call protection, the readback queue has a fixed depth
+ * and further requests fail until the consumer has caught up */
+	struct agp_region region, * rptr = NULL;
+	if (fsrv && fsrv->desc.region_valid){
+		region = (struct agp_region){
+			.x1 = fsrv->desc.region.x1, .y1 = fsrv->desc.region.y1,
+			.x2 = fsrv->desc.region.x2, .y2 = fsrv->desc.region.y2
+		};
+		rptr = &region;
+	}
+
+	if (agp_request_readback(rtgt->color->vstore, rptr)){
 		FL_SET(rtgt, TGTFL_READING);
 		rtgt->transfc++;
 		lua_pushboolean(ctx, true);
@@ -10214,6 +10455,15 @@ static int togglebench(lua_State* ctx)
 		LUA_ETRACE("benchmark_enable", NULL, 0);
 	}
 
+/* file form? same as callback but written out in chrome trace format */
+	if (lua_type(ctx, 1) == LUA_TNUMBER && lua_type(ctx, 2) == LUA_TSTRING){
+		size_t buf_sz = lua_tonumber(ctx, 1) * 1024;
+		if (!alt_trace_start_chrome(ctx, lua_tostring(ctx, 2), buf_sz)){
+			LUA_ETRACE("benchmark_enable", "invalid name or out-of-memory", 0);
+		}
+		LUA_ETRACE("benchmark_enable", NULL, 0);
+	}
+
 /* simple form? normal benchmarking */
 	int nargs = lua_gettop(ctx);
 
@@ -10299,6 +10549,47 @@ static int getbenchvals(lua_State* ctx)
 	LUA_ETRACE("benchmark_data", NULL, 6);
 }
 
+static void pushhistogram(lua_State* ctx,
+	struct arcan_frameserver_histogram* hist)
+{
+	lua_newtable(ctx);
+	int top = lua_gettop(ctx);
+
+	for (size_t i = 0; i < FSRV_HISTOGRAM_BINS; i++){
+		lua_pushnumber(ctx, i+1);
+		lua_pushnumber(ctx, hist->bins[i]);
+		lua_rawset(ctx, top);
+	}
+
+	tblnum(ctx, "unit", hist->unit_us, top);
+	tblnum(ctx, "samples", hist->total, top);
+	tblnum(ctx, "p50", arcan_frameserver_histogram_pct(hist, 0.5), top);
+	tblnum(ctx, "p90", arcan_frameserver_histogram_pct(hist, 0.9), top);
+	tblnum(ctx, "p99", arcan_frameserver_histogram_pct(hist, 0.99), top);
+}
+
+static int getbenchhisto(lua_State* ctx)
+{
+	LUA_TRACE("benchmark_histogram");
+
+	if (lua_type(ctx, 1) != LUA_TNUMBER){
+		pushhistogram(ctx, arcan_conductor_compose_histogram());
+		LUA_ETRACE("benchmark_histogram", NULL, 1);
+	}
+
+	arcan_vobject* vobj;
+	luaL_checkvid(ctx, 1, &vobj);
+	if (vobj->feed.state.tag != ARCAN_TAG_FRAMESERV || !vobj->feed.state.ptr)
+		arcan_fatal("benchmark_histogram(), specified vid (arg 1) is not "
+			"associated with a frameserver.");
+
+	arcan_frameserver* fsrv = vobj->feed.state.ptr;
+	pushhistogram(ctx, &fsrv->timing.render);
+	pushhistogram(ctx, &fsrv->timing.transfer);
+
+	LUA_ETRACE("benchmark_histogram", NULL, 2);
+}
+
 static int timestamp(lua_State* ctx)
 {
 	LUA_TRACE("benchmark_timestamp");
@@ -11753,6 +12044,7 @@ static const luaL_Reg imgfuns[] = {
 static const luaL_Reg threedfuns[] = {
 {"new_3dmodel",      buildmodel   },
 {"finalize_3dmodel", finalmodel   },
+{"instance_3dmodel", instancemodel},
 {"add_3dmesh",       loadmesh     },
 {"attrtag_model",    attrtag      },
 {"move3d_model",     movemodel    },
@@ -11791,6 +12083,7 @@ static const luaL_Reg sysfuns[] = {
 {"benchmark_tracedata", benchtracedata   },
 {"benchmark_timestamp", timestamp        },
 {"benchmark_data",      getbenchvals     },
+{"benchmark_histogram", getbenchhisto    },
 {"appl_arguments",      getapplarguments },
 {"system_identstr",     getidentstr      },
 {"system_defaultfont",  setdefaultfont   },
@@ -783,6 +783,7 @@ cleanup:
 	arcan_monitor_finish(exit_code == 256 || exit_code == 0);
 	arcan_mem_freearr(&arr_hooks);
 	arcan_led_shutdown();
+	platform_launch_prefork_flush();
 	arcan_event_deinit(evctx, true);
 	arcan_audio_shutdown();
 	arcan_video_shutdown(exit_code != 256);
@@ -814,6 +815,7 @@ error:
 
 /* now we can shutdown the subsystems themselves */
 	arcan_monitor_finish(false);
+	platform_launch_prefork_flush();
 	arcan_event_deinit(evctx, true);
 	arcan_mem_free(dbfname);
 	arcan_audio_shutdown();
@@ -22,6 +22,14 @@
 #define ARCAN_FONT_CACHE_LIMIT 8
 #endif
 
+#ifndef ARCAN_TEXT_CACHE_LIMIT
+#define ARCAN_TEXT_CACHE_LIMIT 64
+#endif
+
+#ifndef ARCAN_TEXT_CACHE_SIZE
+#define ARCAN_TEXT_CACHE_SIZE (16 * 1024 * 1024)
+#endif
+
 #define ARCAN_TTF
 
 #include "arcan_math.h"
@@ -117,6 +125,10 @@ static struct tui_font builtin_bitmap;
 static struct font_entry font_cache[ARCAN_FONT_CACHE_LIMIT] = {
 };
 
+/* incremented whenever the default font chain or hinting changes, or when
+ * a font slot is replaced */
+static uint64_t font_gen;
+
 static uint16_t nexthigher(uint16_t k)
 {
 	k--;
@@ -331,10 +343,11 @@ static struct font_entry* grab_font(const char* fname, size_t size)
 		return NULL;
 	}
 
-/* replace? */
+/* replace? cached text can have its end style pointing to the slot */
 	if (i == font_cache_size){
 		i = leasti;
 		zap_slot(i);
+		font_gen++;
 	}
 
 /* update counters */
@@ -367,6 +380,8 @@ bool arcan_video_defaultfont(const char* ident,
 		default_hint = hint;
 	}
 
+	font_gen++;
+
 	if (!append){
 		zap_slot(0);
 		font_cache[0].identifier = strdup(ident);
@@ -409,6 +424,8 @@ void arcan_video_reset_fontcache()
 		for (int i = 0; i < ARCAN_FONT_CACHE_LIMIT; i++)
 			zap_slot(i);
 	}
+
+	font_gen++;
 }
 
 #ifndef TEXT_EMBEDDEDICON_MAXW
@@ -1282,8 +1299,10 @@ static av_pixel* process_chain(struct rcell* root, arcan_vobject* dst,
 
 	*d_sz = *dw * *dh * sizeof(av_pixel);
 
-	if (norender)
+	if (norender){
+		arcan_mem_free(lines);
 		return (cleanup_chain(root), NULL);
+	}
 
 /* if we have a vobj set, re-use that backing store, and treat
  * it as a source-stream resize (so scaling factors etc. get reapplied) */
@@ -1352,6 +1371,345 @@ static av_pixel* process_chain(struct rcell* root, arcan_vobject* dst,
 	return (cleanup_chain(root), raw);
 }
 
+/*
+ * Rendered strings are memoized on the format string(s) along with the state
+ * that affects the raster (default font chain, density, hinting, padding) so
+ * that labels, menus and other static text that is re-rendered on every
+ * update only costs a copy. Strings that embed images or other objects are
+ * never cached as their contents can change behind our back.
+ */
+struct text_cache_entry {
+	uint64_t hash;
+	char* key;
+	size_t key_sz;
+	uint64_t last_use;
+
+/* NULL if only the dimensions are known (norender) */
+	av_pixel* raw;
+	uint32_t d_sz;
+	size_t dw, dh, maxw, maxh;
+	unsigned int n_lines;
+	struct renderline_meta* lines;
+
+/* format state at the end of the string, a hit restores it as last_style so
+ * that a following call with an empty format string continues from it */
+	struct text_format style;
+};
+
+static struct {
+	struct text_cache_entry ent[ARCAN_TEXT_CACHE_LIMIT];
+	size_t used;
+	uint64_t clock;
+	uint64_t font_gen;
+} text_cache;
+
+static size_t text_cache_cost(struct text_cache_entry* ent)
+{
+	return ent->key_sz + (ent->raw ? ent->d_sz : 0) +
+		(ent->lines ? sizeof(struct renderline_meta) * (ent->n_lines + 1) : 0);
+}
+
+static void text_cache_drop(struct text_cache_entry* ent)
+{
+	if (!ent->key)
+		return;
+
+	text_cache.used -= text_cache_cost(ent);
+	arcan_mem_free(ent->key);
+	arcan_mem_free(ent->raw);
+	arcan_mem_free(ent->lines);
+	memset(ent, '\0', sizeof(struct text_cache_entry));
+}
+
+static void text_cache_flush()
+{
+	for (size_t i = 0; i < ARCAN_TEXT_CACHE_LIMIT; i++)
+		text_cache_drop(&text_cache.ent[i]);
+	text_cache.font_gen = font_gen;
+}
+
+static bool cacheable_fmt(const char* msg)
+{
+	for (; *msg; msg++){
+		if (*msg != '\\')
+			continue;
+
+		if (msg[1] == '\\'){
+			msg++;
+			continue;
+		}
+
+		const char* cmd = &msg[1];
+		if (*cmd == '!')
+			cmd++;
+
+		if (*cmd == 'e' || *cmd == 'E' || *cmd == 'p' || *cmd == 'P')
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Build the lookup key from the raster state and the messages (even indices
+ * are format strings, odd are plain text, same as renderfmtstr_extended).
+ * Returns NULL if the request can't be cached.
+ */
+static char* text_cache_key(
+	const char** msgs, bool multiple, bool pot, size_t* key_sz)
+{
+/* cleared first as the padding is part of the key */
+	struct {
+		uint64_t font_gen;
+		float hdpi, vdpi;
+		int hint;
+		bool pot;
+		bool multiple;
+	} state;
+	memset(&state, '\0', sizeof(state));
+	state.font_gen = font_gen;
+	state.hdpi = default_hdpi;
+	state.vdpi = default_vdpi;
+	state.hint = default_hint;
+	state.pot = pot;
+	state.multiple = multiple;
+
+/* an empty first format string means the style carries over from the
+ * previous call, so the result isn't determined by the input alone */
+	if (!msgs[0][0])
+		return NULL;
+
+	size_t sz = sizeof(state);
+	for (size_t i = 0; msgs[i]; i++){
+		if (i % 2 == 0 && !cacheable_fmt(msgs[i]))
+			return NULL;
+		sz += strlen(msgs[i]) + 1;
+	}
+
+	char* key = arcan_alloc_mem(sz,
+		ARCAN_MEM_STRINGBUF, ARCAN_MEM_NONFATAL, ARCAN_MEMALIGN_NATURAL);
+	if (!key)
+		return NULL;
+
+	memcpy(key, &state, sizeof(state));
+	size_t ofs = sizeof(state);
+	for (size_t i = 0; msgs[i]; i++){
+		size_t len = strlen(msgs[i]) + 1;
+		memcpy(&key[ofs], msgs[i], len);
+		ofs += len;
+	}
+
+	*key_sz = sz;
+	return key;
+}
+
+static uint64_t text_cache_hash(const char* key, size_t key_sz)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < key_sz; i++){
+		hash ^= (uint8_t) key[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static struct text_cache_entry* text_cache_find(
+	const char* key, size_t key_sz, uint64_t hash)
+{
+	if (text_cache.font_gen != font_gen)
+		text_cache_flush();
+
+	for (size_t i = 0; i < ARCAN_TEXT_CACHE_LIMIT; i++){
+		struct text_cache_entry* ent = &text_cache.ent[i];
+		if (ent->key && ent->hash == hash &&
+			ent->key_sz == key_sz && memcmp(ent->key, key, key_sz) == 0){
+			ent->last_use = ++text_cache.clock;
+			return ent;
+		}
+	}
+
+	return NULL;
+}
+
+/* takes ownership of [key], copies the raster, metrics and end style */
+static void text_cache_store(char* key, size_t key_sz, uint64_t hash,
+	av_pixel* raw, uint32_t d_sz, size_t dw, size_t dh, size_t maxw,
+	size_t maxh, unsigned int n_lines, struct renderline_meta* lines,
+	struct text_format* style)
+{
+	struct text_cache_entry new = {
+		.hash = hash,
+		.key = key,
+		.key_sz = key_sz,
+		.d_sz = d_sz,
+		.dw = dw,
+		.dh = dh,
+		.maxw = maxw,
+		.maxh = maxh,
+		.n_lines = n_lines,
+		.style = *style
+	};
+
+/* the image and line aliases are only valid while building the chain */
+	new.style.surf.buf = NULL;
+	new.style.endofs = NULL;
+
+	if (raw){
+		new.raw = arcan_alloc_mem(d_sz,
+			ARCAN_MEM_VBUFFER, ARCAN_MEM_NONFATAL, ARCAN_MEMALIGN_PAGE);
+		if (new.raw)
+			memcpy(new.raw, raw, d_sz);
+	}
+
+	if (lines){
+		size_t lines_sz = sizeof(struct renderline_meta) * (n_lines + 1);
+		new.lines = arcan_alloc_mem(lines_sz,
+			ARCAN_MEM_VSTRUCT, ARCAN_MEM_NONFATAL, ARCAN_MEMALIGN_NATURAL);
+		if (new.lines)
+			memcpy(new.lines, lines, lines_sz);
+	}
+
+	size_t cost = text_cache_cost(&new);
+	if ((raw && !new.raw) || (lines && !new.lines) ||
+		cost > ARCAN_TEXT_CACHE_SIZE / 4){
+		arcan_mem_free(new.key);
+		arcan_mem_free(new.raw);
+		arcan_mem_free(new.lines);
+		return;
+	}
+
+/* replace a dimensions-only entry for the same key */
+	struct text_cache_entry* dst = text_cache_find(key, key_sz, hash);
+	if (dst)
+		text_cache_drop(dst);
+
+/* then evict least recently used until there is a free slot and room */
+	for(;;){
+		struct text_cache_entry* lru = NULL;
+		dst = NULL;
+
+		for (size_t i = 0; i < ARCAN_TEXT_CACHE_LIMIT; i++){
+			struct text_cache_entry* ent = &text_cache.ent[i];
+			if (!ent->key){
+				if (!dst)
+					dst = ent;
+			}
+			else if (!lru || ent->last_use < lru->last_use)
+				lru = ent;
+		}
+
+		if (dst && text_cache.used + cost <= ARCAN_TEXT_CACHE_SIZE)
+			break;
+
+		text_cache_drop(lru);
+	}
+
+	new.last_use = ++text_cache.clock;
+	*dst = new;
+	text_cache.used += cost;
+}
+
+/* same output contract as process_chain, but sourced from a cache entry */
+static av_pixel* text_cache_apply(struct text_cache_entry* ent,
+	arcan_vobject* dst, bool norender, unsigned int* n_lines,
+	struct renderline_meta** lineheights, size_t* dw, size_t* dh,
+	uint32_t* d_sz, size_t* maxw, size_t* maxh)
+{
+	last_style = ent->style;
+	*dw = ent->dw;
+	*dh = ent->dh;
+	*d_sz = ent->d_sz;
+	*maxw = ent->maxw;
+	*maxh = ent->maxh;
+
+	if (norender)
+		return NULL;
+
+	struct renderline_meta* lines = NULL;
+	if (lineheights){
+		size_t lines_sz = sizeof(struct renderline_meta) * (ent->n_lines + 1);
+		lines = arcan_alloc_mem(lines_sz, ARCAN_MEM_VSTRUCT,
+			ARCAN_MEM_NONFATAL | ARCAN_MEM_TEMPORARY, ARCAN_MEMALIGN_NATURAL);
+		if (!lines)
+			return NULL;
+		memcpy(lines, ent->lines, lines_sz);
+	}
+
+	av_pixel* raw = NULL;
+	if (dst){
+		struct agp_vstore* s = dst->vstore;
+
+		if (s->vinf.text.raw)
+			arcan_mem_free(s->vinf.text.raw);
+
+	 	raw = s->vinf.text.raw = arcan_alloc_mem(*d_sz,
+			ARCAN_MEM_VBUFFER, 0, ARCAN_MEMALIGN_PAGE);
+		s->vinf.text.s_raw = *d_sz;
+		s->w = *dw;
+		s->h = *dh;
+	}
+	else{
+		raw = arcan_alloc_mem(*d_sz, ARCAN_MEM_VBUFFER,
+			ARCAN_MEM_NONFATAL, ARCAN_MEMALIGN_PAGE);
+	}
+
+	if (!raw){
+		arcan_mem_free(lines);
+		return NULL;
+	}
+
+	memcpy(raw, ent->raw, *d_sz);
+
+	if (n_lines)
+		*n_lines = ent->n_lines;
+
+	if (lineheights)
+		*lineheights = lines;
+
+	if (dst){
+		agp_resize_vstore(dst->vstore, *dw, *dh);
+		dst->vstore->vinf.text.hppcm = default_hdpi / 2.54;
+		dst->vstore->vinf.text.vppcm = default_vdpi / 2.54;
+	}
+
+	return raw;
+}
+
+/*
+ * Process the chain into the destination and store the result if the request
+ * was cacheable ([key] != NULL, ownership is transferred).
+ */
+static av_pixel* process_chain_cached(char* key, size_t key_sz, uint64_t hash,
+	struct rcell* root, arcan_vobject* dst, size_t chainlines, bool norender,
+	bool pot, unsigned int* n_lines, struct renderline_meta** lineheights,
+	size_t* dw, size_t* dh, uint32_t* d_sz, size_t* maxw, size_t* maxh)
+{
+	if (!key)
+		return process_chain(root, dst, chainlines, norender, pot,
+			n_lines, lineheights, dw, dh, d_sz, maxw, maxh);
+
+	unsigned int nl = 0;
+	struct renderline_meta* lines = NULL;
+
+	av_pixel* raw = process_chain(root, dst, chainlines, norender, pot,
+		&nl, &lines, dw, dh, d_sz, maxw, maxh);
+
+	if (norender || (raw && *d_sz && lines))
+		text_cache_store(key, key_sz, hash,
+			raw, *d_sz, *dw, *dh, *maxw, *maxh, nl, lines, &last_style);
+	else
+		arcan_mem_free(key);
+
+	if (n_lines)
+		*n_lines = nl;
+
+	if (lineheights)
+		*lineheights = lines;
+	else
+		arcan_mem_free(lines);
+
+	return raw;
+}
+
 av_pixel* arcan_renderfun_renderfmtstr_extended(const char** msgarray,
 	arcan_vobj_id dstore, bool pot,
 	unsigned int* n_lines, struct renderline_meta** lineheights, size_t* dw,
@@ -1364,6 +1722,19 @@ av_pixel* arcan_renderfun_renderfmtstr_extended(const char** msgarray,
 	if (!root || !msgarray || !msgarray[0])
 		return NULL;
 
+	size_t key_sz = 0;
+	char* key = text_cache_key(msgarray, true, pot, &key_sz);
+	uint64_t hash = key ? text_cache_hash(key, key_sz) : 0;
+	struct text_cache_entry* ent = key ?
+		text_cache_find(key, key_sz, hash) : NULL;
+
+	if (ent && (ent->raw || norender)){
+		arcan_mem_free(key);
+		arcan_mem_free(root);
+		return text_cache_apply(ent, arcan_video_getobject(dstore),
+			norender, n_lines, lineheights, dw, dh, d_sz, maxw, maxh);
+	}
+
 	last_style.newline = 0;
 	last_style.tab = 0;
 	last_style.cr = false;
@@ -1407,7 +1778,8 @@ av_pixel* arcan_renderfun_renderfmtstr_extended(const char** msgarray,
 	);
 	cur->data.format.newline = 1;
 
-	return process_chain(root, arcan_video_getobject(dstore),
+	return process_chain_cached(key, key_sz, hash,
+		root, arcan_video_getobject(dstore),
 		acc+1, norender, pot, n_lines,
 		lineheights, dw, dh, d_sz, maxw, maxh
 	);
@@ -1424,6 +1796,19 @@ av_pixel* arcan_renderfun_renderfmtstr(const char* message,
 
 	av_pixel* raw = NULL;
 
+	size_t key_sz = 0;
+	const char* msgs[] = {message, NULL};
+	char* key = text_cache_key(msgs, false, pot, &key_sz);
+	uint64_t hash = key ? text_cache_hash(key, key_sz) : 0;
+	struct text_cache_entry* ent = key ?
+		text_cache_find(key, key_sz, hash) : NULL;
+
+	if (ent && (ent->raw || norender)){
+		arcan_mem_free(key);
+		return text_cache_apply(ent, arcan_video_getobject(dstore),
+			norender, n_lines, lineheights, dw, dh, d_sz, maxw, maxh);
+	}
+
 /* (A) parse format string and build chains of renderblocks */
 	struct rcell* root = arcan_alloc_mem(sizeof(struct rcell),
 		ARCAN_MEM_VSTRUCT, ARCAN_MEM_BZERO | ARCAN_MEM_TEMPORARY,
@@ -1439,11 +1824,14 @@ av_pixel* arcan_renderfun_renderfmtstr(const char* message,
 	arcan_mem_free(work);
 
 	if (chainlines > 0){
-		raw = process_chain(root, arcan_video_getobject(dstore),
+		raw = process_chain_cached(key, key_sz, hash,
+			root, arcan_video_getobject(dstore),
 			chainlines, norender, pot, n_lines, lineheights,
 			dw, dh, d_sz, maxw, maxh
 		);
 	}
+	else
+		arcan_mem_free(key);
 
 	return raw;
 }
@@ -51,6 +51,11 @@
  * many costly glyph cache invalidations. Since DPI is static and homogenous
  * most of the time this only really matters in the arcan use case where
  * per-rendertarget different densities is a thing.
+ *
+ * On top of that, the finished raster and line metrics are cached on the
+ * message(s), density, hinting and default font (ARCAN_TEXT_CACHE_LIMIT
+ * entries, ARCAN_TEXT_CACHE_SIZE bytes) so repeated renders of the same
+ * string only cost a copy. Strings with \e, \E, \p or \P are not cached.
  */
 
 #ifndef HAVE_RLINE_META
@@ -6,47 +6,215 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdatomic.h>
+#include <pthread.h>
 
 #include "arcan_math.h"
 #include "arcan_general.h"
 
 bool arcan_trace_enabled;
 
+/*
+ * Marks are written into per-thread single-producer rings of fixed size
+ * records so that they can be emitted from any thread (conductor, image
+ * loaders, a12 workers, ...) without locks or string copies on the hot path.
+ * The system/subsystem strings are interned to 16-bit ids and the message is
+ * copied inline and truncated. The rings are drained into the collection
+ * buffer (format described in arcan_general.h) by arcan_trace_flush, which is
+ * expected to be called from the thread that owns the collection buffer.
+ */
+#define TRACE_RING_SZ 4096
+#define TRACE_MSG_SZ 36
+#define TRACE_INTERN_LIM 1024
+#define TRACE_INTERN_CACHE 64
+
+struct trace_record {
+	uint64_t ts;
+	uint64_t ident;
+	uint32_t quant;
+	uint16_t sys;
+	uint16_t subsys;
+	uint8_t trigger;
+	uint8_t level;
+	char msg[TRACE_MSG_SZ];
+};
+
+struct trace_ring {
+	_Atomic size_t head;
+	_Atomic size_t tail;
+	_Atomic uint32_t dropped;
+	_Atomic bool released;
+	uint32_t thread;
+	struct trace_ring* next;
+	struct trace_record rec[TRACE_RING_SZ];
+};
+
+/* rings are never unlinked so that flush can walk the list without locking,
+ * instead the ring of a thread that exits is marked as released and handed
+ * to the next thread that needs one after the remaining marks are flushed */
+static _Atomic(struct trace_ring*) rings;
+static _Atomic uint32_t ring_count;
+static _Thread_local struct trace_ring* thread_ring;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+/* interned strings are never released, id 0 is used when the table is full */
+static struct {
+	const char* str[TRACE_INTERN_LIM];
+	_Atomic uint16_t count;
+	pthread_mutex_t lock;
+} intern = {
+	.str = {"(overflow)"},
+	.count = 1,
+	.lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+static _Thread_local struct {
+	const char* ptr;
+	uint16_t id;
+} intern_cache[TRACE_INTERN_CACHE];
+
+/* the collection buffer is only touched with the flush lock held */
+static pthread_mutex_t flush_lock = PTHREAD_MUTEX_INITIALIZER;
 static uint8_t* buffer;
 static size_t buffer_sz;
 static size_t buffer_pos;
 static bool* buffer_flag;
 
-void arcan_trace_setbuffer(uint8_t* buf, size_t buf_sz, bool* finish_flag)
+static uint16_t intern_str(const char* str)
 {
-	if (buffer){
-		*buffer_flag = true;
-		buffer = NULL;
-		buffer_flag = NULL;
-		buffer_pos = 0;
-		arcan_trace_enabled = false;
+/* the cache is keyed on the pointer as most sites use literals, but the
+ * content is still compared as dynamic strings can reuse the same address */
+	size_t slot = ((uintptr_t) str >> 3) % TRACE_INTERN_CACHE;
+	if (intern_cache[slot].ptr == str &&
+		strcmp(intern.str[intern_cache[slot].id], str) == 0)
+		return intern_cache[slot].id;
+
+	uint16_t id = 0;
+	pthread_mutex_lock(&intern.lock);
+	uint16_t count = atomic_load_explicit(&intern.count, memory_order_relaxed);
+
+	for (size_t i = 1; i < count; i++)
+		if (strcmp(intern.str[i], str) == 0){
+			id = i;
+			break;
+		}
+
+	if (!id && count < TRACE_INTERN_LIM){
+		char* copy = strdup(str);
+		if (copy){
+			intern.str[count] = copy;
+			id = count;
+			atomic_store_explicit(&intern.count, count + 1, memory_order_release);
+		}
 	}
+	pthread_mutex_unlock(&intern.lock);
+
+	intern_cache[slot].ptr = str;
+	intern_cache[slot].id = id;
+	return id;
+}
+
+static void ring_release(void* tag)
+{
+	struct trace_ring* ring = tag;
+	thread_ring = NULL;
+	atomic_store_explicit(&ring->released, true, memory_order_release);
+}
+
+static void ring_key_create()
+{
+	pthread_key_create(&ring_key, ring_release);
+}
+
+static struct trace_ring* ring_reuse()
+{
+	for (struct trace_ring* ring = atomic_load(&rings); ring; ring = ring->next){
+		if (!atomic_load_explicit(&ring->released, memory_order_acquire) ||
+			atomic_load_explicit(&ring->tail, memory_order_acquire) !=
+			atomic_load_explicit(&ring->head, memory_order_relaxed))
+			continue;
+
+		bool expect = true;
+		if (atomic_compare_exchange_strong(&ring->released, &expect, false))
+			return ring;
+	}
+
+	return NULL;
+}
+
+static struct trace_ring* ring_alloc()
+{
+	pthread_once(&ring_key_once, ring_key_create);
+
+/* a reused ring gets a new thread id so the export doesn't merge the two */
+	struct trace_ring* ring = ring_reuse();
+	if (ring)
+		ring->thread = atomic_fetch_add(&ring_count, 1);
+	else {
+		ring = malloc(sizeof(struct trace_ring));
+		if (!ring)
+			return NULL;
 
-	if (!buf || !buf_sz)
+		atomic_init(&ring->head, 0);
+		atomic_init(&ring->tail, 0);
+		atomic_init(&ring->dropped, 0);
+		atomic_init(&ring->released, false);
+		ring->thread = atomic_fetch_add(&ring_count, 1);
+
+		struct trace_ring* old = atomic_load(&rings);
+		do {
+			ring->next = old;
+		} while (!atomic_compare_exchange_weak(&rings, &old, ring));
+	}
+
+	pthread_setspecific(ring_key, ring);
+	thread_ring = ring;
+	return ring;
+}
+
+static void drop_rings()
+{
+	for (struct trace_ring* ring = atomic_load(&rings); ring; ring = ring->next){
+		atomic_store_explicit(&ring->tail,
+			atomic_load_explicit(&ring->head, memory_order_acquire),
+			memory_order_release);
+		atomic_store(&ring->dropped, 0);
+	}
+}
+
+static void finish_buffer()
+{
+	if (!buffer)
 		return;
 
-	buffer = buf;
-	buffer_flag = finish_flag;
-	buffer_sz = buf_sz;
-	arcan_trace_enabled = true;
+	if (buffer_flag)
+		*buffer_flag = true;
+
+	buffer = NULL;
+	buffer_flag = NULL;
+	buffer_pos = 0;
+	arcan_trace_enabled = false;
 }
 
-static bool append_string(const char* str)
+void arcan_trace_setbuffer(uint8_t* buf, size_t buf_sz, bool* finish_flag)
 {
-	do {
-		buffer[buffer_pos++] = *str++;
+	arcan_trace_flush();
 
-		if (buffer_pos == buffer_sz)
-			return false;
+	pthread_mutex_lock(&flush_lock);
+	finish_buffer();
 
-	} while (*str);
+	if (!buf || !buf_sz){
+		pthread_mutex_unlock(&flush_lock);
+		return;
+	}
 
-	return true;
+	drop_rings();
+	buffer = buf;
+	buffer_flag = finish_flag;
+	buffer_sz = buf_sz;
+	buffer_pos = 0;
+	arcan_trace_enabled = true;
+	pthread_mutex_unlock(&flush_lock);
 }
 
 void arcan_trace_mark(
@@ -57,11 +225,53 @@ void arcan_trace_mark(
 	if (!arcan_trace_enabled)
 		return;
 
-	size_t start_ofs = buffer_pos;
+	struct trace_ring* ring = thread_ring ? thread_ring : ring_alloc();
+	if (!ring)
+		return;
 
-	size_t sys_len = strlen(sys) + 1;
-	size_t subsys_len = strlen(subsys) + 1;
-	size_t msg_len = message ? strlen(message) + 1 : 1;
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+	if (head - tail >= TRACE_RING_SZ){
+		atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+		return;
+	}
+
+	struct trace_record* rec = &ring->rec[head % TRACE_RING_SZ];
+	rec->ts = arcan_timemicros();
+	rec->ident = ident;
+	rec->quant = quant;
+	rec->sys = intern_str(sys);
+	rec->subsys = intern_str(subsys);
+	rec->trigger = trigger;
+	rec->level = tracelevel;
+
+	size_t i = 0;
+	if (message)
+		for (; i < TRACE_MSG_SZ - 1 && message[i]; i++)
+			rec->msg[i] = message[i];
+	rec->msg[i] = '\0';
+
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+static bool append_string(const char* str)
+{
+	size_t len = strlen(str) + 1;
+	if (buffer_sz - buffer_pos < len)
+		return false;
+
+	memcpy(&buffer[buffer_pos], str, len);
+	buffer_pos += len;
+	return true;
+}
+
+/*
+ * tight packing format, valid- mark (0xff) then arguments in order, when we
+ * reach the end, set finish_flag and disable tracing - rough safety check
+ * first so a sample is either completely written or not at all
+ */
+static bool pack_record(struct trace_record* rec, uint32_t thread)
+{
 	size_t tot =
 		1 /* ok marker */   +
 		8 /* timestamp */   +
@@ -69,58 +279,160 @@ void arcan_trace_mark(
 		1 /* trace level */ +
 		8 /* identifier */  +
 		4 /* quantifier */  +
-		sys_len + subsys_len + msg_len;
-
-/* tight packing format, valid- mark (0xaa) then arguments in each order,
- * when we reach end, write eos mark (0xff), set finish_flag and disable
- * tracing - rough safety check first before doing anything */
-	if (buffer_sz - buffer_pos < tot)
-		goto fail_short;
-
-/* ok marker */
-	buffer_pos++;
-
-/* timestamp */
-	uint64_t ts = arcan_timemicros();
-	memcpy(&buffer[buffer_pos], &ts, sizeof(ts));
-	buffer_pos += sizeof(ts);
-
-/* sys / subsys */
-	memcpy(&buffer[buffer_pos], sys, sys_len);
-	buffer_pos += sys_len;
-	memcpy(&buffer[buffer_pos], subsys, subsys_len);
-	buffer_pos += subsys_len;
-
-/* trigger */
-	memcpy(&buffer[buffer_pos], &trigger, 1);
-	buffer_pos += 1;
-
-/* tracelevel */
-	memcpy(&buffer[buffer_pos], &tracelevel, 1);
-	buffer_pos += 1;
-
-/* identifier */
-	memcpy(&buffer[buffer_pos], &ident, 8);
+		4 /* thread */      +
+		strlen(intern.str[rec->sys]) + 1 +
+		strlen(intern.str[rec->subsys]) + 1 +
+		strlen(rec->msg) + 1;
+
+/* keep one byte so the buffer is always terminated by a non-ok marker */
+	if (buffer_sz - buffer_pos <= tot)
+		return false;
+
+	size_t start_ofs = buffer_pos++;
+
+	memcpy(&buffer[buffer_pos], &rec->ts, 8);
 	buffer_pos += 8;
 
-/* quantifier */
-	memcpy(&buffer[buffer_pos], &quant, 4);
+	append_string(intern.str[rec->sys]);
+	append_string(intern.str[rec->subsys]);
+
+	buffer[buffer_pos++] = rec->trigger;
+	buffer[buffer_pos++] = rec->level;
+
+	memcpy(&buffer[buffer_pos], &rec->ident, 8);
+	buffer_pos += 8;
+
+	memcpy(&buffer[buffer_pos], &rec->quant, 4);
 	buffer_pos += 4;
 
-/* message */
-	if (message){
-		memcpy(&buffer[buffer_pos], message, msg_len);
-		buffer_pos += msg_len;
-	}
-	else {
-		buffer[buffer_pos++] = '\0';
-	}
+	memcpy(&buffer[buffer_pos], &thread, 4);
+	buffer_pos += 4;
+
+	append_string(rec->msg);
 
 /* mark sample as completed */
 	buffer[start_ofs] = 0xff;
-	return;
+	return true;
+}
+
+void arcan_trace_flush()
+{
+	pthread_mutex_lock(&flush_lock);
+
+/* merge the rings on timestamp so the collection buffer stays ordered
+ * even though each ring is only ordered with respect to its own thread */
+	for(;;){
+		struct trace_ring* best = NULL;
+		struct trace_record* best_rec = NULL;
+
+		for (struct trace_ring* ring = atomic_load(&rings); ring; ring = ring->next){
+			size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+			size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+			if (tail == head)
+				continue;
+
+			struct trace_record* rec = &ring->rec[tail % TRACE_RING_SZ];
+			if (!best_rec || rec->ts < best_rec->ts){
+				best = ring;
+				best_rec = rec;
+			}
+		}
+
+		if (!best)
+			break;
+
+		if (!buffer){
+			drop_rings();
+			break;
+		}
+
+		if (!pack_record(best_rec, best->thread)){
+			finish_buffer();
+			drop_rings();
+			break;
+		}
+
+		atomic_fetch_add_explicit(&best->tail, 1, memory_order_release);
+	}
+
+	pthread_mutex_unlock(&flush_lock);
+}
+
+size_t arcan_trace_dropped()
+{
+	size_t sum = 0;
+	for (struct trace_ring* ring = atomic_load(&rings); ring; ring = ring->next)
+		sum += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+	return sum;
+}
+
+static void json_string(FILE* out, const char* str)
+{
+	fputc('"', out);
+	for (; *str; str++){
+		unsigned char ch = *str;
+		if (ch == '"' || ch == '\\')
+			fprintf(out, "\\%c", ch);
+		else if (ch < 0x20)
+			fprintf(out, "\\u%04x", ch);
+		else
+			fputc(ch, out);
+	}
+	fputc('"', out);
+}
+
+bool arcan_trace_export_chrome(FILE* out, const uint8_t* buf, size_t buf_sz)
+{
+	static const char* levels[] = {"default", "slow", "fast", "warning", "error"};
+	const char* buf_ch = (const char*) buf;
+	size_t pos = 0;
+	bool first = true;
+	long pid = getpid();
+
+	fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+	while (pos < buf_sz && buf[pos++] == 0xff){
+		uint64_t ts, ident;
+		uint32_t quant, thread;
+
+		memcpy(&ts, &buf[pos], 8);
+		pos += 8;
+
+		const char* sys = &buf_ch[pos];
+		pos += strlen(sys) + 1;
+		const char* subsys = &buf_ch[pos];
+		pos += strlen(subsys) + 1;
+
+		uint8_t trigger = buf[pos++];
+		uint8_t level = buf[pos++];
+
+		memcpy(&ident, &buf[pos], 8);
+		pos += 8;
+		memcpy(&quant, &buf[pos], 4);
+		pos += 4;
+		memcpy(&thread, &buf[pos], 4);
+		pos += 4;
+
+		const char* msg = &buf_ch[pos];
+		pos += strlen(msg) + 1;
+
+		fprintf(out, "%s\n{\"name\":", first ? "" : ",");
+		json_string(out, subsys);
+		fprintf(out, ",\"cat\":");
+		json_string(out, sys);
+		fprintf(out,
+			",\"ph\":\"%s\",\"ts\":%"PRIu64",\"pid\":%ld,\"tid\":%"PRIu32
+			",\"args\":{\"ident\":%"PRIu64",\"quant\":%"PRIu32",\"level\":\"%s\""
+			",\"message\":",
+			trigger == 1 ? "B" : (trigger == 2 ? "E" : "i\",\"s\":\"t"),
+			ts, pid, thread, ident, quant,
+			level < sizeof(levels) / sizeof(levels[0]) ? levels[level] : "broken"
+		);
+		json_string(out, msg);
+		fprintf(out, "}}");
+		first = false;
+	}
 
-fail_short:
-	*buffer_flag = true;
-	buffer[start_ofs] = 0xaa;
+	fprintf(out, "\n]}\n");
+	return !ferror(out);
 }
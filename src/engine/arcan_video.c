@@ -4356,12 +4356,35 @@ static inline bool process_counter(
 	return false;
 }
 
+/* if the rendertarget feeds a frameserver that has a region set (output
+ * segments), only that part needs to be read back */
+static struct agp_region* readback_region(
+	struct rendertarget* tgt, struct agp_region* out)
+{
+	if (tgt->color->feed.state.tag != ARCAN_TAG_FRAMESERV || !tgt->color->feed.state.ptr)
+		return NULL;
+
+	struct arcan_frameserver* fsrv = tgt->color->feed.state.ptr;
+	if (!fsrv->desc.region_valid)
+		return NULL;
+
+	*out = (struct agp_region){
+		.x1 = fsrv->desc.region.x1, .y1 = fsrv->desc.region.y1,
+		.x2 = fsrv->desc.region.x2, .y2 = fsrv->desc.region.y2
+	};
+	return out;
+}
+
+/* readbacks are queued in the agp layer, a full queue means the frame is
+ * dropped - e.g. the consumer is not keeping up */
 static inline void process_readback(struct rendertarget* tgt, float fract)
 {
-	if (!FL_TEST(tgt, TGTFL_READING) &&
-		process_counter(tgt, &tgt->readcnt, tgt->readback, fract)){
-		agp_request_readback(tgt->color->vstore);
-		FL_SET(tgt, TGTFL_READING);
+	if (process_counter(tgt, &tgt->readcnt, tgt->readback, fract)){
+		struct agp_region region;
+		if (agp_request_readback(
+			tgt->color->vstore, readback_region(tgt, &region))){
+			FL_SET(tgt, TGTFL_READING);
+		}
 	}
 }
 
@@ -4959,20 +4982,26 @@ arcan_errc arcan_vint_pollfeed(arcan_vobj_id vid, bool step)
 }
 
 /*
- * For large Ns this approach 'should' be rather dumb in the sense
- * that we could arguably well just have a set of descriptors and
- * check the ones that have been signalled. On the other hand, they
- * will be read almost immediately after this, and with that in mind,
- * we would possibly gain more by just having a big-array(TM){for
- * all cases where n*obj_size < data_cache_size} as that hit/miss is
- * really all that matters now.
+ * Frameservers in the connected state (vframe/nullframe feeds) mark readiness
+ * through the flags in the shared page when they signal, check those first so
+ * that idle clients don't cost a dispatch (and the guard setup that comes with
+ * it) every frame. Other feeds are always polled.
  */
+static bool feed_ready(arcan_vobject* vobj)
+{
+	if (vobj->feed.state.tag != ARCAN_TAG_FRAMESERV || !vobj->feed.state.ptr ||
+		(vobj->feed.ffunc != FFUNC_VFRAME && vobj->feed.ffunc != FFUNC_NULLFRAME))
+		return true;
+
+	return arcan_frameserver_pollready(vobj->feed.state.ptr);
+}
+
 static void poll_list(arcan_vobject_litem* current)
 {
 	while(current && current->elem){
 		arcan_vobject* celem = current->elem;
 
-		if (celem->feed.ffunc)
+		if (celem->feed.ffunc && feed_ready(celem))
 			ffunc_process(celem, true);
 
 		current = current->next;
@@ -5484,10 +5513,10 @@ arcan_errc arcan_video_screenshot(av_pixel** dptr, size_t* dsize)
 	return ARCAN_OK;
 }
 
-/* Check outstanding readbacks, map and feed onwards, ideally we should synch
- * this with a fence - but the platform GL etc. versioning restricts things for
- * the time being. Threaded- dispatch from the conductor is the right way
- * forward */
+/* Check outstanding readbacks, map and feed onwards. The agp layer queues
+ * and fences these so polling doesn't stall, and completed ones are consumed
+ * in order for as long as the client is ready for more. Threaded- dispatch
+ * from the conductor is the right way forward */
 void arcan_vint_pollreadback(struct rendertarget* tgt)
 {
 	if (!FL_TEST(tgt, TGTFL_READING))
@@ -5495,38 +5524,45 @@ void arcan_vint_pollreadback(struct rendertarget* tgt)
 
 	arcan_vobject* vobj = tgt->color;
 
+	for(;;){
 /* don't check the readback unless the client is ready, should possibly have a
  * timeout for this as well so we don't hold GL resources with an unwilling /
  * broken client, it's a hard tradeoff as streaming video encode might deal
  * well with the dropped frame at this stage, while a variable rate interactive
  * source may lose data */
-	arcan_vfunc_cb ffunc = NULL;
-	if (vobj->feed.ffunc){
-		ffunc = arcan_ffunc_lookup(vobj->feed.ffunc);
-		if (FRV_GOTFRAME == ffunc(
-			FFUNC_POLL, NULL, 0, 0, 0, 0, vobj->feed.state, vobj->cellid))
-			return;
-	}
+		if (vobj->feed.ffunc){
+			arcan_vfunc_cb ffunc = arcan_ffunc_lookup(vobj->feed.ffunc);
+			if (FRV_GOTFRAME == ffunc(
+				FFUNC_POLL, NULL, 0, 0, 0, 0, vobj->feed.state, vobj->cellid))
+				return;
+		}
 
 /* now we can check the readback, it is not safe to call poll, get results
  * and then call poll again, we have to release once retrieved */
-	struct asynch_readback_meta rbb = agp_poll_readback(vobj->vstore);
+		struct asynch_readback_meta rbb = agp_poll_readback(vobj->vstore);
 
-	if (rbb.ptr == NULL)
-		return;
+		if (rbb.ptr == NULL){
+			if (!rbb.queued)
+				FL_CLEAR(tgt, TGTFL_READING);
+			return;
+		}
 
 /* the ffunc might've disappeared, so disable the readback state */
-	if (!vobj->feed.ffunc)
-		tgt->readback = 0;
-	else{
-		arcan_ffunc_lookup(vobj->feed.ffunc)(
-			FFUNC_READBACK, rbb.ptr, rbb.w * rbb.h * sizeof(av_pixel),
-			rbb.w, rbb.h, 0, vobj->feed.state, vobj->cellid
-		);
-	}
+		if (!vobj->feed.ffunc)
+			tgt->readback = 0;
+		else{
+			arcan_ffunc_lookup(vobj->feed.ffunc)(
+				FFUNC_READBACK, rbb.ptr, rbb.w * rbb.h * sizeof(av_pixel),
+				rbb.w, rbb.h, 0, vobj->feed.state, vobj->cellid
+			);
+		}
 
-	rbb.release(rbb.tag);
-	FL_CLEAR(tgt, TGTFL_READING);
+		rbb.release(rbb.tag);
+		if (!rbb.queued){
+			FL_CLEAR(tgt, TGTFL_READING);
+			return;
+		}
+	}
 }
 
 static size_t steptgt(float fract, struct rendertarget* tgt)
@@ -501,7 +501,8 @@ vfunc_state* arcan_video_feedstate(arcan_vobj_id);
 /*
  * Run through all registered dynamic feed objects and request that they
  * notify if their internal state has changed or not. If it has, backing
- * stores will update.
+ * stores will update. Connected frameservers that haven't signalled anything
+ * since the last poll are skipped (see arcan_frameserver_pollready).
  */
 void arcan_video_pollfeed();
 
@@ -1,6 +1,8 @@
 #include <arcan_shmif.h>
 #include <arcan_tuisym.h>
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "decode.h"
 #include "mupdf/fitz.h"
@@ -8,7 +10,71 @@
 
 #define MIN(a, b)	((a) < (b) ? (a) : (b))
 
-static void rebuild_pixmap();
+/*
+ * Pages are rasterized into fixed size tiles (in page space at a specific
+ * zoom factor), kept in an LRU and composed into the segment with row copies.
+ * A worker thread prerenders the tiles that would be visible on neighbouring
+ * pages and zoom steps, so stepping through those only costs a compose.
+ *
+ * The document itself is not safe for concurrent use, pages are interpreted
+ * into display lists with the document lock held and those are then run
+ * without it. Each thread has its own (cloned) fz_context.
+ */
+#ifndef PDF_TILE_SIZE
+#define PDF_TILE_SIZE 256
+#endif
+
+#ifndef PDF_TILE_LIMIT
+#define PDF_TILE_LIMIT 256
+#endif
+
+#ifndef PDF_LIST_LIMIT
+#define PDF_LIST_LIMIT 8
+#endif
+
+struct page_list {
+	int page_no;
+	fz_display_list* list;
+	fz_rect bounds;
+	uint64_t used;
+};
+
+struct tile {
+	int page_no;
+	int zoom;
+	int tx, ty;
+	fz_pixmap* pmap;
+	uint64_t used;
+};
+
+struct view {
+	int page_no;
+	float fact;
+	float dpi;
+	int dx, dy;
+	size_t w, h;
+};
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_mutex_t doc_lock;
+	pthread_cond_t cond;
+	pthread_mutex_t fz_locks[FZ_LOCK_MAX];
+
+	struct tile tiles[PDF_TILE_LIMIT];
+	struct page_list lists[PDF_LIST_LIMIT];
+	uint64_t clock;
+
+/* what the worker should prerender around, gen is bumped on each change */
+	struct view view;
+	_Atomic uint64_t gen;
+	bool alive;
+	pthread_t worker;
+} cache = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.doc_lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER
+};
 
 static struct {
 /* action schedule triggers */
@@ -20,9 +86,7 @@ static struct {
 /* context tracking */
 	fz_context* ctx;
 	fz_document* doc;
-	fz_pixmap* pmap;
-	fz_device *dev;
-	fz_page *page;
+	int n_pages;
 	struct arcan_shmif_cont con;
 
 /* input states */
@@ -39,6 +103,14 @@ static struct {
 	int page_no;
 	int dx, dy;
 
+/* last composed paper area, what is outside of it is background */
+	struct {
+		bool valid;
+		fz_irect paper;
+		size_t w, h;
+		shmif_pixel* vidp;
+	} shown;
+
 } apdf = {
 	.scale = 1.0,
 	.annotations = true,
@@ -48,139 +120,384 @@ static struct {
 static bool auto_size(void* tag);
 static void calculate_zoom_factor();
 
-static fz_matrix get_transform(bool translate)
+static void fz_lock_cb(void* user, int lock)
 {
-	fz_matrix ctm = fz_rotate(0);
-	float fact = apdf.scale + (apdf.dpy.density * 2.54 / 72.0);
-	if (translate)
-		ctm = fz_pre_translate(ctm, apdf.dx, apdf.dy);
-	ctm = fz_pre_scale(ctm, fact, fact);
+	pthread_mutex_lock(&cache.fz_locks[lock]);
+}
 
-	return ctm;
+static void fz_unlock_cb(void* user, int lock)
+{
+	pthread_mutex_unlock(&cache.fz_locks[lock]);
 }
 
-static void calculate_zoom_factor()
+static float get_fact()
 {
-	fz_rect rect = fz_bound_page(apdf.ctx, apdf.page);
-	float wofs = (apdf.dpy.density * 2.54) / 72.0;
+	return apdf.scale + (apdf.dpy.density * 2.54 / 72.0);
+}
 
-	float imgw = (rect.x1 - rect.x0) * wofs;
-	float imgh = (rect.y1 - rect.y0) * wofs;
-	float wnd_ar = apdf.con.w / apdf.con.h;
-	float doc_ar = imgw / imgh;
+static int zoom_key(float fact)
+{
+	return lroundf(fact * 1000.0);
+}
 
-	if (doc_ar > wnd_ar){
-		apdf.scale = (float) apdf.con.w / imgw;
-	}
-	else {
-		apdf.scale = (float) apdf.con.h / imgh;
-	}
+/* floor division so that pages with a negative origin get the right tiles */
+static int tile_div(int v)
+{
+	return v >= 0 ? v / PDF_TILE_SIZE : -((-v + PDF_TILE_SIZE - 1) / PDF_TILE_SIZE);
 }
 
-static void render()
+/* returns a reference the caller should drop, interprets the page if needed */
+static fz_display_list* get_list(fz_context* ctx, int page_no, fz_rect* bounds)
 {
-	rebuild_pixmap();
+	pthread_mutex_lock(&cache.lock);
+	for (size_t i = 0; i < PDF_LIST_LIMIT; i++){
+		struct page_list* cur = &cache.lists[i];
+		if (cur->list && cur->page_no == page_no){
+			cur->used = ++cache.clock;
+			*bounds = cur->bounds;
+			fz_display_list* res = fz_keep_display_list(ctx, cur->list);
+			pthread_mutex_unlock(&cache.lock);
+			return res;
+		}
+	}
+	pthread_mutex_unlock(&cache.lock);
+
+	fz_display_list* list = NULL;
+	fz_page* page = NULL;
+	fz_device* dev = NULL;
+	fz_rect rect = fz_empty_rect;
+	fz_var(list);
+	fz_var(page);
+	fz_var(dev);
+
+	pthread_mutex_lock(&cache.doc_lock);
+	fz_try(ctx){
+		page = fz_load_page(ctx, apdf.doc, page_no);
+		rect = fz_bound_page(ctx, page);
+		list = fz_new_display_list(ctx, rect);
+		dev = fz_new_list_device(ctx, list);
+		fz_run_page_contents(ctx, page, dev, fz_identity, NULL);
 
-	bool repack = true;
-	fz_matrix transform = get_transform(true);
+/* option here: toggle annotations on / off - possibly also as an overlay
+ * window so the WM gets to split out */
+		if (apdf.annotations)
+			fz_run_page_annots(ctx, page, dev, fz_identity, NULL);
 
-/* pad? */
-	fz_rect rect = fz_bound_page(apdf.ctx, apdf.page);
-	rect = fz_transform_rect(rect, transform);
+		fz_close_device(ctx, dev);
+	}
+	fz_always(ctx){
+		fz_drop_device(ctx, dev);
+		fz_drop_page(ctx, page);
+	}
+	fz_catch(ctx){
+		fprintf(stderr, "couldn't run page %d: %s\n", page_no, fz_caught_message(ctx));
+		fz_drop_display_list(ctx, list);
+		list = NULL;
+	}
+	pthread_mutex_unlock(&cache.doc_lock);
+
+	if (!list)
+		return NULL;
+
+/* the other thread might have beaten us to it, then just use ours anyhow */
+	pthread_mutex_lock(&cache.lock);
+	struct page_list* slot = &cache.lists[0];
+	for (size_t i = 0; i < PDF_LIST_LIMIT; i++){
+		struct page_list* cur = &cache.lists[i];
+		if (cur->list && cur->page_no == page_no){
+			slot = NULL;
+			break;
+		}
+		if (!cur->list || cur->used < slot->used)
+			slot = cur;
+		if (!cur->list)
+			break;
+	}
 
-	shmif_pixel bg_pixel = SHMIF_RGBA(0x40, 0x40, 0x40, 0xff);
+	if (slot){
+		fz_drop_display_list(ctx, slot->list);
+		*slot = (struct page_list){
+			.page_no = page_no,
+			.list = fz_keep_display_list(ctx, list),
+			.bounds = rect,
+			.used = ++cache.clock
+		};
+	}
+	pthread_mutex_unlock(&cache.lock);
+
+	*bounds = rect;
+	return list;
+}
+
+static fz_rect page_bounds(int page_no)
+{
+	fz_rect res = fz_empty_rect;
+	fz_drop_display_list(apdf.ctx, get_list(apdf.ctx, page_no, &res));
+	return res;
+}
 
-/* clear to 'background' first */
-	if (rect.y0 > 0.0){
-		for (size_t y = 0; y < apdf.con.h && y < rect.y0; y++){
-			shmif_pixel* out = &apdf.con.vidp[y * apdf.con.pitch];
-			for (size_t x = 0; x < apdf.con.w; x++)
-				out[x] = bg_pixel;
+static fz_pixmap* tile_lookup(fz_context* ctx, int page_no, int zoom, int tx, int ty)
+{
+	fz_pixmap* res = NULL;
+
+	pthread_mutex_lock(&cache.lock);
+	for (size_t i = 0; i < PDF_TILE_LIMIT; i++){
+		struct tile* cur = &cache.tiles[i];
+		if (cur->pmap && cur->page_no == page_no &&
+			cur->zoom == zoom && cur->tx == tx && cur->ty == ty){
+			cur->used = ++cache.clock;
+			res = fz_keep_pixmap(ctx, cur->pmap);
+			break;
 		}
 	}
+	pthread_mutex_unlock(&cache.lock);
+
+	return res;
+}
 
-	if (rect.y1 < apdf.con.h){
-		for (size_t y = rect.y1 + 1; y < apdf.con.h; y++){
-			shmif_pixel* out = &apdf.con.vidp[y * apdf.con.pitch];
-			for (size_t x = 0; x < apdf.con.w; x++)
-				out[x] = bg_pixel;
+static void tile_insert(fz_context* ctx,
+	int page_no, int zoom, int tx, int ty, fz_pixmap* pmap)
+{
+	pthread_mutex_lock(&cache.lock);
+	struct tile* slot = &cache.tiles[0];
+	for (size_t i = 0; i < PDF_TILE_LIMIT; i++){
+		struct tile* cur = &cache.tiles[i];
+		if (cur->pmap && cur->page_no == page_no &&
+			cur->zoom == zoom && cur->tx == tx && cur->ty == ty){
+			slot = NULL;
+			break;
 		}
+		if (!cur->pmap || cur->used < slot->used)
+			slot = cur;
 	}
 
-	for (size_t y = 0; y < apdf.con.h; y++){
-		shmif_pixel* out = &apdf.con.vidp[y * apdf.con.pitch];
-		for (size_t x = 0; x < rect.x0 && x < apdf.con.w; x++)
-			out[x] = bg_pixel;
-		for (size_t x = rect.x1 < 0 ? 0 : rect.x1; x < apdf.con.w; x++)
-			out[x] = bg_pixel;
+	if (slot){
+		fz_drop_pixmap(ctx, slot->pmap);
+		*slot = (struct tile){
+			.page_no = page_no,
+			.zoom = zoom,
+			.tx = tx,
+			.ty = ty,
+			.pmap = fz_keep_pixmap(ctx, pmap),
+			.used = ++cache.clock
+		};
 	}
+	pthread_mutex_unlock(&cache.lock);
+}
 
-/* then draw in the paper */
-	shmif_pixel fg_pixel = SHMIF_RGBA(0xff, 0xff, 0xff, 0xff);
-	for (size_t y = rect.y0 > 0 ? rect.y0 : 0; y < apdf.con.h && y <= rect.y1; y++){
-		shmif_pixel* out = &apdf.con.vidp[y * apdf.con.pitch];
-		for (size_t x = rect.x0 > 0 ? rect.x0 : 0; x < apdf.con.w && x <= rect.x1; x++){
-			out[x] = fg_pixel;
-		}
+static void cache_flush(fz_context* ctx)
+{
+	pthread_mutex_lock(&cache.lock);
+	for (size_t i = 0; i < PDF_TILE_LIMIT; i++){
+		fz_drop_pixmap(ctx, cache.tiles[i].pmap);
+		cache.tiles[i] = (struct tile){0};
+	}
+	for (size_t i = 0; i < PDF_LIST_LIMIT; i++){
+		fz_drop_display_list(ctx, cache.lists[i].list);
+		cache.lists[i] = (struct page_list){0};
 	}
+	pthread_mutex_unlock(&cache.lock);
+}
 
-	fz_try(apdf.ctx)
-		fz_run_page_contents(apdf.ctx, apdf.page, apdf.dev, transform, NULL);
+static fz_pixmap* render_tile(fz_context* ctx, fz_display_list* list,
+	float fact, float dpi, int tx, int ty, fz_irect paper)
+{
+	fz_irect bbox = {
+		.x0 = tx * PDF_TILE_SIZE,
+		.y0 = ty * PDF_TILE_SIZE,
+		.x1 = (tx + 1) * PDF_TILE_SIZE,
+		.y1 = (ty + 1) * PDF_TILE_SIZE
+	};
+	bbox = fz_intersect_irect(bbox, paper);
+	if (fz_is_empty_irect(bbox))
+		return NULL;
+
+	fz_pixmap* pmap = NULL;
+	fz_device* dev = NULL;
+	fz_var(pmap);
+	fz_var(dev);
 
-/* option here: toggle annotations on / off - possibly also as an overlay
- * window so the WM gets to split out */
+/* For big-endian it might be better to probe shmif_pixel through the packing
+ * macro and switch between bgr and rgb there, the 1 sets n=4 for alpha ch. */
+	fz_try(ctx){
+		pmap = fz_new_pixmap_with_bbox(ctx, fz_device_bgr(ctx), bbox, NULL, 1);
 
-	fz_catch(apdf.ctx){
-		fprintf(stderr, "couldn't run page: %s\n", fz_caught_message(apdf.ctx));
-		repack = false;
+/* change the >density< of the pixmap from the assumed default 72, though
+ * can't find a control for also setting the subchannel layout for hinting */
+		fz_set_pixmap_resolution(ctx, pmap, dpi, dpi);
+
+/* clearing to white with alpha is the paper */
+		fz_clear_pixmap_with_value(ctx, pmap, 0xff);
+		dev = fz_new_draw_device(ctx, fz_identity, pmap);
+		fz_run_display_list(ctx, list, dev,
+			fz_scale(fact, fact), fz_rect_from_irect(bbox), NULL);
+		fz_close_device(ctx, dev);
+	}
+	fz_always(ctx)
+		fz_drop_device(ctx, dev);
+	fz_catch(ctx){
+		fprintf(stderr, "couldn't render tile: %s\n", fz_caught_message(ctx));
+		fz_drop_pixmap(ctx, pmap);
+		pmap = NULL;
 	}
 
-	if (!repack)
-		return;
+	return pmap;
+}
+
+/* paper area in page raster space and the range of tiles visible in view */
+static bool view_tiles(fz_rect bounds, struct view* v, fz_irect* paper, fz_irect* tiles)
+{
+	*paper = fz_round_rect(fz_transform_rect(bounds, fz_scale(v->fact, v->fact)));
+
+	fz_irect vis = {
+		.x0 = -v->dx,
+		.y0 = -v->dy,
+		.x1 = (int) v->w - v->dx,
+		.y1 = (int) v->h - v->dy
+	};
+	vis = fz_intersect_irect(vis, *paper);
+	if (fz_is_empty_irect(vis))
+		return false;
+
+	*tiles = (fz_irect){
+		.x0 = tile_div(vis.x0),
+		.y0 = tile_div(vis.y0),
+		.x1 = tile_div(vis.x1 - 1),
+		.y1 = tile_div(vis.y1 - 1)
+	};
+	return true;
+}
+
+static bool prerender_view(fz_context* ctx, struct view* v, uint64_t gen)
+{
+	if (v->page_no < 0 || v->page_no >= apdf.n_pages || v->fact <= 0.1)
+		return true;
+
+	fz_rect bounds;
+	fz_display_list* list = get_list(ctx, v->page_no, &bounds);
+	if (!list)
+		return true;
+
+	fz_irect paper, tiles;
+	int zoom = zoom_key(v->fact);
+
+	if (view_tiles(bounds, v, &paper, &tiles))
+	for (int ty = tiles.y0; ty <= tiles.y1; ty++)
+		for (int tx = tiles.x0; tx <= tiles.x1; tx++){
+/* the view changed, restart from the new one */
+			if (atomic_load(&cache.gen) != gen){
+				fz_drop_display_list(ctx, list);
+				return false;
+			}
 
-	if (apdf.annotations){
-		fz_try(apdf.ctx)
-			fz_run_page_annots(apdf.ctx, apdf.page, apdf.dev, transform, NULL);
-		fz_catch(apdf.ctx){
-			fprintf(stderr, "couldn't run annotations: %s\n", fz_caught_message(apdf.ctx));
+			fz_pixmap* pmap = tile_lookup(ctx, v->page_no, zoom, tx, ty);
+			if (!pmap){
+				pmap = render_tile(ctx, list, v->fact, v->dpi, tx, ty, paper);
+				if (pmap)
+					tile_insert(ctx, v->page_no, zoom, tx, ty, pmap);
+			}
+			fz_drop_pixmap(ctx, pmap);
 		}
-	}
 
-	arcan_shmif_signal(&apdf.con, SHMIF_SIGVID | SHMIF_SIGBLK_NONE);
-	apdf.locked = true;
+	fz_drop_display_list(ctx, list);
+	return true;
 }
 
-static void set_page(int no)
+static void* prerender(void* tag)
 {
-	if (apdf.page)
-		apdf.page = (fz_drop_page(apdf.ctx, apdf.page), NULL);
+	fz_context* ctx = tag;
+	uint64_t gen = 0;
+
+	pthread_mutex_lock(&cache.lock);
+	while (cache.alive){
+		if (gen == atomic_load(&cache.gen)){
+			pthread_cond_wait(&cache.cond, &cache.lock);
+			continue;
+		}
 
-	int np = fz_count_pages(apdf.ctx, apdf.doc);
+		gen = atomic_load(&cache.gen);
+		struct view cur = cache.view;
+		pthread_mutex_unlock(&cache.lock);
 
-/* don't permit negative wraparound (expensive and rarely desired) */
-	if (no < 0 || !np)
-		no = 0;
-	else if (no >= np)
-		no = np - 1;
+/* next page first as that is the more common step, then zoom steps */
+		struct view set[] = {cur, cur, cur, cur};
+		set[0].page_no++;
+		set[1].page_no--;
+		set[2].fact += 0.1;
+		set[3].fact -= 0.1;
 
-	fz_try(apdf.ctx)
-		apdf.page = fz_load_page(apdf.ctx, apdf.doc, no);
-	fz_catch(apdf.ctx){
-		fprintf(stderr, "couldn't load page %d: %s\n", no, fz_caught_message(apdf.ctx));
-		return;
+		for (size_t i = 0; i < sizeof(set) / sizeof(set[0]); i++)
+			if (!prerender_view(ctx, &set[i], gen))
+				break;
+
+		pthread_mutex_lock(&cache.lock);
 	}
+	pthread_mutex_unlock(&cache.lock);
 
-	apdf.page_no = no;
-	apdf.dirty = true;
+	fz_drop_context(ctx);
+	return NULL;
 }
 
-static void rebuild_pixmap()
+static void fill_rect(fz_irect r, shmif_pixel px)
 {
-	apdf.dirty = true;
-	if (apdf.pmap){
-		apdf.pmap = (fz_drop_pixmap(apdf.ctx, apdf.pmap), NULL);
+	for (int y = r.y0; y < r.y1; y++){
+		shmif_pixel* out = &apdf.con.vidp[y * apdf.con.pitch];
+		for (int x = r.x0; x < r.x1; x++)
+			out[x] = px;
+	}
+}
+
+static void blit_tile(fz_pixmap* pmap, fz_irect clip)
+{
+	fz_irect dst = fz_translate_irect(fz_pixmap_bbox(apdf.ctx, pmap), apdf.dx, apdf.dy);
+	fz_irect r = fz_intersect_irect(dst, clip);
+	if (fz_is_empty_irect(r))
+		return;
+
+	unsigned char* samples = fz_pixmap_samples(apdf.ctx, pmap);
+	size_t stride = fz_pixmap_stride(apdf.ctx, pmap);
+	size_t nb = (r.x1 - r.x0) * sizeof(shmif_pixel);
+
+	for (int y = r.y0; y < r.y1; y++)
+		memcpy(&apdf.con.vidp[y * apdf.con.pitch + r.x0],
+			&samples[(y - dst.y0) * stride + (r.x0 - dst.x0) * 4], nb);
+}
+
+static fz_irect union_irect(fz_irect a, fz_irect b)
+{
+	if (fz_is_empty_irect(a))
+		return b;
+	if (fz_is_empty_irect(b))
+		return a;
+
+	return (fz_irect){
+		.x0 = MIN(a.x0, b.x0),
+		.y0 = MIN(a.y0, b.y0),
+		.x1 = a.x1 > b.x1 ? a.x1 : b.x1,
+		.y1 = a.y1 > b.y1 ? a.y1 : b.y1
+	};
+}
+
+static void calculate_zoom_factor()
+{
+	fz_rect rect = page_bounds(apdf.page_no);
+	float wofs = (apdf.dpy.density * 2.54) / 72.0;
+
+	float imgw = (rect.x1 - rect.x0) * wofs;
+	float imgh = (rect.y1 - rect.y0) * wofs;
+	float wnd_ar = apdf.con.w / apdf.con.h;
+	float doc_ar = imgw / imgh;
+
+	if (doc_ar > wnd_ar){
+		apdf.scale = (float) apdf.con.w / imgw;
 	}
+	else {
+		apdf.scale = (float) apdf.con.h / imgh;
+	}
+}
 
+static void resize_segment()
+{
 /* two different modes here, one is where we switch page size to fit when stepping
  * (assuming it has changed from last time) - or we pan. There is also:
  * fz_is_document_reflowable -> fz_layout_document(ctx, doc, w, h, em_font_sz) */
@@ -199,43 +516,115 @@ static void rebuild_pixmap()
 		apdf.rezoom = true;
 	}
 
-	arcan_shmif_resize_ext(&apdf.con, w, h, (struct shmif_resize_ext){.vbuf_cnt = 2});
+/* single buffered as compose only updates the damaged parts, locked
+ * (waiting for STEPFRAME) prevents us from touching it mid-transfer */
+	arcan_shmif_resize(&apdf.con, w, h);
 	if (apdf.rezoom){
 		calculate_zoom_factor();
 		apdf.rezoom = false;
 	}
 
-/* Now we have the 'negotiated' size - that might not match the actual size of
- * the page though so we might want to pan / offset. Doing that requires we
- * offset the vidb accordingly (and reduce w / h). */
+/* another interesting bit here is that we could add our own font hooks and map
+ * that to the fonthints that we receive over the connection */
+}
+
+static void render()
+{
+	resize_segment();
 
-/* For big-endian it might be better to probe shmif_pixel through the packing
- * macro and switch between bgr and rgb there, the [1] sets n=4 for alpha ch. */
-	fz_colorspace* cspace = fz_device_bgr(apdf.ctx);
-	fz_try(apdf.ctx)
-		apdf.pmap = fz_new_pixmap_with_data(apdf.ctx, cspace,
-			apdf.con.w, apdf.con.h, NULL, 1, apdf.con.stride, apdf.con.vidb);
+	fz_rect bounds;
+	fz_display_list* list = get_list(apdf.ctx, apdf.page_no, &bounds);
+	if (!list)
+		return;
 
-	fz_catch(apdf.ctx){
-		fprintf(stderr, "pixmap creation failed: %s\n", fz_caught_message(apdf.ctx));
-	}
+	struct view v = {
+		.page_no = apdf.page_no,
+		.fact = get_fact(),
+		.dpi = apdf.dpy.density * 2.54,
+		.dx = apdf.dx,
+		.dy = apdf.dy,
+		.w = apdf.con.w,
+		.h = apdf.con.h
+	};
+
+	fz_irect win = {.x1 = apdf.con.w, .y1 = apdf.con.h};
+	fz_irect paper, tiles;
+	bool visible = view_tiles(bounds, &v, &paper, &tiles);
+	fz_irect wpaper = fz_intersect_irect(
+		fz_translate_irect(paper, apdf.dx, apdf.dy), win);
 
-	apdf.pmap->flags &= ~1; /* stop it from free:ing our buffer */
+	shmif_pixel bg_pixel = SHMIF_RGBA(0x40, 0x40, 0x40, 0xff);
 
-/* change the >density< of the pixmap from the assumed default 72, though
- * can't find a control for also setting the subchannel layout for hinting */
-	float dpi = apdf.dpy.density * 2.54;
-	fz_set_pixmap_resolution(apdf.ctx, apdf.pmap, dpi, dpi);
+/* after a resize (or the first frame) the contents are undefined, otherwise
+ * only what the previous paper covered needs to go back to background */
+	fz_irect dirty = win;
+	if (!apdf.shown.valid || apdf.shown.w != apdf.con.w ||
+		apdf.shown.h != apdf.con.h || apdf.shown.vidp != apdf.con.vidp){
+		fill_rect(win, bg_pixel);
+	}
+	else {
+		fill_rect(apdf.shown.paper, bg_pixel);
+		dirty = union_irect(apdf.shown.paper, wpaper);
+	}
 
-	fz_try(apdf.ctx)
-		apdf.dev = fz_new_draw_device(apdf.ctx, fz_identity, apdf.pmap);
+/* missing visible tiles are rendered here, the worker only handles what
+ * might be needed next */
+	int zoom = zoom_key(v.fact);
+	if (visible)
+	for (int ty = tiles.y0; ty <= tiles.y1; ty++)
+		for (int tx = tiles.x0; tx <= tiles.x1; tx++){
+			fz_pixmap* pmap = tile_lookup(apdf.ctx, v.page_no, zoom, tx, ty);
+			if (!pmap){
+				pmap = render_tile(apdf.ctx, list, v.fact, v.dpi, tx, ty, paper);
+				if (!pmap)
+					continue;
+				tile_insert(apdf.ctx, v.page_no, zoom, tx, ty, pmap);
+			}
+			blit_tile(pmap, win);
+			fz_drop_pixmap(apdf.ctx, pmap);
+		}
 
-	fz_catch(apdf.ctx){
-		fprintf(stderr, "device creation failed: %s\n", fz_caught_message(apdf.ctx));
+	fz_drop_display_list(apdf.ctx, list);
+
+	apdf.shown.valid = true;
+	apdf.shown.paper = wpaper;
+	apdf.shown.w = apdf.con.w;
+	apdf.shown.h = apdf.con.h;
+	apdf.shown.vidp = apdf.con.vidp;
+
+	if (!fz_is_empty_irect(dirty)){
+		apdf.con.dirty.x1 = dirty.x0;
+		apdf.con.dirty.y1 = dirty.y0;
+		apdf.con.dirty.x2 = dirty.x1;
+		apdf.con.dirty.y2 = dirty.y1;
+		arcan_shmif_signal(&apdf.con, SHMIF_SIGVID | SHMIF_SIGBLK_NONE);
+		apdf.locked = true;
 	}
 
-/* another interesting bit here is that we could add our own font hooks and map
- * that to the fonthints that we receive over the connection */
+	pthread_mutex_lock(&cache.lock);
+	cache.view = v;
+	atomic_fetch_add(&cache.gen, 1);
+	pthread_cond_signal(&cache.cond);
+	pthread_mutex_unlock(&cache.lock);
+}
+
+static void set_page(int no)
+{
+/* don't permit negative wraparound (expensive and rarely desired) */
+	if (no < 0 || !apdf.n_pages)
+		no = 0;
+	else if (no >= apdf.n_pages)
+		no = apdf.n_pages - 1;
+
+/* usually already interpreted by the worker */
+	fz_rect bounds;
+	fz_display_list* list = get_list(apdf.ctx, no, &bounds);
+	if (!list)
+		return;
+
+	fz_drop_display_list(apdf.ctx, list);
+	apdf.page_no = no;
+	apdf.dirty = true;
 }
 
 static bool zoom_in(void* tag)
@@ -273,7 +662,7 @@ static bool zoom_auto(void* tag)
 
 static bool auto_size(void* tag)
 {
-	fz_rect rect = fz_bound_page(apdf.ctx, apdf.page);
+	fz_rect rect = page_bounds(apdf.page_no);
 	float wofs = (apdf.dpy.density * 2.54) / 72.0 * apdf.scale;
 	apdf.hh = ceilf(rect.x1 * wofs);
 	apdf.hw = ceilf(rect.y1 * wofs);
@@ -513,12 +902,27 @@ int decode_pdf(struct arcan_shmif_cont* C, struct arg_arr* args)
 		return show_use(C, "file=arg [arg] couldn't be opened");
 	}
 
-	apdf.ctx = fz_new_context(NULL, NULL, FZ_STORE_DEFAULT);
+/* locking is needed for the prerender worker to share the store */
+	for (size_t i = 0; i < FZ_LOCK_MAX; i++)
+		pthread_mutex_init(&cache.fz_locks[i], NULL);
+
+	fz_locks_context locks = {
+		.lock = fz_lock_cb,
+		.unlock = fz_unlock_cb
+	};
+
+	apdf.ctx = fz_new_context(NULL, &locks, FZ_STORE_DEFAULT);
 	fz_register_document_handlers(apdf.ctx);
 
 	if (!open_document(fpek, idstr))
 		return EXIT_FAILURE;
 
+	fz_try(apdf.ctx)
+		apdf.n_pages = fz_count_pages(apdf.ctx, apdf.doc);
+	fz_catch(apdf.ctx){
+		fprintf(stderr, "couldn't count pages: %s\n", fz_caught_message(apdf.ctx));
+	}
+
 	apdf.con = *C;
 	labelhint_table(ihandlers);
 	labelhint_announce(&apdf.con);
@@ -529,9 +933,19 @@ int decode_pdf(struct arcan_shmif_cont* C, struct arg_arr* args)
 	apdf.dpy = *init;
 	apdf.hw = apdf.con.w;
 	apdf.hh = apdf.con.h;
-	apdf.con.hints = SHMIF_RHINT_VSIGNAL_EV;
+	apdf.con.hints = SHMIF_RHINT_VSIGNAL_EV | SHMIF_RHINT_SUBREGION;
 	arcan_shmif_mousestate_setup(&apdf.con, true, apdf.mstate);
 
+/* without a worker everything still works, just without prerendering */
+	fz_context* wctx = fz_clone_context(apdf.ctx);
+	if (wctx){
+		cache.alive = true;
+		if (0 != pthread_create(&cache.worker, NULL, prerender, wctx)){
+			cache.alive = false;
+			fz_drop_context(wctx);
+		}
+	}
+
 	set_page(0);
 	render();
 
@@ -549,6 +963,16 @@ int decode_pdf(struct arcan_shmif_cont* C, struct arg_arr* args)
 		}
 	}
 
+	if (cache.alive){
+		pthread_mutex_lock(&cache.lock);
+		cache.alive = false;
+		atomic_fetch_add(&cache.gen, 1);
+		pthread_cond_signal(&cache.cond);
+		pthread_mutex_unlock(&cache.lock);
+		pthread_join(cache.worker, NULL);
+	}
+
+	cache_flush(apdf.ctx);
 	fz_drop_document(apdf.ctx, apdf.doc);
 	fz_drop_context(apdf.ctx);
 	arcan_shmif_drop(&apdf.con);
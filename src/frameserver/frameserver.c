@@ -215,8 +215,84 @@ int launch_mode(const char* modestr,
 	return fptr(con.addr ? &con : NULL, arg);
 }
 
+/*
+ * Pre-forked by the launch pool in the parent: block on the connection socket
+ * until claimed, the claim carries the environment we would otherwise have
+ * been executed with as: u32 length, u8 preserve-env, NUL terminated
+ * key=value strings. EOF means the parent dropped us or is gone.
+ */
+static bool read_full(int fd, void* dst, size_t n)
+{
+	uint8_t* buf = dst;
+	while (n){
+		ssize_t nr = read(fd, buf, n);
+		if (-1 == nr && errno == EINTR)
+			continue;
+		if (nr <= 0)
+			return false;
+		buf += nr;
+		n -= nr;
+	}
+	return true;
+}
+
+static bool prefork_wait()
+{
+	extern char** environ;
+	unsetenv("ARCAN_PREFORK");
+
+	const char* sockstr = getenv("ARCAN_SOCKIN_FD");
+	if (!sockstr)
+		return false;
+
+	int fd = (int) strtol(sockstr, NULL, 10);
+	int flags = fcntl(fd, F_GETFL);
+	if (-1 != flags)
+		fcntl(fd, F_SETFL, flags & (~O_NONBLOCK));
+
+	uint32_t len;
+	if (!read_full(fd, &len, 4) || len < 1 || len > 65536)
+		return false;
+
+	char* buf = malloc(len);
+	if (!buf || !read_full(fd, buf, len) || (len > 1 && buf[len-1] != '\0')){
+		free(buf);
+		return false;
+	}
+
+/* replace rather than override, drop what we were executed with */
+	if (!buf[0]){
+		while (environ && environ[0]){
+			char* eq = strchr(environ[0], '=');
+			if (!eq)
+				break;
+
+			char name[eq - environ[0] + 1];
+			memcpy(name, environ[0], eq - environ[0]);
+			name[eq - environ[0]] = '\0';
+			if (-1 == unsetenv(name))
+				break;
+		}
+	}
+
+	for (size_t ofs = 1; ofs < len; ofs += strlen(&buf[ofs]) + 1){
+		char* val = strchr(&buf[ofs], '=');
+		if (!val)
+			continue;
+		*val = '\0';
+		setenv(&buf[ofs], &val[1], 1);
+		*val = '=';
+	}
+
+	free(buf);
+	return true;
+}
+
 int main(int argc, char** argv)
 {
+	if (getenv("ARCAN_PREFORK") && !prefork_wait())
+		return EXIT_FAILURE;
+
 #ifdef DEFAULT_FSRV_MODE
 	char* fsrvmode = DEFAULT_FSRV_MODE;
 	char* argstr = argc > 1 ? argv[1] : NULL; /* optional */
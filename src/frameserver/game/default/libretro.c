@@ -30,6 +30,7 @@
 #define WANT_ARCAN_SHMIF_HELPER
 #endif
 #include <arcan_shmif.h>
+#include <arcan_shmif_pixconv.h>
 
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -41,6 +42,10 @@
 
 #include "font_8x8.h"
 
+#ifdef LIBRETRO_ZSTD
+#include <zstd.h>
+#endif
+
 #ifndef MAX_PORTS
 #define MAX_PORTS 4
 #endif
@@ -53,6 +58,10 @@
 #define MAX_BUTTONS 16
 #endif
 
+#ifndef MAX_ROLLBACK
+#define MAX_ROLLBACK 60
+#endif
+
 #undef BADID
 
 #define COUNT_OF(x) \
@@ -83,6 +92,35 @@ struct core_variable {
 	bool updated;
 };
 
+/* history of serialized states, the oldest (base) and newest (head) are kept
+ * in full and the ones in between only as the xor of two consecutive states,
+ * compressed. Most of the state is expected to stay the same from one frame to
+ * the next, so the deltas are small and the window can be longer. */
+struct state_delta {
+	uint8_t* buf;
+	size_t sz, cap;
+};
+
+struct state_ring {
+	uint8_t* base;
+	uint8_t* head;
+	uint8_t* work;
+	uint8_t* delta;
+	size_t state_sz;
+
+	struct state_delta* slots;
+	size_t n_slots, first, count;
+
+/* cleared when a frame could not be serialized, the deltas no longer cover
+ * every frame since [base] so the ring can't be used until restarted */
+	bool valid;
+
+#ifdef LIBRETRO_ZSTD
+	ZSTD_CCtx* cctx;
+	ZSTD_DCtx* dctx;
+#endif
+};
+
 typedef void(*pixconv_fun)(const void* data, shmif_pixel* outp,
 	unsigned width, unsigned height, size_t pitch, bool postfilter);
 
@@ -151,9 +189,12 @@ static struct {
  	bool dirty_input;
 	float aframesz;
 	int rollback_window;
-	unsigned rollback_front;
-	char* rollback_state;
+	struct state_ring rollback;
 	size_t state_sz;
+
+/* for runahead, each frame also emulates n frames ahead that are only used
+ * to present the last one, then restores to the first (requires savestate) */
+	int runahead;
 	char* syspath;
 	bool res_empty;
 
@@ -297,6 +338,243 @@ static void resize_shmpage(int neww, int newh, bool first)
 	}
 }
 
+static void xor_state(uint8_t* dst, const uint8_t* a, const uint8_t* b, size_t n)
+{
+	size_t i = 0;
+	for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)){
+		uint64_t va, vb;
+		memcpy(&va, &a[i], sizeof(uint64_t));
+		memcpy(&vb, &b[i], sizeof(uint64_t));
+		va ^= vb;
+		memcpy(&dst[i], &va, sizeof(uint64_t));
+	}
+
+	for (; i < n; i++)
+		dst[i] = a[i] ^ b[i];
+}
+
+#ifndef LIBRETRO_ZSTD
+/* without zstd, the xor:ed state is packed as [u32 zeroes][u32 n][n bytes] */
+static size_t delta_bound(size_t n)
+{
+	return n + 8 * (n / 8 + 2);
+}
+
+static size_t delta_pack(struct state_ring* ring,
+	uint8_t* dst, size_t cap, const uint8_t* src, size_t n)
+{
+	size_t pos = 0;
+	size_t i = 0;
+
+	while (i < n){
+		uint32_t zeroes = 0;
+		while (i < n && !src[i]){
+			zeroes++;
+			i++;
+		}
+
+/* a literal run ends on the first run of 8 or more zeroes */
+		size_t end = i;
+		for (size_t j = i; j < n; j++){
+			if (src[j])
+				end = j + 1;
+			else if (j - end >= 7)
+				break;
+		}
+		uint32_t nlit = end - i;
+
+		if (pos + 8 + nlit > cap)
+			return 0;
+
+		memcpy(&dst[pos], &zeroes, 4);
+		memcpy(&dst[pos+4], &nlit, 4);
+		memcpy(&dst[pos+8], &src[i], nlit);
+		pos += 8 + nlit;
+		i += nlit;
+	}
+
+	return pos;
+}
+
+static bool delta_unpack(struct state_ring* ring,
+	uint8_t* dst, size_t n, const uint8_t* src, size_t sz)
+{
+	size_t pos = 0;
+	size_t i = 0;
+
+	while (pos + 8 <= sz){
+		uint32_t zeroes, nlit;
+		memcpy(&zeroes, &src[pos], 4);
+		memcpy(&nlit, &src[pos+4], 4);
+		pos += 8;
+
+		if (zeroes > n - i || nlit > n - i - zeroes || nlit > sz - pos)
+			return false;
+
+		memset(&dst[i], '\0', zeroes);
+		i += zeroes;
+		memcpy(&dst[i], &src[pos], nlit);
+		i += nlit;
+		pos += nlit;
+	}
+
+	memset(&dst[i], '\0', n - i);
+	return true;
+}
+#else
+static size_t delta_bound(size_t n)
+{
+	return ZSTD_compressBound(n);
+}
+
+static size_t delta_pack(struct state_ring* ring,
+	uint8_t* dst, size_t cap, const uint8_t* src, size_t n)
+{
+	size_t rv = ZSTD_compressCCtx(ring->cctx, dst, cap, src, n, 1);
+	return ZSTD_isError(rv) ? 0 : rv;
+}
+
+static bool delta_unpack(struct state_ring* ring,
+	uint8_t* dst, size_t n, const uint8_t* src, size_t sz)
+{
+	size_t rv = ZSTD_decompressDCtx(ring->dctx, dst, n, src, sz);
+	return !ZSTD_isError(rv) && rv == n;
+}
+#endif
+
+static void ring_free(struct state_ring* ring)
+{
+	for (size_t i = 0; i < ring->n_slots; i++)
+		free(ring->slots[i].buf);
+
+	free(ring->slots);
+	free(ring->base);
+	free(ring->head);
+	free(ring->work);
+	free(ring->delta);
+
+#ifdef LIBRETRO_ZSTD
+	ZSTD_freeCCtx(ring->cctx);
+	ZSTD_freeDCtx(ring->dctx);
+#endif
+
+	*ring = (struct state_ring){0};
+}
+
+/* [window] is the number of states to keep, including the newest one */
+static bool ring_setup(struct state_ring* ring, size_t state_sz, size_t window)
+{
+	ring_free(ring);
+	ring->state_sz = state_sz;
+	ring->n_slots = window > 1 ? window - 1 : 0;
+
+	ring->base = malloc(state_sz);
+	ring->head = malloc(state_sz);
+	ring->work = malloc(state_sz);
+	ring->delta = malloc(state_sz);
+	if (ring->n_slots)
+		ring->slots = calloc(ring->n_slots, sizeof(struct state_delta));
+
+#ifdef LIBRETRO_ZSTD
+	ring->cctx = ZSTD_createCCtx();
+	ring->dctx = ZSTD_createDCtx();
+	if (!ring->cctx || !ring->dctx){
+		ring_free(ring);
+		return false;
+	}
+#endif
+
+	if (!ring->base || !ring->head || !ring->work ||
+		!ring->delta || (ring->n_slots && !ring->slots)){
+		ring_free(ring);
+		return false;
+	}
+
+	return true;
+}
+
+/* drop everything but the oldest state, used after restoring from it */
+static void ring_rewind(struct state_ring* ring)
+{
+	memcpy(ring->head, ring->base, ring->state_sz);
+	ring->first = ring->count = 0;
+}
+
+/* first state, [work] is taken as both the oldest and the newest */
+static void ring_reset(struct state_ring* ring)
+{
+	memcpy(ring->base, ring->work, ring->state_sz);
+	ring_rewind(ring);
+}
+
+/* append the state that has been serialized into [work] */
+static void ring_push(struct state_ring* ring)
+{
+	if (!ring->n_slots){
+		ring_reset(ring);
+		return;
+	}
+
+/* full, fold the oldest delta into the base state */
+	if (ring->count == ring->n_slots){
+		struct state_delta* old = &ring->slots[ring->first];
+		if (!delta_unpack(ring, ring->delta, ring->state_sz, old->buf, old->sz)){
+			LOG("couldn't unpack rollback state, resetting\n");
+			ring_reset(ring);
+			return;
+		}
+		xor_state(ring->base, ring->base, ring->delta, ring->state_sz);
+		ring->first = (ring->first + 1) % ring->n_slots;
+		ring->count--;
+	}
+
+	struct state_delta* slot =
+		&ring->slots[(ring->first + ring->count) % ring->n_slots];
+
+	size_t bound = delta_bound(ring->state_sz);
+	if (slot->cap < bound){
+		free(slot->buf);
+		slot->buf = malloc(bound);
+		slot->cap = slot->buf ? bound : 0;
+	}
+
+	xor_state(ring->delta, ring->work, ring->head, ring->state_sz);
+	slot->sz = slot->buf ?
+		delta_pack(ring, slot->buf, slot->cap, ring->delta, ring->state_sz) : 0;
+
+/* no room for the delta, start over from the new state */
+	if (!slot->sz){
+		ring_reset(ring);
+		return;
+	}
+	ring->count++;
+
+	uint8_t* tmp = ring->head;
+	ring->head = ring->work;
+	ring->work = tmp;
+}
+
+/* returns true if the current state could be serialized, it is then always
+ * the newest (head) state of the ring */
+static bool store_state()
+{
+	if (!retro.rollback.work)
+		return false;
+
+	if (!retro.serialize(retro.rollback.work, retro.state_sz)){
+		retro.rollback.valid = false;
+		return false;
+	}
+
+	if (retro.rollback.valid)
+		ring_push(&retro.rollback);
+	else {
+		ring_reset(&retro.rollback);
+		retro.rollback.valid = true;
+	}
+	return true;
+}
+
 /* overrv / overra are needed for handling rollbacks etc.
  * while still making sure the other frameskipping options are working */
 static void process_frames(int nframes, bool overrv, bool overra)
@@ -310,17 +588,41 @@ static void process_frames(int nframes, bool overrv, bool overra)
 	if (overra)
 		retro.skipframe_a = true;
 
-	while(nframes--)
+	while(nframes--){
 		retro.run();
+		if (retro.skipmode <= TARGET_SKIP_ROLLBACK)
+			store_state();
+	}
 
-	if (retro.skipmode <= TARGET_SKIP_ROLLBACK){
-		retro.serialize(retro.rollback_state +
-			(retro.rollback_front * retro.state_sz), retro.state_sz);
-		retro.rollback_front = (retro.rollback_front + 1)
-			% retro.rollback_window;
+	retro.skipframe_v = cv;
+	retro.skipframe_a = ca;
+}
+
+/* The first frame is the one that belongs to the timeline (audio is kept) and
+ * gets stored, the following ones are run hidden and only the last is shown,
+ * then the stored state is restored so the next frame continues from there.
+ * If the core refuses to serialize there is nothing to restore, so the frame
+ * stays on the timeline and no frames are run ahead. */
+static void process_runahead()
+{
+	bool cv = retro.skipframe_v;
+	bool ca = retro.skipframe_a;
+
+	retro.skipframe_v = true;
+	retro.run();
+	if (!store_state()){
+		retro.skipframe_v = cv;
+		return;
 	}
 
+	retro.skipframe_a = true;
+	for (int i = 1; i < retro.runahead; i++)
+		retro.run();
+
 	retro.skipframe_v = cv;
+	retro.run();
+
+	retro.deserialize(retro.rollback.head, retro.state_sz);
 	retro.skipframe_a = ca;
 }
 
@@ -364,6 +666,14 @@ static void libretro_rgb565_rgba(const uint16_t* data, shmif_pixel* outp,
 	uint16_t* interm = retro.ntsc_imb;
 	retro.colorspace = "RGB565->RGBA";
 
+	if (!retro.ntscconv){
+		arcan_shmif_pixconv_import(SHMIF_PIXFMT_RGB565,
+			(const uint8_t* const[3]){(const uint8_t*) data},
+			(const size_t[3]){pitch}, width, height, outp, 0, 0
+		);
+		return;
+	}
+
 /* with NTSC on, the input format is already correct */
 	for (int y = 0; y < height; y++){
 		for (int x = 0; x < width; x++){
@@ -371,19 +681,12 @@ static void libretro_rgb565_rgba(const uint16_t* data, shmif_pixel* outp,
 			uint8_t r = rgb565_lut5[ (val & 0xf800) >> 11 ];
 			uint8_t g = rgb565_lut6[ (val & 0x07e0) >> 5  ];
 			uint8_t b = rgb565_lut5[ (val & 0x001f)       ];
-
-			if (retro.ntscconv)
-				*interm++ = RGB565(r, g, b);
-			else
-				*outp++ = RGBA(r, g, b, 0xff);
+			*interm++ = RGB565(r, g, b);
 		}
 		data += pitch >> 1;
 	}
 
-	if (retro.ntscconv)
-		push_ntsc(width, height, retro.ntsc_imb, outp);
-
-	return;
+	push_ntsc(width, height, retro.ntsc_imb, outp);
 }
 
 static void libretro_xrgb888_rgba(const uint32_t* data, uint32_t* outp,
@@ -392,22 +695,26 @@ static void libretro_xrgb888_rgba(const uint32_t* data, uint32_t* outp,
 	assert( (uintptr_t)data % 4 == 0 );
 	retro.colorspace = "XRGB888->RGBA";
 
+	if (!retro.ntscconv){
+		arcan_shmif_pixconv_import(SHMIF_PIXFMT_XRGB8888,
+			(const uint8_t* const[3]){(const uint8_t*) data},
+			(const size_t[3]){pitch}, width, height, outp, 0, 0
+		);
+		return;
+	}
+
 	uint16_t* interm = retro.ntsc_imb;
 
 	for (int y = 0; y < height; y++){
 		for (int x = 0; x < width; x++){
 			uint8_t* quad = (uint8_t*) (data + x);
-			if (retro.ntscconv)
-				*interm++ = RGB565(quad[2], quad[1], quad[0]);
-			else
-				*outp++ = RGBA(quad[2], quad[1], quad[0], 0xff);
+			*interm++ = RGB565(quad[2], quad[1], quad[0]);
 		}
 
 		data += pitch >> 2;
 	}
 
-	if (retro.ntscconv)
-		push_ntsc(width, height, retro.ntsc_imb, outp);
+	push_ntsc(width, height, retro.ntsc_imb, outp);
 }
 
 static void libretro_rgb1555_rgba(const uint16_t* data, uint32_t* outp,
@@ -540,6 +847,37 @@ static void libretro_skipnframes(unsigned count, bool fastfwd)
 	retro.skipframe_v = false;
 }
 
+static void setup_rollback()
+{
+	bool rollback = retro.skipmode <= TARGET_SKIP_ROLLBACK;
+	if (retro.state_sz == 0 || (!rollback && !retro.runahead)){
+		ring_free(&retro.rollback);
+		return;
+	}
+
+/* runahead only needs the newest state */
+	retro.rollback_window = 1;
+	if (rollback){
+		retro.rollback_window = (TARGET_SKIP_ROLLBACK - retro.skipmode) + 1;
+		if (retro.rollback_window > MAX_ROLLBACK)
+			retro.rollback_window = MAX_ROLLBACK;
+	}
+
+	if (!ring_setup(&retro.rollback, retro.state_sz, retro.rollback_window)){
+		LOG("couldn't allocate rollback states\n");
+		retro.runahead = 0;
+		return;
+	}
+
+	if (retro.serialize(retro.rollback.work, retro.state_sz)){
+		ring_reset(&retro.rollback);
+		retro.rollback.valid = true;
+	}
+
+	LOG("setting input rollback (%d), runahead (%d)\n",
+		retro.rollback_window, retro.runahead);
+}
+
 static void reset_timing(bool newstate)
 {
 	arcan_shmif_enqueue(&retro.shmcont, &(arcan_event){
@@ -555,23 +893,8 @@ static void reset_timing(bool newstate)
 	}
 
 /* since we can't be certain about our current vantage point...*/
-	if (newstate && retro.skipmode <= TARGET_SKIP_ROLLBACK &&
-		retro.state_sz > 0){
-		retro.rollback_window = (TARGET_SKIP_ROLLBACK - retro.skipmode) + 1;
-		if (retro.rollback_window > 10)
-			retro.rollback_window = 10;
-
-		free(retro.rollback_state);
-		retro.rollback_state = malloc(retro.state_sz * retro.rollback_window);
-		retro.rollback_front = 0;
-
-		retro.serialize(retro.rollback_state, retro.state_sz);
-		for (int i=1; i < retro.rollback_window - 1; i++)
-			memcpy(retro.rollback_state + (i*retro.state_sz),
-				retro.rollback_state, retro.state_sz);
-
-		LOG("setting input rollback (%d)\n", retro.rollback_window);
-	}
+	if (newstate)
+		setup_rollback();
 }
 
 static void libretro_audscb(int16_t left, int16_t right)
@@ -1725,6 +2048,11 @@ int	afsrv_game(struct arcan_shmif_cont* cont, struct arg_arr* args)
 		retro.def_abuf_sz = strtoul(val, NULL, 10);
 	}
 
+	if (arg_lookup(args, "runahead", 0, &val)){
+		int n = strtol(val, NULL, 10);
+		retro.runahead = n > 0 && n <= 8 ? n : 0;
+	}
+
 /* system directory doesn't really match any of arcan namespaces,
  * provide some kind of global-  user overridable way */
 	const char* spath = getenv("ARCAN_LIBRETRO_SYSPATH");
@@ -1827,15 +2155,13 @@ int	afsrv_game(struct arcan_shmif_cont* cont, struct arg_arr* args)
 /* some cores die on this kind of reset, retro.reset() e.g. NXengine
  * retro_reset() */
 
-	if (retro.state_sz > 0)
-		retro.rollback_state = malloc(retro.state_sz);
-
 /* basetime is used as epoch for all other timing calculations, run
  * an initial frame because sometimes first run can introduce a large stall */
 	retro.skipframe_v = retro.skipframe_a = true;
 	retro.run();
 	retro.skipframe_v = retro.skipframe_a = false;
 	retro.basetime = arcan_timemillis();
+	setup_rollback();
 
 /* pre-audio is a last- resort to work around buffering size issues
  * in audio layers -- run one or more frames of emulation, ignoring
@@ -1860,14 +2186,15 @@ int	afsrv_game(struct arcan_shmif_cont* cont, struct arg_arr* args)
 				TARGET_SKIP_STEP + 1, false);
 
 		else if (retro.skipmode <= TARGET_SKIP_ROLLBACK &&
-			retro.dirty_input){
-/* last entry will always be the current front */
-			retro.deserialize(retro.rollback_state +
-				retro.state_sz * retro.rollback_front, retro.state_sz);
+			retro.dirty_input && retro.rollback.valid){
+/* oldest entry is kept in full, the frames after it need to be re-run */
+			size_t nframes = retro.rollback.count;
+			retro.deserialize(retro.rollback.base, retro.state_sz);
+			ring_rewind(&retro.rollback);
 
 /* rollback to desired "point", run frame (which will consume input)
  * then roll forward to next video frame */
-			process_frames(retro.rollback_window - 1, true, true);
+			process_frames(nframes, true, true);
 			retro.dirty_input = false;
 		}
 
@@ -1877,7 +2204,10 @@ int	afsrv_game(struct arcan_shmif_cont* cont, struct arg_arr* args)
  * testing by adding delays at various key synchronization points */
 		start = arcan_timemillis();
 			add_jitter(retro.jitterstep);
-			process_frames(1, false, false);
+			if (retro.runahead && retro.rollback.head)
+				process_runahead();
+			else
+				process_frames(1, false, false);
 		stop = arcan_timemillis();
 		retro.framecost = stop - start;
 		if (retro.sync_data){
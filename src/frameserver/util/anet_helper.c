@@ -293,6 +293,29 @@ bool anet_listen(struct anet_options* args, char** errdst,
 		struct sockaddr_storage in_addr;
 		socklen_t addrlen = sizeof(addr);
 
+/* let the caller do its housekeeping between connections rather than as part
+ * of the dispatch */
+		if (args->on_aux){
+			struct pollfd fds[2] = {
+				{.fd = sockin_fd, .events = POLLIN},
+				{.fd = args->aux_fd, .events = POLLIN}
+			};
+
+			int rv = poll(fds, 2, args->aux_timeout);
+			if (-1 == rv && errno != EINTR && errno != EAGAIN){
+				if (errdst)
+					asprintf(errdst, "error waiting for connection: %s\n", strerror(errno));
+				close(sockin_fd);
+				return false;
+			}
+
+			if (0 == rv || (fds[1].revents & POLLIN))
+				args->on_aux(tag);
+
+			if (!(fds[0].revents & POLLIN))
+				continue;
+		}
+
 		int infd = accept(sockin_fd, (struct sockaddr*) &in_addr, &addrlen);
 		struct a12_state* ast = a12_server(args->opts);
 		if (!ast){
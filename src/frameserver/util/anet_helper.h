@@ -60,6 +60,13 @@ struct anet_options {
 /* construction arguments for the keystore */
 	struct keystore_provider keystore;
 	struct a12_context_options* opts;
+
+/* (listen only) if set, [on_aux] is invoked from the listening loop whenever
+ * [aux_fd] becomes readable or [aux_timeout] ms passed without a connection,
+ * use -1 to disable either one */
+	void (*on_aux)(void* tag);
+	int aux_fd;
+	int aux_timeout;
 };
 
 /*
@@ -139,20 +139,73 @@ const char* agp_shader_language()
 	return "GLSL120";
 }
 
-static void pbo_alloc_read(struct agp_vstore* store)
+/* Readbacks are queued in a ring of PBOs, each with a fence (if supported)
+ * so that polling never has to block on the driver. Requests complete in the
+ * order they were made, [first] is the oldest one in flight. */
+#ifndef READBACK_RING
+#define READBACK_RING 3
+#endif
+
+struct agp_readback {
+	GLuint pbo[READBACK_RING];
+	void* fence[READBACK_RING];
+	size_t w, h;
+	GLuint fbo;
+	size_t first, count;
+	bool mapped;
+};
+
+static struct agp_readback* pbo_alloc_read(struct agp_vstore* store)
 {
-	GLuint pboid;
 	struct agp_fenv* env = agp_env();
-	env->gen_buffers(1, &pboid);
-	store->vinf.text.rid = pboid;
+	struct agp_readback* rb = arcan_alloc_mem(sizeof(struct agp_readback),
+		ARCAN_MEM_VSTRUCT, ARCAN_MEM_BZERO | ARCAN_MEM_NONFATAL,
+		ARCAN_MEMALIGN_NATURAL
+	);
+	if (!rb)
+		return NULL;
 
-	env->bind_buffer(GL_PIXEL_PACK_BUFFER, pboid);
-	env->buffer_data(GL_PIXEL_PACK_BUFFER,
-		store->w * store->h * store->bpp, NULL, GL_STREAM_COPY);
+	rb->w = store->w;
+	rb->h = store->h;
+	env->gen_buffers(READBACK_RING, rb->pbo);
+
+	for (size_t i = 0; i < READBACK_RING; i++){
+		env->bind_buffer(GL_PIXEL_PACK_BUFFER, rb->pbo[i]);
+		env->buffer_data(GL_PIXEL_PACK_BUFFER,
+			store->w * store->h * store->bpp, NULL, GL_STREAM_READ);
+	}
 	env->bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
 
-	verbose_print("allocated %zu*%zu read-pbo",
-		(size_t) store->w, (size_t) store->h);
+	verbose_print("allocated %d * %zu*%zu read-pbo",
+		READBACK_RING, (size_t) store->w, (size_t) store->h);
+
+	store->vinf.text.readback = rb;
+	return rb;
+}
+
+void agp_drop_readback(struct agp_vstore* store)
+{
+	struct agp_readback* rb = store->vinf.text.readback;
+	if (!rb)
+		return;
+
+	struct agp_fenv* env = agp_env();
+	if (rb->mapped){
+		env->bind_buffer(GL_PIXEL_PACK_BUFFER, rb->pbo[rb->first]);
+		env->unmap_buffer(GL_PIXEL_PACK_BUFFER);
+		env->bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	for (size_t i = 0; i < READBACK_RING; i++)
+		if (rb->fence[i])
+			env->delete_sync(rb->fence[i]);
+
+	env->delete_buffers(READBACK_RING, rb->pbo);
+	if (rb->fbo)
+		env->delete_framebuffers(1, &rb->fbo);
+
+	arcan_mem_free(rb);
+	store->vinf.text.readback = NULL;
 }
 
 static void pbo_alloc_write(struct agp_vstore* store)
@@ -179,10 +232,8 @@ static void rebuild_pbo(struct agp_vstore* s)
 		pbo_alloc_write(s);
 	}
 
-	if (s->vinf.text.rid){
-		env->delete_buffers(1, &s->vinf.text.rid);
-		pbo_alloc_read(s);
-	}
+/* the readback ring is allocated again on the next request */
+	agp_drop_readback(s);
 }
 
 static void set_pixel_store(size_t w, struct stream_meta const meta)
@@ -474,10 +525,27 @@ static void default_release(void* tag)
 {
 	if (!tag)
 		return;
+
 	struct agp_fenv* env = agp_env();
+	struct agp_vstore* store = tag;
+	struct agp_readback* rb = store->vinf.text.readback;
+	if (!rb || !rb->count)
+		return;
 
-	env->unmap_buffer(GL_PIXEL_PACK_BUFFER);
+	if (rb->mapped){
+		env->bind_buffer(GL_PIXEL_PACK_BUFFER, rb->pbo[rb->first]);
+		env->unmap_buffer(GL_PIXEL_PACK_BUFFER);
+		rb->mapped = false;
+	}
 	env->bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	if (rb->fence[rb->first]){
+		env->delete_sync(rb->fence[rb->first]);
+		rb->fence[rb->first] = NULL;
+	}
+
+	rb->first = (rb->first + 1) % READBACK_RING;
+	rb->count--;
 }
 
 void agp_resize_vstore(struct agp_vstore* s, size_t w, size_t h)
@@ -494,23 +562,87 @@ void agp_resize_vstore(struct agp_vstore* s, size_t w, size_t h)
 	agp_update_vstore(s, true);
 }
 
-void agp_request_readback(struct agp_vstore* store)
+/* subregion reads go through an fbo with the texture attached, with the pack
+ * state set so that the region ends up where it would in a full readback */
+static void readback_region(struct agp_vstore* store,
+	struct agp_readback* rb, struct agp_region* region)
+{
+	struct agp_fenv* env = agp_env();
+	GLint cfbo;
+
+	if (!rb->fbo)
+		env->gen_framebuffers(1, &rb->fbo);
+
+	env->get_integer_v(GL_READ_FRAMEBUFFER_BINDING, &cfbo);
+	env->bind_framebuffer(GL_READ_FRAMEBUFFER, rb->fbo);
+	env->framebuffer_texture_2d(GL_READ_FRAMEBUFFER,
+		GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, agp_resolve_texid(store), 0);
+
+	env->pixel_storei(GL_PACK_ROW_LENGTH, store->w);
+	env->pixel_storei(GL_PACK_SKIP_ROWS, region->y1);
+	env->pixel_storei(GL_PACK_SKIP_PIXELS, region->x1);
+
+	env->read_pixels(region->x1, region->y1,
+		region->x2 - region->x1, region->y2 - region->y1,
+		GL_PIXEL_FORMAT, GL_UNSIGNED_BYTE, NULL);
+
+	env->pixel_storei(GL_PACK_ROW_LENGTH, 0);
+	env->pixel_storei(GL_PACK_SKIP_ROWS, 0);
+	env->pixel_storei(GL_PACK_SKIP_PIXELS, 0);
+	env->bind_framebuffer(GL_READ_FRAMEBUFFER, cfbo);
+}
+
+bool agp_request_readback(struct agp_vstore* store, struct agp_region* region)
 {
 	if (!store || store->txmapped != TXSTATE_TEX2D)
-		return;
+		return false;
 	struct agp_fenv* env = agp_env();
 
-	if (!store->vinf.text.rid)
-		pbo_alloc_read(store);
+	struct agp_readback* rb = store->vinf.text.readback;
+	if (rb && (rb->w != store->w || rb->h != store->h) && !rb->count){
+		agp_drop_readback(store);
+		rb = NULL;
+	}
+
+	if (!rb && !(rb = pbo_alloc_read(store)))
+		return false;
+
+	if (rb->count == READBACK_RING || rb->w != store->w || rb->h != store->h)
+		return false;
+
+	size_t slot = (rb->first + rb->count) % READBACK_RING;
+	env->bind_buffer(GL_PIXEL_PACK_BUFFER, rb->pbo[slot]);
+
+/* clamp the region and only bother with the fbo if it is a subset */
+	struct agp_region full = {.x2 = store->w, .y2 = store->h};
+	if (region){
+		full.x1 = region->x1 < store->w ? region->x1 : 0;
+		full.y1 = region->y1 < store->h ? region->y1 : 0;
+		full.x2 = region->x2 > full.x1 && region->x2 <= store->w ? region->x2 : store->w;
+		full.y2 = region->y2 > full.y1 && region->y2 <= store->h ? region->y2 : store->h;
+	}
 
-	verbose_print("(%"PRIxPTR":glid %u) getTexImage2D => PBO",
-		(uintptr_t) store, (unsigned) store->vinf.text.glid);
+	if (full.x1 || full.y1 || full.x2 != store->w || full.y2 != store->h){
+		verbose_print("(%"PRIxPTR":glid %u) readPixels(%zu,%zu-%zu,%zu) => PBO(%zu)",
+			(uintptr_t) store, (unsigned) store->vinf.text.glid,
+			full.x1, full.y1, full.x2, full.y2, slot);
+		readback_region(store, rb, &full);
+	}
+	else {
+		verbose_print("(%"PRIxPTR":glid %u) getTexImage2D => PBO(%zu)",
+			(uintptr_t) store, (unsigned) store->vinf.text.glid, slot);
 
-	env->bind_texture(GL_TEXTURE_2D, agp_resolve_texid(store));
-	env->bind_buffer(GL_PIXEL_PACK_BUFFER, store->vinf.text.rid);
-	env->get_tex_image(GL_TEXTURE_2D, 0, GL_PIXEL_FORMAT, GL_UNSIGNED_BYTE, NULL);
+		env->bind_texture(GL_TEXTURE_2D, agp_resolve_texid(store));
+		env->get_tex_image(GL_TEXTURE_2D, 0, GL_PIXEL_FORMAT, GL_UNSIGNED_BYTE, NULL);
+		env->bind_texture(GL_TEXTURE_2D, 0);
+	}
 	env->bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
-	env->bind_texture(GL_TEXTURE_2D, 0);
+
+	if (env->fence_sync)
+		rb->fence[slot] = env->fence_sync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	rb->count++;
+	return true;
 }
 
 struct asynch_readback_meta agp_poll_readback(struct agp_vstore* store)
@@ -520,16 +652,43 @@ struct asynch_readback_meta agp_poll_readback(struct agp_vstore* store)
 	.release = default_release
 	};
 
-	if (!store || store->txmapped != TXSTATE_TEX2D ||
-		store->vinf.text.rid == GL_NONE)
+	if (!store || store->txmapped != TXSTATE_TEX2D || !store->vinf.text.readback)
+		return res;
+
+	struct agp_readback* rb = store->vinf.text.readback;
+	if (!rb->count || rb->mapped){
+		res.queued = rb->count;
 		return res;
+	}
+
+/* without fences, mapping will block until the transfer is done, that is the
+ * best we can do - otherwise just check (and flush so it will be signalled) */
+	void* fence = rb->fence[rb->first];
+	if (fence){
+		GLenum status = env->client_wait_sync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED){
+			res.queued = rb->count;
+			return res;
+		}
+	}
 
-	env->bind_buffer(GL_PIXEL_PACK_BUFFER, store->vinf.text.rid);
+	env->bind_buffer(GL_PIXEL_PACK_BUFFER, rb->pbo[rb->first]);
+	res.ptr = (av_pixel*) env->map_buffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+	res.queued = rb->count - 1;
+	res.tag = store;
+
+/* a failed map still consumes the request so we don't get stuck on it */
+	if (!res.ptr){
+		env->bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+		default_release(store);
+		res.tag = NULL;
+		return res;
+	}
 
-	res.w = store->w;
-	res.h = store->h;
-	res.tag = (void*) 0xdeadbeef;
-	res.ptr = (av_pixel*) env->map_buffer(GL_PIXEL_PACK_BUFFER, GL_READ_WRITE);
+	rb->mapped = true;
+	res.w = rb->w;
+	res.h = rb->h;
+	res.buf_sz = rb->w * rb->h * sizeof(av_pixel);
 
 	return res;
 }
@@ -203,9 +203,14 @@ void agp_readback_synchronous(struct agp_vstore* dst)
 	arcan_warning("agp(gles) - readbacks not supported\n");
 }
 
-void agp_request_readback(struct agp_vstore* store)
+bool agp_request_readback(struct agp_vstore* store, struct agp_region* region)
 {
 	arcan_warning("agp(gles) - readbacks not supported\n");
+	return false;
+}
+
+void agp_drop_readback(struct agp_vstore* store)
+{
 }
 
 struct asynch_readback_meta argp_buffer_readback_asynchronous(
@@ -59,6 +59,11 @@ struct agp_fenv {
 	void (*bind_buffer) (GLenum, GLuint);
 	void* (*map_buffer) (GLenum, GLenum);
 
+/* Synchronization, optional (GL3.2 / ARB_sync), GLsync is kept as a void* */
+	void* (*fence_sync) (GLenum, GLbitfield);
+	GLenum (*client_wait_sync) (void*, GLbitfield, uint64_t);
+	void (*delete_sync) (void*);
+
 /* FBOs */
 	void (*gen_framebuffers) (GLsizei, GLuint*);
 	void (*bind_framebuffer) (GLenum, GLuint);
@@ -105,6 +110,10 @@ struct agp_fenv {
 	void (*link_program) (GLuint);
 	void (*get_program_iv) (GLuint, GLenum, GLint*);
 
+/* Program binaries, optional (GL4.1 / ARB_get_program_binary / GLES3) */
+	void (*get_program_binary) (GLuint, GLsizei, GLsizei*, GLenum*, void*);
+	void (*program_binary) (GLuint, GLenum, const void*, GLsizei);
+
 /* Texturing */
 	void (*gen_textures) (GLsizei, GLuint*);
 	void (*active_texture) (GLenum);
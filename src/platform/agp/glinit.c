@@ -102,6 +102,22 @@ void agp_glinit_fenv(struct agp_fenv* dst,
 	dst->map_buffer =
 		(void*(*)(GLenum, GLenum))
 			lookup(tag, "glMapBuffer");
+	dst->fence_sync =
+		(void*(*)(GLenum, GLbitfield))
+			lookup_opt(tag, "glFenceSync");
+	dst->client_wait_sync =
+		(GLenum(*)(void*, GLbitfield, uint64_t))
+			lookup_opt(tag, "glClientWaitSync");
+	dst->delete_sync =
+		(void(*)(void*))
+			lookup_opt(tag, "glDeleteSync");
+
+/* all or nothing */
+	if (!dst->fence_sync || !dst->client_wait_sync || !dst->delete_sync){
+		dst->fence_sync = NULL;
+		dst->client_wait_sync = NULL;
+		dst->delete_sync = NULL;
+	}
 #endif
 /* FBOs */
 	dst->gen_framebuffers =
@@ -216,6 +232,12 @@ void agp_glinit_fenv(struct agp_fenv* dst,
 	dst->get_program_iv =
 		(void(*)(GLuint, GLenum, GLint*))
 			lookup(tag, "glGetProgramiv");
+	dst->get_program_binary =
+		(void(*)(GLuint, GLsizei, GLsizei*, GLenum*, void*))
+			lookup_opt(tag, "glGetProgramBinary");
+	dst->program_binary =
+		(void(*)(GLuint, GLenum, const void*, GLsizei))
+			lookup_opt(tag, "glProgramBinary");
 
 /* Texturing */
 	dst->gen_textures =
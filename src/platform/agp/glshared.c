@@ -1192,10 +1192,7 @@ void agp_null_vstore(struct agp_vstore* store)
 	store->vinf.text.glid_proxy = NULL;
 
 /* null out any pending PBOs as well, those get re-allocated on demand */
-	if (GL_NONE != store->vinf.text.rid){
-		env->delete_buffers(1, &store->vinf.text.rid);
-		store->vinf.text.rid = GL_NONE;
-	}
+	agp_drop_readback(store);
 
 #ifndef GLES2
 	if (GL_NONE != store->vinf.text.wid){
@@ -1761,10 +1758,7 @@ void agp_drop_vstore(struct agp_vstore* s)
 	env->delete_textures(1, &s->vinf.text.glid);
 	s->vinf.text.glid = GL_NONE;
 
-	if (GL_NONE != s->vinf.text.rid){
-		env->delete_buffers(1, &s->vinf.text.rid);
-		s->vinf.text.rid = GL_NONE;
-	}
+	agp_drop_readback(s);
 
 #ifndef GLES2
 	if (GL_NONE != s->vinf.text.wid){
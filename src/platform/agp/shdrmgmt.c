@@ -13,6 +13,7 @@
 #include <string.h>
 #include <stddef.h>
 #include <unistd.h>
+#include <fcntl.h>
 
 #include "glfun.h"
 
@@ -30,6 +31,20 @@
 
 #define TBLSIZE (1 + TIMESTAMP_D - MODELVIEW_MATR)
 
+/* buckets for the tag -> slot index, chained through the slots */
+#define SHADER_HTBL 512
+
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+/* sanity cap for the on-disk program binary cache */
+#define SHADER_BINARY_LIM (16 * 1024 * 1024)
+
 /* all current global shader settings,
  * updated whenever a vobj/3dobj needs a different state
  * each global */
@@ -158,6 +173,16 @@ struct shader_cont {
 /* match attrsymtbl */
 	GLint attributes[9];
 
+/* uniform values are program state, so track which generation of each
+ * environment value the program holds (valid per bit in env_valid) and
+ * which uniform group (+1) was pushed last */
+	uint32_t env_gen[TBLSIZE];
+	uint16_t env_valid;
+	uint16_t loaded_group;
+
+/* next slot (+1) in the tag hash chain */
+	uint16_t hnext;
+
 	struct arcan_strarr ugroups;
 };
 
@@ -176,6 +201,8 @@ static struct {
 	size_t ofs;
 	agp_shader_id active_prg;
 	struct shader_envts context;
+	uint32_t gen[TBLSIZE];
+	uint16_t htbl[SHADER_HTBL];
 	char guard;
 } shdr_global = {.active_prg = BROKEN_SHADER, .guard = 64};
 
@@ -183,6 +210,49 @@ static bool build_shader(const char*, GLuint*, GLuint*, GLuint*,
 	const char*, const char*);
 static void kill_shader(GLuint* dprg, GLuint* vprg, GLuint* fprg);
 
+static size_t tag_hash(const char* tag)
+{
+	uint32_t hash = 2166136261;
+	for (; *tag; tag++)
+		hash = (hash ^ (uint8_t) *tag) * 16777619;
+	return hash % SHADER_HTBL;
+}
+
+static int tag_find(const char* tag)
+{
+	uint16_t cur = shdr_global.htbl[tag_hash(tag)];
+	while (cur){
+		struct shader_cont* slot = &shdr_global.slots[cur - 1];
+		if (slot->label && strcmp(slot->label, tag) == 0)
+			return cur - 1;
+		cur = slot->hnext;
+	}
+	return -1;
+}
+
+static void tag_insert(size_t ind)
+{
+	uint16_t* head = &shdr_global.htbl[tag_hash(shdr_global.slots[ind].label)];
+	shdr_global.slots[ind].hnext = *head;
+	*head = ind + 1;
+}
+
+static void tag_remove(size_t ind)
+{
+	if (!shdr_global.slots[ind].label)
+		return;
+
+	uint16_t* cur = &shdr_global.htbl[tag_hash(shdr_global.slots[ind].label)];
+	while (*cur){
+		if (*cur == ind + 1){
+			*cur = shdr_global.slots[ind].hnext;
+			break;
+		}
+		cur = &shdr_global.slots[*cur - 1].hnext;
+	}
+	shdr_global.slots[ind].hnext = 0;
+}
+
 static void setv(GLint loc, enum shdrutype kind, void* val,
 	const char* id, const char* program)
 {
@@ -228,6 +298,7 @@ static void destroy_shader(struct shader_cont* cur)
 	if (!cur->label)
 		return;
 
+	tag_remove(cur - shdr_global.slots);
 	free( cur->label );
 	free( cur->vertex );
 	free( cur->fragment );
@@ -284,6 +355,9 @@ bool agp_shader_destroy(agp_shader_id shid)
 	}
 
 	cur->ugroups.count--;
+	if (cur->loaded_group == ind + 1)
+		cur->loaded_group = 0;
+
 	while(sv){
 		struct shaderv* last = sv;
 		free(sv->label);
@@ -313,17 +387,20 @@ int agp_shader_activate(agp_shader_id shid)
 #endif
 
 /*
- * While we chould practically just update the uniforms that has actually
- * changed since the last push as we keep a cache, the incentive is rather
- * small (uniform- set on a bound shader is among the cheaper state changes
- * possible).
+ * Only push the environment values that have changed since this program last
+ * had them, switching back and forth between a few programs with mostly the
+ * same matrices is the common case.
  */
 		for (size_t i = 0; i < sizeof(ofstbl) / sizeof(ofstbl[0]); i++){
-			if (cur->locations[i] >= 0){
-				setv(cur->locations[i], typetbl[i], (char*)(&shdr_global.context)
-					+ ofstbl[i], symtbl[i], cur->label);
-				counttbl[i]++;
-			}
+			if (cur->locations[i] < 0 ||
+				((cur->env_valid & (1 << i)) && cur->env_gen[i] == shdr_global.gen[i]))
+				continue;
+
+			setv(cur->locations[i], typetbl[i], (char*)(&shdr_global.context)
+				+ ofstbl[i], symtbl[i], cur->label);
+			cur->env_gen[i] = shdr_global.gen[i];
+			cur->env_valid |= 1 << i;
+			counttbl[i]++;
 		}
 
 /* activate any persistant values */
@@ -332,7 +409,14 @@ int agp_shader_activate(agp_shader_id shid)
 				"broken group\n", (int)SHADER_INDEX(shid),(int)GROUP_INDEX(shid));
 			return -1;
 		}
+
+/* persistent values are pushed on change (forceunif) to the active group, so
+ * only a group switch within the program needs the full chain */
+		if (cur->loaded_group == GROUP_INDEX(shid) + 1)
+			return ARCAN_OK;
+
 		struct shaderv* current = cur->ugroups.cdata[GROUP_INDEX(shid)];
+		cur->loaded_group = GROUP_INDEX(shid) + 1;
 
 		while (current){
 			setv(current->loc, current->type, (void*) current->data,
@@ -346,14 +430,8 @@ int agp_shader_activate(agp_shader_id shid)
 
 agp_shader_id agp_shader_lookup(const char* tag)
 {
-	for (size_t i=0; i<sizeof(shdr_global.slots)/
-		sizeof(shdr_global.slots[0]); i++){
-		if (shdr_global.slots[i].label &&
-			strcmp(tag, shdr_global.slots[i].label) == 0)
-			return i;
-	}
-
-	return BROKEN_SHADER;
+	int ind = tag_find(tag);
+	return ind == -1 ? BROKEN_SHADER : ind;
 }
 
 const char* agp_shader_lookuptag(agp_shader_id id)
@@ -412,13 +490,8 @@ agp_shader_id agp_shader_build(const char* tag,
 	}
 
 /* first, look for a preexisting tag */
-	for (size_t i = 0; i < slot_lim; i++)
-		if (shdr_global.slots[i].label &&
-			strcmp(shdr_global.slots[i].label, tag) == 0){
-			dstind = i;
-			overwrite = true;
-			break;
-		}
+	dstind = tag_find(tag);
+	overwrite = dstind != -1;
 
 /* no match, find a free slot */
 	if (dstind == -1){
@@ -441,6 +514,7 @@ agp_shader_id agp_shader_build(const char* tag,
 
 /* obliterate the last one first */
 	if (overwrite){
+		tag_remove(dstind);
 		kill_shader(&cur->prg_container, &cur->obj_fragment, &cur->obj_vertex);
 		free(cur->vertex);
 		free(cur->fragment);
@@ -475,6 +549,7 @@ agp_shader_id agp_shader_build(const char* tag,
 	cur->label = strdup(tag);
 	cur->vertex = strdup(vert);
 	cur->fragment = strdup(frag);
+	tag_insert(dstind);
 
 #ifdef SHADER_DEBUG
 	arcan_warning("agp_shader_build(%s) -- new ID : (%i)\n",
@@ -506,6 +581,11 @@ agp_shader_id agp_shader_build(const char* tag,
 #endif
 	}
 
+/* a replaced active program is a new program object without any of the
+ * uniform state, force the next activate to go through */
+	if (overwrite && SHADER_INDEX(shdr_global.active_prg) == dstind)
+		shdr_global.active_prg = BROKEN_SHADER;
+
 /* revert to last used program! */
 	if (shdr_global.active_prg != BROKEN_SHADER){
 		env->use_program(shdr_global.slots[
@@ -518,27 +598,33 @@ agp_shader_id agp_shader_build(const char* tag,
 
 int agp_shader_envv(enum agp_shader_envts slot, void* value, size_t size)
 {
-	memcpy((char*) (&shdr_global.context) + ofstbl[slot], value, size);
+	char* dst = (char*) (&shdr_global.context) + ofstbl[slot];
+	if (memcmp(dst, value, size) != 0){
+		memcpy(dst, value, size);
+		shdr_global.gen[slot]++;
+	}
+
 	int rv = counttbl[slot];
 	counttbl[slot] = 0;
 
 	if (BROKEN_SHADER == shdr_global.active_prg)
 		return rv;
 
-	int glloc = shdr_global.slots[
-		SHADER_INDEX(shdr_global.active_prg)].locations[slot];
+	struct shader_cont* cur = &shdr_global.slots[
+		SHADER_INDEX(shdr_global.active_prg)];
+	int glloc = cur->locations[slot];
 
 /*
  * reflect change in current active shader, the others will be changed on
- * activation
+ * activation - unless it already has this generation of the value
  */
-	if (glloc != -1){
+	if (glloc != -1 && (!(cur->env_valid & (1 << slot)) ||
+		cur->env_gen[slot] != shdr_global.gen[slot])){
 		assert(size == sizetbl[ typetbl[slot] ]);
-		setv(glloc, typetbl[slot], value, symtbl[slot],
-			shdr_global.slots[SHADER_INDEX(shdr_global.active_prg)].label );
+		setv(glloc, typetbl[slot], value, symtbl[slot], cur->label);
+		cur->env_gen[slot] = shdr_global.gen[slot];
+		cur->env_valid |= 1 << slot;
 		counttbl[slot]++;
-
-		return rv;
 	}
 
 	return rv;
@@ -583,6 +669,8 @@ agp_shader_id agp_shader_addgroup(agp_shader_id shid)
 	}
 
 	cur->ugroups.count++;
+	if (cur->loaded_group == dsti + 1)
+		cur->loaded_group = 0;
 
 	struct shaderv** chain = (struct shaderv**) &cur->ugroups.cdata[dsti];
 	struct shaderv* mgroup = cur->ugroups.cdata[GROUP_INDEX(shid)];
@@ -714,12 +802,206 @@ static void dump_shaderlog(const char* label,
 	arcan_warning("%s shader failed on %s stage:\n", label, stage);
 }
 
+/*
+ * Optional on-disk cache of linked program binaries, enabled by pointing the
+ * 'agp_shader_cache' config key at a writable directory. Entries are keyed on
+ * a hash of the sources and the driver strings so a driver update or another
+ * GPU simply misses, and a binary the driver refuses is treated the same.
+ */
+#ifndef HEADLESS_NOARCAN
+static struct {
+	bool checked;
+	char* path;
+	uint64_t driver_hash;
+} shdr_cache;
+
+struct cache_hdr {
+	uint32_t magic;
+	uint32_t format;
+	uint64_t key;
+	uint32_t length;
+};
+
+static uint64_t cache_hash(uint64_t hash, const char* str)
+{
+	for (; str && *str; str++)
+		hash = (hash ^ (uint8_t) *str) * 1099511628211ULL;
+
+/* terminate each part so the concatenation is unambiguous */
+	return hash * 1099511628211ULL;
+}
+
+static bool cache_key(const char* vprg, const char* fprg, uint64_t* key)
+{
+	struct agp_fenv* env = agp_env();
+
+	if (!shdr_cache.checked){
+		shdr_cache.checked = true;
+		GLint nfmt = 0;
+		if (env->get_program_binary && env->program_binary)
+			env->get_integer_v(GL_NUM_PROGRAM_BINARY_FORMATS, &nfmt);
+
+		uintptr_t tag;
+		cfg_lookup_fun get_config = platform_config_lookup(&tag);
+		if (nfmt > 0 &&
+			get_config("agp_shader_cache", 0, &shdr_cache.path, tag) && shdr_cache.path){
+			uint64_t hash = 14695981039346656037ULL;
+			hash = cache_hash(hash, (const char*) glGetString(GL_VENDOR));
+			hash = cache_hash(hash, (const char*) glGetString(GL_RENDERER));
+			hash = cache_hash(hash, (const char*) glGetString(GL_VERSION));
+			shdr_cache.driver_hash = hash;
+		}
+	}
+
+	if (!shdr_cache.path)
+		return false;
+
+	*key = cache_hash(cache_hash(shdr_cache.driver_hash, vprg), fprg);
+	return true;
+}
+
+static int cache_open(uint64_t key, int flags, bool tmp)
+{
+	size_t len = strlen(shdr_cache.path) + sizeof("/0123456789abcdef.bin.tmp");
+	char path[len];
+	snprintf(path, len, "%s/%016"PRIx64".bin%s", shdr_cache.path, key, tmp ? ".tmp" : "");
+	return open(path, flags | O_CLOEXEC, 0600);
+}
+
+static void cache_commit(uint64_t key, bool keep)
+{
+	size_t len = strlen(shdr_cache.path) + sizeof("/0123456789abcdef.bin.tmp");
+	char path[len], tmp[len];
+	snprintf(path, len, "%s/%016"PRIx64".bin", shdr_cache.path, key);
+	snprintf(tmp, len, "%s.tmp", path);
+
+	if (!keep || -1 == rename(tmp, path))
+		unlink(tmp);
+}
+
+static bool cache_read(int fd, void* dst, size_t n)
+{
+	uint8_t* buf = dst;
+	while (n){
+		ssize_t nr = read(fd, buf, n);
+		if (nr <= 0)
+			return false;
+		buf += nr;
+		n -= nr;
+	}
+	return true;
+}
+
+static bool cache_load(uint64_t key, GLuint* dprg)
+{
+	struct agp_fenv* env = agp_env();
+	int fd = cache_open(key, O_RDONLY, false);
+	if (-1 == fd)
+		return false;
+
+	struct cache_hdr hdr;
+	void* buf = NULL;
+	if (!cache_read(fd, &hdr, sizeof(hdr)) || hdr.magic != 0x42504741 ||
+		hdr.key != key || !hdr.length || hdr.length > SHADER_BINARY_LIM ||
+		!(buf = malloc(hdr.length)) || !cache_read(fd, buf, hdr.length)){
+		free(buf);
+		close(fd);
+		return false;
+	}
+	close(fd);
+
+	*dprg = env->create_program();
+	env->program_binary(*dprg, hdr.format, buf, hdr.length);
+	free(buf);
+
+	GLint lstat = 0;
+	env->get_program_iv(*dprg, GL_LINK_STATUS, &lstat);
+	if (GL_FALSE == lstat){
+		env->delete_program(*dprg);
+		*dprg = 0;
+		return false;
+	}
+
+	return true;
+}
+
+static void cache_store(uint64_t key, GLuint prg)
+{
+	struct agp_fenv* env = agp_env();
+	GLint len = 0;
+	env->get_program_iv(prg, GL_PROGRAM_BINARY_LENGTH, &len);
+	if (len <= 0 || len > SHADER_BINARY_LIM)
+		return;
+
+	struct cache_hdr* hdr = malloc(sizeof(struct cache_hdr) + len);
+	if (!hdr)
+		return;
+
+	GLsizei outlen = 0;
+	GLenum format = 0;
+	env->get_program_binary(prg, len, &outlen, &format, &hdr[1]);
+	*hdr = (struct cache_hdr){
+		.magic = 0x42504741,
+		.format = format,
+		.key = key,
+		.length = outlen
+	};
+
+	int fd = cache_open(key, O_WRONLY | O_CREAT | O_TRUNC, true);
+	if (-1 != fd){
+		size_t tot = sizeof(struct cache_hdr) + outlen;
+		bool ok = outlen > 0 && write(fd, hdr, tot) == tot;
+		close(fd);
+		cache_commit(key, ok);
+	}
+
+	free(hdr);
+}
+#else
+static bool cache_key(const char* vprg, const char* fprg, uint64_t* key)
+{
+	return false;
+}
+
+static bool cache_load(uint64_t key, GLuint* dprg)
+{
+	return false;
+}
+
+static void cache_store(uint64_t key, GLuint prg)
+{
+}
+#endif
+
+static void preset_samplers(GLuint prg)
+{
+	struct agp_fenv* env = agp_env();
+	env->use_program(prg);
+	int loc = env->get_uniform_loc(prg, "map_tu0");
+	GLint val = 0;
+
+	if (loc >= 0)
+		env->unif_1i(loc, val);
+
+	loc = env->get_uniform_loc(prg, "map_diffuse");
+	if (loc >= 0)
+		env->unif_1i(loc, val);
+}
+
 static bool build_shader(const char* label, GLuint* dprg,
 	GLuint* vprg, GLuint* fprg, const char* vprogram, const char* fprogram)
 {
 	struct agp_fenv* env = agp_env();
 	bool failed = false;
 
+	uint64_t key;
+	bool cache = cache_key(vprogram, fprogram, &key);
+	if (cache && cache_load(key, dprg)){
+		*vprg = *fprg = 0;
+		preset_samplers(*dprg);
+		return true;
+	}
+
 #ifdef DEBUG
 	bool force = true;
 #else
@@ -752,16 +1034,9 @@ static bool build_shader(const char* label, GLuint* dprg,
 		dump_shaderlog(label, "link-fragment", fprogram, *dprg);
 	}
 	else {
-		env->use_program(*dprg);
-		int loc = env->get_uniform_loc(*dprg, "map_tu0");
-		GLint val = 0;
-
-		if (loc >= 0)
-			env->unif_1i(loc, val);
-
-		loc = env->get_uniform_loc(*dprg, "map_diffuse");
-		if (loc >= 0)
-			env->unif_1i(loc, val);
+		preset_samplers(*dprg);
+		if (cache && !failed)
+			cache_store(key, *dprg);
 	}
 
 	return !failed;
@@ -781,6 +1056,13 @@ void agp_shader_flush()
 
 	shdr_global.ofs = 0;
 	shdr_global.active_prg = BROKEN_SHADER;
+
+/* the next context might be on another device or driver */
+#ifndef HEADLESS_NOARCAN
+	free(shdr_cache.path);
+	shdr_cache.path = NULL;
+	shdr_cache.checked = false;
+#endif
 }
 
 void agp_shader_rebuild_all()
@@ -798,5 +1080,10 @@ void agp_shader_rebuild_all()
 			cur->vertex,
 			cur->fragment
 		);
+
+		cur->env_valid = 0;
+		cur->loaded_group = 0;
 	}
+
+	shdr_global.active_prg = BROKEN_SHADER;
 }
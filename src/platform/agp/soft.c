@@ -0,0 +1,2443 @@
+/*
+ * Copyright 2014-2020, Björn Ståhl
+ * License: 3-Clause BSD, see COPYING file in arcan source repository.
+ * Reference: http://arcan-fe.com
+ * Description: Software AGP implementation for running the headless platform
+ * on machines without a GPU (servers, CI, remoting). Draw calls are recorded
+ * into a queue for the active rendertarget and rasterized when something needs
+ * the results (rendertarget switch, writes to a store, readbacks). The target
+ * is split into horizontal bands that are rasterized in parallel by a small
+ * worker pool, with vectorized spans for the common blend paths.
+ *
+ * Only the behaviour of the built-in shaders is emulated (texture with object
+ * opacity, or solid obj_col). Custom shaders are accepted and tracked so that
+ * scripts keep working, but are drawn as if they were the default ones. There
+ * is no support for 3D models, cubemaps or 3D textures, and interpolation is
+ * affine (fine for the orthographic 2D pipeline).
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <unistd.h>
+#include <math.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "../video_platform.h"
+#include "../platform.h"
+
+#include "arcan_math.h"
+#include "arcan_general.h"
+#include "arcan_video.h"
+#include "arcan_mem.h"
+#include "arcan_videoint.h"
+
+#ifdef HEADLESS_NOARCAN
+#undef FLAG_DIRTY
+#define FLAG_DIRTY()
+#endif
+
+#ifdef _DEBUG
+#define DEBUG 1
+#else
+#define DEBUG 0
+#endif
+
+#define debug_print(fmt, ...) \
+            do { if (DEBUG) arcan_warning("%lld:%s:%d:%s(): " fmt "\n",\
+						arcan_timemillis(), "agp-soft:", __LINE__, __func__,##__VA_ARGS__); } while (0)
+
+#ifndef verbose_print
+#define verbose_print
+#endif
+
+/* vertices are snapped to 1/256th of a pixel and clamped to a guard band
+ * so that the edge functions can be evaluated exactly in 64-bit */
+#define SUBPX_BITS 8
+#define SUBPX (1 << SUBPX_BITS)
+#define GUARD_BAND (1 << 20)
+
+/* rows per unit of work, and the amount of pixels a flush needs to touch
+ * before it is worth waking the workers */
+#define BAND_ROWS 32
+#define THREAD_THRESHOLD (256 * 256)
+#define MAX_THREADS 16
+
+#define MAX_BUFFERS 4
+
+#ifndef READBACK_RING
+#define READBACK_RING 3
+#endif
+
+/*
+ * The equivalent to a GL texture object, vstores reference these through
+ * glid (index + 1) so that the rendertarget swap / proxy logic can stay the
+ * same as in the GL backends.
+ */
+struct soft_surf {
+	av_pixel* buf;
+	size_t w, h;
+	bool used;
+};
+
+struct agp_rendertarget
+{
+	ssize_t viewport[4];
+	float clearcol[4];
+
+	enum rendertarget_mode mode;
+	struct agp_vstore* store;
+
+/* allocated on the first prepare_stencil */
+	uint8_t* stencil;
+	size_t stencil_w, stencil_h;
+
+	bool (*proxy_state)(struct agp_rendertarget* tgt, uintptr_t tag);
+	uintptr_t proxy_tag;
+
+/* used for multi-buffering mode, same semantics as in glshared.c */
+	bool rz_ack;
+	size_t n_stores;
+	size_t dirty_flip, dirty_region, dirty_region_decay;
+	size_t store_ind;
+	struct agp_vstore* stores[MAX_BUFFERS];
+	struct agp_vstore* shadow[MAX_BUFFERS];
+
+	bool (*alloc)(struct agp_rendertarget*, struct agp_vstore*, int, void*);
+	void* alloc_tag;
+};
+
+struct agp_readback {
+	av_pixel* buf[READBACK_RING];
+	size_t w, h;
+	size_t first, count;
+};
+
+enum {
+	CMD_CLEAR = 0,
+	CMD_STENCIL_CLEAR = 1,
+	CMD_DRAW = 2
+};
+
+enum {
+	STENCIL_OFF = 0,
+	STENCIL_WRITE = 1,
+	STENCIL_TEST = 2
+};
+
+/*
+ * Everything a draw needs is resolved when it is recorded, so that the state
+ * can keep changing while the queue is pending. The texture mapping is kept
+ * as an affine function of the window coordinates, in texels.
+ */
+struct soft_cmd {
+	uint8_t kind;
+	uint8_t blend;
+	uint8_t stencil;
+	uint8_t n_verts;
+	bool retain_alpha;
+	bool textured;
+	bool bilinear;
+	bool repeat_u, repeat_v;
+	bool direct;
+	uint8_t opacity;
+	av_pixel color;
+
+	int x1, y1, x2, y2;
+	int64_t vx[4], vy[4];
+	uint8_t bias[4];
+
+	double ua, ub, uc;
+	double va, vb, vc;
+	const av_pixel* tex;
+	size_t tw, th;
+};
+
+struct soft_target {
+	av_pixel* buf;
+	uint8_t* stencil;
+	size_t w, h;
+	int clip[4];
+};
+
+struct soft_shader {
+	char* label;
+	char* vert;
+	char* frag;
+	float obj_col[3];
+	bool color;
+	bool used;
+};
+
+struct soft_worker {
+	pthread_t thread;
+	av_pixel* scratch;
+	size_t scratch_sz;
+};
+
+static const char defvprg[] = "/* soft: position */";
+static const char deffprg[] = "/* soft: texture * obj_opacity */";
+static const char defcfprg[] = "/* soft: obj_col, obj_opacity */";
+
+static float ident[] = {
+	1.0, 0.0, 0.0, 0.0,
+	0.0, 1.0, 0.0, 0.0,
+	0.0, 0.0, 1.0, 0.0,
+	0.0, 0.0, 0.0, 1.0
+};
+
+static struct {
+	struct soft_surf* surf;
+	size_t n_surf;
+
+	struct soft_shader* shaders;
+	size_t n_shaders;
+	agp_shader_id shader;
+
+/* what is being drawn into, NULL rendertarget is the display */
+	struct agp_rendertarget* rtgt;
+	struct soft_target dst;
+	struct {
+		av_pixel* buf;
+		uint8_t* stencil;
+		size_t w, h;
+	} display;
+	float clearcol[4];
+
+	int blend;
+	bool retain_alpha;
+	int stencil;
+	unsigned tex;
+	uint8_t filter, txu, txv;
+
+	float projection[16];
+	float opacity;
+
+	struct soft_cmd* cmds;
+	size_t n_cmds, cmd_cap;
+} soft = {
+	.shader = BROKEN_SHADER,
+	.projection = {
+		1.0, 0.0, 0.0, 0.0,
+		0.0, 1.0, 0.0, 0.0,
+		0.0, 0.0, 1.0, 0.0,
+		0.0, 0.0, 0.0, 1.0
+	},
+	.opacity = 1.0
+};
+
+static struct {
+	struct soft_worker workers[MAX_THREADS];
+	size_t n_workers;
+	bool init;
+
+	pthread_mutex_t lock;
+	pthread_cond_t wake, done;
+	uint64_t gen;
+	size_t pending;
+
+	_Atomic size_t next_band;
+	size_t n_bands;
+	int y1, y2;
+} pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.wake = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER
+};
+
+/*
+ * ---- surface table ----
+ */
+static struct soft_surf* surf_get(unsigned id)
+{
+	if (!id || id > soft.n_surf || !soft.surf[id-1].used)
+		return NULL;
+	return &soft.surf[id-1];
+}
+
+static unsigned surf_alloc()
+{
+	for (size_t i = 0; i < soft.n_surf; i++)
+		if (!soft.surf[i].used){
+			soft.surf[i] = (struct soft_surf){.used = true};
+			return i + 1;
+		}
+
+	size_t new_sz = soft.n_surf + 64;
+	struct soft_surf* new_surf =
+		realloc(soft.surf, sizeof(struct soft_surf) * new_sz);
+	if (!new_surf)
+		return 0;
+
+	memset(&new_surf[soft.n_surf], '\0',
+		sizeof(struct soft_surf) * (new_sz - soft.n_surf));
+	soft.surf = new_surf;
+
+	unsigned id = soft.n_surf + 1;
+	soft.n_surf = new_sz;
+	soft.surf[id-1].used = true;
+	return id;
+}
+
+static bool surf_resize(struct soft_surf* s, size_t w, size_t h)
+{
+	if (s->buf && s->w * s->h == w * h){
+		s->w = w;
+		s->h = h;
+		return true;
+	}
+
+	arcan_mem_free(s->buf);
+	s->w = s->h = 0;
+	s->buf = NULL;
+
+	if (!w || !h)
+		return false;
+
+	s->buf = arcan_alloc_mem(w * h * sizeof(av_pixel),
+		ARCAN_MEM_VBUFFER, ARCAN_MEM_NONFATAL, ARCAN_MEMALIGN_PAGE);
+	if (!s->buf)
+		return false;
+
+	s->w = w;
+	s->h = h;
+	return true;
+}
+
+static void surf_free(unsigned id)
+{
+	struct soft_surf* s = surf_get(id);
+	if (!s)
+		return;
+
+	arcan_mem_free(s->buf);
+	*s = (struct soft_surf){0};
+}
+
+/*
+ * ---- pixel math ----
+ * All of these are channel order agnostic, the only assumption is that alpha
+ * is in the high byte (true for both RGBA and BGRA packing).
+ */
+static inline unsigned div255(unsigned v)
+{
+	v += 128;
+	return (v + (v >> 8)) >> 8;
+}
+
+static inline av_pixel scale_alpha(av_pixel px, unsigned op)
+{
+	return (px & 0x00ffffff) | ((av_pixel) div255((px >> 24) * op) << 24);
+}
+
+static inline av_pixel lerp_px(av_pixel a, av_pixel b, unsigned f)
+{
+	uint32_t rb = ((a & 0x00ff00ff) * (256 - f) + (b & 0x00ff00ff) * f) >> 8;
+	uint32_t ag = (((a >> 8) & 0x00ff00ff) * (256 - f) +
+		((b >> 8) & 0x00ff00ff) * f) >> 8;
+	return (rb & 0x00ff00ff) | ((ag & 0x00ff00ff) << 8);
+}
+
+/* src * sa + dst * (1 - sa), two channels per lane */
+static inline av_pixel blend_normal(av_pixel s, av_pixel d, bool retain)
+{
+	unsigned sa = s >> 24;
+	unsigned isa = 255 - sa;
+
+	uint32_t rb = (s & 0x00ff00ff) * sa + (d & 0x00ff00ff) * isa + 0x00800080;
+	rb = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+
+	uint32_t ag = ((s >> 8) & 0x00ff00ff) * sa +
+		((d >> 8) & 0x00ff00ff) * isa + 0x00800080;
+	ag = (ag + ((ag >> 8) & 0x00ff00ff)) & 0xff00ff00;
+
+	av_pixel res = rb | ag;
+	if (retain)
+		return res;
+
+	unsigned a = sa + (d >> 24);
+	return (res & 0x00ffffff) | ((av_pixel)(a > 255 ? 255 : a) << 24);
+}
+
+static inline av_pixel blend_px(int mode, bool retain, av_pixel s, av_pixel d)
+{
+	if (mode == BLEND_NORMAL)
+		return blend_normal(s, d, retain);
+
+	int sa = s >> 24;
+	int da = d >> 24;
+	int isa = 255 - sa;
+	av_pixel res = 0;
+
+	for (size_t i = 0; i < 24; i += 8){
+		int sc = (s >> i) & 0xff;
+		int dc = (d >> i) & 0xff;
+		int r;
+
+		switch (mode){
+		case BLEND_MULTIPLY:
+			r = div255(sc * dc + dc * isa);
+		break;
+		case BLEND_PREMUL:
+			r = sc + div255(dc * isa);
+		break;
+		case BLEND_ADD:
+			r = sc + dc;
+		break;
+		case BLEND_SUB:
+			r = sc - (int) div255(dc * isa);
+		break;
+		default:
+			r = sc;
+		break;
+		}
+
+		r = r < 0 ? 0 : (r > 255 ? 255 : r);
+		res |= (av_pixel) r << i;
+	}
+
+/* the alpha factors are (1, 1) or (sa, 1-sa) depending on the rendertarget,
+ * with the same equation as the color channels */
+	int sf = retain ? (int) div255(sa * sa) : sa;
+	int df = retain ? (int) div255(da * isa) : da;
+	int a = mode == BLEND_SUB ? sf - df : sf + df;
+	a = a < 0 ? 0 : (a > 255 ? 255 : a);
+
+	return res | ((av_pixel) a << 24);
+}
+
+#ifdef __SSE2__
+/* four pixels of blend_normal, rounding is identical to the scalar version */
+static inline __m128i blend_normal4(__m128i s, __m128i d, bool retain)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i c255 = _mm_set1_epi16(255);
+	const __m128i c128 = _mm_set1_epi16(128);
+	const __m128i c257 = _mm_set1_epi16(257);
+	const __m128i amask = _mm_set1_epi32(0xff000000);
+
+	__m128i slo = _mm_unpacklo_epi8(s, zero);
+	__m128i shi = _mm_unpackhi_epi8(s, zero);
+	__m128i dlo = _mm_unpacklo_epi8(d, zero);
+	__m128i dhi = _mm_unpackhi_epi8(d, zero);
+
+	__m128i alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(slo, 0xff), 0xff);
+	__m128i ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(shi, 0xff), 0xff);
+
+	__m128i rlo = _mm_add_epi16(_mm_mullo_epi16(slo, alo),
+		_mm_mullo_epi16(dlo, _mm_sub_epi16(c255, alo)));
+	__m128i rhi = _mm_add_epi16(_mm_mullo_epi16(shi, ahi),
+		_mm_mullo_epi16(dhi, _mm_sub_epi16(c255, ahi)));
+
+	rlo = _mm_mulhi_epu16(_mm_add_epi16(rlo, c128), c257);
+	rhi = _mm_mulhi_epu16(_mm_add_epi16(rhi, c128), c257);
+
+	__m128i res = _mm_packus_epi16(rlo, rhi);
+	if (retain)
+		return res;
+
+	return _mm_or_si128(_mm_andnot_si128(amask, res),
+		_mm_and_si128(amask, _mm_adds_epu8(s, d)));
+}
+#endif
+
+static void blend_span(int mode, bool retain,
+	av_pixel* restrict dst, const av_pixel* restrict src, size_t n)
+{
+	size_t i = 0;
+
+#ifdef __SSE2__
+	if (mode == BLEND_NORMAL){
+		for (; i + 4 <= n; i += 4){
+			__m128i s = _mm_loadu_si128((const __m128i*) &src[i]);
+			__m128i d = _mm_loadu_si128((const __m128i*) &dst[i]);
+			_mm_storeu_si128((__m128i*) &dst[i], blend_normal4(s, d, retain));
+		}
+	}
+#endif
+
+	for (; i < n; i++)
+		dst[i] = blend_px(mode, retain, src[i], dst[i]);
+}
+
+static void blend_span_const(int mode,
+	bool retain, av_pixel* restrict dst, av_pixel col, size_t n)
+{
+	size_t i = 0;
+
+#ifdef __SSE2__
+	if (mode == BLEND_NORMAL){
+		__m128i s = _mm_set1_epi32(col);
+		for (; i + 4 <= n; i += 4){
+			__m128i d = _mm_loadu_si128((const __m128i*) &dst[i]);
+			_mm_storeu_si128((__m128i*) &dst[i], blend_normal4(s, d, retain));
+		}
+	}
+#endif
+
+	for (; i < n; i++)
+		dst[i] = blend_px(mode, retain, col, dst[i]);
+}
+
+static inline void fill_span(av_pixel* dst, av_pixel col, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		dst[i] = col;
+}
+
+/*
+ * ---- rasterization ----
+ */
+static inline int64_t floor_div(int64_t a, int64_t b)
+{
+	int64_t q = a / b;
+	if ((a % b) != 0 && ((a < 0) != (b < 0)))
+		q--;
+	return q;
+}
+
+static inline int64_t ceil_div(int64_t a, int64_t b)
+{
+	int64_t q = a / b;
+	if ((a % b) != 0 && ((a < 0) == (b < 0)))
+		q++;
+	return q;
+}
+
+static inline size_t wrap_coord(int64_t c, size_t n, bool repeat)
+{
+	if (c >= 0 && c < (int64_t) n)
+		return c;
+
+	if (!repeat)
+		return c < 0 ? 0 : n - 1;
+
+	int64_t r = c % (int64_t) n;
+	return r < 0 ? r + n : r;
+}
+
+/*
+ * Solve the [x1, x2) span of pixel centers on row [y] that are inside the
+ * (convex, positively oriented) polygon, with the top-left rule deciding
+ * ownership of pixels exactly on an edge.
+ */
+static bool solve_span(const struct soft_cmd* cmd, int y, int* x1, int* x2)
+{
+	int64_t lo = cmd->x1;
+	int64_t hi = (int64_t) cmd->x2 - 1;
+	int64_t py = (int64_t) y * SUBPX + SUBPX / 2;
+
+	for (size_t i = 0; i < cmd->n_verts; i++){
+		size_t j = (i + 1) % cmd->n_verts;
+		int64_t dx = cmd->vx[j] - cmd->vx[i];
+		int64_t dy = cmd->vy[j] - cmd->vy[i];
+
+/* E(px) = dx * (py - y0) - dy * (px - x0) >= bias, px = x * SUBPX + SUBPX/2 */
+		int64_t a = -dy;
+		int64_t c = dx * (py - cmd->vy[i]) + dy * cmd->vx[i];
+		int64_t r = (int64_t) cmd->bias[i] - c - a * (SUBPX / 2);
+
+		if (a > 0){
+			int64_t v = ceil_div(r, a * SUBPX);
+			if (v > lo)
+				lo = v;
+		}
+		else if (a < 0){
+			int64_t v = floor_div(r, a * SUBPX);
+			if (v < hi)
+				hi = v;
+		}
+		else if (c < cmd->bias[i])
+			return false;
+
+		if (lo > hi)
+			return false;
+	}
+
+	*x1 = lo;
+	*x2 = hi + 1;
+	return true;
+}
+
+static void sample_span(const struct soft_cmd* cmd,
+	int y, int x, size_t n, av_pixel* restrict out)
+{
+	double fx = (double) x + 0.5;
+	double fy = (double) y + 0.5;
+
+	int64_t u = llround((cmd->ua * fx + cmd->ub * fy + cmd->uc) * 65536.0);
+	int64_t v = llround((cmd->va * fx + cmd->vb * fy + cmd->vc) * 65536.0);
+	int64_t du = llround(cmd->ua * 65536.0);
+	int64_t dv = llround(cmd->va * 65536.0);
+
+	const av_pixel* tex = cmd->tex;
+	size_t tw = cmd->tw;
+	size_t th = cmd->th;
+
+	if (!cmd->bilinear){
+		for (size_t i = 0; i < n; i++, u += du, v += dv){
+			size_t tx = wrap_coord(u >> 16, tw, cmd->repeat_u);
+			size_t ty = wrap_coord(v >> 16, th, cmd->repeat_v);
+			out[i] = tex[ty * tw + tx];
+		}
+	}
+	else {
+		u -= 32768;
+		v -= 32768;
+		for (size_t i = 0; i < n; i++, u += du, v += dv){
+			int64_t ix = u >> 16;
+			int64_t iy = v >> 16;
+			size_t tx0 = wrap_coord(ix, tw, cmd->repeat_u);
+			size_t tx1 = wrap_coord(ix + 1, tw, cmd->repeat_u);
+			const av_pixel* r0 = &tex[wrap_coord(iy, th, cmd->repeat_v) * tw];
+			const av_pixel* r1 = &tex[wrap_coord(iy + 1, th, cmd->repeat_v) * tw];
+
+			unsigned wx = (u >> 8) & 0xff;
+			unsigned wy = (v >> 8) & 0xff;
+			out[i] = lerp_px(
+				lerp_px(r0[tx0], r0[tx1], wx), lerp_px(r1[tx0], r1[tx1], wx), wy);
+		}
+	}
+
+	if (cmd->opacity != 255)
+		for (size_t i = 0; i < n; i++)
+			out[i] = scale_alpha(out[i], cmd->opacity);
+}
+
+static av_pixel* get_scratch(struct soft_worker* self, size_t n)
+{
+	if (self->scratch_sz >= n)
+		return self->scratch;
+
+	arcan_mem_free(self->scratch);
+	self->scratch = arcan_alloc_mem(n * sizeof(av_pixel),
+		ARCAN_MEM_VBUFFER, ARCAN_MEM_NONFATAL, ARCAN_MEMALIGN_NATURAL);
+	self->scratch_sz = self->scratch ? n : 0;
+
+	return self->scratch;
+}
+
+static void draw_span(struct soft_worker* self,
+	const struct soft_cmd* cmd, av_pixel* out, int y, int x, size_t n)
+{
+	if (!cmd->textured){
+		if (cmd->blend == BLEND_NONE)
+			fill_span(out, cmd->color, n);
+		else
+			blend_span_const(cmd->blend, cmd->retain_alpha, out, cmd->color, n);
+		return;
+	}
+
+/* 1:1 copy, common for opaque surfaces drawn at their native size */
+	if (cmd->direct && cmd->blend == BLEND_NONE){
+		double fx = (double) x + 0.5;
+		double fy = (double) y + 0.5;
+		int64_t tx = floor(cmd->ua * fx + cmd->ub * fy + cmd->uc);
+		int64_t ty = floor(cmd->va * fx + cmd->vb * fy + cmd->vc);
+		if (tx >= 0 && tx + n <= cmd->tw && ty >= 0 && ty < cmd->th){
+			memcpy(out, &cmd->tex[ty * cmd->tw + tx], n * sizeof(av_pixel));
+			return;
+		}
+	}
+
+	av_pixel* tmp = get_scratch(self, n);
+	if (!tmp)
+		return;
+
+	sample_span(cmd, y, x, n, tmp);
+
+	if (cmd->blend == BLEND_NONE)
+		memcpy(out, tmp, n * sizeof(av_pixel));
+	else
+		blend_span(cmd->blend, cmd->retain_alpha, out, tmp, n);
+}
+
+static void raster_band(struct soft_worker* self, int y1, int y2)
+{
+	struct soft_target* dst = &soft.dst;
+
+	for (size_t i = 0; i < soft.n_cmds; i++){
+		const struct soft_cmd* cmd = &soft.cmds[i];
+		int cy1 = cmd->y1 > y1 ? cmd->y1 : y1;
+		int cy2 = cmd->y2 < y2 ? cmd->y2 : y2;
+
+		for (int y = cy1; y < cy2; y++){
+			av_pixel* row = &dst->buf[(size_t) y * dst->w];
+			uint8_t* srow = dst->stencil ? &dst->stencil[(size_t) y * dst->w] : NULL;
+			int x1 = cmd->x1, x2 = cmd->x2;
+
+			switch (cmd->kind){
+			case CMD_CLEAR:
+				fill_span(&row[x1], cmd->color, x2 - x1);
+			break;
+
+			case CMD_STENCIL_CLEAR:
+				if (srow)
+					memset(&srow[x1], 0, x2 - x1);
+			break;
+
+			case CMD_DRAW:
+				if (!solve_span(cmd, y, &x1, &x2))
+					continue;
+
+				if (cmd->stencil == STENCIL_WRITE){
+					if (srow)
+						memset(&srow[x1], 1, x2 - x1);
+					continue;
+				}
+
+				if (cmd->stencil != STENCIL_TEST || !srow){
+					draw_span(self, cmd, &row[x1], y, x1, x2 - x1);
+					continue;
+				}
+
+/* split into the runs that pass the stencil test */
+				for (int x = x1; x < x2;){
+					while (x < x2 && srow[x] != 1)
+						x++;
+					int run = x;
+					while (x < x2 && srow[x] == 1)
+						x++;
+					if (x > run)
+						draw_span(self, cmd, &row[run], y, run, x - run);
+				}
+			break;
+			}
+		}
+	}
+}
+
+static void run_bands(struct soft_worker* self)
+{
+	for(;;){
+		size_t band = atomic_fetch_add(&pool.next_band, 1);
+		if (band >= pool.n_bands)
+			return;
+
+		int y1 = pool.y1 + band * BAND_ROWS;
+		int y2 = y1 + BAND_ROWS;
+		raster_band(self, y1, y2 < pool.y2 ? y2 : pool.y2);
+	}
+}
+
+static void* worker_loop(void* arg)
+{
+	struct soft_worker* self = arg;
+	uint64_t seen = 0;
+
+	pthread_mutex_lock(&pool.lock);
+	for(;;){
+		while (pool.gen == seen)
+			pthread_cond_wait(&pool.wake, &pool.lock);
+		seen = pool.gen;
+		pthread_mutex_unlock(&pool.lock);
+
+		run_bands(self);
+
+		pthread_mutex_lock(&pool.lock);
+		if (--pool.pending == 0)
+			pthread_cond_signal(&pool.done);
+	}
+
+	return NULL;
+}
+
+static void setup_pool()
+{
+	pool.init = true;
+	pool.n_workers = 1;
+
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	uintptr_t tag;
+	char* val;
+	cfg_lookup_fun get_config = platform_config_lookup(&tag);
+	if (get_config && get_config("agp_soft_threads", 0, &val, tag) && val){
+		n = strtol(val, NULL, 10);
+		free(val);
+	}
+
+	if (n > MAX_THREADS)
+		n = MAX_THREADS;
+
+/* worker 0 is the calling thread */
+	for (long i = 1; i < n; i++){
+		if (0 != pthread_create(&pool.workers[i].thread,
+			NULL, worker_loop, &pool.workers[i])){
+			arcan_warning("agp(soft): couldn't spawn raster thread %ld\n", i);
+			break;
+		}
+		pool.n_workers++;
+	}
+
+	debug_print("raster threads: %zu", pool.n_workers);
+}
+
+/*
+ * Rasterize everything queued for the current target, this needs to happen
+ * before anything can read or modify a surface the queue might reference.
+ */
+static void flush()
+{
+	if (!soft.n_cmds)
+		return;
+
+	if (!pool.init)
+		setup_pool();
+
+	int y1 = INT_MAX, y2 = 0;
+	size_t px = 0;
+	for (size_t i = 0; i < soft.n_cmds; i++){
+		struct soft_cmd* cmd = &soft.cmds[i];
+		if (cmd->y1 < y1)
+			y1 = cmd->y1;
+		if (cmd->y2 > y2)
+			y2 = cmd->y2;
+		px += (size_t)(cmd->y2 - cmd->y1) * (cmd->x2 - cmd->x1);
+	}
+
+	verbose_print("flush %zu commands, %zu px", soft.n_cmds, px);
+	pool.y1 = y1;
+	pool.y2 = y2;
+	pool.n_bands = (y2 - y1 + BAND_ROWS - 1) / BAND_ROWS;
+	atomic_store(&pool.next_band, 0);
+
+	if (pool.n_workers > 1 && pool.n_bands > 1 && px >= THREAD_THRESHOLD){
+		pthread_mutex_lock(&pool.lock);
+		pool.pending = pool.n_workers - 1;
+		pool.gen++;
+		pthread_cond_broadcast(&pool.wake);
+		pthread_mutex_unlock(&pool.lock);
+
+		run_bands(&pool.workers[0]);
+
+		pthread_mutex_lock(&pool.lock);
+		while (pool.pending)
+			pthread_cond_wait(&pool.done, &pool.lock);
+		pthread_mutex_unlock(&pool.lock);
+	}
+	else
+		run_bands(&pool.workers[0]);
+
+	soft.n_cmds = 0;
+}
+
+static struct soft_cmd* queue_cmd()
+{
+	if (!soft.dst.buf)
+		return NULL;
+
+	if (soft.n_cmds == soft.cmd_cap){
+		size_t new_cap = soft.cmd_cap ? soft.cmd_cap * 2 : 256;
+		struct soft_cmd* new_cmds =
+			realloc(soft.cmds, sizeof(struct soft_cmd) * new_cap);
+
+/* out of memory, draw what we have and reuse the queue */
+		if (!new_cmds){
+			flush();
+			return &soft.cmds[soft.n_cmds++];
+		}
+
+		soft.cmds = new_cmds;
+		soft.cmd_cap = new_cap;
+	}
+
+	struct soft_cmd* cmd = &soft.cmds[soft.n_cmds++];
+	memset(cmd, '\0', sizeof(struct soft_cmd));
+	return cmd;
+}
+
+static void queue_rect(int kind, av_pixel col)
+{
+	int* clip = soft.dst.clip;
+	if (clip[2] <= clip[0] || clip[3] <= clip[1])
+		return;
+
+	struct soft_cmd* cmd = queue_cmd();
+	if (!cmd)
+		return;
+
+	*cmd = (struct soft_cmd){
+		.kind = kind,
+		.color = col,
+		.x1 = clip[0], .y1 = clip[1],
+		.x2 = clip[2], .y2 = clip[3]
+	};
+}
+
+static bool set_mapping(struct soft_cmd* cmd,
+	const double* sx, const double* sy, const double* tu, const double* tv)
+{
+	double det = (sx[1] - sx[0]) * (sy[2] - sy[0]) -
+		(sx[2] - sx[0]) * (sy[1] - sy[0]);
+	if (fabs(det) < 1e-9)
+		return false;
+
+	cmd->ua = ((tu[1] - tu[0]) * (sy[2] - sy[0]) -
+		(tu[2] - tu[0]) * (sy[1] - sy[0])) / det;
+	cmd->ub = ((tu[2] - tu[0]) * (sx[1] - sx[0]) -
+		(tu[1] - tu[0]) * (sx[2] - sx[0])) / det;
+	cmd->uc = tu[0] - cmd->ua * sx[0] - cmd->ub * sy[0];
+
+	cmd->va = ((tv[1] - tv[0]) * (sy[2] - sy[0]) -
+		(tv[2] - tv[0]) * (sy[1] - sy[0])) / det;
+	cmd->vb = ((tv[2] - tv[0]) * (sx[1] - sx[0]) -
+		(tv[1] - tv[0]) * (sx[2] - sx[0])) / det;
+	cmd->vc = tv[0] - cmd->va * sx[0] - cmd->vb * sy[0];
+
+/* axis aligned at scale 1, pixel centers land on texel centers */
+	cmd->direct =
+		fabs(cmd->ua - 1.0) < 1e-6 && fabs(cmd->ub) < 1e-6 &&
+		fabs(cmd->va) < 1e-6 && fabs(fabs(cmd->vb) - 1.0) < 1e-6 &&
+		fabs(cmd->uc - floor(cmd->uc)) < 1e-4 &&
+		fabs(cmd->vc - floor(cmd->vc)) < 1e-4;
+
+	return true;
+}
+
+/*
+ * Convert one convex polygon (3 or 4 window-space vertices, in draw order)
+ * into a command, using [base] for the shared draw state.
+ */
+static void queue_poly(const struct soft_cmd* base, size_t n,
+	const double* sx, const double* sy, const double* tu, const double* tv)
+{
+	int64_t vx[4], vy[4];
+	double minx = sx[0], maxx = sx[0], miny = sy[0], maxy = sy[0];
+
+	for (size_t i = 0; i < n; i++){
+		double x = sx[i] < -GUARD_BAND ? -GUARD_BAND :
+			(sx[i] > GUARD_BAND ? GUARD_BAND : sx[i]);
+		double y = sy[i] < -GUARD_BAND ? -GUARD_BAND :
+			(sy[i] > GUARD_BAND ? GUARD_BAND : sy[i]);
+		vx[i] = llround(x * SUBPX);
+		vy[i] = llround(y * SUBPX);
+		minx = x < minx ? x : minx;
+		maxx = x > maxx ? x : maxx;
+		miny = y < miny ? y : miny;
+		maxy = y > maxy ? y : maxy;
+	}
+
+	int64_t area = 0;
+	for (size_t i = 0; i < n; i++){
+		size_t j = (i + 1) % n;
+		area += vx[i] * vy[j] - vx[j] * vy[i];
+	}
+	if (!area)
+		return;
+
+	int* clip = soft.dst.clip;
+	int x1 = floor(minx), x2 = ceil(maxx) + 1;
+	int y1 = floor(miny), y2 = ceil(maxy) + 1;
+	x1 = x1 < clip[0] ? clip[0] : x1;
+	y1 = y1 < clip[1] ? clip[1] : y1;
+	x2 = x2 > clip[2] ? clip[2] : x2;
+	y2 = y2 > clip[3] ? clip[3] : y2;
+	if (x2 <= x1 || y2 <= y1)
+		return;
+
+	struct soft_cmd* cmd = queue_cmd();
+	if (!cmd)
+		return;
+
+	*cmd = *base;
+	cmd->n_verts = n;
+	cmd->x1 = x1;
+	cmd->y1 = y1;
+	cmd->x2 = x2;
+	cmd->y2 = y2;
+
+	for (size_t i = 0; i < n; i++){
+		size_t si = area > 0 ? i : n - 1 - i;
+		cmd->vx[i] = vx[si];
+		cmd->vy[i] = vy[si];
+	}
+
+/* one of the two polygons sharing an edge walks it in the opposite direction,
+ * so exactly one of them gets to own pixel centers on it */
+	for (size_t i = 0; i < n; i++){
+		size_t j = (i + 1) % n;
+		int64_t dx = cmd->vx[j] - cmd->vx[i];
+		int64_t dy = cmd->vy[j] - cmd->vy[i];
+		cmd->bias[i] = (dy > 0 || (dy == 0 && dx < 0)) ? 0 : 1;
+	}
+
+	if (cmd->textured && !set_mapping(cmd, sx, sy, tu, tv))
+		soft.n_cmds--;
+}
+
+/*
+ * ---- shaders ----
+ * Tracked so that lookups, groups and uniforms behave, only obj_col and the
+ * environment (projection, opacity) affect the output.
+ */
+static struct soft_shader* shader_get(agp_shader_id id)
+{
+	if (id >= soft.n_shaders || !soft.shaders[id].used)
+		return NULL;
+	return &soft.shaders[id];
+}
+
+static agp_shader_id shader_slot()
+{
+	for (size_t i = 0; i < soft.n_shaders; i++)
+		if (!soft.shaders[i].used)
+			return i;
+
+	size_t new_sz = soft.n_shaders + 16;
+	struct soft_shader* new_shaders =
+		realloc(soft.shaders, sizeof(struct soft_shader) * new_sz);
+	if (!new_shaders)
+		return BROKEN_SHADER;
+
+	memset(&new_shaders[soft.n_shaders], '\0',
+		sizeof(struct soft_shader) * (new_sz - soft.n_shaders));
+	soft.shaders = new_shaders;
+
+	agp_shader_id res = soft.n_shaders;
+	soft.n_shaders = new_sz;
+	return res;
+}
+
+static void shader_free(struct soft_shader* shdr)
+{
+	free(shdr->label);
+	free(shdr->vert);
+	free(shdr->frag);
+	*shdr = (struct soft_shader){0};
+}
+
+agp_shader_id agp_default_shader(enum SHADER_TYPES type)
+{
+	static agp_shader_id shids[SHADER_TYPE_ENDM];
+	static bool defshdr_build;
+
+	assert(type < SHADER_TYPE_ENDM);
+
+	if (!defshdr_build){
+		shids[BASIC_2D] = agp_shader_build("DEFAULT", NULL, defvprg, deffprg);
+		shids[COLOR_2D] = agp_shader_build(
+			"DEFAULT_COLOR", NULL, defvprg, defcfprg);
+		shids[BASIC_3D] = shids[BASIC_2D];
+		defshdr_build = true;
+	}
+
+	return shids[type];
+}
+
+void agp_shader_source(enum SHADER_TYPES type,
+	const char** vert, const char** frag)
+{
+	switch(type){
+	case BASIC_2D:
+	case BASIC_3D:
+		*vert = defvprg;
+		*frag = deffprg;
+	break;
+
+	case COLOR_2D:
+		*vert = defvprg;
+		*frag = defcfprg;
+	break;
+
+	default:
+		*vert = NULL;
+		*frag = NULL;
+	break;
+	}
+}
+
+agp_shader_id agp_shader_build(const char* tag,
+	const char* geom, const char* vert, const char* frag)
+{
+	agp_shader_id id = shader_slot();
+	if (BROKEN_SHADER == id)
+		return BROKEN_SHADER;
+
+	struct soft_shader* shdr = &soft.shaders[id];
+	shdr->label = strdup(tag ? tag : "");
+	shdr->vert = strdup(vert ? vert : defvprg);
+	shdr->frag = strdup(frag ? frag : deffprg);
+
+	if (!shdr->label || !shdr->vert || !shdr->frag){
+		shader_free(shdr);
+		return BROKEN_SHADER;
+	}
+
+	shdr->color = strcmp(shdr->frag, defcfprg) == 0;
+	shdr->used = true;
+	return id;
+}
+
+agp_shader_id agp_shader_addgroup(agp_shader_id shid)
+{
+	struct soft_shader* src = shader_get(shid);
+	if (!src)
+		return BROKEN_SHADER;
+
+	agp_shader_id id = agp_shader_build(src->label, NULL, src->vert, src->frag);
+	if (BROKEN_SHADER != id)
+		memcpy(soft.shaders[id].obj_col, src->obj_col, sizeof(float) * 3);
+
+	return id;
+}
+
+bool agp_shader_destroy(agp_shader_id shid)
+{
+	struct soft_shader* shdr = shader_get(shid);
+	if (!shdr ||
+		shid == agp_default_shader(BASIC_2D) ||
+		shid == agp_default_shader(COLOR_2D))
+		return false;
+
+	shader_free(shdr);
+	if (soft.shader == shid)
+		soft.shader = BROKEN_SHADER;
+
+	return true;
+}
+
+agp_shader_id agp_shader_lookup(const char* tag)
+{
+	for (size_t i = 0; i < soft.n_shaders && tag; i++)
+		if (soft.shaders[i].used && strcmp(soft.shaders[i].label, tag) == 0)
+			return i;
+
+	return BROKEN_SHADER;
+}
+
+const char* agp_shader_lookuptag(agp_shader_id id)
+{
+	struct soft_shader* shdr = shader_get(id);
+	return shdr ? shdr->label : NULL;
+}
+
+bool agp_shader_lookupprgs(agp_shader_id id,
+	const char** vert, const char** frag)
+{
+	struct soft_shader* shdr = shader_get(id);
+	if (!shdr)
+		return false;
+
+	*vert = shdr->vert;
+	*frag = shdr->frag;
+	return true;
+}
+
+bool agp_shader_valid(agp_shader_id id)
+{
+	return shader_get(id) != NULL;
+}
+
+int agp_shader_activate(agp_shader_id shid)
+{
+	if (!agp_shader_valid(shid))
+		return ARCAN_ERRC_NO_SUCH_OBJECT;
+
+	soft.shader = shid;
+	return ARCAN_OK;
+}
+
+int agp_shader_envv(enum agp_shader_envts slot, void* value, size_t size)
+{
+	switch (slot){
+	case PROJECTION_MATR:
+		if (size == sizeof(float) * 16){
+			memcpy(soft.projection, value, size);
+			return 1;
+		}
+	break;
+	case OBJ_OPACITY:
+		if (size == sizeof(float)){
+			memcpy(&soft.opacity, value, size);
+			return 1;
+		}
+	break;
+	default:
+	break;
+	}
+	return 0;
+}
+
+void agp_shader_forceunif(const char* label, enum shdrutype type, void* val)
+{
+	struct soft_shader* shdr = shader_get(soft.shader);
+	if (!shdr || type != shdrvec3 || strcmp(label, "obj_col") != 0)
+		return;
+
+	memcpy(shdr->obj_col, val, sizeof(float) * 3);
+}
+
+#define TBLSIZE (1 + TIMESTAMP_D - MODELVIEW_MATR)
+static char* symtbl[TBLSIZE] = {
+	"modelview",
+	"projection",
+	"texturem",
+	"obj_opacity",
+	"trans_blend",
+	"trans_move",
+	"trans_rotate",
+	"trans_scale",
+	"obj_input_sz",
+	"obj_output_sz",
+	"obj_storage_sz",
+	"rtgt_id",
+	"fract_timestamp",
+	"timestamp"
+};
+
+const char* agp_shader_symtype(enum agp_shader_envts env)
+{
+	return symtbl[env];
+}
+
+int agp_shader_vattribute_loc(enum shader_vertex_attributes attr)
+{
+	return -1;
+}
+
+void agp_shader_flush()
+{
+	for (size_t i = 0; i < soft.n_shaders; i++)
+		shader_free(&soft.shaders[i]);
+
+	soft.shader = BROKEN_SHADER;
+}
+
+void agp_shader_unload_all()
+{
+}
+
+void agp_shader_rebuild_all()
+{
+	soft.shader = BROKEN_SHADER;
+}
+
+const char* agp_ident()
+{
+	return "SOFT";
+}
+
+const char* agp_shader_language()
+{
+	return "NONE";
+}
+
+const char** agp_envopts()
+{
+	static const char* env[] = {
+		"ARCAN_AGP_SOFT_THREADS=n",
+		"Number of raster threads (default: one per core, max 16)",
+		NULL
+	};
+	return env;
+}
+
+/*
+ * ---- function environment ----
+ * There is no GL context, these only exist so that platforms written against
+ * the GL backends still link.
+ */
+struct agp_fenv* agp_alloc_fenv(
+	void*(lookup)(void* tag, const char* sym, bool req), void* tag)
+{
+	return NULL;
+}
+
+struct agp_fenv* agp_env()
+{
+	return NULL;
+}
+
+void agp_setenv(struct agp_fenv* dst)
+{
+}
+
+void agp_dropenv(struct agp_fenv* env)
+{
+}
+
+void agp_glinit_fenv(struct agp_fenv* dst,
+	void*(*lookup)(void* tag, const char* sym, bool req), void* tag)
+{
+}
+
+void agp_init()
+{
+	soft.blend = BLEND_NORMAL;
+	soft.clearcol[0] = 0.0;
+	soft.clearcol[1] = 0.0;
+	soft.clearcol[2] = 0.0;
+	soft.clearcol[3] = 1.0;
+}
+
+bool agp_status_ok(const char** msg)
+{
+	return true;
+}
+
+void agp_render_options(struct agp_render_options opts)
+{
+}
+
+bool agp_accelerated()
+{
+	return false;
+}
+
+/*
+ * ---- vstores ----
+ */
+unsigned agp_resolve_texid(struct agp_vstore* vs)
+{
+	if (vs->vinf.text.glid_proxy)
+		return *vs->vinf.text.glid_proxy;
+	else
+		return vs->vinf.text.glid;
+}
+
+static void alloc_buffer(struct agp_vstore* s)
+{
+	if (s->vinf.text.s_raw != s->w * s->h * sizeof(av_pixel)){
+		arcan_mem_free(s->vinf.text.raw);
+		s->vinf.text.raw = NULL;
+	}
+
+	if (!s->vinf.text.raw){
+		verbose_print("(%"PRIxPTR") alloc buffer", (uintptr_t) s);
+		s->vinf.text.s_raw = s->w * s->h * sizeof(av_pixel);
+		s->vinf.text.raw = arcan_alloc_mem(s->vinf.text.s_raw,
+			ARCAN_MEM_VBUFFER, ARCAN_MEM_BZERO, ARCAN_MEMALIGN_PAGE);
+	}
+}
+
+/* get the surface backing [s] at the current vstore dimensions */
+static struct soft_surf* vstore_surf(struct agp_vstore* s)
+{
+	if (!s->vinf.text.glid)
+		s->vinf.text.glid = surf_alloc();
+
+	struct soft_surf* surf = surf_get(s->vinf.text.glid);
+	if (!surf)
+		return NULL;
+
+	if (surf->w != s->w || surf->h != s->h){
+		flush();
+		if (!surf_resize(surf, s->w, s->h))
+			return NULL;
+		memset(surf->buf, '\0', s->w * s->h * sizeof(av_pixel));
+	}
+
+	return surf;
+}
+
+/* copy a full frame layout buffer, or the dirty part of it, into [dst] */
+static void copy_region(av_pixel* dst, const av_pixel* src,
+	size_t w, size_t h, const struct stream_meta* meta)
+{
+	if (!meta || !meta->dirty ||
+		(float)(meta->w * meta->h) / (w * h) > 0.5){
+		memcpy(dst, src, w * h * sizeof(av_pixel));
+		return;
+	}
+
+	size_t row_sz = meta->w * sizeof(av_pixel);
+	for (size_t y = meta->y1; y < meta->y1 + meta->h; y++)
+		memcpy(&dst[y * w + meta->x1], &src[y * w + meta->x1], row_sz);
+}
+
+void agp_update_vstore(struct agp_vstore* s, bool copy)
+{
+	if (s->txmapped == TXSTATE_OFF)
+		return;
+
+	verbose_print(
+		"update vstore (%"PRIxPTR"), copy: %d", (uintptr_t) s, (int) copy);
+	FLAG_DIRTY();
+
+	if (copy){
+		flush();
+
+/* for the launch_resume and resize states, were we'd push a new
+ * update but have multiple references */
+		if (s->refcount == 0)
+			s->refcount = 1;
+
+		struct soft_surf* surf = vstore_surf(s);
+		if (surf){
+			size_t sz = s->w * s->h * sizeof(av_pixel);
+			if (s->txmapped == TXSTATE_TEX2D &&
+				s->vinf.text.raw && s->vinf.text.s_raw >= sz)
+				memcpy(surf->buf, s->vinf.text.raw, sz);
+			else
+				memset(surf->buf, '\0', sz);
+		}
+		s->update_ts = arcan_timemillis();
+	}
+	s->vinf.text.glid_proxy = NULL;
+
+#ifndef HEADLESS_NOARCAN
+	if (arcan_video_display.conservative){
+		arcan_mem_free(s->vinf.text.raw);
+		s->vinf.text.raw = NULL;
+		s->vinf.text.s_raw = 0;
+	}
+#endif
+}
+
+void agp_empty_vstore(struct agp_vstore* vs, size_t w, size_t h)
+{
+/* this is to allow an override of s_fmt and still handle reset */
+	if (vs->vinf.text.s_fmt == 0){
+		vs->vinf.text.s_fmt = GL_PIXEL_FORMAT;
+	if (vs->vinf.text.d_fmt == 0)
+		vs->vinf.text.d_fmt = GL_STORE_PIXEL_FORMAT;
+	}
+
+	vs->w = w;
+	vs->h = h;
+	vs->bpp = sizeof(av_pixel);
+	vs->txmapped = TXSTATE_TEX2D;
+
+/* no need for a zeroed upload buffer, update_vstore clears the surface
+ * when there is nothing to copy from */
+	arcan_mem_free(vs->vinf.text.raw);
+	vs->vinf.text.raw = NULL;
+	vs->vinf.text.s_raw = 0;
+
+	agp_update_vstore(vs, true);
+
+	verbose_print("(%"PRIxPTR") cleared to %zu*%zu", (uintptr_t) vs, w, h);
+}
+
+/* the storage is always native pixels, the hint only affects the GL backends */
+void agp_empty_vstoreext(struct agp_vstore* vs,
+	size_t w, size_t h, enum vstore_hint hint)
+{
+	agp_empty_vstore(vs, w, h);
+}
+
+void agp_resize_vstore(struct agp_vstore* s, size_t w, size_t h)
+{
+	s->w = w;
+	s->h = h;
+	s->bpp = sizeof(av_pixel);
+
+	verbose_print("(%"PRIxPTR") resize to %zu * %zu", (uintptr_t) s, w, h);
+	alloc_buffer(s);
+	agp_drop_readback(s);
+
+	agp_update_vstore(s, true);
+}
+
+void agp_null_vstore(struct agp_vstore* store)
+{
+	if (!store ||
+		store->txmapped != TXSTATE_TEX2D || !store->vinf.text.glid)
+		return;
+
+	flush();
+	surf_free(store->vinf.text.glid);
+	verbose_print("cleared (%"PRIxPTR"), dropped %u",
+		(uintptr_t) store, store->vinf.text.glid);
+
+	store->vinf.text.glid = 0;
+	store->vinf.text.glid_proxy = NULL;
+	agp_drop_readback(store);
+}
+
+void agp_drop_vstore(struct agp_vstore* s)
+{
+	if (!s || !s->vinf.text.glid)
+		return;
+
+	if (s->vinf.text.tag)
+		platform_video_map_handle(s, -1);
+
+	if (s->vinf.text.kind == STORAGE_TEXT){
+		arcan_mem_free(s->vinf.text.source);
+	}
+	else if (s->vinf.text.kind == STORAGE_TPACK){
+		arcan_mem_free(s->vinf.text.tpack.buf);
+	}
+	if (s->vinf.text.kind == STORAGE_TEXTARRAY){
+		char** work = s->vinf.text.source_arr;
+		while(*work){
+			arcan_mem_free(*work);
+			work++;
+		}
+		arcan_mem_free(s->vinf.text.source_arr);
+	}
+
+	flush();
+	agp_drop_readback(s);
+	surf_free(s->vinf.text.glid);
+	s->vinf.text.glid = 0;
+}
+
+bool agp_slice_vstore(struct agp_vstore* backing,
+	size_t n_slices, size_t base, enum txstate txstate)
+{
+	return false;
+}
+
+bool agp_slice_synch(
+	struct agp_vstore* backing, size_t n_slices, struct agp_vstore** slices)
+{
+	return false;
+}
+
+void agp_activate_vstore(struct agp_vstore* s)
+{
+	switch (s->txmapped){
+	case TXSTATE_OFF:
+		return;
+	break;
+	case TXSTATE_TEX2D:
+		soft.tex = agp_resolve_texid(s);
+		soft.filter = s->filtermode & (~ARCAN_VFILTER_MIPMAP);
+		soft.txu = s->txu;
+		soft.txv = s->txv;
+	break;
+	default:
+		verbose_print("unsupported store type: %d", (int) s->txmapped);
+		soft.tex = 0;
+	break;
+	}
+}
+
+void agp_deactivate_vstore()
+{
+	soft.tex = 0;
+}
+
+/* only the first map slot can be sampled by the built-in shaders */
+void agp_activate_vstore_multi(struct agp_vstore** backing, size_t n)
+{
+	if (n)
+		agp_activate_vstore(backing[0]);
+}
+
+void agp_vstore_copyreg(
+	struct agp_vstore* restrict src, struct agp_vstore* restrict dst,
+	size_t x1, size_t y1, size_t x2, size_t y2)
+{
+	if (!src || !dst || y1 > dst->h || y1 > src->h || x1 > dst->w || x1 > src->w)
+		return;
+
+	if (y2 > dst->h)
+		y2 = dst->h;
+
+	if (y2 > src->h)
+		y2 = src->h;
+
+	if (x2 > dst->w)
+		x2 = dst->w;
+
+	if (x2 > src->w)
+		x2 = src->w;
+
+	if (x2 <= x1 || y2 <= y1)
+		return;
+
+	size_t line_w = (x2 - x1) * sizeof(av_pixel);
+	size_t dst_pitch = dst->vinf.text.stride / sizeof(av_pixel);
+	size_t src_pitch = src->vinf.text.stride / sizeof(av_pixel);
+
+	if (!dst_pitch)
+		dst_pitch = dst->w;
+
+	if (!src_pitch)
+		src_pitch = src->w;
+
+	for (size_t y = y1; y < y2; y++){
+		memcpy(
+			&dst->vinf.text.raw[y * dst_pitch + x1],
+			&src->vinf.text.raw[y * src_pitch + x1], line_w
+		);
+	}
+}
+
+/*
+ * ---- streaming ----
+ */
+struct stream_meta agp_stream_prepare(struct agp_vstore* s,
+		struct stream_meta meta, enum stream_type type)
+{
+	struct stream_meta res = meta;
+	struct soft_surf* surf;
+	res.state = true;
+	res.type = type;
+
+	switch (type){
+	case STREAM_RAW:
+		verbose_print("(%"PRIxPTR") prepare upload (raw)", (uintptr_t) s);
+		alloc_buffer(s);
+		res.buf = s->vinf.text.raw;
+		res.state = res.buf != NULL;
+	break;
+
+	case STREAM_RAW_DIRECT_COPY:
+		alloc_buffer(s);
+	case STREAM_RAW_DIRECT:
+	case STREAM_RAW_DIRECT_SYNCHRONOUS:
+		verbose_print("(%"PRIxPTR") prepare upload (raw/direct)", (uintptr_t) s);
+		flush();
+		if (!(surf = vstore_surf(s))){
+			res.state = false;
+			break;
+		}
+
+		copy_region(surf->buf, meta.buf, s->w, s->h, &meta);
+		if (type == STREAM_RAW_DIRECT_COPY && s->vinf.text.raw){
+			copy_region(s->vinf.text.raw, meta.buf, s->w, s->h, &meta);
+			s->update_ts = arcan_timemillis();
+		}
+	break;
+
+	case STREAM_EXT_RESYNCH:
+		verbose_print("(%"PRIxPTR") resynch stream", (uintptr_t) s);
+		agp_null_vstore(s);
+		agp_update_vstore(s, true);
+	break;
+
+/* no GPU buffers to import, the frameserver will fall back to shm */
+	case STREAM_HANDLE:
+		res.state = platform_video_map_buffer(s, meta.planes, meta.used);
+	break;
+	}
+
+	return res;
+}
+
+void agp_stream_release(struct agp_vstore* s, struct stream_meta meta)
+{
+	verbose_print("(%"PRIxPTR") release", (uintptr_t) s);
+	if (!s->vinf.text.raw)
+		return;
+
+	flush();
+	struct soft_surf* surf = vstore_surf(s);
+	if (surf)
+		copy_region(surf->buf, s->vinf.text.raw, s->w, s->h, &meta);
+}
+
+void agp_stream_commit(struct agp_vstore* s, struct stream_meta meta)
+{
+}
+
+/*
+ * ---- readbacks ----
+ * Everything is already in host memory, so the 'asynchronous' readbacks are
+ * just copies into a ring to keep the same lifecycle as the PBO version.
+ */
+void agp_readback_synchronous(struct agp_vstore* dst)
+{
+	if (!(dst->txmapped == TXSTATE_TEX2D) || !dst->vinf.text.raw)
+		return;
+
+	flush();
+	struct soft_surf* surf = surf_get(agp_resolve_texid(dst));
+	if (!surf)
+		return;
+
+	size_t sz = surf->w * surf->h * sizeof(av_pixel);
+	memcpy(dst->vinf.text.raw, surf->buf,
+		sz < dst->vinf.text.s_raw ? sz : dst->vinf.text.s_raw);
+	dst->update_ts = arcan_timemillis();
+}
+
+void agp_drop_readback(struct agp_vstore* store)
+{
+	struct agp_readback* rb = store->vinf.text.readback;
+	if (!rb)
+		return;
+
+	for (size_t i = 0; i < READBACK_RING; i++)
+		arcan_mem_free(rb->buf[i]);
+
+	arcan_mem_free(rb);
+	store->vinf.text.readback = NULL;
+}
+
+static void default_release(void* tag)
+{
+	if (!tag)
+		return;
+
+	struct agp_vstore* store = tag;
+	struct agp_readback* rb = store->vinf.text.readback;
+	if (!rb || !rb->count)
+		return;
+
+	rb->first = (rb->first + 1) % READBACK_RING;
+	rb->count--;
+}
+
+bool agp_request_readback(struct agp_vstore* store, struct agp_region* region)
+{
+	if (!store || store->txmapped != TXSTATE_TEX2D)
+		return false;
+
+	struct agp_readback* rb = store->vinf.text.readback;
+	if (rb && (rb->w != store->w || rb->h != store->h) && !rb->count){
+		agp_drop_readback(store);
+		rb = NULL;
+	}
+
+	if (!rb){
+		rb = arcan_alloc_mem(sizeof(struct agp_readback), ARCAN_MEM_VSTRUCT,
+			ARCAN_MEM_BZERO | ARCAN_MEM_NONFATAL, ARCAN_MEMALIGN_NATURAL);
+		if (!rb)
+			return false;
+		rb->w = store->w;
+		rb->h = store->h;
+		store->vinf.text.readback = rb;
+	}
+
+	if (rb->count == READBACK_RING || rb->w != store->w || rb->h != store->h)
+		return false;
+
+	size_t slot = (rb->first + rb->count) % READBACK_RING;
+	if (!rb->buf[slot]){
+		rb->buf[slot] = arcan_alloc_mem(rb->w * rb->h * sizeof(av_pixel),
+			ARCAN_MEM_VBUFFER, ARCAN_MEM_BZERO | ARCAN_MEM_NONFATAL,
+			ARCAN_MEMALIGN_PAGE);
+		if (!rb->buf[slot])
+			return false;
+	}
+
+	flush();
+	struct soft_surf* surf = surf_get(agp_resolve_texid(store));
+	if (!surf || surf->w != rb->w || surf->h != rb->h)
+		return false;
+
+/* same clamping rules as the GL version, the region ends up where it
+ * would be in a full readback */
+	struct agp_region full = {.x2 = store->w, .y2 = store->h};
+	if (region){
+		full.x1 = region->x1 < store->w ? region->x1 : 0;
+		full.y1 = region->y1 < store->h ? region->y1 : 0;
+		full.x2 = region->x2 > full.x1 && region->x2 <= store->w ? region->x2 : store->w;
+		full.y2 = region->y2 > full.y1 && region->y2 <= store->h ? region->y2 : store->h;
+	}
+
+	if (full.x1 || full.y1 || full.x2 != store->w || full.y2 != store->h){
+		size_t row_sz = (full.x2 - full.x1) * sizeof(av_pixel);
+		for (size_t y = full.y1; y < full.y2; y++)
+			memcpy(&rb->buf[slot][y * rb->w + full.x1],
+				&surf->buf[y * rb->w + full.x1], row_sz);
+	}
+	else
+		memcpy(rb->buf[slot], surf->buf, rb->w * rb->h * sizeof(av_pixel));
+
+	rb->count++;
+	return true;
+}
+
+struct asynch_readback_meta agp_poll_readback(struct agp_vstore* store)
+{
+	struct asynch_readback_meta res = {
+	.release = default_release
+	};
+
+	if (!store || store->txmapped != TXSTATE_TEX2D || !store->vinf.text.readback)
+		return res;
+
+	struct agp_readback* rb = store->vinf.text.readback;
+	if (!rb->count)
+		return res;
+
+	res.ptr = rb->buf[rb->first];
+	res.queued = rb->count - 1;
+	res.tag = store;
+	res.w = rb->w;
+	res.h = rb->h;
+	res.buf_sz = rb->w * rb->h * sizeof(av_pixel);
+
+	return res;
+}
+
+void agp_save_output(size_t w, size_t h, av_pixel* dst, size_t dsz)
+{
+	assert(w * h * sizeof(av_pixel) == dsz);
+	flush();
+
+	if (soft.display.buf && soft.display.w == w && soft.display.h == h)
+		memcpy(dst, soft.display.buf, dsz);
+	else
+		memset(dst, '\0', dsz);
+}
+
+/*
+ * ---- rendertargets ----
+ */
+static void erase_store(struct agp_vstore* os)
+{
+	if (!os)
+		return;
+
+	agp_null_vstore(os);
+	arcan_mem_free(os->vinf.text.raw);
+	os->vinf.text.raw = NULL;
+	os->vinf.text.s_raw = 0;
+}
+
+/*
+ * build alternate stores for rendertarget swapping
+ */
+static void setup_stores(struct agp_rendertarget* dst)
+{
+	dst->n_stores = MAX_BUFFERS;
+	dst->dirty_flip = MAX_BUFFERS;
+	dst->dirty_region_decay = dst->dirty_region = 0;
+
+	for (size_t i = 0; i < MAX_BUFFERS; i++){
+		dst->stores[i] = arcan_alloc_mem(sizeof(struct agp_vstore),
+			ARCAN_MEM_VSTRUCT, ARCAN_MEM_BZERO, ARCAN_MEMALIGN_NATURAL);
+		dst->stores[i]->vinf.text.s_fmt = dst->store->vinf.text.s_fmt;
+		dst->stores[i]->vinf.text.d_fmt = dst->store->vinf.text.d_fmt;
+
+		if (dst->alloc){
+			dst->stores[i]->w = dst->store->w;
+			dst->stores[i]->h = dst->store->h;
+			dst->alloc(dst, dst->stores[i], RTGT_ALLOC_SETUP, dst->alloc_tag);
+		}
+		else{
+			agp_empty_vstore(dst->stores[i], dst->store->w, dst->store->h);
+		}
+	}
+}
+
+void agp_rendertarget_allocator(struct agp_rendertarget* tgt, bool (*handler)(
+	struct agp_rendertarget*, struct agp_vstore*, int action, void* tag), void* tag)
+{
+	if (!tgt)
+		return;
+
+	flush();
+	if (tgt->alloc){
+		for (size_t i = 0; i < tgt->n_stores; i++){
+			tgt->alloc(tgt, tgt->stores[i], RTGT_ALLOC_FREE, tgt->alloc_tag);
+			if (tgt->shadow[i]){
+				tgt->alloc(tgt, tgt->shadow[i], RTGT_ALLOC_FREE, tgt->alloc_tag);
+				arcan_mem_free(tgt->shadow[i]);
+				tgt->shadow[i] = NULL;
+			}
+		}
+	}
+
+	tgt->alloc = handler;
+	tgt->alloc_tag = tag;
+
+	if (!tgt->n_stores)
+		return;
+
+/* the glid_proxy is a pointer so it will still be valid */
+	for (size_t i = 0; i < tgt->n_stores; i++){
+		tgt->alloc(tgt, tgt->stores[i], RTGT_ALLOC_SETUP, tgt->alloc_tag);
+	}
+}
+
+void agp_rendertarget_dropswap(struct agp_rendertarget* tgt)
+{
+	if (!tgt || !tgt->n_stores)
+		return;
+
+	flush();
+	verbose_print("dropping normal and shadow stores");
+	for (size_t i = 0; i < tgt->n_stores; i++){
+		if (tgt->alloc){
+			tgt->alloc(tgt, tgt->stores[i], RTGT_ALLOC_FREE, tgt->alloc_tag);
+		}
+		else
+			agp_drop_vstore(tgt->stores[i]);
+
+		if (tgt->shadow[i]){
+			if (tgt->alloc)
+				tgt->alloc(tgt, tgt->shadow[i], RTGT_ALLOC_FREE, tgt->alloc_tag);
+			else
+				agp_drop_vstore(tgt->shadow[i]);
+
+			arcan_mem_free(tgt->shadow[i]);
+			tgt->shadow[i] = NULL;
+		}
+	}
+
+	tgt->n_stores = 0;
+	tgt->store->vinf.text.glid_proxy = NULL;
+	tgt->alloc = NULL;
+	tgt->alloc_tag = NULL;
+	tgt->dirty_flip++;
+}
+
+size_t agp_rendertarget_dirty(
+	struct agp_rendertarget* dst, struct agp_region* dirty)
+{
+	if (!dst)
+		return 0;
+
+	if (dirty){
+		dst->dirty_region++;
+		dst->dirty_region_decay++;
+	}
+
+	return dst->dirty_region_decay;
+}
+
+void agp_rendertarget_dirty_reset(
+	struct agp_rendertarget* src, struct agp_region* dst)
+{
+	for (size_t i = 0; i < src->dirty_region_decay && dst; i++){
+		dst[i] = (struct agp_region){
+			.x1 = 0, .y1 = 0,
+			.x2 = src->store->w, .y2 = src->store->h
+		};
+	}
+
+	src->dirty_region_decay = src->dirty_region;
+	src->dirty_region = 0;
+}
+
+struct agp_vstore*
+	agp_rendertarget_swap(struct agp_rendertarget* dst, bool* swap)
+{
+	if (!dst || !dst->store){
+		*swap = false;
+		return NULL;
+	}
+
+/* the front store is what gets drawn into, so the queue must land first */
+	if (dst == soft.rtgt)
+		flush();
+
+	int old_front = dst->store_ind;
+	int front = dst->store_ind;
+
+	if (!dst->n_stores){
+		setup_stores(dst);
+		FLAG_DIRTY();
+		*swap = false;
+	}
+	else {
+		front = dst->store_ind = (dst->store_ind + 1) % MAX_BUFFERS;
+		*swap = true;
+	}
+
+	dst->store->vinf.text.glid_proxy = &dst->stores[front]->vinf.text.glid;
+
+/* retarget the queue if the swap happened while the rendertarget is active */
+	if (dst == soft.rtgt){
+		struct soft_surf* surf = surf_get(agp_resolve_texid(dst->store));
+		soft.dst.buf = surf ? surf->buf : NULL;
+	}
+
+	if (dst->dirty_flip > 0){
+		dst->dirty_flip--;
+		FLAG_DIRTY();
+
+		if (!dst->dirty_flip){
+			for (size_t i = 0; i < MAX_BUFFERS; i++){
+				if (!dst->shadow[i])
+					continue;
+
+				if (dst->alloc)
+					dst->alloc(dst, dst->shadow[i], RTGT_ALLOC_FREE, dst->alloc_tag);
+				else
+					erase_store(dst->shadow[i]);
+
+				arcan_mem_free(dst->shadow[i]);
+				dst->shadow[i] = NULL;
+			}
+		}
+
+		if (dst->rz_ack){
+			*swap = false;
+			dst->rz_ack = false;
+			return NULL;
+		}
+	}
+
+	return dst->stores[old_front];
+}
+
+bool agp_rendertarget_swapstore(
+	struct agp_rendertarget* tgt, struct agp_vstore* vstore)
+{
+	if (!tgt || !vstore ||
+		vstore->txmapped != TXSTATE_TEX2D || tgt->n_stores ||
+		tgt->store->w != vstore->w || tgt->store->h != vstore->h)
+		return false;
+
+	if (tgt->store == vstore)
+		return true;
+
+	if (tgt == soft.rtgt)
+		agp_activate_rendertarget(NULL);
+
+	tgt->store = vstore;
+	return true;
+}
+
+struct agp_rendertarget* agp_setup_rendertarget(
+	struct agp_vstore* vstore, enum rendertarget_mode m)
+{
+	if (vstore->txmapped != TXSTATE_TEX2D)
+		return NULL;
+
+	struct agp_rendertarget* r = arcan_alloc_mem(sizeof(struct agp_rendertarget),
+		ARCAN_MEM_VSTRUCT, ARCAN_MEM_BZERO, ARCAN_MEMALIGN_NATURAL);
+
+	r->store = vstore;
+	r->mode = m;
+	r->viewport[0] = 0;
+	r->viewport[1] = 0;
+	r->viewport[2] = vstore->w;
+	r->viewport[3] = vstore->h;
+	r->clearcol[0] = 0.05;
+	r->clearcol[1] = 0.05;
+	r->clearcol[2] = 0.05;
+	r->clearcol[3] = 1.0;
+	verbose_print("vstore (%"PRIxPTR") bound to rendertarget "
+		"(%"PRIxPTR") in mode %d", (uintptr_t) vstore, (uintptr_t) r, (int) m);
+
+	return r;
+}
+
+void agp_rendertarget_ids(struct agp_rendertarget* rtgt, uintptr_t* tgt,
+	uintptr_t* col, uintptr_t* depth)
+{
+	if (tgt)
+		*tgt = 0;
+	if (col)
+		*col = agp_resolve_texid(rtgt->store);
+	if (depth)
+		*depth = 0;
+}
+
+void agp_drop_rendertarget(struct agp_rendertarget* tgt)
+{
+	if (!tgt)
+		return;
+
+	if (tgt == soft.rtgt)
+		agp_activate_rendertarget(NULL);
+
+	if (tgt->n_stores){
+		verbose_print("dropping normal and shadow stores");
+		for (size_t i = 0; i < tgt->n_stores; i++){
+			agp_drop_vstore(tgt->stores[i]);
+			if (tgt->shadow[i]){
+				agp_drop_vstore(tgt->shadow[i]);
+				arcan_mem_free(tgt->shadow[i]);
+				tgt->shadow[i] = NULL;
+			}
+		}
+		tgt->n_stores = 0;
+		tgt->store->vinf.text.glid_proxy = NULL;
+	}
+
+	arcan_mem_free(tgt->stencil);
+	verbose_print("(%"PRIxPTR") rendertarget gone", (uintptr_t) tgt);
+	arcan_mem_free(tgt);
+}
+
+void agp_rendertarget_proxy(struct agp_rendertarget* tgt,
+	bool (*proxy_state)(struct agp_rendertarget*, uintptr_t tag), uintptr_t tag)
+{
+/* there is no scanout to hand over, but keep it for _ids/_swap users */
+	tgt->proxy_state = proxy_state;
+	tgt->proxy_tag = tag;
+}
+
+static void set_clip(ssize_t x, ssize_t y, ssize_t w, ssize_t h)
+{
+	ssize_t x2 = x + w, y2 = y + h;
+	x = x < 0 ? 0 : x;
+	y = y < 0 ? 0 : y;
+	x2 = x2 > (ssize_t) soft.dst.w ? (ssize_t) soft.dst.w : x2;
+	y2 = y2 > (ssize_t) soft.dst.h ? (ssize_t) soft.dst.h : y2;
+
+	soft.dst.clip[0] = x;
+	soft.dst.clip[1] = y;
+	soft.dst.clip[2] = x2 > x ? x2 : x;
+	soft.dst.clip[3] = y2 > y ? y2 : y;
+}
+
+void agp_activate_rendertarget(struct agp_rendertarget* tgt)
+{
+	verbose_print("set rendertarget: %"PRIxPTR, (uintptr_t)(void*)tgt);
+	flush();
+
+	if (!tgt){
+		agp_blendstate(BLEND_NONE);
+		soft.retain_alpha = false;
+	}
+	else {
+		agp_blendstate(BLEND_NORMAL);
+		soft.retain_alpha = (tgt->mode & RENDERTARGET_RETAIN_ALPHA) > 0;
+	}
+
+	soft.rtgt = tgt;
+	soft.dst = (struct soft_target){0};
+
+	if (!tgt){
+		struct monitor_mode mode = platform_video_dimensions();
+		if (soft.display.w != mode.width || soft.display.h != mode.height){
+			arcan_mem_free(soft.display.buf);
+			arcan_mem_free(soft.display.stencil);
+			soft.display.stencil = NULL;
+			soft.display.w = soft.display.h = 0;
+			soft.display.buf = arcan_alloc_mem(
+				(size_t) mode.width * mode.height * sizeof(av_pixel),
+				ARCAN_MEM_VBUFFER, ARCAN_MEM_BZERO | ARCAN_MEM_NONFATAL,
+				ARCAN_MEMALIGN_PAGE
+			);
+			if (soft.display.buf){
+				soft.display.w = mode.width;
+				soft.display.h = mode.height;
+			}
+		}
+
+		soft.dst.buf = soft.display.buf;
+		soft.dst.stencil = soft.display.stencil;
+		soft.dst.w = soft.display.w;
+		soft.dst.h = soft.display.h;
+		soft.clearcol[0] = soft.clearcol[1] = soft.clearcol[2] = 0.05;
+		soft.clearcol[3] = 1.0;
+		set_clip(0, 0, soft.dst.w, soft.dst.h);
+		return;
+	}
+
+	struct soft_surf* surf = surf_get(agp_resolve_texid(tgt->store));
+	if (!surf || !surf->buf){
+		arcan_warning("agp(soft): rendertarget without a backing store\n");
+		return;
+	}
+
+	if (tgt->stencil &&
+		(tgt->stencil_w != surf->w || tgt->stencil_h != surf->h)){
+		arcan_mem_free(tgt->stencil);
+		tgt->stencil = NULL;
+	}
+
+	soft.dst.buf = surf->buf;
+	soft.dst.stencil = tgt->stencil;
+	soft.dst.w = surf->w;
+	soft.dst.h = surf->h;
+	memcpy(soft.clearcol, tgt->clearcol, sizeof(float) * 4);
+
+	ssize_t* vp = tgt->viewport;
+	set_clip(vp[0], vp[1], vp[2], vp[3]);
+}
+
+void agp_rendertarget_viewport(struct agp_rendertarget* tgt,
+	ssize_t x1, ssize_t y1, ssize_t x2, ssize_t y2)
+{
+	if (!tgt || !tgt->store){
+		arcan_warning("attempted resize on broken rendertarget\n");
+		return;
+	}
+
+	tgt->viewport[0] = x1;
+	tgt->viewport[1] = y1;
+	tgt->viewport[2] = x2;
+	tgt->viewport[3] = y2;
+}
+
+void agp_resize_rendertarget(
+	struct agp_rendertarget* tgt, size_t neww, size_t newh)
+{
+	if (!tgt || !tgt->store){
+		arcan_warning("attempted resize on broken rendertarget\n");
+		return;
+	}
+
+	if (tgt->store->w == neww && tgt->store->h == newh)
+		return;
+
+	verbose_print(
+		"resize (%"PRIxPTR") to %zu*%zu", (uintptr_t) tgt, neww, newh);
+
+	bool active = tgt == soft.rtgt;
+	if (active)
+		agp_activate_rendertarget(NULL);
+
+	tgt->store->w = neww;
+	tgt->store->h = newh;
+	tgt->viewport[0] = 0;
+	tgt->viewport[1] = 0;
+	tgt->viewport[2] = neww;
+	tgt->viewport[3] = newh;
+	tgt->rz_ack = true;
+
+	if (tgt->n_stores){
+		for (size_t i = 0; i < tgt->n_stores; i++){
+			if (tgt->shadow[i]){
+				if (tgt->alloc){
+					tgt->alloc(tgt, tgt->shadow[i], RTGT_ALLOC_FREE, tgt->alloc_tag);
+				}
+				else
+					erase_store(tgt->shadow[i]);
+
+				arcan_mem_free(tgt->shadow[i]);
+				tgt->shadow[i] = NULL;
+			}
+
+			tgt->shadow[i] = tgt->stores[i];
+			tgt->stores[i] = NULL;
+		}
+
+		setup_stores(tgt);
+		tgt->store->vinf.text.glid_proxy = &tgt->stores[0]->vinf.text.glid;
+	}
+	else {
+		erase_store(tgt->store);
+		agp_empty_vstore(tgt->store, neww, newh);
+	}
+
+	arcan_mem_free(tgt->stencil);
+	tgt->stencil = NULL;
+
+	if (active)
+		agp_activate_rendertarget(tgt);
+}
+
+void agp_rendertarget_clearcolor(
+	struct agp_rendertarget* tgt, float r, float g, float b, float a)
+{
+	if (!tgt)
+		return;
+
+	tgt->clearcol[0] = r;
+	tgt->clearcol[1] = g;
+	tgt->clearcol[2] = b;
+	tgt->clearcol[3] = a;
+
+	if (tgt == soft.rtgt)
+		memcpy(soft.clearcol, tgt->clearcol, sizeof(float) * 4);
+}
+
+static inline uint8_t unorm8(float v)
+{
+	return v <= 0.0 ? 0 : (v >= 1.0 ? 255 : (uint8_t)(v * 255.0 + 0.5));
+}
+
+void agp_rendertarget_clear()
+{
+	verbose_print("");
+
+	queue_rect(CMD_CLEAR, RGBA(unorm8(soft.clearcol[0]),
+		unorm8(soft.clearcol[1]), unorm8(soft.clearcol[2]),
+		unorm8(soft.clearcol[3])));
+
+	agp_rendertarget_dirty(soft.rtgt, &(struct agp_region){});
+}
+
+void agp_pipeline_hint(enum pipeline_mode mode)
+{
+}
+
+/*
+ * ---- drawing ----
+ */
+void agp_prepare_stencil()
+{
+	if (!soft.dst.buf)
+		return;
+
+/* allocated lazily as most rendertargets never clip */
+	if (!soft.dst.stencil){
+		uint8_t* buf = arcan_alloc_mem(soft.dst.w * soft.dst.h,
+			ARCAN_MEM_VBUFFER, ARCAN_MEM_BZERO | ARCAN_MEM_NONFATAL,
+			ARCAN_MEMALIGN_NATURAL);
+		if (!buf)
+			return;
+
+		soft.dst.stencil = buf;
+		if (soft.rtgt){
+			soft.rtgt->stencil = buf;
+			soft.rtgt->stencil_w = soft.dst.w;
+			soft.rtgt->stencil_h = soft.dst.h;
+		}
+		else
+			soft.display.stencil = buf;
+	}
+
+	queue_rect(CMD_STENCIL_CLEAR, 0);
+	soft.stencil = STENCIL_WRITE;
+	soft.blend = BLEND_NONE;
+}
+
+void agp_activate_stencil()
+{
+	if (soft.dst.stencil)
+		soft.stencil = STENCIL_TEST;
+}
+
+void agp_disable_stencil()
+{
+	soft.stencil = STENCIL_OFF;
+}
+
+void agp_blendstate(enum arcan_blendfunc mode)
+{
+	if (mode & BLEND_FORCE){
+		mode &= ~BLEND_FORCE;
+		if (mode == BLEND_NONE)
+			mode = BLEND_NORMAL;
+	}
+
+	if (mode > BLEND_PREMUL)
+		mode = BLEND_NORMAL;
+
+	soft.blend = mode;
+}
+
+void agp_draw_vobj(
+	float x1, float y1, float x2, float y2,
+	const float* txcos, const float* model)
+{
+	verbose_print("draw-vobj(%f,%f-%f,%f)", x1, y1, x2, y2);
+	if (!soft.dst.buf)
+		return;
+
+	struct soft_shader* shdr = shader_get(soft.shader);
+	struct soft_surf* tex = surf_get(soft.tex);
+	unsigned op = unorm8(soft.opacity);
+
+	struct soft_cmd base = {
+		.kind = CMD_DRAW,
+		.blend = soft.blend,
+		.stencil = soft.stencil,
+		.retain_alpha = soft.retain_alpha,
+		.opacity = op
+	};
+
+/* same selection the GL shaders would do: color shaders ignore the texture */
+	if (shdr && shdr->color){
+		base.color = RGBA(unorm8(shdr->obj_col[0]),
+			unorm8(shdr->obj_col[1]), unorm8(shdr->obj_col[2]), op);
+	}
+	else if (tex && tex->buf && soft.stencil != STENCIL_WRITE){
+		base.textured = true;
+		base.tex = tex->buf;
+		base.tw = tex->w;
+		base.th = tex->h;
+		base.bilinear = soft.filter != ARCAN_VFILTER_NONE;
+		base.repeat_u = soft.txu == ARCAN_VTEX_REPEAT;
+		base.repeat_v = soft.txv == ARCAN_VTEX_REPEAT;
+	}
+	else
+		base.color = RGBA(0, 0, 0, op);
+
+/* fully transparent draws don't contribute unless they replace */
+	if (!op && base.blend != BLEND_NONE && soft.stencil != STENCIL_WRITE)
+		return;
+
+	float mvp[16];
+	multiply_matrix(mvp, soft.projection, model ? model : ident);
+
+	float verts[4][2] = {{x1, y1}, {x2, y1}, {x2, y2}, {x1, y2}};
+	double sx[4], sy[4], tu[4] = {0}, tv[4] = {0};
+	float vw = soft.rtgt ? soft.rtgt->viewport[2] : soft.dst.w;
+	float vh = soft.rtgt ? soft.rtgt->viewport[3] : soft.dst.h;
+	float vx = soft.rtgt ? soft.rtgt->viewport[0] : 0;
+	float vy = soft.rtgt ? soft.rtgt->viewport[1] : 0;
+
+	for (size_t i = 0; i < 4; i++){
+		float in[4] = {verts[i][0], verts[i][1], 0.0, 1.0};
+		float out[4];
+		mult_matrix_vecf(mvp, in, out);
+		if (fabs(out[3]) < 1e-6)
+			return;
+
+		sx[i] = ((double) out[0] / out[3] + 1.0) * 0.5 * vw + vx;
+		sy[i] = ((double) out[1] / out[3] + 1.0) * 0.5 * vh + vy;
+
+		if (base.textured && txcos){
+			tu[i] = (double) txcos[i * 2 + 0] * base.tw;
+			tv[i] = (double) txcos[i * 2 + 1] * base.th;
+		}
+	}
+
+/* a parallelogram with a consistent mapping (anything from a 2D transform)
+ * is a single polygon, otherwise split the fan like GL would */
+	if (fabs(sx[0] + sx[2] - sx[1] - sx[3]) < 1e-3 &&
+		fabs(sy[0] + sy[2] - sy[1] - sy[3]) < 1e-3 &&
+		fabs(tu[0] + tu[2] - tu[1] - tu[3]) < 1e-3 &&
+		fabs(tv[0] + tv[2] - tv[1] - tv[3]) < 1e-3){
+		queue_poly(&base, 4, sx, sy, tu, tv);
+	}
+	else {
+		queue_poly(&base, 3, sx, sy, tu, tv);
+		queue_poly(&base, 3,
+			(double[]){sx[0], sx[2], sx[3]}, (double[]){sy[0], sy[2], sy[3]},
+			(double[]){tu[0], tu[2], tu[3]}, (double[]){tv[0], tv[2], tv[3]}
+		);
+	}
+
+	agp_rendertarget_dirty(soft.rtgt, &(struct agp_region){});
+}
+
+/*
+ * ---- 3D ----
+ */
+void agp_submit_mesh(struct agp_mesh_store* base, enum agp_mesh_flags fl)
+{
+	static bool warned;
+	if (!warned){
+		arcan_warning("agp(soft): 3D models are not supported, ignored\n");
+		warned = true;
+	}
+}
+
+void agp_invalidate_mesh(struct agp_mesh_store* bs)
+{
+}
+
+void agp_drop_mesh(struct agp_mesh_store* s)
+{
+	if (!s)
+		return;
+
+	uintptr_t targets[] = {
+		(uintptr_t) s->verts, (uintptr_t) s->txcos,
+		(uintptr_t) s->txcos2, (uintptr_t) s->normals,
+		(uintptr_t) s->colors, (uintptr_t) s->tangents,
+		(uintptr_t) s->bitangents, (uintptr_t) s->weights,
+		(uintptr_t) s->joints, (uintptr_t) s->indices
+	};
+
+	if (s->shared_buffer != NULL){
+		arcan_mem_free(s->shared_buffer);
+		uintptr_t base = (uintptr_t) s->shared_buffer;
+		uintptr_t end = base + s->shared_buffer_sz;
+
+		for (size_t i = 0; i < COUNT_OF(targets); i++){
+			if (targets[i] != (uintptr_t) NULL &&
+				(targets[i] < base || targets[i] >= end)){
+				arcan_mem_free((void*)targets[i]);
+			}
+		}
+	}
+	else{
+		for (size_t i = 0; i < COUNT_OF(targets); i++){
+			if (targets[i] != (uintptr_t) NULL){
+				arcan_mem_free((void*)targets[i]);
+			}
+		}
+	}
+
+	verbose_print("(%"PRIxPTR")", (uintptr_t) s);
+	memset(s, '\0', sizeof(struct agp_mesh_store));
+}
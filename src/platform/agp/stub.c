@@ -83,7 +83,12 @@ void agp_resize_vstore(struct agp_vstore* s, size_t w, size_t h)
 {
 }
 
-void agp_request_readback(struct agp_vstore* s)
+bool agp_request_readback(struct agp_vstore* s, struct agp_region* region)
+{
+	return false;
+}
+
+void agp_drop_readback(struct agp_vstore* s)
 {
 }
 
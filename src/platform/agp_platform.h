@@ -285,22 +285,35 @@ struct asynch_readback_meta {
 	size_t h;
 	size_t stride;
 
+/* number of requests still in flight, not counting the one in [ptr] */
+	size_t queued;
+
 	void (*release)(void* tag);
 	void* tag;
 };
 
 /*
- * Check if a pending readback request has been completed.
+ * Check if the oldest pending readback request has been completed.
  * In that case, [meta.ptr] will be !NULL and the caller is expected to:
  * meta.release(meta.tag); when finished using the contents of [meta.ptr]
+ * Requests complete in the order they were made.
  */
 struct asynch_readback_meta agp_poll_readback(struct agp_vstore*);
 
 /*
- * Initiate a new asynchronous readback.
- * if one is already pending, this is a no-operation.
+ * Initiate a new asynchronous readback. Multiple requests can be in flight,
+ * returns false if the backend queue is full (the request is dropped).
+ *
+ * If [region] is provided, only that part of the store will be read back, the
+ * buffer returned from poll will still have the layout of the full store but
+ * contents outside of the region are undefined.
+ */
+bool agp_request_readback(struct agp_vstore*, struct agp_region* region);
+
+/*
+ * Release any pending readbacks and the resources allocated for them.
  */
-void agp_request_readback(struct agp_vstore*);
+void agp_drop_readback(struct agp_vstore*);
 
 /*
  * For clipping and similar operations where we want to
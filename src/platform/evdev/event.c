@@ -155,8 +155,6 @@ static struct {
 
 	unsigned short mouseid;
 	struct devnode* nodes;
-
-	struct pollfd* pollset;
 } iodev = {0};
 
 struct devnode {
@@ -638,16 +636,13 @@ static void disconnect(struct arcan_evctx* ctx, struct devnode* node)
 
 	for (size_t i = 0; i < iodev.sz_nodes; i++)
 		if (node->devnum == iodev.nodes[i].devnum){
+			arcan_event_del_source(ctx, node->handle, O_RDONLY, NULL);
 			close(node->handle);
 			free(node->path);
 			node->path = NULL;
 			node->handle = -1;
-			iodev.pollset[i].events = iodev.pollset[i].revents = 0;
-			iodev.pollset[i].fd = -1;
 			if (node->led.gotled){
-				iodev.pollset[i+iodev.sz_nodes].fd = -1;
-				iodev.pollset[i+iodev.sz_nodes].events =
-					iodev.pollset[i+iodev.sz_nodes].revents = 0;
+				arcan_event_del_source(ctx, node->led.fds[0], O_RDONLY, NULL);
 				node->led.gotled = false;
 				arcan_led_remove(node->led.ctrlid);
 				close(node->led.fds[0]);
@@ -703,6 +698,39 @@ static void do_led(struct devnode* node)
 	}
 }
 
+static void node_ready(struct arcan_evctx* ctx, int fd, int mask, intptr_t tag)
+{
+	if (tag < 0 || (size_t) tag >= iodev.sz_nodes || iodev.nodes[tag].handle != fd)
+		return;
+
+	struct devnode* node = &iodev.nodes[tag];
+
+/* !POLLIN, then something is wrong, remove the node */
+	if (0 == (mask & POLLIN)){
+		disconnect(ctx, node);
+		return;
+	}
+
+/* some nodes may get a null handler temporarily or permanently assiged,
+ * drain those for evdev structures */
+	if (node->hnd.handler)
+		node->hnd.handler(ctx, node);
+	else{
+		char dump[256];
+		size_t nr __attribute__((unused));
+		nr = read(node->handle, dump, 256);
+	}
+}
+
+static void led_ready(struct arcan_evctx* ctx, int fd, int mask, intptr_t tag)
+{
+	if (tag < 0 || (size_t) tag >= iodev.sz_nodes ||
+		iodev.nodes[tag].led.fds[0] != fd || !(mask & POLLIN))
+		return;
+
+	do_led(&iodev.nodes[tag]);
+}
+
 void platform_event_process(struct arcan_evctx* ctx)
 {
 /* lovely little variable length field at end of struct here /sarcasm,
@@ -733,38 +761,8 @@ void platform_event_process(struct arcan_evctx* ctx)
 	if (gstate.pending)
 		process_pending(ctx);
 
-	int nr = poll(iodev.pollset, iodev.sz_nodes * 2, 0);
-	if (nr <= 0){
-		TRACE_MARK_EXIT("event", "flush-pending-in", TRACE_SYS_FAST, 0, 0, "flush-in");
-		return;
-	}
-
-	for (size_t i = 0; i < iodev.sz_nodes; i++){
-/* recall, sz_nodes is half the count, i + sz_nodes = alt-dev index */
-		if (iodev.pollset[i+iodev.sz_nodes].revents & POLLIN){
-			do_led(&iodev.nodes[i]);
-		}
-
-		if (iodev.pollset[i].fd == -1 || 0 == iodev.pollset[i].revents)
-			continue;
-
-/* !POLLIN, then something is wrong, remove the node */
-		if (0 == (iodev.pollset[i].revents & POLLIN)){
-			disconnect(ctx, &iodev.nodes[i]);
-			continue;
-		}
-/* some nodes may get a null handler temporarily or permanently assiged,
- * drain those for evdev structures */
-		else {
-			if (iodev.nodes[i].hnd.handler)
-				iodev.nodes[i].hnd.handler(ctx, &iodev.nodes[i]);
-			else{
-				char dump[256];
-				size_t nr __attribute__((unused));
-				nr = read(iodev.nodes[i].handle, dump, 256);
-			}
-		}
-	}
+/* device and led nodes are registered as event sources and serviced from
+ * arcan_event_poll_sources through node_ready / led_ready */
 	TRACE_MARK_EXIT("event", "flush-pending-in", TRACE_SYS_DEFAULT, 0, 0, "flush-in");
 }
 
@@ -1034,13 +1032,15 @@ static int alloc_node_slot(const char* path)
  * stays the same and got_device will still register so don't have
  * to consider leak for ledset */
 		if (iodev.nodes[i].path && strcmp(iodev.nodes[i].path, path) == 0){
+			arcan_event_del_source(
+				arcan_event_defaultctx(), iodev.nodes[i].handle, O_RDONLY, NULL);
 			close(iodev.nodes[i].handle);
 			iodev.n_devs--;
 			return i;
 		}
 	}
 
-/* no empty slot, grow pollsets and node tracking */
+/* no empty slot, grow node tracking */
 	if (hole == -1){
 		size_t new_cnt = iodev.sz_nodes + 8;
 		struct devnode* nn = realloc(
@@ -1054,25 +1054,7 @@ static int alloc_node_slot(const char* path)
 			iodev.nodes[i].led.fds[0] = iodev.nodes[i].led.fds[1] = BADFD;
 		}
 
-/* pollset size is actually twice the number of nodes to allow a
- * 'mirror address' for a possible led- or other special device ref.
- * (say sound...) */
-		struct pollfd* newset = malloc(2 * sizeof(struct pollfd) * new_cnt);
-		if (!newset)
-			return -1;
-
-		free(iodev.pollset);
-		for (size_t i = 0; i < new_cnt; i++){
-			memset(&newset[i], '\0', sizeof(struct pollfd));
-			memset(&newset[i+new_cnt], '\0', sizeof(struct pollfd));
-			newset[i].events = POLLIN | POLLERR | POLLHUP;
-			newset[i].fd = iodev.nodes[i].handle;
-			newset[i+new_cnt].events = POLLIN;
-			newset[i+new_cnt].fd = iodev.nodes[i].led.fds[0];
-		}
-
-/* update pointers, set hole to the first new entry */
-		iodev.pollset = newset;
+/* set hole to the first new entry */
 		hole = iodev.sz_nodes;
 		iodev.sz_nodes = new_cnt;
 	}
@@ -1347,23 +1329,21 @@ static void got_device(struct arcan_evctx* ctx, int fd, const char* path)
 
 	iodev.n_devs++;
 	node.path = strdup(path);
-	iodev.pollset[hole].fd = fd;
-	iodev.pollset[hole].events = POLLIN | POLLERR | POLLHUP;
-	iodev.pollset[hole + iodev.sz_nodes].fd = BADFD;
 	send_device_added(ctx, &node);
 
 /* had to defer led device creation until now because we didn't
- * know if there's a slot for it or not, the pollset actually is
- * twice the expected size, one for the main device and one for
- * the possible led controller */
-	if (add_led != -1){
+ * know if there's a slot for it or not */
+	if (add_led != -1)
 		setup_led(&node, add_led, fd);
-		if (node.led.gotled){
-			iodev.pollset[hole+iodev.sz_nodes].fd = node.led.fds[0];
-		}
-	}
 	iodev.nodes[hole] = node;
 
+/* the slot index is stable across node array growth so use that as tag */
+	if (!arcan_event_add_handler(ctx, fd, O_RDONLY, node_ready, hole))
+		arcan_warning("evdev(), couldn't register %s as event source\n", path);
+
+	if (node.led.gotled)
+		arcan_event_add_handler(ctx, node.led.fds[0], O_RDONLY, led_ready, hole);
+
 	if (node.type == DEVNODE_KEYBOARD){
 		const char* err;
 		platform_event_translation(node.devnum, EVENT_TRANSLATION_CLEAR, NULL, &err);
@@ -1954,6 +1934,9 @@ void platform_event_deinit(struct arcan_evctx* ctx)
 	for (size_t i = 0; i < iodev.n_devs; i++){
 		if (iodev.nodes[i].handle > 0){
 			verbose_print("closing %zu:%d", i, iodev.nodes[i].handle);
+			arcan_event_del_source(ctx, iodev.nodes[i].handle, O_RDONLY, NULL);
+			if (iodev.nodes[i].led.gotled)
+				arcan_event_del_source(ctx, iodev.nodes[i].led.fds[0], O_RDONLY, NULL);
 			close(iodev.nodes[i].handle);
 			memset(&iodev.nodes[i], '\0', sizeof(struct devnode));
 			iodev.nodes[i].handle = -1;
@@ -5,7 +5,8 @@
  * Description: The headless platform video implementation, uses egl in a
  * displayless configuration to allow local processing for testing,
  * verification and so on, with the option of exposing the default output via
- * the encode frameserver.
+ * the encode frameserver. When built with the software agp (AGP_SOFT) there is
+ * no GL context at all and everything is rasterized into host memory.
  */
 
 /*
@@ -36,9 +37,11 @@
 #include "arcan_conductor.h"
 #include "arcan_event.h"
 
-#include "agp/glfun.h"
 #include "../platform.h"
 
+#ifndef AGP_SOFT
+#include "agp/glfun.h"
+
 #define EGL_EGLEXT_PROTOTYPES
 #define GL_GLEXT_PROTOTYPES
 #define MESA_EGL_NO_X11_HEADERS
@@ -49,6 +52,7 @@
 #include <drm_fourcc.h>
 #include <xf86drm.h>
 #include <gbm.h>
+#endif
 
 static struct {
 	size_t width;
@@ -62,6 +66,7 @@ static struct {
 		bool block;
 	} encode;
 
+#ifndef AGP_SOFT
 	struct {
 		EGLDisplay disp;
 		EGLContext ctx;
@@ -70,6 +75,7 @@ static struct {
 		EGLNativeWindowType wnd;
 		struct gbm_device* gbmdev;
 	} egl;
+#endif
 
 	struct agp_vstore* vstore;
 } global = {
@@ -585,10 +591,12 @@ void platform_video_preinit()
 {
 }
 
+#ifndef AGP_SOFT
 static void* lookup_fenv(void* tag, const char* sym, bool req)
 {
 	return eglGetProcAddress(sym);
 }
+#endif
 
 bool platform_video_init(uint16_t width,
 	uint16_t height, uint8_t bpp, bool fs, bool frames, const char* capt)
@@ -602,6 +610,27 @@ bool platform_video_init(uint16_t width,
 	if (!global.height)
 		global.height = 480;
 
+	uintptr_t tag;
+	cfg_lookup_fun get_config = platform_config_lookup(&tag);
+
+/*
+ * Default is ~75Hz (no real need to be very precise, but % logic clock) Then
+ * let user override. This will only be effective if we don't tie the output to
+ * the encode/remoting stage.
+ */
+	char* node;
+	if (get_config("video_refresh", 0, &node, tag)){
+		float hz = strtoul("node", NULL, 10);
+		if (hz)
+			global.deadline = 1.0 / hz;
+		free(node);
+		debug_print("deadline changed to %d", global.deadline);
+	}
+
+/* nothing more to set up, the agp renders into host memory */
+#ifdef AGP_SOFT
+	return true;
+#else
 	const EGLint attribs[] = {
 		EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
 		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
@@ -643,9 +672,6 @@ bool platform_video_init(uint16_t width,
 		eglGetProcAddress("eglGetPlatformDisplayEXT");
 	debug_print("platform_display_support: %d", get_platform_display != NULL);
 
-	uintptr_t tag;
-	cfg_lookup_fun get_config = platform_config_lookup(&tag);
-
 /* this is not right for nvidia, and would possibly pick nouveau even in the
  * presence of the binary driver, we have the same issue with streams */
 	if (!get_config("video_disable_platform", 0, NULL, tag) && get_platform_display){
@@ -719,20 +745,6 @@ bool platform_video_init(uint16_t width,
 		return false;
 	}
 
-/*
- * Default is ~75Hz (no real need to be very precise, but % logic clock) Then
- * let user override. This will only be effective if we don't tie the output to
- * the encode/remoting stage.
- */
-	char* node;
-	if (get_config("video_refresh", 0, &node, tag)){
-		float hz = strtoul("node", NULL, 10);
-		if (hz)
-			global.deadline = 1.0 / hz;
-		free(node);
-		debug_print("deadline changed to %d", global.deadline);
-	}
-
 	EGLint cas[] = {
 		EGL_CONTEXT_CLIENT_VERSION, 2,
 		EGL_NONE, EGL_NONE,
@@ -764,4 +776,5 @@ bool platform_video_init(uint16_t width,
 		global.egl.disp, EGL_NO_SURFACE, EGL_NO_SURFACE, global.egl.ctx);
 
 	return true;
+#endif
 }
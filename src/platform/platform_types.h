@@ -31,8 +31,9 @@ typedef int arcan_aobj_id;
 
 typedef VIDEO_PIXEL_TYPE av_pixel;
 
-/* GLES2/3 typically, doesn't support BGRA formats */
-#ifndef OPENGL
+/* GLES2/3 typically, doesn't support BGRA formats, the software agp uses
+ * the same packing as shmif to avoid swizzling on upload */
+#if !defined(OPENGL) && !defined(AGP_SOFT)
 #ifndef RGBA
 #define RGBA(r, g, b, a)(\
 ((uint32_t) (a) << 24) |\
@@ -190,6 +191,7 @@ struct agp_region {
 };
 
 struct agp_vstore;
+struct agp_readback;
 struct agp_vstore {
 	size_t refcount;
 	uint32_t update_ts;
@@ -201,8 +203,10 @@ struct agp_vstore {
 			unsigned glid;
 			unsigned* glid_proxy;
 
-/* used for PBO transfers */
-			unsigned rid, wid;
+/* used for PBO transfers, readbacks have a backend defined queue that
+ * is allocated on the first request */
+			unsigned wid;
+			struct agp_readback* readback;
 
 /* intermediate storage for reconstructing lost context */
 			uint32_t s_raw;
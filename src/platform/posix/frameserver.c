@@ -113,6 +113,40 @@ static size_t shmpage_size(size_t w, size_t h,
 #endif
 }
 
+/*
+ * Segments are sized in classes rather than to the exact need so that an
+ * interactive resize steps through a handful of truncate/remap operations
+ * (on both sides) instead of one per intermediate size: 64k granules up to
+ * 1M, then eight classes per power of two.
+ */
+static size_t shmpage_class(size_t sz)
+{
+#ifdef ARCAN_SHMIF_OVERCOMMIT
+	return sz;
+#else
+	size_t step = 65536;
+	if (sz > 1024 * 1024){
+		step = 1024 * 1024;
+		while (step <= sz / 2)
+			step *= 2;
+		step /= 8;
+	}
+
+	sz = (sz + step - 1) / step * step;
+	return sz > ARCAN_SHMPAGE_MAX_SZ ? ARCAN_SHMPAGE_MAX_SZ : sz;
+#endif
+}
+
+/* large segments can opt in to transparent huge pages on the shmem mapping,
+ * fewer faults and TLB entries at the cost of coarser zeroing */
+static void shmpage_advise(void* addr, size_t sz)
+{
+#if defined(ARCAN_SHMIF_HUGEPAGES) && defined(MADV_HUGEPAGE)
+	if (sz >= 2 * 1024 * 1024)
+		madvise(addr, sz, MADV_HUGEPAGE);
+#endif
+}
+
 static void dropshared_keyed(char** key)
 {
 	if (!key || !(*key))
@@ -705,6 +739,8 @@ fail:
 		return false;
 	}
 
+	shmpage_advise(shmpage, ctx->shm.shmsize);
+
 /* separate failure code here as the memory is still mapped */
 	jmp_buf out;
 	if (0 != setjmp(out)){
@@ -740,6 +776,8 @@ struct arcan_frameserver* platform_fsrv_alloc()
 	res->watch_const = 0xfeed;
 
 	res->dpipe = BADFD;
+	res->wake.fd = BADFD;
+	res->wake.dpipe = BADFD;
 	res->queue_mask = EVENT_EXTERNAL;
 	res->playstate = ARCAN_PLAYING;
 	res->flags.alive = true;
@@ -863,7 +901,8 @@ static bool prepare_segment(struct arcan_frameserver* ctx,
 		abufsz = 65535;
 	}
 
-	ctx->shm.shmsize = shmpage_size(hintw, hinth, 1, abufc, abufsz, 0);
+	ctx->shm.shmsize =
+		shmpage_class(shmpage_size(hintw, hinth, 1, abufc, abufsz, 0));
 
 	if (!shmalloc(ctx, named, optkey, optdesc))
 		return NULL;
@@ -884,10 +923,11 @@ static bool prepare_segment(struct arcan_frameserver* ctx,
 		shmpage->vpending = 1;
 		shmpage->abufsize = abufsz;
 		shmpage->apending = abufc;
-		shmpage->segment_size = arcan_shmif_mapav(shmpage,
+		arcan_shmif_mapav(shmpage,
 			ctx->vbufs, 1, hintw * hinth * sizeof(shmif_pixel),
 			ctx->abufs, abufc, abufsz
 		);
+		shmpage->segment_size = ctx->shm.shmsize;
 	platform_fsrv_leave(ctx);
 
 	ctx->desc = (struct arcan_frameserver_meta){
@@ -1318,8 +1358,10 @@ int platform_fsrv_resynch(struct arcan_frameserver* s)
 		(s->max_h && h > s->max_h))
 		goto fail;
 
-/* no remapping required, resize effect is insignificant or impossible */
-	bool rmap = (shmsz > src->shmsize || shmsz < (float) src->shmsize * 0.8);
+/* no remapping required if the size class still fits, shrinking only gives
+ * memory back when it is substantial as the next resize might grow again */
+	shmsz = shmpage_class(shmsz);
+	bool rmap = (shmsz > src->shmsize || shmsz < src->shmsize / 2);
 
 /* special case, no remap supported */
 #ifdef ARCAN_SHMIF_OVERCOMMIT
@@ -1345,6 +1387,7 @@ int platform_fsrv_resynch(struct arcan_frameserver* s)
 		goto fail;
 	}
 	src->ptr = newp;
+	shmpage_advise(newp, shmsz);
 /*
  * doesn't seem to exist on FBSD10 etc.?
 	struct arcan_shmif_page* newp = mremap(src->ptr, src->shmsize, shmsz, NULL);
@@ -1362,11 +1405,13 @@ int platform_fsrv_resynch(struct arcan_frameserver* s)
 		arcan_warning("frameserver_resize() failed, reason: %s\n", strerror(errno));
 		goto fail;
 	}
+	shmpage_advise(src->ptr, shmsz);
 #endif
+		src->shmsize = shmsz;
 	}
 
+/* without a remap the segment keeps its current size */
 	shmpage = src->ptr;
-	src->shmsize = shmsz;
 
 /* commit to local tracking */
 	atomic_store(&shmpage->w, w);
@@ -1400,9 +1445,12 @@ int platform_fsrv_resynch(struct arcan_frameserver* s)
 
 /* remap pointers, padding need to be updated first as shmif_mapav
  * uses that as a side-channel and we don't want to change the interface */
+/* segment_size is what the client maps, so report the class rather than the
+ * used size or the client would remap on every resize */
 	atomic_store(&shmpage->apad, apad_sz);
-	shmpage->segment_size = arcan_shmif_mapav(shmpage,
+	arcan_shmif_mapav(shmpage,
 		s->vbufs, s->vbuf_cnt, vbufsz, s->abufs, s->abuf_cnt, abufsz);
+	shmpage->segment_size = src->shmsize;
 	s->abuf_sz = abufsz;
 	arcan_shmif_setevqs(shmpage, s->esync, &(s->inqueue), &(s->outqueue), 1);
 
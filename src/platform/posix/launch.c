@@ -263,6 +263,355 @@ arcan_frameserver* platform_launch_listen_external(const char* key,
 	return res;
 }
 
+/*
+ * runs in the child after fork: move the connection socket into the inherited
+ * position, sandbox-prepare the process and exec, never returns
+ */
+static void child_exec(
+	struct frameserver_envp* setup, struct arcan_strarr* arr, int clsock)
+{
+	close(STDERR_FILENO+1);
+/* will also strip CLOEXEC */
+	dup2(clsock, STDERR_FILENO+1);
+	arcan_closefrom(STDERR_FILENO+2);
+
+/* split out into a new session */
+	if (setsid() == -1)
+		_exit(EXIT_FAILURE);
+
+/* drop our nice level to normal user, have that configurable so that some
+ * setups may allow trusted launch-path children to have higher priority */
+	uintptr_t cfg;
+	cfg_lookup_fun get_config = platform_config_lookup(&cfg);
+	int level = 0;
+	char* priostr;
+
+/* nice itself will clamp */
+	if (get_config("child_priority", 0, &priostr, cfg)){
+		level = (int) strtol(priostr, NULL, 10) % INT_MAX;
+	}
+	setpriority(PRIO_PROCESS, 0, level);
+
+/* do this twice so that they have the correct mode and the 'right' ops fail */
+	int nfd = open("/dev/null", O_RDONLY);
+	if (-1 != nfd){
+		dup2(nfd, STDIN_FILENO);
+		close(nfd);
+	}
+
+	nfd = open("/dev/null", O_WRONLY);
+	if (-1 != nfd){
+		dup2(nfd, STDOUT_FILENO);
+		dup2(nfd, STDERR_FILENO);
+		close(nfd);
+	}
+
+/*
+ * we need to mask this signal as when debugging parent process, GDB pushes
+ * SIGINT to children, killing them and changing the behavior in the core
+ * process
+ */
+	sigaction(SIGPIPE, &(struct sigaction){
+		.sa_handler = SIG_IGN}, NULL);
+
+	if (setup->use_builtin){
+		char* argv[] = {
+			arcan_fetch_namespace(RESOURCE_SYS_BINS),
+			(char*) setup->args.builtin.mode,
+			NULL
+		};
+
+/* OVERRIDE/INHERIT rather than REPLACE environment (terminal, ...) */
+		if (setup->preserve_env){
+			for (size_t i = 0; i < arr->count;	i++){
+				if (!(arr->data[i] || arr->data[i][0]))
+					continue;
+
+				char* val = strchr(arr->data[i], '=');
+				*val++ = '\0';
+				setenv(arr->data[i], val, 1);
+			}
+			execv(argv[0], argv);
+		}
+		else
+			execve(argv[0], argv, arr->data);
+
+		arcan_warning("platform_fsrv_spawn_server() failed: %s, %s\n",
+			strerror(errno), argv[0]);
+			;
+		_exit(EXIT_FAILURE);
+	}
+/* non-frameserver executions (hijack libs, ...) */
+	else {
+		execve(setup->args.external.fname,
+			setup->args.external.argv->data, setup->args.external.envv->data);
+		_exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * Launch pool: builtin frameservers can be pre-forked and executed ahead of
+ * time per archetype (config key 'launch_prefork' as mode=count:mode=count).
+ * A pool entry has its segment and connection socket allocated and the child
+ * has gone through the same sandbox preparation as a normal launch, then it
+ * blocks on the socket. Claiming sends the environment it would otherwise
+ * have been executed with, so a launch skips fork, exec, dynamic linking and
+ * library setup. The pool is refilled one entry per logic tick so that a
+ * launch burst doesn't turn into a burst of forks in the main loop.
+ */
+#ifndef PREFORK_LIMIT
+#define PREFORK_LIMIT 8
+#endif
+
+#ifndef PREFORK_MSG_LIM
+#define PREFORK_MSG_LIM 65536
+#endif
+
+/* entries that die while waiting this many times in a row disable the type */
+#ifndef PREFORK_FAIL_LIM
+#define PREFORK_FAIL_LIM 3
+#endif
+
+static struct {
+	bool configured;
+
+	struct {
+		char mode[16];
+		size_t count;
+		size_t fails;
+	} types[PREFORK_LIMIT];
+	size_t n_types;
+
+	struct {
+		size_t type;
+		struct arcan_frameserver* ctx;
+	} slots[PREFORK_LIMIT];
+	size_t n_slots;
+} prefork;
+
+static void prefork_config()
+{
+	uintptr_t cfg;
+	cfg_lookup_fun get_config = platform_config_lookup(&cfg);
+	char* val;
+
+	prefork.configured = true;
+	if (!get_config("launch_prefork", 0, &val, cfg) || !val)
+		return;
+
+	size_t total = 0;
+	char* saveptr = NULL;
+
+	for (char* tok = strtok_r(val, ":", &saveptr);
+		tok && prefork.n_types < PREFORK_LIMIT;
+		tok = strtok_r(NULL, ":", &saveptr)){
+		char* cnt = strchr(tok, '=');
+		if (cnt)
+			*cnt++ = '\0';
+
+/* net- is excluded as the mode is rewritten along with the segment type */
+		size_t len = strlen(tok);
+		if (!len || len >= sizeof(prefork.types[0].mode) ||
+			strncmp(tok, "net", 3) == 0){
+			arcan_warning("launch_prefork: ignoring unsupported mode (%s)\n", tok);
+			continue;
+		}
+
+		size_t count = cnt ? strtoul(cnt, NULL, 10) : 1;
+		if (total + count > PREFORK_LIMIT)
+			count = PREFORK_LIMIT - total;
+		if (!count)
+			continue;
+
+		memcpy(prefork.types[prefork.n_types].mode, tok, len + 1);
+		prefork.types[prefork.n_types++].count = count;
+		total += count;
+	}
+
+	free(val);
+}
+
+static void prefork_drop(size_t i)
+{
+	platform_fsrv_destroy(prefork.slots[i].ctx);
+	prefork.slots[i] = prefork.slots[--prefork.n_slots];
+}
+
+/* the child has already been collected, so the pid must not be signalled or
+ * waited on again by destroy, and the death counts against the mode */
+static void prefork_reaped(size_t i)
+{
+	size_t type = prefork.slots[i].type;
+	if (++prefork.types[type].fails == PREFORK_FAIL_LIM)
+		arcan_warning("launch_prefork: %s keeps failing, disabled\n",
+			prefork.types[type].mode);
+
+	prefork.slots[i].ctx->child = BROKEN_PROCESS_HANDLE;
+	prefork_drop(i);
+}
+
+static bool prefork_spawn(size_t type)
+{
+	int clsock;
+	struct arcan_frameserver* ctx =
+		platform_fsrv_spawn_server(SEGID_UNKNOWN, 0, 0, 0, &clsock);
+	if (!ctx)
+		return false;
+
+	struct arcan_strarr arr = {0};
+	append_env(&arr, NULL, "3", ctx->shm.key);
+	if (arr.limit - arr.count < 2)
+		arcan_mem_growarr(&arr);
+	arr.data[arr.count++] = strdup("ARCAN_PREFORK=1");
+	arr.data[arr.count] = NULL;
+
+/* terminal is the only archetype launched with the environment preserved */
+	struct frameserver_envp setup = {
+		.use_builtin = true,
+		.preserve_env = strcmp(prefork.types[type].mode, "terminal") == 0,
+		.args.builtin.mode = prefork.types[type].mode
+	};
+
+	pid_t child = fork();
+	if (0 == child)
+		child_exec(&setup, &arr, clsock);
+
+	close(clsock);
+	arcan_mem_freearr(&arr);
+
+	if (-1 == child){
+		platform_fsrv_destroy(ctx);
+		return false;
+	}
+
+	ctx->child = child;
+	prefork.slots[prefork.n_slots].type = type;
+	prefork.slots[prefork.n_slots++].ctx = ctx;
+	return true;
+}
+
+/*
+ * claim message: u32 length, u8 preserve-env, then NUL terminated key=value
+ * strings, the child side is in frameserver/frameserver.c
+ */
+static bool prefork_send(
+	struct arcan_frameserver* ctx, bool preserve, const char* resource)
+{
+	struct arcan_strarr arr = {0};
+	append_env(&arr, (char*) resource, "3", ctx->shm.key);
+
+	size_t len = 1;
+	for (size_t i = 0; i < arr.count; i++)
+		len += strlen(arr.data[i]) + 1;
+
+	uint8_t* buf = len <= PREFORK_MSG_LIM ? malloc(len + 4) : NULL;
+	if (!buf){
+		arcan_mem_freearr(&arr);
+		return false;
+	}
+
+	uint32_t len32 = len;
+	memcpy(buf, &len32, 4);
+	buf[4] = preserve;
+
+	size_t ofs = 5;
+	for (size_t i = 0; i < arr.count; i++){
+		size_t sz = strlen(arr.data[i]) + 1;
+		memcpy(&buf[ofs], arr.data[i], sz);
+		ofs += sz;
+	}
+	arcan_mem_freearr(&arr);
+
+/* the socket is non-blocking, but the child is blocked reading it */
+	size_t sent = 0;
+	while (sent < ofs){
+		ssize_t nw = write(ctx->dpipe, &buf[sent], ofs - sent);
+		if (-1 == nw){
+			if (errno == EAGAIN || errno == EINTR){
+				poll(&(struct pollfd){.fd = ctx->dpipe, .events = POLLOUT}, 1, 10);
+				continue;
+			}
+			break;
+		}
+		sent += nw;
+	}
+
+	free(buf);
+	return sent == ofs;
+}
+
+static struct arcan_frameserver* prefork_claim(
+	struct frameserver_envp* setup, uintptr_t tag)
+{
+	if (!setup->use_builtin || setup->init_w || setup->init_h)
+		return NULL;
+
+	size_t i = 0;
+	while (i < prefork.n_slots){
+		size_t type = prefork.slots[i].type;
+		if (strcmp(prefork.types[type].mode, setup->args.builtin.mode) != 0){
+			i++;
+			continue;
+		}
+
+		struct arcan_frameserver* ctx = prefork.slots[i].ctx;
+		if (0 != waitpid(ctx->child, NULL, WNOHANG)){
+			prefork_reaped(i);
+			continue;
+		}
+
+		if (prefork_send(ctx, setup->preserve_env, setup->args.builtin.resource)){
+			prefork.slots[i] = prefork.slots[--prefork.n_slots];
+			prefork.types[type].fails = 0;
+			ctx->tag = tag;
+			return ctx;
+		}
+
+		prefork_drop(i);
+	}
+
+	return NULL;
+}
+
+void platform_launch_prefork_tick()
+{
+	if (!prefork.configured)
+		prefork_config();
+
+/* reap entries that died while waiting */
+	for (size_t i = 0; i < prefork.n_slots;){
+		struct arcan_frameserver* ctx = prefork.slots[i].ctx;
+		if (0 == waitpid(ctx->child, NULL, WNOHANG)){
+			i++;
+			continue;
+		}
+
+		prefork_reaped(i);
+	}
+
+	for (size_t i = 0; i < prefork.n_types; i++){
+		if (prefork.types[i].fails >= PREFORK_FAIL_LIM)
+			continue;
+
+		size_t count = 0;
+		for (size_t j = 0; j < prefork.n_slots; j++)
+			count += prefork.slots[j].type == i;
+
+		if (count < prefork.types[i].count){
+			prefork_spawn(i);
+			return;
+		}
+	}
+}
+
+void platform_launch_prefork_flush()
+{
+	while (prefork.n_slots)
+		prefork_drop(0);
+	prefork.configured = false;
+	prefork.n_types = 0;
+}
+
 /*
  * this warrants explaining - to avoid dynamic allocations in the asynch unsafe
  * context of fork, we prepare the str_arr in *setup along with all envs needed
@@ -279,10 +628,13 @@ struct arcan_frameserver* platform_launch_fork(
 	const char* source;
 	int modem = 0;
 	bool add_audio = true;
-	int clsock;
+	int clsock = -1;
 
-	struct arcan_frameserver* ctx =
-		platform_fsrv_spawn_server(
+	struct arcan_frameserver* ctx = prefork_claim(setup, tag);
+	bool pooled = ctx != NULL;
+
+	if (!ctx)
+		ctx = platform_fsrv_spawn_server(
 			SEGID_UNKNOWN, setup->init_w, setup->init_h, tag, &clsock);
 
 	if (!ctx)
@@ -320,8 +672,10 @@ struct arcan_frameserver* platform_launch_fork(
 			setup->args.builtin.resource ?
 			setup->args.builtin.resource : setup->args.builtin.mode);
 
-		append_env(&arr,
-			(char*) setup->args.builtin.resource, "3", ctx->shm.key);
+/* a claimed pool entry has already been sent its environment */
+		if (!pooled)
+			append_env(&arr,
+				(char*) setup->args.builtin.resource, "3", ctx->shm.key);
 	}
 	else{
 		ctx->source = strdup(
@@ -357,89 +711,13 @@ struct arcan_frameserver* platform_launch_fork(
 		ctx->vid = setup->custom_feed;
 	}
 
-/* spawn the process */
-	pid_t child = fork();
+/* spawn the process, a claimed pool entry is already running */
+	pid_t child = pooled ? ctx->child : fork();
 	if (child){
 		ctx->child = child;
 	}
 	else if (child == 0){
-		close(STDERR_FILENO+1);
-/* will also strip CLOEXEC */
-		dup2(clsock, STDERR_FILENO+1);
-		arcan_closefrom(STDERR_FILENO+2);
-
-/* split out into a new session */
-		if (setsid() == -1)
-			_exit(EXIT_FAILURE);
-
-/* drop our nice level to normal user, have that configurable so that some
- * setups may allow trusted launch-path children to have higher priority */
-		uintptr_t cfg;
-		cfg_lookup_fun get_config = platform_config_lookup(&cfg);
-		int level = 0;
-		char* priostr;
-
-/* nice itself will clamp */
-		if (get_config("child_priority", 0, &priostr, cfg)){
-			level = (int) strtol(priostr, NULL, 10) % INT_MAX;
-		}
-		setpriority(PRIO_PROCESS, 0, level);
-
-/* do this twice so that they have the correct mode and the 'right' ops fail */
-		int nfd = open("/dev/null", O_RDONLY);
-		if (-1 != nfd){
-			dup2(nfd, STDIN_FILENO);
-			close(nfd);
-		}
-
-		nfd = open("/dev/null", O_WRONLY);
-		if (-1 != nfd){
-			dup2(nfd, STDOUT_FILENO);
-			dup2(nfd, STDERR_FILENO);
-			close(nfd);
-		}
-
-/*
- * we need to mask this signal as when debugging parent process, GDB pushes
- * SIGINT to children, killing them and changing the behavior in the core
- * process
- */
-		sigaction(SIGPIPE, &(struct sigaction){
-			.sa_handler = SIG_IGN}, NULL);
-
-		if (setup->use_builtin){
-			char* argv[] = {
-				arcan_fetch_namespace(RESOURCE_SYS_BINS),
-				(char*) setup->args.builtin.mode,
-				NULL
-			};
-
-/* OVERRIDE/INHERIT rather than REPLACE environment (terminal, ...) */
-			if (setup->preserve_env){
-				for (size_t i = 0; i < arr.count;	i++){
-					if (!(arr.data[i] || arr.data[i][0]))
-						continue;
-
-					char* val = strchr(arr.data[i], '=');
-					*val++ = '\0';
-					setenv(arr.data[i], val, 1);
-				}
-				execv(argv[0], argv);
-			}
-			else
-				execve(argv[0], argv, arr.data);
-
-			arcan_warning("platform_fsrv_spawn_server() failed: %s, %s\n",
-				strerror(errno), argv[0]);
-				;
-			_exit(EXIT_FAILURE);
-		}
-/* non-frameserver executions (hijack libs, ...) */
-		else {
-			execve(setup->args.external.fname,
-				setup->args.external.argv->data, setup->args.external.envv->data);
-			_exit(EXIT_FAILURE);
-		}
+		child_exec(setup, &arr, clsock);
 	}
 /* out of alloted limit of subprocesses */
 	else {
@@ -447,7 +725,9 @@ struct arcan_frameserver* platform_launch_fork(
 		platform_fsrv_destroy(ctx);
 		return NULL;
 	}
-	close(clsock);
+	if (!pooled)
+		close(clsock);
+	arcan_mem_freearr(&arr);
 
 /* most kinds will need this, not the encode though */
 	arcan_errc errc;
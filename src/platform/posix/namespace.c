@@ -18,6 +18,11 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+
+#ifdef __LINUX
+#include <sys/inotify.h>
+#endif
 
 #include <arcan_math.h>
 #include <arcan_general.h>
@@ -101,6 +106,192 @@ static char* find_ns_user(const char* str, struct arcan_userns* dns)
 	return res;
 }
 
+/*
+ * Resolution cache for arcan_find_resource. Scripts tend to probe the same
+ * labels over and over (load_image, resource, system_load, ...) and each
+ * miss otherwise costs one stat per namespace in the mask. Both hits and
+ * misses are cached, keyed on (label, mask, type), as the namespace index
+ * that resolved (or -1). The table is direct-mapped and bounded, collisions
+ * simply replace.
+ *
+ * Invalidation is coarse: every directory that a probe depended on (the
+ * namespace root and each existing directory down to the parent of the
+ * label) gets an inotify watch, and any event at all flushes the whole
+ * table. The queue is drained with a non-blocking read before each lookup
+ * so a file created by the engine itself is seen immediately. Without
+ * inotify the cache stays disabled.
+ */
+#ifndef RESOURCE_CACHE_SIZE
+#define RESOURCE_CACHE_SIZE 256
+#endif
+
+#ifndef RESOURCE_CACHE_LABEL
+#define RESOURCE_CACHE_LABEL 256
+#endif
+
+#ifndef RESOURCE_CACHE_WATCHES
+#define RESOURCE_CACHE_WATCHES 1024
+#endif
+
+struct res_entry {
+	char* label;
+	uint32_t hash;
+	uint32_t space;
+	uint8_t type;
+	int8_t ns;
+};
+
+static struct {
+	struct res_entry ent[RESOURCE_CACHE_SIZE];
+	int fd;
+	int wd_max;
+	bool broken;
+} rescache = {
+	.fd = -1
+};
+
+static void rescache_flush()
+{
+	for (size_t i = 0; i < RESOURCE_CACHE_SIZE; i++){
+		free(rescache.ent[i].label);
+		rescache.ent[i] = (struct res_entry){0};
+	}
+
+/* closing the descriptor drops all watches in one go */
+	if (-1 != rescache.fd){
+		close(rescache.fd);
+		rescache.fd = -1;
+	}
+	rescache.wd_max = 0;
+}
+
+#ifdef __LINUX
+static uint32_t rescache_hash(const char* label, uint32_t space, uint8_t type)
+{
+	uint32_t hash = 2166136261u;
+	for (; *label; label++)
+		hash = (hash ^ (uint8_t)*label) * 16777619u;
+
+	hash = (hash ^ space) * 16777619u;
+	hash = (hash ^ type) * 16777619u;
+	return hash;
+}
+
+static void rescache_drain()
+{
+	if (-1 == rescache.fd)
+		return;
+
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t nr = read(rescache.fd, buf, sizeof(buf));
+	if (nr > 0 || (nr == -1 && errno != EAGAIN && errno != EINTR))
+		rescache_flush();
+}
+
+/* watch the root and every existing directory down to the parent of label,
+ * a directory that doesn't exist yet is covered by the watch on its parent */
+static bool rescache_watch(const char* root, size_t root_len, const char* label)
+{
+	if (-1 == rescache.fd){
+		if (rescache.broken)
+			return false;
+
+		rescache.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (-1 == rescache.fd){
+			arcan_warning("find_resource: inotify unavailable, cache disabled\n");
+			rescache.broken = true;
+			return false;
+		}
+	}
+
+	const uint32_t mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+		IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+	size_t label_len = strlen(label);
+	char scratch[root_len + label_len + 2];
+	memcpy(scratch, root, root_len);
+	scratch[root_len] = '\0';
+	size_t pos = root_len;
+
+	for (size_t i = 0;; i++){
+/* wd:s are handed out in increasing order per descriptor and re-adding a
+ * watch returns the existing one, so the largest wd bounds the count - when
+ * it is reached, start over so the working set can repopulate */
+		if (rescache.wd_max >= RESOURCE_CACHE_WATCHES){
+			rescache_flush();
+			return false;
+		}
+
+		int wd = inotify_add_watch(rescache.fd, scratch, mask);
+		if (-1 == wd)
+			return errno == ENOENT || errno == ENOTDIR;
+
+		if (wd > rescache.wd_max)
+			rescache.wd_max = wd;
+
+/* next component, skipping the last one as that is the label itself */
+		for (; i < label_len && label[i] == '/'; i++);
+		size_t end = i;
+		for (; end < label_len && label[end] != '/'; end++);
+		if (end >= label_len)
+			return true;
+
+		scratch[pos++] = '/';
+		memcpy(&scratch[pos], &label[i], end - i);
+		pos += end - i;
+		scratch[pos] = '\0';
+		i = end;
+	}
+}
+#else
+static bool rescache_watch(const char* root, size_t root_len, const char* label)
+{
+	return false;
+}
+#endif
+
+/* returns the cache slot to use or NULL if the lookup shouldn't be cached,
+ * *ns is set to the namespace index on a hit, -1 on a cached miss and -2
+ * when nothing is cached */
+static struct res_entry* rescache_lookup(
+	const char* label, uint32_t space, uint8_t type, uint32_t* hash, int* ns)
+{
+	*ns = -2;
+#ifdef __LINUX
+	if (rescache.broken || strlen(label) >= RESOURCE_CACHE_LABEL)
+		return NULL;
+
+	rescache_drain();
+	*hash = rescache_hash(label, space, type);
+	struct res_entry* ent = &rescache.ent[*hash % RESOURCE_CACHE_SIZE];
+
+	if (ent->label && ent->hash == *hash && ent->space == space &&
+		ent->type == type && strcmp(ent->label, label) == 0)
+		*ns = ent->ns;
+
+	return ent;
+#else
+	return NULL;
+#endif
+}
+
+static void rescache_store(struct res_entry* ent,
+	const char* label, uint32_t hash, uint32_t space, uint8_t type, int ns)
+{
+	char* copy = strdup(label);
+	if (!copy)
+		return;
+
+	free(ent->label);
+	*ent = (struct res_entry){
+		.label = copy,
+		.hash = hash,
+		.space = space,
+		.type = type,
+		.ns = ns
+	};
+}
+
 static char* handle_dynfile(char* base, enum resource_type ares, int* dfd)
 {
 /* only want to resolve */
@@ -165,6 +356,27 @@ char* arcan_find_resource(const char* label,
 	space &= ~RESOURCE_NS_USER;
 	size_t label_len = strlen(label);
 
+/* creation depends on more than existence, don't cache */
+	struct res_entry* ent = NULL;
+	uint8_t type = ares & (ARES_FILE | ARES_FOLDER);
+	uint32_t hash = 0;
+	int cns = -2;
+
+	if (!(ares & ARES_CREATE))
+		ent = rescache_lookup(label, space, type, &hash, &cns);
+
+	if (cns == -1)
+		return NULL;
+
+	if (cns >= 0){
+		char scratch[ namespaces.lenv[cns] + label_len + 2 ];
+		snprintf(scratch, sizeof(scratch),
+			label[0] == '/' ? "%s%s" : "%s/%s",
+			namespaces.paths[cns], label
+		);
+		return handle_dynfile(strdup(scratch), ares, dfd);
+	}
+
 	for (int i = 1, j = 0; i <= RESOURCE_SYS_ENDM; i <<= 1, j++){
 		if ((space & i) == 0 || !namespaces.paths[j])
 			continue;
@@ -175,10 +387,16 @@ char* arcan_find_resource(const char* label,
 			namespaces.paths[j], label
 		);
 
+/* the watch goes in before the probe so a change racing it is not lost */
+		if (ent && !rescache_watch(namespaces.paths[j], namespaces.lenv[j], label))
+			ent = NULL;
+
 		if (
 			((ares & ARES_FILE) && arcan_isfile(scratch)) ||
 			((ares & ARES_FOLDER) && arcan_isdir(scratch))
 		){
+			if (ent)
+				rescache_store(ent, label, hash, space, type, j);
 			return handle_dynfile(strdup(scratch), ares, dfd);
 		}
 /* this assumes that the write- permission is enforced by the layer making the
@@ -189,6 +407,9 @@ char* arcan_find_resource(const char* label,
 		}
 	}
 
+	if (ent)
+		rescache_store(ent, label, hash, space, type, -1);
+
 	return NULL;
 }
 
@@ -351,6 +572,7 @@ void arcan_override_namespace(const char* path, enum arcan_namespaces space)
 		arcan_mem_free(namespaces.paths[space_ind]);
 	}
 
+	rescache_flush();
 	namespaces.paths[space_ind] = strdup(path);
 	namespaces.lenv[space_ind] = strlen(namespaces.paths[space_ind]);
 }
@@ -192,6 +192,11 @@ struct shmif_hidden {
  * by the user via an environment variable */
 	char* alt_conn;
 
+/* Provided by the server (DEVICE_NODE, type 6) and written to whenever the
+ * vready/aready/resized flags are set so that the server does not need to
+ * check the page of idle clients */
+	int wake_fd;
+
 /* The named key used to find the initial connection (if there is one) should
  * be unliked on use. For special cases (SHMIF_DONT_UNLINK) this can be deferred
  * and be left to the user. In these scenarios we need to keep the key around. */
@@ -338,6 +343,22 @@ uint64_t arcan_shmif_cookie()
 	return base;
 }
 
+/*
+ * Poke the server after changing any of the readiness flags, a full socket
+ * means that there already is a wakeup pending so EAGAIN is fine to ignore
+ */
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+static void wake_parent(struct arcan_shmif_cont* c)
+{
+	if (BADFD == c->priv->wake_fd)
+		return;
+
+	char ch = 1;
+	send(c->priv->wake_fd, &ch, 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
 static bool fd_event(struct arcan_shmif_cont* c, struct arcan_event* dst)
 {
 /*
@@ -796,6 +817,20 @@ checkfd:
 			}
 
 			if (priv->pev.fd != BADFD){
+/* the wake descriptor is consumed here and never forwarded, acknowledge it
+ * so that the server can start trusting it right away */
+				if (priv->pev.ev.category == EVENT_TARGET &&
+					priv->pev.ev.tgt.kind == TARGET_COMMAND_DEVICE_NODE &&
+					priv->pev.ev.tgt.ioevs[1].iv == 6){
+					if (BADFD != priv->wake_fd)
+						close(priv->wake_fd);
+					priv->wake_fd = priv->pev.fd;
+					priv->pev.fd = BADFD;
+					priv->pev.gotev = false;
+					wake_parent(c);
+					goto reset;
+				}
+
 				if (fd_event(c, dst) && priv->autoclean){
 					priv->autoclean = false;
 					consume(c);
@@ -951,6 +986,12 @@ checkfd:
 					}
 /* other ones are ignored for now, require cooperation with shmifext */
 				}
+/* readiness wakeup descriptor, intercepted at checkfd */
+				else if (iev == 6){
+					priv->pev.ev = *dst;
+					priv->pev.gotev = true;
+					goto checkfd;
+				}
 				else
 					goto reset;
 			}
@@ -1128,6 +1169,10 @@ static int enqueue_internal(
 		process_events(c, &ev, true, true);
 	}
 
+/* The parent only posts the semaphore when a dequeue frees slots that were
+ * all in use, so our last update to back must be visible before we read front
+ * and decide to sleep, or both sides could act on stale indices. */
+	FORCE_SYNCH();
 	while ( check_dms(c) &&
 			((*ctx->back + 1) % ctx->eventbuf_sz) == *ctx->front){
 		struct arcan_event outev = *src;
@@ -1539,6 +1584,7 @@ static struct arcan_shmif_cont shmif_acquire_int(
 		.flags = flags,
 		.pev = {.fd = BADFD},
 		.pseg = {.epipe = BADFD},
+		.wake_fd = BADFD,
 	};
 
 	atomic_store(&gs.guard.dms, (uint8_t*) &res.addr->dms);
@@ -1914,6 +1960,7 @@ unsigned arcan_shmif_signal(
 
 	if ( mask & SHMIF_SIGAUD ){
 		bool lock = step_a(ctx);
+		wake_parent(ctx);
 
 /* guard-thread will pull the sems for us on dms */
 		if (lock && !(mask & SHMIF_SIGBLK_NONE))
@@ -1929,6 +1976,7 @@ unsigned arcan_shmif_signal(
 			arcan_sem_wait(ctx->vsem);
 
 		bool lock = step_v(ctx, mask);
+		wake_parent(ctx);
 
 		if (lock && !(mask & SHMIF_SIGBLK_NONE)){
 			while (ctx->addr->vready && check_dms(ctx))
@@ -1990,6 +2038,8 @@ void arcan_shmif_drop(struct arcan_shmif_cont* inctx)
 
 /* guard thread will clean up on its own */
 	free(inctx->priv->alt_conn);
+	if (BADFD != gstr->wake_fd)
+		close(gstr->wake_fd);
 	if (inctx->privext->cleanup)
 		inctx->privext->cleanup(inctx);
 
@@ -2117,6 +2167,7 @@ static bool shmif_resize(struct arcan_shmif_cont* arg,
  * behavior have been verified properly */
 	FORCE_SYNCH();
 	arg->addr->resized = 1;
+	wake_parent(arg);
 	do{
 		if (0 == arcan_sem_trywait(arg->vsem))
 			arcan_timesleep(16);
@@ -2156,14 +2207,28 @@ static bool shmif_resize(struct arcan_shmif_cont* arg,
 		if (gs->guard.active)
 			pthread_mutex_lock(&gs->guard.synch);
 
+/* the parent sizes the segment in classes so this is rare during a drag-
+ * resize, and where possible the mapping is resized rather than replaced so
+ * the pages that are already faulted in stay that way */
+#if defined(_GNU_SOURCE) && !defined(__APPLE__) && !defined(__BSD)
+		void* newp = mremap(arg->addr, arg->shmsize, new_sz, MREMAP_MAYMOVE);
+#else
 		munmap(arg->addr, arg->shmsize);
-		arg->shmsize = new_sz;
-		arg->addr = mmap(NULL, arg->shmsize,
+		void* newp = mmap(NULL, new_sz,
 			PROT_READ | PROT_WRITE, MAP_SHARED, arg->shmh, 0);
-		if (!arg->addr){
+#endif
+		if (MAP_FAILED == newp){
 			debug_print(FATAL, arg, "segment couldn't be remapped");
+			if (gs->guard.active)
+				pthread_mutex_unlock(&gs->guard.synch);
 			return false;
 		}
+		arg->addr = newp;
+		arg->shmsize = new_sz;
+#if defined(ARCAN_SHMIF_HUGEPAGES) && defined(MADV_HUGEPAGE)
+		if (new_sz >= 2 * 1024 * 1024)
+			madvise(arg->addr, new_sz, MADV_HUGEPAGE);
+#endif
 
 		atomic_store(&gs->guard.dms, (uint8_t*) &arg->addr->dms);
 		if (gs->guard.active)
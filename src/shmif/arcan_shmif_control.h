@@ -70,10 +70,12 @@
 
 /*
  * Define the reserved ring-buffer space used for input and output events
- * must be 0 < PP_QUEUE_SZ < 256
+ * must be 0 < PP_QUEUE_SZ < 256 as the ring indices are 8-bit. The default
+ * uses all of that range so that bursty clients (terminals flushing output,
+ * high-rate input devices) do not stall on a full queue.
  */
 #ifndef PP_QUEUE_SZ
-#define PP_QUEUE_SZ 127
+#define PP_QUEUE_SZ 255
 #endif
 static const int ARCAN_SHMIF_QUEUE_SZ = PP_QUEUE_SZ;
 
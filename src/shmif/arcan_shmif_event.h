@@ -504,6 +504,9 @@ enum ARCAN_TARGET_COMMAND {
  *              5: reply to a request for privileged device access,
  *                 this is special magic used for bridging DRI2 and will
  *                 weaken security.
+ *              6: readiness wakeup, consumed by shmif and never forwarded.
+ *                 A byte is written to the handle whenever vready, aready
+ *                 or resized is set.
  *
  * Note: for the [1].iv == 2, 4 cases, the remote address (keyid:host:port) may
  * be longer than the permitted message length. In such cases, the code field
@@ -0,0 +1,951 @@
+/*
+ * Copyright: Björn Ståhl
+ * Description: Pixel format conversion to and from shmif_pixel, scalar
+ * reference implementation with SSE2/AVX2/NEON row kernels.
+ * License: 3-Clause BSD, see COPYING file in arcan source repository.
+ * Reference: https://arcan-fe.com
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "arcan_shmif.h"
+#include "arcan_shmif_pixconv.h"
+
+/*
+ * The vector kernels hardcode the default shmif_pixel packing (0xAARRGGBB
+ * in a little-endian word), anything else only gets the scalar path.
+ */
+#if SHMIF_RGBA_RSHIFT == 16 && SHMIF_RGBA_GSHIFT == 8 &&\
+	SHMIF_RGBA_BSHIFT == 0 && SHMIF_RGBA_ASHIFT == 24 &&\
+	defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define PIXCONV_NATIVE
+#endif
+
+#if defined(PIXCONV_NATIVE) && defined(__SSE2__) && defined(__GNUC__) &&\
+	(defined(__x86_64__) || defined(__i386__))
+#define PIXCONV_X86
+#include <immintrin.h>
+#define AVX2_FN __attribute__((target("avx2")))
+#elif defined(PIXCONV_NATIVE) && defined(__ARM_NEON)
+#define PIXCONV_NEON
+#include <arm_neon.h>
+#endif
+
+/*
+ * Each kernel converts as much of a row as it can and returns the number of
+ * pixels it consumed, the scalar version takes care of the rest. A NULL
+ * kernel means that the scalar version does the entire row.
+ */
+typedef size_t (*import_fn)(const uint8_t* src, shmif_pixel* dst, size_t n);
+typedef size_t (*export_fn)(const shmif_pixel* src, uint8_t* dst, size_t n);
+typedef size_t (*yuv_fn)(const uint8_t* y,
+	const uint8_t* u, const uint8_t* v, shmif_pixel* dst, size_t n);
+typedef size_t (*premul_fn)(shmif_pixel* px, size_t n);
+
+struct pixconv_ops {
+	const char* name;
+	import_fn import[SHMIF_PIXFMT_YUV420];
+	export_fn export[SHMIF_PIXFMT_YUV420];
+	yuv_fn yuv420;
+	premul_fn premultiply;
+};
+
+static const uint8_t fmt_bpp[SHMIF_PIXFMT_YUV420] = {2, 4, 4, 4, 4, 3};
+
+/* expansion by bit replication, (v << 3 | v >> 2) and (v << 2 | v >> 4), so
+ * that white is white and the vector versions get by with shifts only */
+static const uint8_t rgb565_lut5[] = {
+  0,   8,  16,  24,  33,  41,  49,  57,  66,  74,  82,  90,  99, 107, 115, 123,
+132, 140, 148, 156, 165, 173, 181, 189, 198, 206, 214, 222, 231, 239, 247, 255
+};
+
+static const uint8_t rgb565_lut6[] = {
+  0,   4,   8,  12,  16,  20,  24,  28,  32,  36,  40,  44,  48,  52,  56,  60,
+ 65,  69,  73,  77,  81,  85,  89,  93,  97, 101, 105, 109, 113, 117, 121, 125,
+130, 134, 138, 142, 146, 150, 154, 158, 162, 166, 170, 174, 178, 182, 186, 190,
+195, 199, 203, 207, 211, 215, 219, 223, 227, 231, 235, 239, 243, 247, 251, 255
+};
+
+static inline uint8_t clamp_u8(int v)
+{
+	return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+/* round(c * a / 255) without the division */
+static inline uint8_t mul_u8(uint8_t c, uint8_t a)
+{
+	unsigned t = c * a + 128;
+	return (t + (t >> 8)) >> 8;
+}
+
+static void scalar_import(
+	int fmt, const uint8_t* src, shmif_pixel* dst, size_t n)
+{
+	switch (fmt){
+	case SHMIF_PIXFMT_RGB565:
+		for (size_t i = 0; i < n; i++, src += 2){
+			uint16_t px = src[0] | (src[1] << 8);
+			dst[i] = SHMIF_RGBA(
+				rgb565_lut5[(px & 0xf800) >> 11],
+				rgb565_lut6[(px & 0x07e0) >>  5],
+				rgb565_lut5[(px & 0x001f)      ],
+				0xff
+			);
+		}
+	break;
+	case SHMIF_PIXFMT_XRGB8888:
+		for (size_t i = 0; i < n; i++, src += 4)
+			dst[i] = SHMIF_RGBA(src[2], src[1], src[0], 0xff);
+	break;
+	case SHMIF_PIXFMT_ARGB8888:
+		for (size_t i = 0; i < n; i++, src += 4)
+			dst[i] = SHMIF_RGBA(src[2], src[1], src[0], src[3]);
+	break;
+	case SHMIF_PIXFMT_XBGR8888:
+		for (size_t i = 0; i < n; i++, src += 4)
+			dst[i] = SHMIF_RGBA(src[0], src[1], src[2], 0xff);
+	break;
+	case SHMIF_PIXFMT_ABGR8888:
+		for (size_t i = 0; i < n; i++, src += 4)
+			dst[i] = SHMIF_RGBA(src[0], src[1], src[2], src[3]);
+	break;
+	case SHMIF_PIXFMT_RGB888:
+		for (size_t i = 0; i < n; i++, src += 3)
+			dst[i] = SHMIF_RGBA(src[0], src[1], src[2], 0xff);
+	break;
+	}
+}
+
+static void scalar_export(
+	int fmt, const shmif_pixel* src, uint8_t* dst, size_t n)
+{
+	for (size_t i = 0; i < n; i++){
+		uint8_t r, g, b, a;
+		SHMIF_RGBA_DECOMP(src[i], &r, &g, &b, &a);
+
+		switch (fmt){
+		case SHMIF_PIXFMT_RGB565:{
+			uint16_t px =
+				(((b >> 3) & 0x1f) << 0) |
+				(((g >> 2) & 0x3f) << 5) |
+				(((r >> 3) & 0x1f) << 11);
+			*dst++ = px & 0xff;
+			*dst++ = px >> 8;
+		}
+		break;
+		case SHMIF_PIXFMT_XRGB8888:
+		case SHMIF_PIXFMT_ARGB8888:
+			*dst++ = b;
+			*dst++ = g;
+			*dst++ = r;
+			*dst++ = fmt == SHMIF_PIXFMT_ARGB8888 ? a : 0xff;
+		break;
+		case SHMIF_PIXFMT_XBGR8888:
+		case SHMIF_PIXFMT_ABGR8888:
+			*dst++ = r;
+			*dst++ = g;
+			*dst++ = b;
+			*dst++ = fmt == SHMIF_PIXFMT_ABGR8888 ? a : 0xff;
+		break;
+		case SHMIF_PIXFMT_RGB888:
+			*dst++ = r;
+			*dst++ = g;
+			*dst++ = b;
+		break;
+		}
+	}
+}
+
+/* BT.601, limited range - the integer form is kept exactly in the vector
+ * versions so that the output is identical between implementations */
+static void scalar_yuv420(const uint8_t* y,
+	const uint8_t* u, const uint8_t* v, shmif_pixel* dst, size_t n)
+{
+	for (size_t i = 0; i < n; i++){
+		int c = y[i] - 16;
+		int d = u[i >> 1] - 128;
+		int e = v[i >> 1] - 128;
+		dst[i] = SHMIF_RGBA(
+			clamp_u8((298 * c + 409 * e + 128) >> 8),
+			clamp_u8((298 * c - 100 * d - 208 * e + 128) >> 8),
+			clamp_u8((298 * c + 516 * d + 128) >> 8),
+			0xff
+		);
+	}
+}
+
+static void scalar_premultiply(shmif_pixel* px, size_t n)
+{
+	for (size_t i = 0; i < n; i++){
+		uint8_t r, g, b, a;
+		SHMIF_RGBA_DECOMP(px[i], &r, &g, &b, &a);
+		px[i] = SHMIF_RGBA(mul_u8(r, a), mul_u8(g, a), mul_u8(b, a), a);
+	}
+}
+
+static const struct pixconv_ops scalar_ops = {
+	.name = "scalar"
+};
+
+#if defined(PIXCONV_X86) || defined(PIXCONV_NEON)
+/* shmif_pixel and ARGB8888 are the same thing here */
+static size_t copy_import(const uint8_t* src, shmif_pixel* dst, size_t n)
+{
+	memcpy(dst, src, n * sizeof(shmif_pixel));
+	return n;
+}
+
+static size_t copy_export(const shmif_pixel* src, uint8_t* dst, size_t n)
+{
+	memcpy(dst, src, n * sizeof(shmif_pixel));
+	return n;
+}
+#endif
+
+#ifdef PIXCONV_X86
+/* lo, hi int16 pair for madd */
+#define PAIR16(lo, hi) (int)(((uint32_t)(uint16_t)(hi) << 16) | (uint16_t)(lo))
+
+/*
+ * Each channel is moved to the top of its target byte and or:ed with itself
+ * shifted down by its width so the low bits repeat the high ones, b and r end
+ * up in the low byte and g in the high byte of each 16-bit lane.
+ */
+static size_t sse2_rgb565_import(const uint8_t* src, shmif_pixel* dst, size_t n)
+{
+	const __m128i mr = _mm_set1_epi16((short) 0xf800);
+	const __m128i mg = _mm_set1_epi16(0x07e0);
+	const __m128i hi = _mm_set1_epi16((short) 0xff00);
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8){
+		__m128i px = _mm_loadu_si128((const __m128i*) &src[i * 2]);
+		__m128i b = _mm_slli_epi16(px, 11);
+		__m128i g = _mm_and_si128(px, mg);
+		__m128i r = _mm_and_si128(px, mr);
+
+		b = _mm_srli_epi16(_mm_or_si128(b, _mm_srli_epi16(b, 5)), 8);
+		g = _mm_and_si128(
+			_mm_or_si128(_mm_slli_epi16(g, 5), _mm_srli_epi16(g, 1)), hi);
+		r = _mm_srli_epi16(_mm_or_si128(r, _mm_srli_epi16(r, 5)), 8);
+
+		__m128i bg = _mm_or_si128(b, g);
+		__m128i ra = _mm_or_si128(r, hi);
+		_mm_storeu_si128((__m128i*) &dst[i + 0], _mm_unpacklo_epi16(bg, ra));
+		_mm_storeu_si128((__m128i*) &dst[i + 4], _mm_unpackhi_epi16(bg, ra));
+	}
+
+	return i;
+}
+
+static inline __m128i sse2_pack565(__m128i px)
+{
+	__m128i res = _mm_or_si128(_mm_or_si128(
+		_mm_and_si128(_mm_srli_epi32(px, 8), _mm_set1_epi32(0xf800)),
+		_mm_and_si128(_mm_srli_epi32(px, 5), _mm_set1_epi32(0x07e0))),
+		_mm_and_si128(_mm_srli_epi32(px, 3), _mm_set1_epi32(0x001f))
+	);
+
+/* sign extend so that the saturating pack keeps the bit pattern */
+	return _mm_srai_epi32(_mm_slli_epi32(res, 16), 16);
+}
+
+static size_t sse2_rgb565_export(const shmif_pixel* src, uint8_t* dst, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8){
+		__m128i lo = sse2_pack565(_mm_loadu_si128((const __m128i*) &src[i + 0]));
+		__m128i hi = sse2_pack565(_mm_loadu_si128((const __m128i*) &src[i + 4]));
+		_mm_storeu_si128((__m128i*) &dst[i * 2], _mm_packs_epi32(lo, hi));
+	}
+
+	return i;
+}
+
+static size_t sse2_xrgb_import(const uint8_t* src, shmif_pixel* dst, size_t n)
+{
+	const __m128i alpha = _mm_set1_epi32(0xff000000);
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4){
+		__m128i px = _mm_loadu_si128((const __m128i*) &src[i * 4]);
+		_mm_storeu_si128((__m128i*) &dst[i], _mm_or_si128(px, alpha));
+	}
+
+	return i;
+}
+
+static size_t sse2_xrgb_export(const shmif_pixel* src, uint8_t* dst, size_t n)
+{
+	return sse2_xrgb_import((const uint8_t*) src, (shmif_pixel*) dst, n);
+}
+
+/* swapping R and B is its own inverse, so the same kernels are used for
+ * both directions */
+static inline __m128i sse2_swap_rb(__m128i px)
+{
+	return _mm_or_si128(
+		_mm_and_si128(px, _mm_set1_epi32(0xff00ff00)),
+		_mm_or_si128(
+			_mm_and_si128(_mm_srli_epi32(px, 16), _mm_set1_epi32(0xff)),
+			_mm_slli_epi32(_mm_and_si128(px, _mm_set1_epi32(0xff)), 16)
+		)
+	);
+}
+
+static size_t sse2_abgr_import(const uint8_t* src, shmif_pixel* dst, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4){
+		__m128i px = _mm_loadu_si128((const __m128i*) &src[i * 4]);
+		_mm_storeu_si128((__m128i*) &dst[i], sse2_swap_rb(px));
+	}
+
+	return i;
+}
+
+static size_t sse2_xbgr_import(const uint8_t* src, shmif_pixel* dst, size_t n)
+{
+	const __m128i alpha = _mm_set1_epi32(0xff000000);
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4){
+		__m128i px = _mm_loadu_si128((const __m128i*) &src[i * 4]);
+		_mm_storeu_si128((__m128i*) &dst[i], _mm_or_si128(sse2_swap_rb(px), alpha));
+	}
+
+	return i;
+}
+
+static size_t sse2_abgr_export(const shmif_pixel* src, uint8_t* dst, size_t n)
+{
+	return sse2_abgr_import((const uint8_t*) src, (shmif_pixel*) dst, n);
+}
+
+static size_t sse2_xbgr_export(const shmif_pixel* src, uint8_t* dst, size_t n)
+{
+	return sse2_xbgr_import((const uint8_t*) src, (shmif_pixel*) dst, n);
+}
+
+/* 8 pixels at a time, the products are formed in 32-bit through madd on
+ * (channel, channel) pairs to stay identical to the scalar version */
+static size_t sse2_yuv420(const uint8_t* y,
+	const uint8_t* u, const uint8_t* v, shmif_pixel* dst, size_t n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi16(1);
+	const __m128i k_re = _mm_set1_epi32(PAIR16(298, 409));
+	const __m128i k_gd = _mm_set1_epi32(PAIR16(298, -100));
+	const __m128i k_ge = _mm_set1_epi32(PAIR16(-208, 128));
+	const __m128i k_bd = _mm_set1_epi32(PAIR16(298, 516));
+	const __m128i round = _mm_set1_epi32(128);
+	const __m128i alpha = _mm_set1_epi8((char) 0xff);
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8){
+		uint32_t u4, v4;
+		memcpy(&u4, &u[i >> 1], 4);
+		memcpy(&v4, &v[i >> 1], 4);
+
+		__m128i c = _mm_sub_epi16(_mm_unpacklo_epi8(
+			_mm_loadl_epi64((const __m128i*) &y[i]), zero), _mm_set1_epi16(16));
+		__m128i d = _mm_sub_epi16(_mm_unpacklo_epi8(
+			_mm_cvtsi32_si128(u4), zero), _mm_set1_epi16(128));
+		__m128i e = _mm_sub_epi16(_mm_unpacklo_epi8(
+			_mm_cvtsi32_si128(v4), zero), _mm_set1_epi16(128));
+
+/* one chroma sample covers two horizontal pixels */
+		d = _mm_unpacklo_epi16(d, d);
+		e = _mm_unpacklo_epi16(e, e);
+
+		__m128i ce_lo = _mm_unpacklo_epi16(c, e);
+		__m128i ce_hi = _mm_unpackhi_epi16(c, e);
+		__m128i cd_lo = _mm_unpacklo_epi16(c, d);
+		__m128i cd_hi = _mm_unpackhi_epi16(c, d);
+		__m128i e1_lo = _mm_unpacklo_epi16(e, one);
+		__m128i e1_hi = _mm_unpackhi_epi16(e, one);
+
+		__m128i r = _mm_packs_epi32(
+			_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(ce_lo, k_re), round), 8),
+			_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(ce_hi, k_re), round), 8)
+		);
+		__m128i g = _mm_packs_epi32(
+			_mm_srai_epi32(_mm_add_epi32(
+				_mm_madd_epi16(cd_lo, k_gd), _mm_madd_epi16(e1_lo, k_ge)), 8),
+			_mm_srai_epi32(_mm_add_epi32(
+				_mm_madd_epi16(cd_hi, k_gd), _mm_madd_epi16(e1_hi, k_ge)), 8)
+		);
+		__m128i b = _mm_packs_epi32(
+			_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cd_lo, k_bd), round), 8),
+			_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cd_hi, k_bd), round), 8)
+		);
+
+		__m128i r8 = _mm_packus_epi16(r, r);
+		__m128i g8 = _mm_packus_epi16(g, g);
+		__m128i b8 = _mm_packus_epi16(b, b);
+
+		__m128i bg = _mm_unpacklo_epi8(b8, g8);
+		__m128i ra = _mm_unpacklo_epi8(r8, alpha);
+		_mm_storeu_si128((__m128i*) &dst[i + 0], _mm_unpacklo_epi16(bg, ra));
+		_mm_storeu_si128((__m128i*) &dst[i + 4], _mm_unpackhi_epi16(bg, ra));
+	}
+
+	return i;
+}
+
+static inline __m128i sse2_premul16(__m128i px)
+{
+/* broadcast alpha to the color lanes and use 255 for the alpha lane itself
+ * so it comes out unchanged */
+	const __m128i m_rgb = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+	const __m128i m_a = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+	__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(px, 0xff), 0xff);
+	a = _mm_or_si128(_mm_and_si128(a, m_rgb), m_a);
+
+	__m128i t = _mm_add_epi16(_mm_mullo_epi16(px, a), _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+static size_t sse2_premultiply(shmif_pixel* px, size_t n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4){
+		__m128i in = _mm_loadu_si128((const __m128i*) &px[i]);
+		__m128i lo = sse2_premul16(_mm_unpacklo_epi8(in, zero));
+		__m128i hi = sse2_premul16(_mm_unpackhi_epi8(in, zero));
+		_mm_storeu_si128((__m128i*) &px[i], _mm_packus_epi16(lo, hi));
+	}
+
+	return i;
+}
+
+static const struct pixconv_ops sse2_ops = {
+	.name = "sse2",
+	.import = {
+		[SHMIF_PIXFMT_RGB565] = sse2_rgb565_import,
+		[SHMIF_PIXFMT_XRGB8888] = sse2_xrgb_import,
+		[SHMIF_PIXFMT_ARGB8888] = copy_import,
+		[SHMIF_PIXFMT_XBGR8888] = sse2_xbgr_import,
+		[SHMIF_PIXFMT_ABGR8888] = sse2_abgr_import
+	},
+	.export = {
+		[SHMIF_PIXFMT_RGB565] = sse2_rgb565_export,
+		[SHMIF_PIXFMT_XRGB8888] = sse2_xrgb_export,
+		[SHMIF_PIXFMT_ARGB8888] = copy_export,
+		[SHMIF_PIXFMT_XBGR8888] = sse2_xbgr_export,
+		[SHMIF_PIXFMT_ABGR8888] = sse2_abgr_export
+	},
+	.yuv420 = sse2_yuv420,
+	.premultiply = sse2_premultiply
+};
+
+/*
+ * AVX2 doubles the width of the simple ones and adds the byte shuffles that
+ * SSE2 lacks for the packed 24-bit format. The lanes of the unpack / pack
+ * instructions work per 128-bit half, hence the permutes.
+ */
+AVX2_FN static size_t avx2_rgb565_import(
+	const uint8_t* src, shmif_pixel* dst, size_t n)
+{
+	const __m256i mr = _mm256_set1_epi16((short) 0xf800);
+	const __m256i mg = _mm256_set1_epi16(0x07e0);
+	const __m256i hi8 = _mm256_set1_epi16((short) 0xff00);
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16){
+		__m256i px = _mm256_loadu_si256((const __m256i*) &src[i * 2]);
+		__m256i b = _mm256_slli_epi16(px, 11);
+		__m256i g = _mm256_and_si256(px, mg);
+		__m256i r = _mm256_and_si256(px, mr);
+
+		b = _mm256_srli_epi16(_mm256_or_si256(b, _mm256_srli_epi16(b, 5)), 8);
+		g = _mm256_and_si256(_mm256_or_si256(
+			_mm256_slli_epi16(g, 5), _mm256_srli_epi16(g, 1)), hi8);
+		r = _mm256_srli_epi16(_mm256_or_si256(r, _mm256_srli_epi16(r, 5)), 8);
+
+		__m256i bg = _mm256_or_si256(b, g);
+		__m256i ra = _mm256_or_si256(r, hi8);
+		__m256i lo = _mm256_unpacklo_epi16(bg, ra);
+		__m256i hi = _mm256_unpackhi_epi16(bg, ra);
+
+		_mm256_storeu_si256((__m256i*) &dst[i + 0],
+			_mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256((__m256i*) &dst[i + 8],
+			_mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+
+	return i + sse2_rgb565_import(&src[i * 2], &dst[i], n - i);
+}
+
+AVX2_FN static inline __m256i avx2_pack565(__m256i px)
+{
+	return _mm256_or_si256(_mm256_or_si256(
+		_mm256_and_si256(_mm256_srli_epi32(px, 8), _mm256_set1_epi32(0xf800)),
+		_mm256_and_si256(_mm256_srli_epi32(px, 5), _mm256_set1_epi32(0x07e0))),
+		_mm256_and_si256(_mm256_srli_epi32(px, 3), _mm256_set1_epi32(0x001f))
+	);
+}
+
+AVX2_FN static size_t avx2_rgb565_export(
+	const shmif_pixel* src, uint8_t* dst, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16){
+		__m256i lo = avx2_pack565(_mm256_loadu_si256((const __m256i*) &src[i + 0]));
+		__m256i hi = avx2_pack565(_mm256_loadu_si256((const __m256i*) &src[i + 8]));
+		__m256i res = _mm256_permute4x64_epi64(
+			_mm256_packus_epi32(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+		_mm256_storeu_si256((__m256i*) &dst[i * 2], res);
+	}
+
+	return i + sse2_rgb565_export(&src[i], &dst[i * 2], n - i);
+}
+
+AVX2_FN static size_t avx2_xrgb_import(
+	const uint8_t* src, shmif_pixel* dst, size_t n)
+{
+	const __m256i alpha = _mm256_set1_epi32(0xff000000);
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8){
+		__m256i px = _mm256_loadu_si256((const __m256i*) &src[i * 4]);
+		_mm256_storeu_si256((__m256i*) &dst[i], _mm256_or_si256(px, alpha));
+	}
+
+	return i + sse2_xrgb_import(&src[i * 4], &dst[i], n - i);
+}
+
+AVX2_FN static size_t avx2_xrgb_export(
+	const shmif_pixel* src, uint8_t* dst, size_t n)
+{
+	return avx2_xrgb_import((const uint8_t*) src, (shmif_pixel*) dst, n);
+}
+
+AVX2_FN static size_t avx2_abgr_import(
+	const uint8_t* src, shmif_pixel* dst, size_t n)
+{
+	const __m256i swap = _mm256_setr_epi8(
+		2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+		2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15
+	);
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8){
+		__m256i px = _mm256_loadu_si256((const __m256i*) &src[i * 4]);
+		_mm256_storeu_si256((__m256i*) &dst[i], _mm256_shuffle_epi8(px, swap));
+	}
+
+	return i + sse2_abgr_import(&src[i * 4], &dst[i], n - i);
+}
+
+AVX2_FN static size_t avx2_xbgr_import(
+	const uint8_t* src, shmif_pixel* dst, size_t n)
+{
+	const __m256i swap = _mm256_setr_epi8(
+		2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+		2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15
+	);
+	const __m256i alpha = _mm256_set1_epi32(0xff000000);
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8){
+		__m256i px = _mm256_loadu_si256((const __m256i*) &src[i * 4]);
+		_mm256_storeu_si256((__m256i*) &dst[i],
+			_mm256_or_si256(_mm256_shuffle_epi8(px, swap), alpha));
+	}
+
+	return i + sse2_xbgr_import(&src[i * 4], &dst[i], n - i);
+}
+
+AVX2_FN static size_t avx2_abgr_export(
+	const shmif_pixel* src, uint8_t* dst, size_t n)
+{
+	return avx2_abgr_import((const uint8_t*) src, (shmif_pixel*) dst, n);
+}
+
+AVX2_FN static size_t avx2_xbgr_export(
+	const shmif_pixel* src, uint8_t* dst, size_t n)
+{
+	return avx2_xbgr_import((const uint8_t*) src, (shmif_pixel*) dst, n);
+}
+
+/* 4 pixels per 16 byte load, the last 4 bytes are not used so stop early
+ * enough to not read past the end of the row */
+AVX2_FN static size_t avx2_rgb888_import(
+	const uint8_t* src, shmif_pixel* dst, size_t n)
+{
+	const __m128i shuf = _mm_setr_epi8(
+		2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+	const __m128i alpha = _mm_set1_epi32(0xff000000);
+	size_t i = 0;
+
+	for (; i + 6 <= n; i += 4){
+		__m128i px = _mm_loadu_si128((const __m128i*) &src[i * 3]);
+		_mm_storeu_si128((__m128i*) &dst[i],
+			_mm_or_si128(_mm_shuffle_epi8(px, shuf), alpha));
+	}
+
+	return i;
+}
+
+AVX2_FN static size_t avx2_rgb888_export(
+	const shmif_pixel* src, uint8_t* dst, size_t n)
+{
+	const __m128i shuf = _mm_setr_epi8(
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4){
+		__m128i px = _mm_shuffle_epi8(
+			_mm_loadu_si128((const __m128i*) &src[i]), shuf);
+		_mm_storel_epi64((__m128i*) &dst[i * 3], px);
+		uint32_t tail = _mm_cvtsi128_si32(_mm_srli_si128(px, 8));
+		memcpy(&dst[i * 3 + 8], &tail, 4);
+	}
+
+	return i;
+}
+
+AVX2_FN static size_t avx2_premultiply(shmif_pixel* px, size_t n)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i m_a = _mm256_setr_epi16(
+		0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255);
+	const __m256i m_rgb = _mm256_setr_epi16(
+		-1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0);
+	const __m256i round = _mm256_set1_epi16(128);
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8){
+		__m256i in = _mm256_loadu_si256((const __m256i*) &px[i]);
+		__m256i half[2] = {
+			_mm256_unpacklo_epi8(in, zero),
+			_mm256_unpackhi_epi8(in, zero)
+		};
+
+		for (size_t j = 0; j < 2; j++){
+			__m256i a = _mm256_shufflehi_epi16(
+				_mm256_shufflelo_epi16(half[j], 0xff), 0xff);
+			a = _mm256_or_si256(_mm256_and_si256(a, m_rgb), m_a);
+			__m256i t = _mm256_add_epi16(_mm256_mullo_epi16(half[j], a), round);
+			half[j] = _mm256_srli_epi16(
+				_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+		}
+
+/* unpack / pack are both per-lane so the order is already right */
+		_mm256_storeu_si256((__m256i*) &px[i], _mm256_packus_epi16(half[0], half[1]));
+	}
+
+	return i + sse2_premultiply(&px[i], n - i);
+}
+
+static const struct pixconv_ops avx2_ops = {
+	.name = "avx2",
+	.import = {
+		[SHMIF_PIXFMT_RGB565] = avx2_rgb565_import,
+		[SHMIF_PIXFMT_XRGB8888] = avx2_xrgb_import,
+		[SHMIF_PIXFMT_ARGB8888] = copy_import,
+		[SHMIF_PIXFMT_XBGR8888] = avx2_xbgr_import,
+		[SHMIF_PIXFMT_ABGR8888] = avx2_abgr_import,
+		[SHMIF_PIXFMT_RGB888] = avx2_rgb888_import
+	},
+	.export = {
+		[SHMIF_PIXFMT_RGB565] = avx2_rgb565_export,
+		[SHMIF_PIXFMT_XRGB8888] = avx2_xrgb_export,
+		[SHMIF_PIXFMT_ARGB8888] = copy_export,
+		[SHMIF_PIXFMT_XBGR8888] = avx2_xbgr_export,
+		[SHMIF_PIXFMT_ABGR8888] = avx2_abgr_export,
+		[SHMIF_PIXFMT_RGB888] = avx2_rgb888_export
+	},
+	.yuv420 = sse2_yuv420,
+	.premultiply = avx2_premultiply
+};
+#endif
+
+#ifdef PIXCONV_NEON
+/* the interleaved load/store forms do most of the work here, bytes are used
+ * for all memory access as the packed buffers have no alignment guarantees */
+static size_t neon_rgb565_import(const uint8_t* src, shmif_pixel* dst, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8){
+		uint16x8_t px = vreinterpretq_u16_u8(vld1q_u8(&src[i * 2]));
+
+/* narrow so each channel sits at the top of a byte, then replicate */
+		uint8x8_t r = vshrn_n_u16(px, 8);
+		uint8x8_t g = vshrn_n_u16(px, 3);
+		uint8x8_t b = vshl_n_u8(vmovn_u16(px), 3);
+
+		uint8x8x4_t out;
+		out.val[0] = vorr_u8(b, vshr_n_u8(b, 5));
+		out.val[1] = vorr_u8(vand_u8(g, vdup_n_u8(0xfc)), vshr_n_u8(g, 6));
+		out.val[2] = vorr_u8(vand_u8(r, vdup_n_u8(0xf8)), vshr_n_u8(r, 5));
+		out.val[3] = vdup_n_u8(0xff);
+		vst4_u8((uint8_t*) &dst[i], out);
+	}
+
+	return i;
+}
+
+static size_t neon_rgb565_export(const shmif_pixel* src, uint8_t* dst, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8){
+		uint8x8x4_t in = vld4_u8((const uint8_t*) &src[i]);
+		uint16x8_t px = vorrq_u16(vorrq_u16(
+			vandq_u16(vshll_n_u8(in.val[2], 8), vdupq_n_u16(0xf800)),
+			vandq_u16(vshll_n_u8(in.val[1], 3), vdupq_n_u16(0x07e0))),
+			vmovl_u8(vshr_n_u8(in.val[0], 3))
+		);
+		vst1q_u8(&dst[i * 2], vreinterpretq_u8_u16(px));
+	}
+
+	return i;
+}
+
+static size_t neon_xrgb_import(const uint8_t* src, shmif_pixel* dst, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4){
+		uint32x4_t px = vreinterpretq_u32_u8(vld1q_u8(&src[i * 4]));
+		px = vorrq_u32(px, vdupq_n_u32(0xff000000));
+		vst1q_u8((uint8_t*) &dst[i], vreinterpretq_u8_u32(px));
+	}
+
+	return i;
+}
+
+static size_t neon_xrgb_export(const shmif_pixel* src, uint8_t* dst, size_t n)
+{
+	return neon_xrgb_import((const uint8_t*) src, (shmif_pixel*) dst, n);
+}
+
+static inline size_t neon_swap_rb(
+	const uint8_t* src, uint8_t* dst, size_t n, bool opaque)
+{
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16){
+		uint8x16x4_t px = vld4q_u8(&src[i * 4]);
+		uint8x16_t tmp = px.val[0];
+		px.val[0] = px.val[2];
+		px.val[2] = tmp;
+		if (opaque)
+			px.val[3] = vdupq_n_u8(0xff);
+		vst4q_u8(&dst[i * 4], px);
+	}
+
+	return i;
+}
+
+static size_t neon_abgr_import(const uint8_t* src, shmif_pixel* dst, size_t n)
+{
+	return neon_swap_rb(src, (uint8_t*) dst, n, false);
+}
+
+static size_t neon_xbgr_import(const uint8_t* src, shmif_pixel* dst, size_t n)
+{
+	return neon_swap_rb(src, (uint8_t*) dst, n, true);
+}
+
+static size_t neon_abgr_export(const shmif_pixel* src, uint8_t* dst, size_t n)
+{
+	return neon_swap_rb((const uint8_t*) src, dst, n, false);
+}
+
+static size_t neon_xbgr_export(const shmif_pixel* src, uint8_t* dst, size_t n)
+{
+	return neon_swap_rb((const uint8_t*) src, dst, n, true);
+}
+
+static size_t neon_rgb888_import(const uint8_t* src, shmif_pixel* dst, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16){
+		uint8x16x3_t in = vld3q_u8(&src[i * 3]);
+		uint8x16x4_t out;
+		out.val[0] = in.val[2];
+		out.val[1] = in.val[1];
+		out.val[2] = in.val[0];
+		out.val[3] = vdupq_n_u8(0xff);
+		vst4q_u8((uint8_t*) &dst[i], out);
+	}
+
+	return i;
+}
+
+static size_t neon_rgb888_export(const shmif_pixel* src, uint8_t* dst, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16){
+		uint8x16x4_t in = vld4q_u8((const uint8_t*) &src[i]);
+		uint8x16x3_t out;
+		out.val[0] = in.val[2];
+		out.val[1] = in.val[1];
+		out.val[2] = in.val[0];
+		vst3q_u8(&dst[i * 3], out);
+	}
+
+	return i;
+}
+
+static size_t neon_premultiply(shmif_pixel* px, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8){
+		uint8x8x4_t in = vld4_u8((const uint8_t*) &px[i]);
+		for (size_t j = 0; j < 3; j++){
+			uint16x8_t t = vaddq_u16(
+				vmull_u8(in.val[j], in.val[3]), vdupq_n_u16(128));
+			in.val[j] = vaddhn_u16(t, vshrq_n_u16(t, 8));
+		}
+		vst4_u8((uint8_t*) &px[i], in);
+	}
+
+	return i;
+}
+
+static const struct pixconv_ops neon_ops = {
+	.name = "neon",
+	.import = {
+		[SHMIF_PIXFMT_RGB565] = neon_rgb565_import,
+		[SHMIF_PIXFMT_XRGB8888] = neon_xrgb_import,
+		[SHMIF_PIXFMT_ARGB8888] = copy_import,
+		[SHMIF_PIXFMT_XBGR8888] = neon_xbgr_import,
+		[SHMIF_PIXFMT_ABGR8888] = neon_abgr_import,
+		[SHMIF_PIXFMT_RGB888] = neon_rgb888_import
+	},
+	.export = {
+		[SHMIF_PIXFMT_RGB565] = neon_rgb565_export,
+		[SHMIF_PIXFMT_XRGB8888] = neon_xrgb_export,
+		[SHMIF_PIXFMT_ARGB8888] = copy_export,
+		[SHMIF_PIXFMT_XBGR8888] = neon_xbgr_export,
+		[SHMIF_PIXFMT_ABGR8888] = neon_abgr_export,
+		[SHMIF_PIXFMT_RGB888] = neon_rgb888_export
+	},
+	.premultiply = neon_premultiply
+};
+#endif
+
+static const struct pixconv_ops* active_ops = &scalar_ops;
+static pthread_once_t ops_once = PTHREAD_ONCE_INIT;
+
+static void select_ops()
+{
+#ifdef PIXCONV_X86
+	__builtin_cpu_init();
+	active_ops = __builtin_cpu_supports("avx2") ? &avx2_ops : &sse2_ops;
+#elif defined(PIXCONV_NEON)
+	active_ops = &neon_ops;
+#endif
+}
+
+static const struct pixconv_ops* get_ops(int flags)
+{
+	if (flags & SHMIF_PIXCONV_SCALAR)
+		return &scalar_ops;
+
+	pthread_once(&ops_once, select_ops);
+	return active_ops;
+}
+
+const char* arcan_shmif_pixconv_backend()
+{
+	return get_ops(0)->name;
+}
+
+bool arcan_shmif_pixconv_import(int fmt,
+	const uint8_t* const planes[3], const size_t strides[3],
+	size_t w, size_t h, shmif_pixel* dst, size_t dst_stride, int flags)
+{
+	if (fmt < 0 || fmt > SHMIF_PIXFMT_YUV420 || !planes || !planes[0] || !dst)
+		return false;
+
+	const struct pixconv_ops* ops = get_ops(flags);
+	uint8_t* out = (uint8_t*) dst;
+	if (!dst_stride)
+		dst_stride = w * sizeof(shmif_pixel);
+
+	if (fmt == SHMIF_PIXFMT_YUV420){
+		if (!planes[1] || !planes[2])
+			return false;
+
+		size_t cw = (w + 1) >> 1;
+		size_t ys = strides && strides[0] ? strides[0] : w;
+		size_t us = strides && strides[1] ? strides[1] : cw;
+		size_t vs = strides && strides[2] ? strides[2] : cw;
+
+		for (size_t y = 0; y < h; y++, out += dst_stride){
+			const uint8_t* yr = &planes[0][y * ys];
+			const uint8_t* ur = &planes[1][(y >> 1) * us];
+			const uint8_t* vr = &planes[2][(y >> 1) * vs];
+			shmif_pixel* row = (shmif_pixel*) out;
+
+/* kernels only consume full chroma pairs so the offset stays even */
+			size_t done = ops->yuv420 ? ops->yuv420(yr, ur, vr, row, w) : 0;
+			scalar_yuv420(&yr[done],
+				&ur[done >> 1], &vr[done >> 1], &row[done], w - done);
+		}
+
+		return true;
+	}
+
+	bool premul = (flags & SHMIF_PIXCONV_PREMULTIPLY) &&
+		(fmt == SHMIF_PIXFMT_ARGB8888 || fmt == SHMIF_PIXFMT_ABGR8888);
+	size_t bpp = fmt_bpp[fmt];
+	size_t stride = strides && strides[0] ? strides[0] : w * bpp;
+	const uint8_t* src = planes[0];
+
+	for (size_t y = 0; y < h; y++, src += stride, out += dst_stride){
+		shmif_pixel* row = (shmif_pixel*) out;
+		size_t done = ops->import[fmt] ? ops->import[fmt](src, row, w) : 0;
+		scalar_import(fmt, &src[done * bpp], &row[done], w - done);
+
+/* second pass while the row is still in cache */
+		if (premul){
+			done = ops->premultiply ? ops->premultiply(row, w) : 0;
+			scalar_premultiply(&row[done], w - done);
+		}
+	}
+
+	return true;
+}
+
+bool arcan_shmif_pixconv_export(int fmt,
+	const shmif_pixel* src, size_t src_stride,
+	size_t w, size_t h, uint8_t* dst, size_t dst_stride, int flags)
+{
+	if (fmt < 0 || fmt >= SHMIF_PIXFMT_YUV420 || !src || !dst)
+		return false;
+
+	const struct pixconv_ops* ops = get_ops(flags);
+	size_t bpp = fmt_bpp[fmt];
+	const uint8_t* in = (const uint8_t*) src;
+
+	if (!src_stride)
+		src_stride = w * sizeof(shmif_pixel);
+	if (!dst_stride)
+		dst_stride = w * bpp;
+
+	for (size_t y = 0; y < h; y++, in += src_stride, dst += dst_stride){
+		const shmif_pixel* row = (const shmif_pixel*) in;
+		size_t done = ops->export[fmt] ? ops->export[fmt](row, dst, w) : 0;
+		scalar_export(fmt, &row[done], &dst[done * bpp], w - done);
+	}
+
+	return true;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright: Björn Ståhl
+ * Description: Pixel format conversion to and from shmif_pixel, shared
+ * between frameservers, a12 and the bridges so that the per-frame repacking
+ * does not need to be re-implemented (and re-vectorized) in each of them.
+ * License: 3-Clause BSD, see COPYING file in arcan source repository.
+ * Reference: https://arcan-fe.com
+ */
+#ifndef HAVE_ARCAN_SHMIF_PIXCONV
+#define HAVE_ARCAN_SHMIF_PIXCONV
+
+/*
+ * Formats follow the DRM/wl_shm naming and are all defined as little-endian
+ * in memory regardless of host, i.e. XRGB8888 is stored B, G, R, X.
+ */
+enum shmif_pixfmt {
+	SHMIF_PIXFMT_RGB565 = 0,
+
+/* X is ignored and substituted with 0xff */
+	SHMIF_PIXFMT_XRGB8888 = 1,
+	SHMIF_PIXFMT_ARGB8888 = 2,
+
+/* bytes R, G, B, (X|A), a12 'RGBA' and GL_RGBA */
+	SHMIF_PIXFMT_XBGR8888 = 3,
+	SHMIF_PIXFMT_ABGR8888 = 4,
+
+/* bytes R, G, B */
+	SHMIF_PIXFMT_RGB888 = 5,
+
+/* planar Y, U, V (I420) with half resolution chroma, BT.601 limited range,
+ * import only */
+	SHMIF_PIXFMT_YUV420 = 6
+};
+
+enum shmif_pixconv_flags {
+/* multiply color channels with alpha on import */
+	SHMIF_PIXCONV_PREMULTIPLY = 1,
+
+/* ignore any vectorized implementation, used for testing */
+	SHMIF_PIXCONV_SCALAR = 2
+};
+
+/*
+ * Convert a [w*h] region of [fmt] in [planes] into [dst]. Strides are in
+ * bytes, a zero stride is treated as tightly packed. Only YUV420 uses more
+ * than the first plane / stride.
+ *
+ * Returns false if the format is not supported in this direction.
+ */
+bool arcan_shmif_pixconv_import(int fmt,
+	const uint8_t* const planes[3], const size_t strides[3],
+	size_t w, size_t h, shmif_pixel* dst, size_t dst_stride, int flags);
+
+/*
+ * Convert a [w*h] region of [src] into [fmt] in [dst], same conventions as
+ * for import. Alpha is dropped when packing to formats without it.
+ */
+bool arcan_shmif_pixconv_export(int fmt,
+	const shmif_pixel* src, size_t src_stride,
+	size_t w, size_t h, uint8_t* dst, size_t dst_stride, int flags);
+
+/*
+ * Name of the implementation that will be used for the vectorized paths,
+ * ("scalar", "sse2", "avx2", "neon").
+ */
+const char* arcan_shmif_pixconv_backend();
+
+#endif
@@ -239,23 +239,47 @@ size_t shmifsrv_dequeue_events(
 		return 0;
 
 	if (shmifsrv_enter(cl)){
+		struct arcan_shmif_page* page = cl->con->shm.ptr;
 		size_t count = 0;
-		uint8_t front = cl->con->shm.ptr->parentevq.front;
-		uint8_t back = cl->con->shm.ptr->parentevq.back;
-		if (front > PP_QUEUE_SZ || back > PP_QUEUE_SZ){
+		uint8_t front = page->parentevq.front;
+		uint8_t back = page->parentevq.back;
+		if (front >= PP_QUEUE_SZ || back >= PP_QUEUE_SZ){
 			cl->errors++;
 			shmifsrv_leave();
 			return 0;
 		}
 
+/* copy out in (at most) two runs, the tail of the ring and the wrapped head */
 		while (count < limit && front != back){
-			newev[count++] = cl->con->shm.ptr->parentevq.evqueue[front];
-			front = (front + 1) % PP_QUEUE_SZ;
+			size_t run = (back > front ? back : PP_QUEUE_SZ) - front;
+			if (run > limit - count)
+				run = limit - count;
+
+			memcpy(&newev[count],
+				&page->parentevq.evqueue[front], run * sizeof(struct arcan_event));
+			count += run;
+			front = (front + run) % PP_QUEUE_SZ;
 		}
+
+		if (!count){
+			shmifsrv_leave();
+			return 0;
+		}
+
 		asm volatile("": : :"memory");
 		__sync_synchronize();
-		cl->con->shm.ptr->parentevq.front = front;
-		arcan_sem_post(cl->con->esync);
+		page->parentevq.front = front;
+		__sync_synchronize();
+
+/* The client only sleeps on the semaphore when it finds the queue full, so
+ * only post if it could have seen that: the slots we just released have all
+ * been refilled. Posting on every dequeue just accumulates a count that the
+ * next full-queue wait spins through. */
+		size_t free_slots =
+			(front + PP_QUEUE_SZ - page->parentevq.back - 1) % PP_QUEUE_SZ;
+		if (free_slots <= count)
+			arcan_sem_post(cl->con->esync);
+
 		shmifsrv_leave();
 		return count;
 	}
@@ -44,7 +44,8 @@ static void resize_cellbuffer(struct tui_context* tui)
 
 	tui->base = NULL;
 
-	size_t buffer_sz = 2 * tui->rows * tui->cols * sizeof(struct tui_cell);
+	size_t buffer_sz = 2 * tui->rows * tui->cols * sizeof(struct tui_cell) +
+		2 * tui->rows * sizeof(uint32_t);
 	size_t rbuf_sz = tui_screen_tpack_sz(tui);
 
 	tui->base = malloc(buffer_sz);
@@ -60,6 +61,7 @@ static void resize_cellbuffer(struct tui_context* tui)
 
 	tui->front = tui->base;
 	tui->back = &tui->base[tui->rows * tui->cols];
+	tui->row_hash = (uint32_t*) &tui->base[2 * tui->rows * tui->cols];
 	tui->dirty |= DIRTY_FULL;
 }
 
@@ -81,6 +83,96 @@ static ssize_t find_row_ofs(
 	return -1;
 }
 
+static bool row_equal(struct tui_cell* a, struct tui_cell* b, size_t n)
+{
+	for (size_t i = 0; i < n; i++){
+		if (a[i].ch != b[i].ch || !tui_attr_equal(a[i].attr, b[i].attr))
+			return false;
+	}
+	return true;
+}
+
+static uint32_t row_hash(struct tui_cell* row, size_t n)
+{
+	uint32_t h = 2166136261;
+	for (size_t i = 0; i < n; i++){
+		uint32_t v[3] = {
+			row[i].ch,
+			row[i].attr.fr | row[i].attr.fg << 8 | row[i].attr.fb << 16,
+			row[i].attr.br | row[i].attr.bg << 8 |
+			row[i].attr.bb << 16 | (uint32_t) row[i].attr.custom_id << 24
+		};
+		v[0] ^= (uint32_t) row[i].attr.aflags << 21;
+		for (size_t j = 0; j < 3; j++){
+			h = (h ^ v[j]) * 16777619;
+		}
+	}
+	return h;
+}
+
+/*
+ * Look for a run of rows in the front buffer that exists at some other offset
+ * in the back buffer, i.e. the contents has been scrolled. Only one region is
+ * tracked, with the longest run of the first few candidates being picked.
+ */
+static bool find_scroll(
+	struct tui_context* tui, size_t* src, size_t* dst, size_t* n)
+{
+	size_t rows = tui->rows;
+	size_t cols = tui->cols;
+	uint32_t* fh = tui->row_hash;
+	uint32_t* bh = &tui->row_hash[rows];
+	size_t best = 0;
+	size_t attempts = 4;
+
+	for (size_t row = 0; row < rows; row++){
+		fh[row] = row_hash(&tui->front[row * cols], cols);
+		bh[row] = row_hash(&tui->back[row * cols], cols);
+	}
+
+	for (size_t row = 0; row < rows && attempts; row++){
+		if (fh[row] == bh[row])
+			continue;
+
+		for (size_t j = 0; j < rows; j++){
+			if (j == row || fh[row] != bh[j] ||
+				!row_equal(&tui->front[row * cols], &tui->back[j * cols], cols))
+				continue;
+
+/* extend the run in both directions, the match itself is verified so a hash
+ * collision on the others just ends the run */
+			size_t first = row;
+			size_t first_src = j;
+			while (first && first_src && fh[first - 1] == bh[first_src - 1] &&
+				row_equal(&tui->front[(first-1) * cols], &tui->back[(first_src-1) * cols], cols)){
+				first--;
+				first_src--;
+			}
+
+			size_t len = row - first + 1;
+			while (first + len < rows && first_src + len < rows &&
+				fh[first + len] == bh[first_src + len] &&
+				row_equal(&tui->front[(first + len) * cols],
+					&tui->back[(first_src + len) * cols], cols)){
+				len++;
+			}
+
+			if (len > best){
+				best = len;
+				*dst = first;
+				*src = first_src;
+			}
+
+			attempts--;
+			break;
+		}
+	}
+
+/* a single line has no real gain and is likely just a repeated blank */
+	*n = best;
+	return best > 1;
+}
+
 static void pack_u32(uint32_t src, uint8_t* outb)
 {
 	outb[0] = (uint8_t)(src >> 0);
@@ -249,6 +341,34 @@ size_t tui_screen_tpack(struct tui_context* tui,
 
 /* delta update, find_row_ofs gives the next mismatch on the row */
 	else if (tui->dirty & DIRTY_PARTIAL){
+/* scrolling would otherwise have every cell on the screen changed, check if
+ * the rows have just been moved and, if so, emit that as a copy-line and apply
+ * the same move to the back buffer so that only the remainder gets diffed */
+		size_t src, dst, nrows;
+		if (opts.synch && find_scroll(tui, &src, &dst, &nrows)){
+			struct tui_raster_line line = {
+				.start_line = dst,
+				.offset = src,
+				.ncells = nrows,
+				.line_state = LSTATE_COPY
+			};
+			memcpy(&out[outsz], &line, sizeof(line));
+			outsz += sizeof(line);
+			hdr.lines++;
+
+			memmove(&tui->back[dst * tui->cols],
+				&tui->back[src * tui->cols], nrows * tui->cols * sizeof(struct tui_cell));
+
+/* the drawn cursor gets moved along with the rows, make sure that the cell it
+ * ends up at is considered changed so the real contents gets drawn over it */
+			if (tui->last_cursor.active &&
+				tui->last_cursor.row >= src && tui->last_cursor.row < src + nrows){
+				size_t row = tui->last_cursor.row - src + dst;
+				if (row != tui->last_cursor.row)
+					tui->back[row * tui->cols + tui->last_cursor.col].ch = ~0;
+			}
+		}
+
 		for (size_t row = 0; row < tui->rows; row++){
 			ssize_t ofs = find_row_ofs(tui, row, 0);
 			if (-1 == ofs)
@@ -505,6 +625,25 @@ int tui_tpack_unpack(struct tui_context* C,
 
 		memcpy(&line, buf, sizeof(struct tui_raster_line));
 		buf += sizeof(line);
+		buf_sz -= sizeof(line);
+
+/* region move, the clipping region is treated as the screen */
+		if (line.line_state & LSTATE_COPY){
+			size_t src = line.offset;
+			size_t dst = line.start_line;
+			size_t n = line.ncells;
+			if (src >= y2 || dst >= y2)
+				continue;
+
+			if (src + n > y2)
+				n = y2 - src;
+			if (dst + n > y2)
+				n = y2 - dst;
+
+			memmove(&C->front[dst * C->cols],
+				&C->front[src * C->cols], n * C->cols * sizeof(struct tui_cell));
+			continue;
+		}
 
 		for (size_t i = line.offset; line.ncells && buf_sz >= raster_cell_sz; i++){
 			line.ncells--;
@@ -239,6 +239,30 @@ static size_t drawglyph(struct tui_raster_context* ctx, struct cell* cell,
 	return ctx->cell_w;
 }
 
+/*
+ * Move [n] lines from [src] so that they start at [dst], the rows are stored
+ * back to back so the whole region can be moved in one go including any pad.
+ */
+static void copy_lines(struct tui_raster_context* ctx, shmif_pixel* vidp,
+	size_t pitch, size_t max_h, size_t src, size_t dst, size_t n)
+{
+	size_t src_y = src * ctx->cell_h;
+	size_t dst_y = dst * ctx->cell_h;
+	size_t h = n * ctx->cell_h;
+
+	if (src_y >= max_h || dst_y >= max_h)
+		return;
+
+	if (src_y + h > max_h)
+		h = max_h - src_y;
+
+	if (dst_y + h > max_h)
+		h = max_h - dst_y;
+
+	memmove(&vidp[dst_y * pitch],
+		&vidp[src_y * pitch], h * pitch * sizeof(shmif_pixel));
+}
+
 static int raster_tobuf(
 	struct tui_raster_context* ctx, shmif_pixel* vidp, size_t pitch,
 	size_t max_w, size_t max_h,
@@ -319,6 +343,27 @@ static int raster_tobuf(
 		memcpy(&line, buf, sizeof(struct tui_raster_line));
 		buf += sizeof(line);
 
+/* region copy (scrolling), blit what is already there and extend the dirty
+ * region to cover the destination */
+		if (line.line_state & LSTATE_COPY){
+			buf_sz -= sizeof(line);
+			if (!line.ncells)
+				continue;
+
+			copy_lines(ctx, vidp, pitch, max_h, line.offset, line.start_line, line.ncells);
+
+			size_t dy = line.start_line * ctx->cell_h;
+			if (update && dy < *y1)
+				*y1 = dy;
+
+			*x1 = 0;
+			*x2 = max_w;
+
+			if (line.start_line + line.ncells - 1 > last_line)
+				last_line = line.start_line + line.ncells - 1;
+			continue;
+		}
+
 /* remember the lower line we were at, these are not always ordered */
 		if (line.start_line > last_line)
 			last_line = line.start_line;
@@ -326,7 +371,7 @@ static int raster_tobuf(
 /* respecting scrolling will need another drawing routine, as we need clipping
  * etc. and multiple lines can be scrolled, and that's better fixed when we
  * have an atlas to work from */
-		if (update && cur_y == -1){
+		if (update && cur_y == -1 && line.start_line * ctx->cell_h < *y1){
 			*y1 = line.start_line * ctx->cell_h;
 		}
 
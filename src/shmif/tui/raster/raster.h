@@ -25,9 +25,9 @@
  * verified against the fonts so that the codepoints exist, otherwise swapped
  * for a valid replacement.
  *
- * 5. Scrolling need to update all relevant lines in the region to scroll,
- *    only the step and direction of the first scroll- marked line will be
- *    respected (and applies to all subseqent scroll- tagged lines).
+ * 5. Scrolling is expressed as a copy line (LSTATE_COPY) that moves a region
+ *    of already drawn lines, it is applied in the order it appears in the
+ *    buffer so any lines that follow are drawn on top of the moved contents.
  */
 
 /* the raster cell is 12 byte:
@@ -99,6 +99,13 @@ enum raster_content {
 	LINE_NOBREAK = 4,
 };
 
+/* line_state bits */
+enum line_state {
+/* the line carries no cells, instead the [ncells] lines starting at [offset]
+ * are moved so that they start at [start_line], overlap is permitted */
+	LSTATE_COPY = 1
+};
+
 struct __attribute__((packed)) tui_raster_line {
 	uint16_t start_line;
 	uint16_t ncells;
@@ -38,10 +38,12 @@ struct tui_context {
  * use the double- buffering as a refactoring stage to eventually get rid of
  * the tsm_screen implementation and layer scrollback mode on top of the screen
  * implementation rather than mixing them like it is done now. The base/front
- * are compared and built into the packed tui_rasterer screen format */
+ * are compared and built into the packed tui_rasterer screen format, with
+ * the per-row hashes (front rows, then back rows) used to find scrolling */
 	struct tui_cell* base;
 	struct tui_cell* front;
 	struct tui_cell* back;
+	uint32_t* row_hash;
 	uint8_t fstamp;
 
 	float progress[5];
@@ -11,6 +11,7 @@
 
 #define WANT_ARCAN_SHMIF_HELPER
 #include "../shmif/arcan_shmif.h"
+#include "../shmif/arcan_shmif_pixconv.h"
 #include <wayland-server.h>
 #include <signal.h>
 #include <EGL/egl.h>
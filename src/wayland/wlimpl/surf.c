@@ -471,7 +471,24 @@ static bool push_shm(struct wl_client* cl,
  * and use a rare linuxism known as process_vm_writev and process_vm_readv
  * and send the pointers that way. One might call that one exotic.
  */
-	if (stride != acon->stride){
+	int pxfmt = -1;
+	switch (fmt){
+	case WL_SHM_FORMAT_ABGR8888: pxfmt = SHMIF_PIXFMT_ABGR8888; break;
+	case WL_SHM_FORMAT_XBGR8888: pxfmt = SHMIF_PIXFMT_XBGR8888; break;
+	case WL_SHM_FORMAT_RGB565: pxfmt = SHMIF_PIXFMT_RGB565; break;
+	default:
+	break;
+	}
+
+/* ARGB/XRGB match shmif_pixel and the alpha hint takes care of X, the rest
+ * need repacking and there is no point doing that in two passes */
+	if (-1 != pxfmt){
+		arcan_shmif_pixconv_import(pxfmt,
+			(const uint8_t* const[3]){data}, (const size_t[3]){stride},
+			w, h, acon->vidp, acon->stride, 0
+		);
+	}
+	else if (stride != acon->stride){
 		trace(TRACE_SURF,"surf_commit(stride-mismatch)");
 		for (size_t row = 0; row < h; row++){
 			memcpy(&acon->vidp[row * acon->pitch],
@@ -43,6 +43,21 @@ struct timed_request {
 	int x, y;
 };
 
+enum window_props {
+	PROP_TITLE = 1,
+	PROP_TYPE = 2,
+	PROP_TRANSIENT = 4,
+	PROP_PROTOCOLS = 8,
+	PROP_ALL = 15
+};
+#define PROP_COUNT 4
+
+enum deferred_kind {
+	DEFER_CREATE = 1,
+	DEFER_TITLE = 2,
+	DEFER_MAP = 4
+};
+
 struct xwnd_state {
 	uint64_t mapped;
 	uint64_t managed;
@@ -62,9 +77,26 @@ struct xwnd_state {
 	int kill_count;
 	int id;
 	char* title;
+
+/* property cache, a field is only trusted while its bit is set in prop_valid,
+ * PropertyNotify clears the bit and requests in flight are in prop_pending */
+	int prop_valid;
+	int prop_pending;
+	xcb_get_property_cookie_t prop_cookie[PROP_COUNT];
+	const char* wtype;
+	uint32_t parent_id;
+	bool delete_window;
+
+/* notifications waiting for property replies, see resolve_deferred */
+	int deferred;
+	bool in_deferred;
+	struct xwnd_state* next_deferred;
+
 	UT_hash_handle hh;
 };
 static struct xwnd_state* windows;
+static struct xwnd_state* deferred_head;
+static struct xwnd_state* deferred_tail;
 
 struct selection {
 	uint8_t* buf;
@@ -199,28 +231,40 @@ static bool setup_visuals()
 	return false;
 }
 
-static void update_title(struct xwnd_state* state)
+static void defer_window(struct xwnd_state* state, int kind)
 {
-	xcb_get_property_cookie_t cookie = xcb_get_property(
-		dpy, 0, state->id, atoms[NET_WM_NAME], XCB_ATOM_ANY, 0, 2048);
-	xcb_get_property_reply_t* reply = xcb_get_property_reply(dpy, cookie, NULL);
+	state->deferred |= kind;
+	if (state->in_deferred)
+		return;
 
+	state->in_deferred = true;
+	state->next_deferred = NULL;
+	if (deferred_tail)
+		deferred_tail->next_deferred = state;
+	else
+		deferred_head = state;
+	deferred_tail = state;
+}
+
+static void update_title(
+	struct xwnd_state* state, xcb_get_property_reply_t* reply)
+{
 	if (!reply)
 		return;
 
 	if (reply->type != atoms[UTF8_STRING]){
 		trace("title:unsupported_type:%d", (int)reply->type);
-		goto out;
+		return;
 	}
 
 	size_t len = xcb_get_property_value_length(reply);
 	char* title = xcb_get_property_value(reply);
 	if (!title || !len)
-		goto out;
+		return;
 
 	char* scratch = strndup(title, len);
 	if (!scratch)
-		goto out;
+		return;
 
 /* treat as non-0 terminated */
 	if (!state->title || strcmp(state->title, scratch) != 0){
@@ -234,40 +278,10 @@ static void update_title(struct xwnd_state* state)
 			pos++;
 		}
 
-		wm_command(WM_FLUSH, "kind=title:id=%"PRIu32":msg=%s", state->id, state->title);
+		defer_window(state, DEFER_TITLE);
 	}
 	else
 		free(scratch);
-
-out:
-	free(reply);
-}
-
-static void xcb_property_notify(xcb_property_notify_event_t* ev)
-{
-	struct xwnd_state* state = NULL;
-
-#ifdef _DEBUG
-	xcb_get_atom_name_cookie_t cookie = xcb_get_atom_name(dpy, ev->atom);
-	xcb_get_atom_name_reply_t* name = xcb_get_atom_name_reply(dpy, cookie, NULL);
-	trace("xcb=property-notify:property=%s", xcb_get_atom_name_name(name));
-	xcb_get_atom_name_name_end(name);
-#endif
-
-/* intended for our clipboard? */
-	if (ev->window == wnd_wm){
-
-/* simplified utf8- for the time only - other is to enumerate the TARGETS */
-	}
-
-	HASH_FIND_INT(windows,&ev->window,state);
-	if (!state)
-		return;
-
-	if (ev->atom != atoms[NET_WM_NAME])
-		return;
-
-	update_title(state);
 }
 
 static void update_focus(int64_t id)
@@ -369,24 +383,6 @@ static bool has_atom(
 	return false;
 }
 
-static bool check_window_support(xcb_window_t wnd, xcb_atom_t atom)
-{
-	xcb_get_property_cookie_t cookie =
-		xcb_icccm_get_wm_protocols(dpy, wnd, atoms[WM_PROTOCOLS]);
-	xcb_icccm_get_wm_protocols_reply_t protocols;
-
-	if (xcb_icccm_get_wm_protocols_reply(dpy, cookie, &protocols, NULL) == 1){
-		for (size_t i = 0; i < protocols.atoms_len; i++){
-			if (protocols.atoms[i] == atom){
-				xcb_icccm_get_wm_protocols_reply_wipe(&protocols);
-				return true;
-			}
-		}
-	}
-
-	return false;
-}
-
 static void send_net_wm_state(struct xwnd_state* wnd)
 {
 	uint32_t property[6] = {0};
@@ -471,12 +467,8 @@ static void send_configure_notify(uint32_t id)
 	xcb_send_event(dpy, 0, id, XCB_EVENT_MASK_STRUCTURE_NOTIFY, (char*)&notify);
 }
 
-static const char* check_window_state(uint32_t id)
+static const char* window_type(xcb_get_property_reply_t* reply)
 {
-	xcb_get_property_cookie_t cookie = xcb_get_property(
-		dpy, 0, id, atoms[NET_WM_WINDOW_TYPE], XCB_ATOM_ANY, 0, 2048);
-	xcb_get_property_reply_t* reply = xcb_get_property_reply(dpy, cookie, NULL);
-
 /* couldn't find out more, just map it and hope */
 	bool popup = false, dnd = false, menu = false, notification = false;
 	bool splash = false, tooltip = false, utility = false, dropdown = false;
@@ -494,15 +486,6 @@ static const char* check_window_state(uint32_t id)
 	splash = has_atom(reply, NET_WM_WINDOW_TYPE_SPLASH);
 	tooltip = has_atom(reply, NET_WM_WINDOW_TYPE_TOOLTIP);
 	utility = has_atom(reply, NET_WM_WINDOW_TYPE_UTILITY);
-	free(reply);
-
-/*
- * trace("wnd-state:%"PRIu32",popup=%d,menu=%d,dnd=%d,dropdown=%d,"
-		"notification=%d,splash=%d,tooltip=%d,utility=%d:fullscreen=%d",
-		id, popup, menu, dnd, dropdown, notification, splash,
-		tooltip, utility, fullscreen
-	);
-*/
 
 /* just string- translate and leave for higher layers to deal with */
 	if (popup)
@@ -525,6 +508,111 @@ static const char* check_window_state(uint32_t id)
 	return "default";
 }
 
+/*
+ * Property fetches are split into issuing the requests and collecting the
+ * replies so that everything needed for a window (or a burst of windows) is
+ * in flight at the same time and costs one round trip rather than one per
+ * property. Results are kept until a PropertyNotify invalidates them.
+ */
+static void request_properties(struct xwnd_state* state, int mask)
+{
+	mask &= ~(state->prop_valid | state->prop_pending);
+
+	for (size_t i = 0; i < PROP_COUNT; i++){
+		switch (mask & (1 << i)){
+		case PROP_TITLE:
+			state->prop_cookie[i] = xcb_get_property(dpy,
+				0, state->id, atoms[NET_WM_NAME], XCB_ATOM_ANY, 0, 2048);
+		break;
+		case PROP_TYPE:
+			state->prop_cookie[i] = xcb_get_property(dpy,
+				0, state->id, atoms[NET_WM_WINDOW_TYPE], XCB_ATOM_ANY, 0, 2048);
+		break;
+		case PROP_TRANSIENT:
+			state->prop_cookie[i] = xcb_get_property(dpy,
+				0, state->id, XCB_ATOM_WM_TRANSIENT_FOR, XCB_ATOM_WINDOW, 0, 2048);
+		break;
+		case PROP_PROTOCOLS:
+			state->prop_cookie[i] =
+				xcb_icccm_get_wm_protocols(dpy, state->id, atoms[WM_PROTOCOLS]);
+		break;
+		}
+	}
+
+	state->prop_pending |= mask;
+}
+
+static void invalidate_properties(struct xwnd_state* state, int mask)
+{
+	for (size_t i = 0; i < PROP_COUNT; i++){
+		if (state->prop_pending & mask & (1 << i))
+			xcb_discard_reply(dpy, state->prop_cookie[i].sequence);
+	}
+
+	state->prop_pending &= ~mask;
+	state->prop_valid &= ~mask;
+}
+
+static void resolve_protocols(
+	struct xwnd_state* state, xcb_get_property_cookie_t cookie)
+{
+	xcb_icccm_get_wm_protocols_reply_t protocols;
+	state->delete_window = false;
+
+	if (xcb_icccm_get_wm_protocols_reply(dpy, cookie, &protocols, NULL) != 1)
+		return;
+
+	for (size_t i = 0; i < protocols.atoms_len; i++){
+		if (protocols.atoms[i] == atoms[WM_DELETE_WINDOW]){
+			state->delete_window = true;
+			break;
+		}
+	}
+
+	xcb_icccm_get_wm_protocols_reply_wipe(&protocols);
+}
+
+static void resolve_properties(struct xwnd_state* state, int mask)
+{
+	for (size_t i = 0; i < PROP_COUNT; i++){
+		int bit = 1 << i;
+		if (!(state->prop_pending & mask & bit))
+			continue;
+
+		state->prop_pending &= ~bit;
+		state->prop_valid |= bit;
+
+		if (bit == PROP_PROTOCOLS){
+			resolve_protocols(state, state->prop_cookie[i]);
+			continue;
+		}
+
+		xcb_get_property_reply_t* reply =
+			xcb_get_property_reply(dpy, state->prop_cookie[i], NULL);
+
+		if (bit == PROP_TITLE){
+			update_title(state, reply);
+		}
+		else if (bit == PROP_TYPE){
+			state->wtype = window_type(reply);
+		}
+		else if (bit == PROP_TRANSIENT){
+			state->parent_id = 0;
+			if (reply && xcb_get_property_value_length(reply) >= sizeof(xcb_window_t))
+				state->parent_id = *(xcb_window_t*) xcb_get_property_value(reply);
+		}
+
+		free(reply);
+	}
+}
+
+/* synchronous path for the few places that need an answer right away */
+static void fetch_properties(struct xwnd_state* state, int mask)
+{
+	request_properties(state, mask);
+	resolve_properties(state, mask);
+}
+
 static void send_updated_window(struct xwnd_state* wnd, const char* kind)
 {
 /* defer update information until we have something mapped, otherwise we can
@@ -539,22 +627,18 @@ static void send_updated_window(struct xwnd_state* wnd, const char* kind)
 	trace("update_window=%s:x=%"PRId32":y=%"PRId32":w=%"PRId32":y=%"PRId32,
 		kind, wnd->x, wnd->y, wnd->w, wnd->h);
 
-	xcb_get_property_cookie_t cookie = xcb_get_property(dpy,
-		0, wnd->id, XCB_ATOM_WM_TRANSIENT_FOR, XCB_ATOM_WINDOW, 0, 2048);
-	xcb_get_property_reply_t* reply = xcb_get_property_reply(dpy, cookie, NULL);
+/* normally already resolved through resolve_deferred */
+	fetch_properties(wnd, PROP_TYPE | PROP_TRANSIENT);
 
-	if (reply){
-		xcb_window_t* pwd = xcb_get_property_value(reply);
+	if (wnd->parent_id)
 		wm_command(WM_FLUSH,
 			"kind=%s:id=%"PRIu32":type=%s:x=%"PRId32":y=%"PRId32":parent_id=%"PRIu32,
-			kind, wnd->id, check_window_state(wnd->id), wnd->x, wnd->y, *pwd
+			kind, wnd->id, wnd->wtype, wnd->x, wnd->y, wnd->parent_id
 		);
-		free(reply);
-	}
 	else
 		wm_command(WM_FLUSH,
 			"kind=%s:id=%"PRIu32":type=%s:x=%"PRId32":y=%"PRId32":w=%"PRId32":h=%"PRId32,
-			kind, wnd->id, check_window_state(wnd->id), wnd->x, wnd->y, wnd->w, wnd->h
+			kind, wnd->id, wnd->wtype, wnd->x, wnd->y, wnd->w, wnd->h
 		);
 
 /*
@@ -573,6 +657,74 @@ static void send_updated_window(struct xwnd_state* wnd, const char* kind)
  */
 }
 
+static void xcb_property_notify(xcb_property_notify_event_t* ev)
+{
+	struct xwnd_state* state = NULL;
+
+#ifdef _DEBUG
+	xcb_get_atom_name_cookie_t cookie = xcb_get_atom_name(dpy, ev->atom);
+	xcb_get_atom_name_reply_t* name = xcb_get_atom_name_reply(dpy, cookie, NULL);
+	trace("xcb=property-notify:property=%s", xcb_get_atom_name_name(name));
+	xcb_get_atom_name_name_end(name);
+#endif
+
+/* intended for our clipboard? */
+	if (ev->window == wnd_wm){
+
+/* simplified utf8- for the time only - other is to enumerate the TARGETS */
+	}
+
+	HASH_FIND_INT(windows,&ev->window,state);
+	if (!state)
+		return;
+
+	int mask = 0;
+	if (ev->atom == atoms[NET_WM_NAME])
+		mask = PROP_TITLE;
+	else if (ev->atom == atoms[NET_WM_WINDOW_TYPE])
+		mask = PROP_TYPE;
+	else if (ev->atom == XCB_ATOM_WM_TRANSIENT_FOR)
+		mask = PROP_TRANSIENT;
+	else if (ev->atom == atoms[WM_PROTOCOLS])
+		mask = PROP_PROTOCOLS;
+	else
+		return;
+
+/* refetch right away, the reply is collected with the rest of the batch */
+	invalidate_properties(state, mask);
+	request_properties(state, mask);
+	defer_window(state, 0);
+}
+
+static void resolve_deferred()
+{
+/* all the requests are already in flight so collecting them blocks for at
+ * most one round trip no matter how many windows are waiting */
+	for (struct xwnd_state* cur = deferred_head; cur; cur = cur->next_deferred)
+		resolve_properties(cur, PROP_ALL);
+
+	while (deferred_head){
+		struct xwnd_state* cur = deferred_head;
+		deferred_head = cur->next_deferred;
+		int kind = cur->deferred;
+		cur->deferred = 0;
+		cur->in_deferred = false;
+		cur->next_deferred = NULL;
+
+		if (kind & DEFER_CREATE)
+			send_updated_window(cur, "create");
+
+		if ((kind & DEFER_TITLE) && cur->title)
+			wm_command(WM_FLUSH,
+				"kind=title:id=%"PRIu32":msg=%s", cur->id, cur->title);
+
+		if (kind & DEFER_MAP)
+			send_updated_window(cur, "map");
+	}
+
+	deferred_tail = NULL;
+}
+
 static void xcb_create_notify(xcb_create_notify_event_t* ev)
 {
 	trace("xcb=create-notify:%"PRIu32, ev->window);
@@ -594,7 +746,13 @@ static void xcb_create_notify(xcb_create_notify_event_t* ev)
 	};
 
 	HASH_ADD_INT(windows, id, state);
-	send_updated_window(state, "create");
+
+/* select property changes before asking so that nothing between the reply
+ * and the first PropertyNotify goes unnoticed by the cache */
+	xcb_change_window_attributes(dpy, state->id,
+		XCB_CW_EVENT_MASK, (uint32_t[]){XCB_EVENT_MASK_PROPERTY_CHANGE, 0});
+	request_properties(state, PROP_ALL);
+	defer_window(state, DEFER_CREATE);
 }
 
 static void xcb_map_notify(xcb_map_notify_event_t* ev)
@@ -606,8 +764,8 @@ static void xcb_map_notify(xcb_map_notify_event_t* ev)
 		return;
 
 	state->mapped = arcan_timemillis();
-	update_title(state);
-	send_updated_window(state, "map");
+	request_properties(state, PROP_ALL);
+	defer_window(state, DEFER_MAP);
 }
 
 static void xcb_map_request(xcb_map_request_event_t* ev)
@@ -725,6 +883,7 @@ static void xcb_destroy_notify(xcb_destroy_notify_event_t* ev)
 	HASH_FIND_INT(windows,&ev->window,state);
 
 	if (state){
+		invalidate_properties(state, PROP_ALL);
 		HASH_DEL(windows, state);
 		free(state->title);
 	}
@@ -890,7 +1049,8 @@ static void process_wm_command(const char* arg)
 		}
 		size_t h = strtoul(dst, NULL, 10);
 		trace("wm=srv-resize:id=%s:width=%zu:height=%zu", idstr, w, h);
-		const char* wtype = check_window_state(id);
+		fetch_properties(state, PROP_TYPE);
+		const char* wtype = state->wtype;
 
 /* just don't configure popups etc. */
 		if (strcmp(wtype, "default") == 0){
@@ -920,7 +1080,8 @@ static void process_wm_command(const char* arg)
 	}
 	else if (strcmp(dst, "destroy") == 0){
 /* check if window support WM_DELETE_WINDOW, and if so: */
-		if (check_window_support(id, atoms[WM_DELETE_WINDOW]) && state->kill_count){
+		fetch_properties(state, PROP_PROTOCOLS);
+		if (state->delete_window && state->kill_count){
 			trace("srv-destroy, delete_window(%d)", id);
 			xcb_client_message_event_t ev = {
 				.response_type = XCB_CLIENT_MESSAGE,
@@ -1054,15 +1215,17 @@ static void* process_thread(void* arg)
 	return NULL;
 }
 
-static void run_event()
+static void dispatch_event(xcb_generic_event_t* ev)
 {
-	xcb_generic_event_t* ev = xcb_wait_for_event(dpy);
-	if (ev->response_type == 0){
-		return;
-	}
+	int type = ev->response_type & ~0x80;
 
-	pthread_mutex_lock(&wm_synch);
-	switch (ev->response_type & ~0x80) {
+/* these only issue property requests and queue their notifications, anything
+ * else might emit something about the same windows so settle those first */
+	if (type != XCB_CREATE_NOTIFY &&
+		type != XCB_MAP_NOTIFY && type != XCB_PROPERTY_NOTIFY)
+		resolve_deferred();
+
+	switch (type) {
 /* the following are mostly relevant for "UI" events if the decorations are
 * implemented in the context of X rather than at a higher level. Since this
 * doesn't really apply to us, these can be ignored */
@@ -1132,6 +1295,26 @@ static void run_event()
 		trace("xcb-unhandled:type=%"PRIu8, ev->response_type);
 	break;
 	}
+}
+
+static void run_event()
+{
+	xcb_generic_event_t* ev = xcb_wait_for_event(dpy);
+	if (!ev){
+		trace("shutdown:source=xcb_connection");
+		exit(EXIT_FAILURE);
+	}
+
+/* drain whatever else has arrived so that the property requests for a burst
+ * of windows (dialog + menus + tooltips) are collected in one go */
+	pthread_mutex_lock(&wm_synch);
+	do {
+		if (ev->response_type != 0)
+			dispatch_event(ev);
+		free(ev);
+	} while ((ev = xcb_poll_for_event(dpy)));
+
+	resolve_deferred();
 	xcb_flush(dpy);
 	pthread_mutex_unlock(&wm_synch);
 }
@@ -15,10 +15,13 @@
 #include <assert.h>
 
 extern void arcan_random(uint8_t*, size_t);
+extern unsigned long long arcan_timemicros();
 #define clsrv_okstate() (a12_poll(cl) != -1 && a12_poll(srv) != -1)
 
 static uint8_t clpriv[32];
 static uint8_t srvpriv[32];
+static struct a12_context_options cl_opts;
+static struct a12_context_options srv_opts;
 
 static struct pk_response key_auth_cl(uint8_t pk[static 32])
 {
@@ -225,6 +228,389 @@ static bool video_test_raw(struct a12_state* cl, struct a12_state* srv)
 	return tag.match && clsrv_okstate();
 }
 
+/* delta frames are applied against the previous contents so the destination
+ * need to be retained between frames, unlike the normal raw test */
+static shmif_pixel* video_signal_alloc_keep(
+	size_t w, size_t h, size_t* stride, int fl, void* tag)
+{
+	struct video_tag* data = tag;
+	*stride = sizeof(shmif_pixel) * w;
+	if (data->srv_buf)
+		return data->srv_buf;
+
+	assert(w == data->w);
+	data->srv_buf = malloc(*stride * h);
+	return data->srv_buf;
+}
+
+/* measure the time spent unpacking / decoding on the receiving side */
+static size_t data_round_timed(
+	struct a12_state* src, struct a12_state* dst, unsigned long long* acc)
+{
+	uint8_t* buf;
+	if (a12_poll(src) == -1 || a12_poll(dst) == -1)
+		return 0;
+
+	size_t out = a12_flush(src, &buf, 0);
+	if (out){
+		unsigned long long start = arcan_timemicros();
+		a12_unpack(dst, buf, out, NULL, NULL);
+		*acc += arcan_timemicros() - start;
+	}
+
+	return out;
+}
+
+static bool video_test_dzstd(struct a12_state* cl, struct a12_state* srv)
+{
+	size_t w = 1920;
+	size_t h = 1080;
+	size_t n_frames = 60;
+	size_t buf_sz = w * h * sizeof(shmif_pixel);
+	unsigned long long decode_us = 0;
+
+/* the encoder side retains its accumulation buffer between passes, so the
+ * destination has to be retained as well or the next pass starts on a delta */
+	static shmif_pixel* srv_buf;
+	struct video_tag tag =
+	{
+		.buffer = malloc(buf_sz),
+		.buf_n_px = w * h,
+		.w = w,
+		.match = true,
+		.srv_buf = srv_buf
+	};
+
+	a12_set_destination_raw(srv, 0,
+		(struct a12_unpack_cfg){
+		.tag = &tag,
+		.signal_video = video_signal_raw,
+		.request_raw_buffer = video_signal_alloc_keep,
+		}, sizeof(struct a12_unpack_cfg)
+	);
+
+/* low-entropy base frame (I) followed by bands of noise (P) */
+	for (size_t i = 0; i < w * h; i++)
+		tag.buffer[i] = SHMIF_RGBA(i % w, i / w, i % 256, 0xff);
+
+	size_t i = 0;
+	for (; i < n_frames && clsrv_okstate() && tag.match; i++){
+		if (i){
+			size_t band = (i * 37) % (h - 64);
+			arcan_random((uint8_t*)&tag.buffer[band * w], w * 64 * sizeof(shmif_pixel));
+			for (size_t j = band * w; j < (band + 64) * w; j++)
+				tag.buffer[j] |= SHMIF_RGBA(0, 0, 0, 0xff);
+		}
+
+		a12_channel_vframe(cl,
+		&(struct shmifsrv_vbuffer){
+			.buffer = tag.buffer,
+			.w = w,
+			.h = h,
+			.pitch = w,
+			.stride = w * sizeof(shmif_pixel),
+		},
+		(struct a12_vframe_opts){
+			.method = VFRAME_METHOD_DZSTD
+		});
+
+		while (data_round_timed(cl, srv, &decode_us) ||
+			data_round_timed(srv, cl, &decode_us)){}
+	}
+
+	if (decode_us)
+		printf("dzstd: %zu frames (%zux%zu) decoded in %llu us, %.2f MB/s\n",
+			i, w, h, decode_us, (double)(i * buf_sz) / (double) decode_us);
+
+	free(tag.buffer);
+	srv_buf = tag.srv_buf;
+	a12_set_destination_raw(srv, 0,
+		(struct a12_unpack_cfg){}, sizeof(struct a12_unpack_cfg));
+
+	return tag.match && clsrv_okstate();
+}
+
+/*
+ * Simulated constrained link for the congestion control test. Data is
+ * delivered after the serialization time at [rate] plus [delay], and with
+ * [loss] percent chance a write is 'lost' and delivered [rto] later. The
+ * transport is reliable so loss shows up as head-of-line blocking rather than
+ * missing bytes, which is what a12 would see on top of TCP.
+ */
+struct sim_segment {
+	uint8_t* buf;
+	size_t buf_sz;
+	unsigned long long due;
+	struct sim_segment* next;
+};
+
+struct sim_link {
+	size_t rate;
+	size_t delay;
+	size_t loss;
+	size_t rto;
+	unsigned long long busy;
+	size_t queued;
+	struct sim_segment* first;
+	struct sim_segment* last;
+};
+
+/* the link, a12 scheduling and the frame contents all run off a simulated
+ * clock and a fixed seed so the outcome doesn't depend on host scheduling */
+static unsigned long long sim_now;
+static uint32_t sim_seed;
+
+static unsigned long long sim_millis()
+{
+	return sim_now / 1000;
+}
+
+static void sim_random(uint8_t* buf, size_t buf_sz)
+{
+	for (size_t i = 0; i < buf_sz; i++){
+		sim_seed ^= sim_seed << 13;
+		sim_seed ^= sim_seed >> 17;
+		sim_seed ^= sim_seed << 5;
+		buf[i] = sim_seed;
+	}
+}
+
+static void link_write(struct sim_link* link, uint8_t* buf, size_t buf_sz)
+{
+	struct sim_segment* seg = malloc(sizeof(struct sim_segment));
+	unsigned long long now = sim_now;
+	assert(seg);
+
+	*seg = (struct sim_segment){
+		.buf = malloc(buf_sz),
+		.buf_sz = buf_sz
+	};
+	memcpy(seg->buf, buf, buf_sz);
+
+/* serialize after whatever is already on the wire */
+	if (link->busy < now)
+		link->busy = now;
+	if (link->rate)
+		link->busy += (unsigned long long) buf_sz * 1000000 / link->rate;
+	seg->due = link->busy + link->delay * 1000;
+
+	uint8_t rnd;
+	sim_random(&rnd, 1);
+	if (link->loss && rnd % 100 < link->loss)
+		seg->due += link->rto * 1000;
+
+/* in-order delivery, a retransmission holds back everything behind it */
+	if (link->last){
+		if (seg->due < link->last->due)
+			seg->due = link->last->due;
+		link->last->next = seg;
+	}
+	else
+		link->first = seg;
+
+	link->last = seg;
+	link->queued += buf_sz;
+}
+
+static size_t link_deliver(struct sim_link* link, struct a12_state* dst)
+{
+	unsigned long long now = sim_now;
+	size_t nb = 0;
+
+	while (link->first && link->first->due <= now){
+		struct sim_segment* seg = link->first;
+		link->first = seg->next;
+		if (!link->first)
+			link->last = NULL;
+
+		link->queued -= seg->buf_sz;
+		nb += seg->buf_sz;
+		a12_unpack(dst, seg->buf, seg->buf_sz, NULL, NULL);
+		free(seg->buf);
+		free(seg);
+	}
+
+	return nb;
+}
+
+static void link_drop(struct sim_link* link)
+{
+	while (link->first){
+		struct sim_segment* seg = link->first;
+		link->first = seg->next;
+		free(seg->buf);
+		free(seg);
+	}
+	link->last = NULL;
+	link->queued = 0;
+}
+
+struct cc_tag {
+	shmif_pixel* srv_buf;
+	size_t w;
+	size_t frames;
+};
+
+static void cc_signal(size_t x1, size_t y1, size_t x2, size_t y2, void* tag)
+{
+	struct cc_tag* data = tag;
+	data->frames++;
+}
+
+static shmif_pixel* cc_alloc(
+	size_t w, size_t h, size_t* stride, int fl, void* tag)
+{
+	struct cc_tag* data = tag;
+	*stride = sizeof(shmif_pixel) * w;
+	if (data->srv_buf && data->w == w)
+		return data->srv_buf;
+
+	free(data->srv_buf);
+	data->w = w;
+	data->srv_buf = malloc(*stride * h);
+	return data->srv_buf;
+}
+
+struct cc_phase {
+	size_t sent;
+	size_t deferred;
+	size_t max_queued;
+	size_t quality;
+};
+
+/* push frames as fast as a12_vframe_admit allows for [ms] */
+static struct cc_phase cc_run(struct a12_state* cl, struct a12_state* srv,
+	struct sim_link* up, struct sim_link* down, shmif_pixel* buf,
+	size_t w, size_t h, size_t ms)
+{
+	struct cc_phase res = {0};
+	unsigned long long end = sim_now + ms * 1000;
+
+	while (sim_now < end && clsrv_okstate()){
+		if (a12_vframe_admit(cl, 0)){
+			size_t band = (res.sent * 37) % (h - 32);
+			sim_random((uint8_t*)&buf[band * w], w * 32 * sizeof(shmif_pixel));
+
+			struct a12_vframe_opts opts = a12_vframe_adapt(cl, 0,
+				(struct a12_vframe_opts){
+					.method = VFRAME_METHOD_DZSTD,
+					.bias = VFRAME_BIAS_BALANCED
+				});
+			res.quality += opts.bias == VFRAME_BIAS_QUALITY;
+
+			a12_channel_vframe(cl,
+			&(struct shmifsrv_vbuffer){
+				.buffer = buf,
+				.w = w,
+				.h = h,
+				.pitch = w,
+				.stride = w * sizeof(shmif_pixel),
+			}, opts);
+			res.sent++;
+		}
+		else
+			res.deferred++;
+
+		uint8_t* out;
+		size_t nb;
+		while ((nb = a12_flush(cl, &out, 0)))
+			link_write(up, out, nb);
+		while ((nb = a12_flush(srv, &out, 0)))
+			link_write(down, out, nb);
+
+		if (up->queued > res.max_queued)
+			res.max_queued = up->queued;
+
+		link_deliver(up, srv);
+		link_deliver(down, cl);
+		sim_now += 1000;
+	}
+
+	return res;
+}
+
+static bool congestion_pass(struct a12_state* cl, struct a12_state* srv)
+{
+	size_t w = 640;
+	size_t h = 480;
+	struct sim_link up = {
+		.rate = 2 * 1024 * 1024,
+		.delay = 20,
+		.loss = 2,
+		.rto = 100
+	};
+	struct sim_link down = {
+		.delay = 20
+	};
+
+	struct cc_tag tag = {0};
+	a12_set_destination_raw(srv, 0,
+		(struct a12_unpack_cfg){
+		.tag = &tag,
+		.signal_video = cc_signal,
+		.request_raw_buffer = cc_alloc,
+		}, sizeof(struct a12_unpack_cfg)
+	);
+
+	shmif_pixel* buf = malloc(w * h * sizeof(shmif_pixel));
+	for (size_t i = 0; i < w * h; i++)
+		buf[i] = SHMIF_RGBA(i % w, i / w, 0x40, 0xff);
+
+	struct cc_phase focus = cc_run(cl, srv, &up, &down, buf, w, h, 1500);
+	struct a12_iostat stat = a12_state_iostat(cl);
+
+/* then tell the source that the window lost focus */
+	a12_channel_enqueue(srv, &(struct arcan_event){
+		.category = EVENT_TARGET,
+		.tgt.kind = TARGET_COMMAND_DISPLAYHINT,
+		.tgt.ioevs[0].iv = w,
+		.tgt.ioevs[1].iv = h,
+		.tgt.ioevs[2].iv = 4
+	});
+	struct cc_phase bg = cc_run(cl, srv, &up, &down, buf, w, h, 1500);
+
+	printf(" (bw=%zu rtt=%zu min=%zu focus: %zu sent, %zu kb max queue, "
+		"%zu high, background: %zu sent, %zu kb max queue) ",
+		stat.bw_estimate, stat.roundtrip_latency, stat.min_latency,
+		focus.sent, focus.max_queued / 1024, focus.quality,
+		bg.sent, bg.max_queued / 1024
+	);
+
+	free(buf);
+	free(tag.srv_buf);
+	link_drop(&up);
+	link_drop(&down);
+
+/* the estimate should be in the right ballpark of the link rate, and the
+ * queue should be held to a few frame windows rather than grow unbounded
+ * (that would be ~1.5s * 1000 frames without admission control) */
+	size_t queue_limit = up.rate / 2;
+	return clsrv_okstate() &&
+		stat.bw_estimate > up.rate / 8 && stat.bw_estimate < up.rate * 2 &&
+		focus.max_queued < queue_limit && bg.max_queued < queue_limit &&
+		bg.sent <= focus.sent && focus.sent > 0;
+}
+
+/* the other passes run without a link in between, so use a fresh pair of
+ * states that has only seen the simulated one */
+static bool congestion_test(struct a12_state* main_cl, struct a12_state* main_srv)
+{
+	sim_now = 1000000;
+	sim_seed = 0x12345678;
+	a12_set_clock(sim_millis);
+
+	struct a12_state* srv = a12_server(&srv_opts);
+	struct a12_state* cl = a12_client(&cl_opts);
+	bool ok = run_auth_test(cl, srv) && congestion_pass(cl, srv);
+
+	a12_set_clock(NULL);
+	a12_channel_close(cl);
+	a12_channel_close(srv);
+	a12_free(cl);
+	a12_free(srv);
+	return ok;
+}
+
 struct audio_tag {
 	shmif_asample* buffer;
 	size_t buf_sz;
@@ -346,7 +732,7 @@ static bool test_bxfer(struct a12_state* cl, struct a12_state* srv)
 
 /* send same file twice, the second time we should be able to just reject */
 	for (size_t i = 0; i < 2 && a12_poll(cl) != -1 && a12_poll(srv) != -1; i++){
-		a12_enqueue_bstream(cl, myfd, A12_BTYPE_BLOB, false, base_sz);
+		a12_enqueue_bstream(cl, myfd, A12_BTYPE_BLOB, 0, false, base_sz);
 		FLUSH(cl, srv);
 	}
 
@@ -355,6 +741,119 @@ static bool test_bxfer(struct a12_state* cl, struct a12_state* srv)
 	return true;
 }
 
+struct delta_md {
+	int basis;
+	int out;
+	bool completed;
+	bool offered;
+};
+
+static struct a12_bhandler_res delta_bhandler(
+	struct a12_state* S, struct a12_bhandler_meta md, void* tag)
+{
+	struct delta_md* dmd = tag;
+	struct a12_bhandler_res res = {
+		.flag = A12_BHANDLER_DONTWANT,
+		.fd = -1,
+		.basis = -1
+	};
+
+	if (md.state == A12_BHANDLER_COMPLETED){
+		dmd->completed = true;
+		return res;
+	}
+
+	if (md.state != A12_BHANDLER_INITIALIZE)
+		return res;
+
+	dmd->offered = md.delta;
+	res.fd = dmd->out;
+	res.basis = dup(dmd->basis);
+	res.flag = A12_BHANDLER_NEWFD_DELTA;
+	return res;
+}
+
+static size_t data_round_blob(struct a12_state* src, struct a12_state* dst)
+{
+	uint8_t* buf;
+	size_t out = a12_flush(src, &buf, A12_FLUSH_ALL);
+
+	if (out)
+		a12_unpack(dst, buf, out, NULL, NULL);
+
+	return out;
+}
+
+static int delta_tmpfile(const uint8_t* buf, size_t buf_sz)
+{
+	char name[] = "deltaxfer-XXXXXX";
+	int fd = mkstemp(name);
+	if (-1 == fd)
+		return -1;
+
+	unlink(name);
+	if (buf_sz && write(fd, buf, buf_sz) != buf_sz){
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* send a modified version of a file that the sink already has an old copy of,
+ * only the chunks around the edits should need to be transferred */
+static bool test_bxfer_delta(struct a12_state* cl, struct a12_state* srv)
+{
+	size_t base_sz = 4 * 1024 * 1024;
+	uint8_t* base = malloc(base_sz + 4096);
+	uint8_t* mod = malloc(base_sz + 4096);
+	if (!base || !mod)
+		return false;
+
+	arcan_random(base, base_sz);
+
+/* overwrite a few bytes, insert a block and drop the tail */
+	memcpy(mod, base, base_sz);
+	memset(&mod[100000], 'x', 32);
+	size_t mod_sz = base_sz;
+	memmove(&mod[2000000 + 4096], &mod[2000000], base_sz - 2000000);
+	arcan_random(&mod[2000000], 4096);
+	mod_sz += 4096 - 65536;
+
+	struct delta_md dmd = {
+		.basis = delta_tmpfile(base, base_sz),
+		.out = delta_tmpfile(NULL, 0)
+	};
+	int src = delta_tmpfile(mod, mod_sz);
+
+	a12_set_bhandler(srv, delta_bhandler, &dmd);
+	a12_enqueue_bstream(cl, src, A12_BTYPE_BLOB, 0, false, mod_sz);
+
+	size_t nb = 0, step;
+	while (((step = data_round_blob(cl, srv)) | data_round_blob(srv, cl)) &&
+		clsrv_okstate())
+		nb += step;
+
+	a12_set_bhandler(srv, NULL, NULL);
+
+	bool ok = dmd.completed && dmd.offered;
+	if (ok){
+		uint8_t* res = malloc(mod_sz);
+		ok = res && pread(dmd.out, res, mod_sz, 0) == mod_sz &&
+			lseek(dmd.out, 0, SEEK_END) == mod_sz && memcmp(res, mod, mod_sz) == 0;
+		free(res);
+	}
+
+	printf(" (%zu bytes for %zu) ", nb, mod_sz);
+	close(src);
+	close(dmd.basis);
+	close(dmd.out);
+	free(base);
+	free(mod);
+
+	return ok;
+}
+
 static bool buffer_sink(uint8_t* buf, size_t nb, void* tag)
 {
 	struct a12_state* dst = tag;
@@ -367,16 +866,17 @@ int main(int argc, char** argv)
 	arcan_random(clpriv, 32);
 	arcan_random(srvpriv, 32);
 
-	struct a12_context_options cl_opts = {
+	cl_opts = (struct a12_context_options){
 		.pk_lookup = key_auth_cl,
-		.disable_cipher = true,
+		.local_role = ROLE_SOURCE,
 		.disable_ephemeral_k = false
 	};
 
 
-	struct a12_context_options srv_opts = cl_opts;
+	srv_opts = cl_opts;
 	memcpy(cl_opts.priv_key, clpriv, 32);
 	srv_opts.pk_lookup = key_auth_srv;
+	srv_opts.local_role = ROLE_SINK;
 
 /* parse arguments from cmdline, ... */
 	a12_set_trace_level(
@@ -418,6 +918,10 @@ int main(int argc, char** argv)
 		.pass = video_test_raw,
 		.name = "Video(Raw)",
 	},
+	{
+		.pass = video_test_dzstd,
+		.name = "Video(DZSTD)",
+	},
 	{
 		.pass = audio_test_raw,
 		.name = "Audio(Raw)",
@@ -427,6 +931,14 @@ int main(int argc, char** argv)
 		.pass = test_bxfer,
 		.name = "Binary",
 		.ignore = true
+	},
+	{
+		.pass = test_bxfer_delta,
+		.name = "Binary(Delta)",
+	},
+	{
+		.pass = congestion_test,
+		.name = "Congestion",
 	}
 /* checklist:
  * - working audio
@@ -0,0 +1,267 @@
+/*
+ * Correctness and throughput harness for arcan_shmif_pixconv.
+ *
+ * Every format / direction is run through the active (vectorized) backend
+ * and the scalar reference with random data, odd widths and padded strides,
+ * and the outputs are compared byte for byte. The scalar reference itself is
+ * checked against a few independent definitions (565 expansion, premultiply
+ * rounding, 8888 round-trips).
+ *
+ * ./pixconv [width] [height] [iterations] for the throughput part,
+ * default is one 4K frame repeated 50 times.
+ */
+#include <arcan_shmif.h>
+#include <arcan_shmif_pixconv.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <time.h>
+#include <math.h>
+
+static const char* fmt_names[] = {
+	"rgb565", "xrgb8888", "argb8888", "xbgr8888", "abgr8888", "rgb888", "yuv420"
+};
+static const size_t fmt_bpp[] = {2, 4, 4, 4, 4, 3, 1};
+
+static size_t failures;
+
+static void fill_random(uint8_t* buf, size_t sz)
+{
+	for (size_t i = 0; i < sz; i++)
+		buf[i] = rand();
+}
+
+static void fail(const char* msg, ...)
+{
+	va_list args;
+	va_start(args, msg);
+	fprintf(stderr, "FAIL: ");
+	vfprintf(stderr, msg, args);
+	fputc('\n', stderr);
+	va_end(args);
+	failures++;
+}
+
+static uint64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* run one import against both backends, the padding at the end of each
+ * destination row should be left untouched */
+static void check_import(int fmt, size_t w, size_t h, int flags)
+{
+	size_t pad = 13;
+	size_t cw = (w + 1) >> 1;
+	size_t strides[3] = {w * fmt_bpp[fmt] + pad, cw + pad, cw + pad};
+	uint8_t* planes[3] = {
+		malloc(strides[0] * h), malloc(strides[1] * h), malloc(strides[2] * h)
+	};
+
+	size_t dst_stride = w * sizeof(shmif_pixel) + 2 * sizeof(shmif_pixel);
+	uint8_t* ref = malloc(dst_stride * h);
+	uint8_t* vec = malloc(dst_stride * h);
+
+	for (size_t i = 0; i < 3; i++)
+		fill_random(planes[i], strides[i] * h);
+	memset(ref, 0xaa, dst_stride * h);
+	memset(vec, 0xaa, dst_stride * h);
+
+	const uint8_t* const cplanes[3] = {planes[0], planes[1], planes[2]};
+	arcan_shmif_pixconv_import(fmt, cplanes, strides, w, h,
+		(shmif_pixel*) ref, dst_stride, flags | SHMIF_PIXCONV_SCALAR);
+	arcan_shmif_pixconv_import(fmt, cplanes, strides, w, h,
+		(shmif_pixel*) vec, dst_stride, flags);
+
+	if (memcmp(ref, vec, dst_stride * h) != 0){
+		for (size_t i = 0; i < dst_stride * h; i++)
+			if (ref[i] != vec[i]){
+				fail("import(%s, %zu*%zu, flags=%d): mismatch at row %zu, byte %zu",
+					fmt_names[fmt], w, h, flags, i / dst_stride, i % dst_stride);
+				break;
+			}
+	}
+
+	for (size_t y = 0; y < h; y++)
+		for (size_t i = w * sizeof(shmif_pixel); i < dst_stride; i++)
+			if (vec[y * dst_stride + i] != 0xaa){
+				fail("import(%s, %zu*%zu): wrote past row end", fmt_names[fmt], w, h);
+				y = h;
+				break;
+			}
+
+	for (size_t i = 0; i < 3; i++)
+		free(planes[i]);
+	free(ref);
+	free(vec);
+}
+
+static void check_export(int fmt, size_t w, size_t h)
+{
+	size_t src_stride = w * sizeof(shmif_pixel) + 3 * sizeof(shmif_pixel);
+	size_t dst_stride = w * fmt_bpp[fmt] + 7;
+
+	uint8_t* src = malloc(src_stride * h);
+	uint8_t* ref = malloc(dst_stride * h);
+	uint8_t* vec = malloc(dst_stride * h);
+	fill_random(src, src_stride * h);
+	memset(ref, 0x55, dst_stride * h);
+	memset(vec, 0x55, dst_stride * h);
+
+	arcan_shmif_pixconv_export(fmt, (shmif_pixel*) src,
+		src_stride, w, h, ref, dst_stride, SHMIF_PIXCONV_SCALAR);
+	arcan_shmif_pixconv_export(fmt, (shmif_pixel*) src,
+		src_stride, w, h, vec, dst_stride, 0);
+
+	if (memcmp(ref, vec, dst_stride * h) != 0)
+		fail("export(%s, %zu*%zu): mismatch", fmt_names[fmt], w, h);
+
+/* 8888 formats should survive the trip back */
+	if (fmt == SHMIF_PIXFMT_ARGB8888 || fmt == SHMIF_PIXFMT_ABGR8888){
+		shmif_pixel* back = malloc(w * h * sizeof(shmif_pixel));
+		arcan_shmif_pixconv_import(fmt, (const uint8_t* const[3]){vec},
+			(const size_t[3]){dst_stride}, w, h, back, 0, 0);
+
+		for (size_t y = 0; y < h; y++)
+			if (memcmp(&back[y * w],
+				&src[y * src_stride], w * sizeof(shmif_pixel)) != 0){
+				fail("round-trip(%s, %zu*%zu): mismatch", fmt_names[fmt], w, h);
+				break;
+			}
+		free(back);
+	}
+
+	free(src);
+	free(ref);
+	free(vec);
+}
+
+/* every 16-bit value against expansion by bit replication */
+static void check_rgb565_reference()
+{
+	uint8_t src[65536 * 2];
+	shmif_pixel dst[65536];
+	for (size_t i = 0; i < 65536; i++){
+		src[i * 2 + 0] = i & 0xff;
+		src[i * 2 + 1] = i >> 8;
+	}
+
+	arcan_shmif_pixconv_import(SHMIF_PIXFMT_RGB565,
+		(const uint8_t* const[3]){src}, NULL, 65536, 1, dst, 0, 0);
+
+	for (size_t i = 0; i < 65536; i++){
+		uint8_t r, g, b, a;
+		SHMIF_RGBA_DECOMP(dst[i], &r, &g, &b, &a);
+		size_t r5 = (i >> 11) & 0x1f, g6 = (i >> 5) & 0x3f, b5 = i & 0x1f;
+		if (r != ((r5 << 3) | (r5 >> 2)) ||
+			g != ((g6 << 2) | (g6 >> 4)) ||
+			b != ((b5 << 3) | (b5 >> 2)) || a != 0xff){
+			fail("rgb565 expansion of %zx", i);
+			break;
+		}
+	}
+}
+
+static void check_premultiply_reference()
+{
+	uint8_t src[256 * 256 * 4];
+	shmif_pixel dst[256 * 256];
+	for (size_t i = 0; i < 256 * 256; i++){
+		src[i * 4 + 0] = i & 0xff;
+		src[i * 4 + 1] = i & 0xff;
+		src[i * 4 + 2] = i & 0xff;
+		src[i * 4 + 3] = i >> 8;
+	}
+
+	arcan_shmif_pixconv_import(SHMIF_PIXFMT_ARGB8888,
+		(const uint8_t* const[3]){src}, NULL,
+		256 * 256, 1, dst, 0, SHMIF_PIXCONV_PREMULTIPLY);
+
+	for (size_t i = 0; i < 256 * 256; i++){
+		uint8_t r, g, b, a;
+		SHMIF_RGBA_DECOMP(dst[i], &r, &g, &b, &a);
+		long want = lround((i & 0xff) * (i >> 8) / 255.0);
+		if (r != want || g != want || b != want || a != (i >> 8)){
+			fail("premultiply of %zu by %zu", i & 0xff, i >> 8);
+			break;
+		}
+	}
+}
+
+static void bench(size_t w, size_t h, size_t iter)
+{
+	size_t cw = (w + 1) >> 1;
+	uint8_t* src = malloc(w * h * 4);
+	uint8_t* dst = malloc(w * h * 4);
+	fill_random(src, w * h * 4);
+
+	printf("%-10s %-6s %12s %12s %8s\n", "format", "dir", "scalar ms", "vector ms", "gain");
+
+	for (int fmt = 0; fmt <= SHMIF_PIXFMT_YUV420; fmt++){
+		for (int dir = 0; dir < 2; dir++){
+			if (dir == 1 && fmt == SHMIF_PIXFMT_YUV420)
+				continue;
+
+			double ms[2];
+			for (size_t pass = 0; pass < 2; pass++){
+				int flags = pass == 0 ? SHMIF_PIXCONV_SCALAR : 0;
+				uint64_t start = now_ns();
+
+				for (size_t i = 0; i < iter; i++){
+					if (dir == 0)
+						arcan_shmif_pixconv_import(fmt,
+							(const uint8_t* const[3]){
+								src, &src[w * h], &src[w * h + cw * h]}, NULL,
+							w, h, (shmif_pixel*) dst, 0, flags
+						);
+					else
+						arcan_shmif_pixconv_export(fmt,
+							(shmif_pixel*) src, 0, w, h, dst, 0, flags);
+				}
+
+				ms[pass] = (double)(now_ns() - start) / 1000000.0 / iter;
+			}
+
+			printf("%-10s %-6s %12.3f %12.3f %7.2fx\n", fmt_names[fmt],
+				dir == 0 ? "import" : "export", ms[0], ms[1], ms[0] / ms[1]);
+		}
+	}
+
+	free(src);
+	free(dst);
+}
+
+int main(int argc, char** argv)
+{
+	size_t w = argc > 1 ? strtoul(argv[1], NULL, 10) : 3840;
+	size_t h = argc > 2 ? strtoul(argv[2], NULL, 10) : 2160;
+	size_t iter = argc > 3 ? strtoul(argv[3], NULL, 10) : 50;
+
+	printf("backend: %s\n", arcan_shmif_pixconv_backend());
+	srand(0xbacabaca);
+
+	check_rgb565_reference();
+	check_premultiply_reference();
+
+	static const size_t widths[] = {1, 2, 3, 7, 8, 15, 16, 17, 31, 33, 64, 100, 1921};
+	for (size_t i = 0; i < sizeof(widths) / sizeof(widths[0]); i++){
+		for (int fmt = 0; fmt <= SHMIF_PIXFMT_YUV420; fmt++){
+			check_import(fmt, widths[i], 5, 0);
+			check_import(fmt, widths[i], 5, SHMIF_PIXCONV_PREMULTIPLY);
+			if (fmt != SHMIF_PIXFMT_YUV420)
+				check_export(fmt, widths[i], 5);
+		}
+	}
+
+	if (failures){
+		fprintf(stderr, "%zu checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("all conversions match the reference\n");
+
+	if (w && h && iter)
+		bench(w, h, iter);
+
+	return EXIT_SUCCESS;
+}